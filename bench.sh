@@ -0,0 +1,21 @@
+#!/bin/sh
+# Builds and runs the benchmarks in bench/. Pass a name (f.ex. "hashmap") to only run that one.
+set -e
+
+SRCS=$(find "src" -type f -name "*.c" -not -name "main.c" -not -name "parser_main.c")
+CFLAGS="-Isrc -Ibench -Wall -Wpedantic -Wextra -Wshadow -std=c11 -D_DEFAULT_SOURCE -O2 -DNDEBUG -pthread"
+
+for bench in bench/*_bench.c; do
+    name=$(basename "$bench" _bench.c)
+    if [ -n "$1" ] && [ "$1" != "$name" ]; then
+        continue
+    fi
+    echo "--- $name ---"
+    cc $CFLAGS $SRCS "$bench" -o "metagen-bench-$name"
+    ./"metagen-bench-$name"
+    if [ "$name" = "vm" ]; then
+        # Again with switch dispatch to compare against
+        cc $CFLAGS -DVM_COMPUTED_GOTO=0 $SRCS "$bench" -o "metagen-bench-$name-switch"
+        ./"metagen-bench-$name-switch"
+    fi
+done
@@ -0,0 +1,40 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "base/types.h"
+
+static inline f64 bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec / 1e9;
+}
+
+static inline void bench_report(char *name, f64 seconds, u64 n_ops)
+{
+    printf("%-40s %10.3f ms %10.2f ns/op\n", name, seconds * 1e3, seconds * 1e9 / (f64)n_ops);
+}
+
+/* Keeps the compiler from optimizing away the benchmarked work */
+static volatile u64 bench_sink;
+
+#endif /* BENCH_H */
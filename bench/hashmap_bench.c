@@ -0,0 +1,211 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "base/base.h"
+#include "bench.h"
+#include "old_hashmap.h"
+
+#define NICC_IMPLEMENTATION
+#include "base/nicc.h"
+#define SAC_IMPLEMENTATION
+#include "base/sac_single.h"
+
+/*
+ * Symbol table like workload: many small tables (one per scope) with a handful of short
+ * identifiers each, and a few large global tables. Lookups are mostly hits with some misses
+ * that walk up to the parent scope.
+ * Every workload runs on the Swiss table in nicc.h and on the bucketed map it replaced, see
+ * old_hashmap.h.
+ */
+#define N_IDENTS 4096
+#define N_SCOPES 2048
+#define IDENTS_PER_SCOPE 8
+#define LOOKUP_ROUNDS 64
+
+static char idents[N_IDENTS][16];
+static u32 ident_lens[N_IDENTS];
+
+static void make_idents(void)
+{
+    char *prefixes[] = { "i", "len", "node", "tmp", "sym", "arena", "type_info", "x" };
+    for (u32 i = 0; i < N_IDENTS; i++) {
+        int n = snprintf(idents[i], sizeof(idents[i]), "%s%u", prefixes[i % ARRAY_LENGTH(prefixes)],
+                         i / (u32)ARRAY_LENGTH(prefixes));
+        ident_lens[i] = (u32)n;
+    }
+}
+
+/* Either map, picked once per benchmark so the branch on it always predicts */
+typedef struct {
+    bool old;
+    HashMap map;
+    OldHashMap old_map;
+} BenchMap;
+
+static void map_init(BenchMap *m, bool old, Arena *arena)
+{
+    m->old = old;
+    if (old) {
+        if (arena != NULL) {
+            old_hashmap_init_arena(&m->old_map, arena, true);
+        } else {
+            old_hashmap_init(&m->old_map);
+        }
+    } else {
+        if (arena != NULL) {
+            hashmap_init_arena(&m->map, arena, true);
+        } else {
+            hashmap_init(&m->map);
+        }
+    }
+}
+
+static inline void map_put(BenchMap *m, void *key, u32 key_size, void *value)
+{
+    if (m->old) {
+        old_hashmap_put(&m->old_map, key, key_size, value, sizeof(void *), false);
+    } else {
+        hashmap_put(&m->map, key, key_size, value, sizeof(void *), false);
+    }
+}
+
+static inline void *map_get(BenchMap *m, void *key, u32 key_size)
+{
+    return m->old ? old_hashmap_get(&m->old_map, key, key_size)
+                  : hashmap_get(&m->map, key, key_size);
+}
+
+static void map_free(BenchMap *m)
+{
+    if (m->old) {
+        old_hashmap_free(&m->old_map);
+    } else {
+        hashmap_free(&m->map);
+    }
+}
+
+static char *map_kind(bool old, bool use_arena)
+{
+    if (old)
+        return use_arena ? "bucketed, arena, borrowed keys" : "bucketed, heap";
+    return use_arena ? "swiss, arena, borrowed keys" : "swiss, heap";
+}
+
+static void bench_global_table(bool old, bool use_arena)
+{
+    Arena arena;
+    m_arena_init_dynamic(&arena, 1, 4096);
+    BenchMap map;
+    map_init(&map, old, use_arena ? &arena : NULL);
+
+    f64 start = bench_now();
+    for (u32 i = 0; i < N_IDENTS; i++) {
+        map_put(&map, idents[i], ident_lens[i], (void *)(uintptr_t)(i + 1));
+    }
+    f64 insert_time = bench_now() - start;
+
+    u64 sum = 0;
+    start = bench_now();
+    for (u32 round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (u32 i = 0; i < N_IDENTS; i++) {
+            sum += (uintptr_t)map_get(&map, idents[i], ident_lens[i]);
+        }
+    }
+    f64 hit_time = bench_now() - start;
+    assert(sum == (u64)LOOKUP_ROUNDS * N_IDENTS * (N_IDENTS + 1) / 2);
+
+    start = bench_now();
+    for (u32 round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (u32 i = 0; i < N_IDENTS; i++) {
+            /* same identifiers, but one byte shorter, so they all miss */
+            sum += map_get(&map, idents[i], ident_lens[i] - 1) != NULL;
+        }
+    }
+    f64 miss_time = bench_now() - start;
+    bench_sink = sum;
+
+    printf("global table (%s):\n", map_kind(old, use_arena));
+    bench_report("  insert", insert_time, N_IDENTS);
+    bench_report("  lookup hit", hit_time, (u64)LOOKUP_ROUNDS * N_IDENTS);
+    bench_report("  lookup miss", miss_time, (u64)LOOKUP_ROUNDS * N_IDENTS);
+
+    map_free(&map);
+    m_arena_release(&arena);
+}
+
+static void bench_scopes(bool old, bool use_arena)
+{
+    Arena arena;
+    m_arena_init_dynamic(&arena, 1, 1 << 16);
+    static BenchMap scopes[N_SCOPES];
+
+    f64 start = bench_now();
+    for (u32 s = 0; s < N_SCOPES; s++) {
+        map_init(&scopes[s], old, use_arena ? &arena : NULL);
+        for (u32 i = 0; i < IDENTS_PER_SCOPE; i++) {
+            u32 ident = (s * IDENTS_PER_SCOPE + i) % N_IDENTS;
+            map_put(&scopes[s], idents[ident], ident_lens[ident], &idents[ident]);
+        }
+    }
+    f64 build_time = bench_now() - start;
+
+    u64 found = 0;
+    start = bench_now();
+    for (u32 round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (u32 s = 1; s < N_SCOPES; s++) {
+            /* resolve an identifier of the parent scope from the child scope */
+            u32 ident = ((s - 1) * IDENTS_PER_SCOPE + round % IDENTS_PER_SCOPE) % N_IDENTS;
+            void *v = map_get(&scopes[s], idents[ident], ident_lens[ident]);
+            if (v == NULL) {
+                v = map_get(&scopes[s - 1], idents[ident], ident_lens[ident]);
+            }
+            found += v != NULL;
+        }
+    }
+    f64 lookup_time = bench_now() - start;
+    assert(found == (u64)LOOKUP_ROUNDS * (N_SCOPES - 1));
+    bench_sink = found;
+
+    start = bench_now();
+    for (u32 s = 0; s < N_SCOPES; s++) {
+        map_free(&scopes[s]);
+    }
+    m_arena_release(&arena);
+    f64 free_time = bench_now() - start;
+
+    printf("scoped tables (%s):\n", map_kind(old, use_arena));
+    bench_report("  build scope", build_time, N_SCOPES);
+    bench_report("  parent scope lookup", lookup_time, (u64)LOOKUP_ROUNDS * (N_SCOPES - 1));
+    bench_report("  teardown scope", free_time, N_SCOPES);
+}
+
+int main(void)
+{
+    make_idents();
+    for (u32 old = 0; old < 2; old++) {
+        bench_global_table(old, false);
+        bench_global_table(old, true);
+    }
+    for (u32 old = 0; old < 2; old++) {
+        bench_scopes(old, false);
+        bench_scopes(old, true);
+    }
+    return 0;
+}
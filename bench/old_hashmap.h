@@ -0,0 +1,274 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OLD_HASHMAP_H
+#define OLD_HASHMAP_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base/sac_single.h"
+#include "base/types.h"
+
+/*
+ * The bucketed hashmap nicc.h had before the Swiss table, so hashmap_bench.c can measure one
+ * against the other. Only what the benchmark uses is kept, renamed so both fit in one program.
+ * Every bucket stores 6 entries, and a full bucket makes the whole map grow.
+ */
+#define OLD_HM_STARTING_BUCKETS_LOG2 3 // the amount of starting buckets
+#define OLD_HM_BUCKET_SIZE 6
+#define OLD_HM_N_BUCKETS(log2) (1 << (log2))
+
+/* return codes for old_hm_insert() */
+#define OLD_HM_FULL 1
+#define OLD_HM_OVERRIDE 2
+#define OLD_HM_SUCCESS 3
+
+typedef struct {
+    void *key; // if NULL then entry is considered unused
+    void *value;
+    u32 key_size;
+    u32 value_size;
+    u8 hash_extra; // used for faster comparison
+    u8 alloc_flag; // true if value is alloced
+} OldHashMapEntry;
+
+typedef struct {
+    OldHashMapEntry entries[OLD_HM_BUCKET_SIZE];
+} OldHashMapBucket;
+
+typedef struct {
+    OldHashMapBucket *buckets;
+    u8 size_log2;
+    u32 len; // total items stored in the hashmap
+    Arena *arena; // @NULLABLE. If set, buckets, keys and alloced values live here
+    bool borrow_keys; // if true, keys are not copied and must outlive the map
+} OldHashMap;
+
+static u32 old_hm_hash(void *data, u32 size)
+{
+    u32 A = 1327217885;
+    u32 k = 0;
+    for (u32 i = 0; i < size; i++)
+        k += (k << 5) + ((u8 *)data)[i];
+
+    return k * A;
+}
+
+static inline u8 old_hm_hash_extra(u32 hash)
+{
+    return (u8)(hash & ((1 << 8) - 1));
+}
+
+static inline void old_hm_entry_free(OldHashMap *map, OldHashMapEntry *entry)
+{
+    /* arena backed memory is reclaimed when the arena is */
+    if (map->arena != NULL)
+        return;
+    if (!map->borrow_keys)
+        free(entry->key);
+    if (entry->alloc_flag)
+        free(entry->value);
+}
+
+static inline void *old_hm_alloc(OldHashMap *map, size_t size)
+{
+    if (map->arena != NULL)
+        return m_arena_alloc(map->arena, size);
+    return malloc(size);
+}
+
+static inline void old_hm_insert_entry(OldHashMap *map, OldHashMapEntry *found,
+                                       OldHashMapEntry *new)
+{
+    if (map->borrow_keys) {
+        found->key = new->key;
+    } else if (found->key == NULL || found->key_size < new->key_size) {
+        /* an overridden entry has an equal key, so its copy can be reused */
+        if (found->key != NULL && map->arena == NULL)
+            free(found->key);
+        found->key = old_hm_alloc(map, new->key_size);
+        memcpy(found->key, new->key, new->key_size);
+    }
+
+    if (!new->alloc_flag) {
+        if (found->alloc_flag && map->arena == NULL)
+            free(found->value);
+        found->value = new->value;
+    } else {
+        if (!found->alloc_flag || new->value_size > found->value_size) {
+            if (found->alloc_flag && map->arena == NULL)
+                free(found->value);
+            found->value = old_hm_alloc(map, new->value_size);
+        }
+        memcpy(found->value, new->value, new->value_size);
+    }
+
+    found->key_size = new->key_size;
+    found->value_size = new->value_size;
+    found->hash_extra = new->hash_extra;
+    found->alloc_flag = new->alloc_flag;
+}
+
+/* Overrides an entry with an equal key, or takes the first unused one */
+static int old_hm_insert(OldHashMap *map, OldHashMapBucket *bucket, OldHashMapEntry *new)
+{
+    OldHashMapEntry *found = NULL;
+    bool override = false;
+    for (u8 i = 0; i < OLD_HM_BUCKET_SIZE; i++) {
+        OldHashMapEntry *entry = &bucket->entries[i];
+        if (entry->key != NULL && new->hash_extra == entry->hash_extra &&
+            new->key_size == entry->key_size) {
+            if (memcmp(new->key, entry->key, new->key_size) == 0) {
+                found = entry;
+                override = true;
+                break;
+            }
+        }
+
+        if (found == NULL && entry->key == NULL)
+            found = entry;
+    }
+
+    if (found == NULL)
+        return OLD_HM_FULL;
+
+    old_hm_insert_entry(map, found, new);
+    return override ? OLD_HM_OVERRIDE : OLD_HM_SUCCESS;
+}
+
+static OldHashMapEntry *old_hm_get_entry(OldHashMap *map, void *key, u32 key_size)
+{
+    if (map->len == 0)
+        return NULL;
+
+    u32 hash = old_hm_hash(key, key_size);
+    OldHashMapBucket *bucket = &map->buckets[hash >> (32 - map->size_log2)];
+    u8 extra = old_hm_hash_extra(hash);
+    for (u8 i = 0; i < OLD_HM_BUCKET_SIZE; i++) {
+        OldHashMapEntry entry = bucket->entries[i];
+        if (entry.key == NULL)
+            continue;
+        if (key_size == entry.key_size && extra == entry.hash_extra &&
+            memcmp(key, entry.key, key_size) == 0)
+            return &bucket->entries[i];
+    }
+    return NULL;
+}
+
+static void *old_hashmap_get(OldHashMap *map, void *key, u32 key_size)
+{
+    OldHashMapEntry *entry = old_hm_get_entry(map, key, key_size);
+    if (entry == NULL)
+        return NULL;
+    return entry->value;
+}
+
+static OldHashMapBucket *old_hm_alloc_buckets(OldHashMap *map, u8 size_log2)
+{
+    int n_buckets = OLD_HM_N_BUCKETS(size_log2);
+    OldHashMapBucket *buckets = old_hm_alloc(map, sizeof(OldHashMapBucket) * n_buckets);
+    for (int i = 0; i < n_buckets; i++) {
+        for (u8 j = 0; j < OLD_HM_BUCKET_SIZE; j++) {
+            buckets[i].entries[j].key = NULL;
+            buckets[i].entries[j].alloc_flag = false;
+        }
+    }
+    return buckets;
+}
+
+static void old_hm_increase(OldHashMap *map)
+{
+    map->size_log2++;
+    assert(map->size_log2 < 32);
+    OldHashMapBucket *new_buckets = old_hm_alloc_buckets(map, map->size_log2);
+
+    /* Every key is unique, so entries are moved as is into the first unused slot */
+    int old_n_buckets = OLD_HM_N_BUCKETS(map->size_log2 - 1);
+    for (int i = 0; i < old_n_buckets; i++) {
+        for (u8 j = 0; j < OLD_HM_BUCKET_SIZE; j++) {
+            OldHashMapEntry *entry = &map->buckets[i].entries[j];
+            if (entry->key == NULL)
+                continue;
+            u32 hash = old_hm_hash(entry->key, entry->key_size);
+            OldHashMapBucket *bucket = &new_buckets[hash >> (32 - map->size_log2)];
+            for (u8 k = 0; k < OLD_HM_BUCKET_SIZE; k++) {
+                if (bucket->entries[k].key == NULL) {
+                    bucket->entries[k] = *entry;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (map->arena == NULL)
+        free(map->buckets);
+    map->buckets = new_buckets;
+}
+
+static void old_hashmap_put(OldHashMap *map, void *key, u32 key_size, void *value, u32 val_size,
+                            bool alloc_flag)
+{
+    double load_factor = (double)map->len / (OLD_HM_N_BUCKETS(map->size_log2) * OLD_HM_BUCKET_SIZE);
+    if (load_factor >= 0.75)
+        old_hm_increase(map);
+
+    u32 hash = old_hm_hash(key, key_size);
+    OldHashMapEntry new = { key, value, key_size, val_size, old_hm_hash_extra(hash), alloc_flag };
+    int rc = old_hm_insert(map, &map->buckets[hash >> (32 - map->size_log2)], &new);
+
+    if (rc == OLD_HM_FULL) {
+        old_hm_increase(map);
+        old_hashmap_put(map, key, key_size, value, val_size, alloc_flag);
+    }
+
+    if (rc == OLD_HM_SUCCESS)
+        map->len++;
+}
+
+static void old_hashmap_init_arena(OldHashMap *map, Arena *arena, bool borrow_keys)
+{
+    map->arena = arena;
+    map->borrow_keys = borrow_keys;
+    map->len = 0;
+    map->size_log2 = OLD_HM_STARTING_BUCKETS_LOG2;
+    map->buckets = old_hm_alloc_buckets(map, map->size_log2);
+}
+
+static void old_hashmap_init(OldHashMap *map)
+{
+    old_hashmap_init_arena(map, NULL, false);
+}
+
+static void old_hashmap_free(OldHashMap *map)
+{
+    if (map->arena != NULL)
+        return;
+
+    for (int i = 0; i < OLD_HM_N_BUCKETS(map->size_log2); i++) {
+        for (u8 j = 0; j < OLD_HM_BUCKET_SIZE; j++) {
+            OldHashMapEntry *entry = &map->buckets[i].entries[j];
+            if (entry->key != NULL)
+                old_hm_entry_free(map, entry);
+        }
+    }
+
+    free(map->buckets);
+}
+
+#endif /* OLD_HASHMAP_H */
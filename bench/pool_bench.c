@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base/base.h"
+#include "base/pool.h"
+#include "bench.h"
+
+#define NICC_IMPLEMENTATION
+#include "base/nicc.h"
+#define SAC_IMPLEMENTATION
+#include "base/sac_single.h"
+
+/*
+ * Two workloads:
+ * - A flat parallel for over a compute heavy loop body. Measures raw scaling.
+ * - Recursive fork-join where every job spawns two children and waits on them, like a parallel
+ *   pass over a tree would. Most of the work is found by stealing.
+ */
+#define N_ITEMS (1u << 21)
+#define ROUNDS_PER_ITEM 64
+#define TREE_DEPTH 18
+#define TREE_LEAF_ROUNDS 256
+
+typedef struct {
+    u64 sum;
+    u8 pad[56]; // one cache line each
+} PartialSum;
+
+static u64 work(u64 x, u32 rounds)
+{
+    for (u32 i = 0; i < rounds; i++) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 29;
+    }
+    return x;
+}
+
+static void for_body(void *arg, u32 start, u32 end, Arena *scratch, u32 worker_id)
+{
+    (void)scratch;
+    PartialSum *sums = arg;
+    u64 sum = 0;
+    for (u32 i = start; i < end; i++)
+        sum += work(i, ROUNDS_PER_ITEM);
+    sums[worker_id].sum += sum;
+}
+
+typedef struct {
+    ThreadPool *pool;
+    u32 depth;
+    u32 idx;
+    u64 result;
+} TreeJob;
+
+static void tree_job(void *arg, Arena *scratch, u32 worker_id)
+{
+    (void)worker_id;
+    TreeJob *job = arg;
+    if (job->depth == 0) {
+        job->result = work(job->idx, TREE_LEAF_ROUNDS);
+        return;
+    }
+
+    /* children live on the workers scratch arena, which is reset once we return */
+    TreeJob *children = m_arena_alloc(scratch, sizeof(TreeJob) * 2);
+    PoolGroup group = { 0 };
+    for (u32 i = 0; i < 2; i++) {
+        children[i] = (TreeJob){ .pool = job->pool, .depth = job->depth - 1,
+                                 .idx = job->idx * 2 + i };
+        pool_submit(job->pool, &group, tree_job, &children[i]);
+    }
+    pool_group_wait(job->pool, &group);
+    job->result = children[0].result + children[1].result;
+}
+
+static u64 bench_for(u32 n_workers, f64 *seconds)
+{
+    ThreadPool pool;
+    pool_init(&pool, n_workers);
+    PartialSum *sums = calloc(n_workers + 1, sizeof(PartialSum));
+
+    f64 start = bench_now();
+    pool_parallel_for(&pool, N_ITEMS, 0, for_body, sums);
+    *seconds = bench_now() - start;
+
+    u64 total = 0;
+    for (u32 i = 0; i <= n_workers; i++)
+        total += sums[i].sum;
+    free(sums);
+    pool_destroy(&pool);
+    return total;
+}
+
+static u64 bench_tree(u32 n_workers, f64 *seconds)
+{
+    ThreadPool pool;
+    pool_init(&pool, n_workers);
+    TreeJob root = { .pool = &pool, .depth = TREE_DEPTH, .idx = 1 };
+
+    f64 start = bench_now();
+    PoolGroup group = { 0 };
+    pool_submit(&pool, &group, tree_job, &root);
+    pool_group_wait(&pool, &group);
+    *seconds = bench_now() - start;
+
+    pool_destroy(&pool);
+    return root.result;
+}
+
+int main(void)
+{
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char name[64];
+
+    /* Serial baselines */
+    f64 start = bench_now();
+    u64 expected_for = 0;
+    for (u32 i = 0; i < N_ITEMS; i++)
+        expected_for += work(i, ROUNDS_PER_ITEM);
+    f64 serial_for = bench_now() - start;
+    bench_report("parallel for, serial", serial_for, N_ITEMS);
+
+    u64 expected_tree = 0;
+    start = bench_now();
+    for (u32 i = 0; i < (1u << TREE_DEPTH); i++)
+        expected_tree += work((1u << TREE_DEPTH) + i, TREE_LEAF_ROUNDS);
+    f64 serial_tree = bench_now() - start;
+    bench_report("fork-join tree, serial", serial_tree, 1u << TREE_DEPTH);
+
+    /* The calling thread helps while waiting, so n_workers spawned means n_workers + 1 threads */
+    for (u32 n_threads = 1; n_threads <= (u32)n_cpus; n_threads *= 2) {
+        f64 seconds;
+        u64 result = bench_for(n_threads - 1, &seconds);
+        if (result != expected_for)
+            printf("parallel for gave the wrong result!\n");
+        snprintf(name, sizeof(name), "parallel for, %u threads (x%.2f)", n_threads,
+                 serial_for / seconds);
+        bench_report(name, seconds, N_ITEMS);
+
+        result = bench_tree(n_threads - 1, &seconds);
+        if (result != expected_tree)
+            printf("fork-join tree gave the wrong result!\n");
+        snprintf(name, sizeof(name), "fork-join tree, %u threads (x%.2f)", n_threads,
+                 serial_tree / seconds);
+        bench_report(name, seconds, 1u << TREE_DEPTH);
+        bench_sink += result;
+    }
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+
+#include "base/base.h"
+#include "bench.h"
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/dispatch.h"
+#include "compiler/comptime/peephole.h"
+#include "compiler/comptime/reg_bytecode.h"
+#include "compiler/comptime/reg_vm.h"
+#include "compiler/comptime/vm.h"
+
+#define NICC_IMPLEMENTATION
+#include "base/nicc.h"
+#define SAC_IMPLEMENTATION
+#include "base/sac_single.h"
+
+/*
+ * Stack VM against the register VM on a call heavy and a loop heavy program, and the stack VM
+ * again after the peephole pass. Then the stack VM alone on arithmetic heavy and branch heavy
+ * loops, which is where keeping the top of the stack in a register matters. fib also runs with the
+ * JIT, the loops are in the entry function which is only called once and never gets compiled.
+ * bench.sh builds this twice, once with each kind of dispatch, see compiler/comptime/dispatch.h.
+ */
+#define FIB_N 27
+#define LOOP_N 5000000
+#define ROUNDS 5
+
+#if VM_COMPUTED_GOTO
+#define DISPATCH_NAME "computed goto"
+#else
+#define DISPATCH_NAME "switch"
+#endif
+
+typedef BytecodeWord (*RunFunc)(void *code);
+
+static BytecodeWord run_stack(void *code)
+{
+    return run(code);
+}
+
+static BytecodeWord run_stack_jit(void *code)
+{
+    VMMeter meter;
+    vm_meter_init(&meter, 0, 0);
+    return run_with(code, &meter, NULL, true);
+}
+
+static BytecodeWord run_reg(void *code)
+{
+    return reg_run(code);
+}
+
+/* Best of a few rounds */
+static f64 bench_run(RunFunc func, void *code)
+{
+    f64 best = 1e9;
+    for (u32 i = 0; i < ROUNDS; i++) {
+        f64 start = bench_now();
+        bench_sink += func(code);
+        f64 seconds = bench_now() - start;
+        best = seconds < best ? seconds : best;
+    }
+    return best;
+}
+
+static u64 fib_calls(u64 n)
+{
+    return n < 2 ? 1 : 1 + fib_calls(n - 1) + fib_calls(n - 2);
+}
+
+int main(void)
+{
+    Arena arena;
+    m_arena_init_dynamic(&arena, 1, 64);
+    char name[64];
+
+    u64 n_calls = fib_calls(FIB_N);
+    Bytecode *fib = fib_test(&arena, FIB_N);
+    f64 stack = bench_run(run_stack, fib);
+    snprintf(name, sizeof(name), "fib(%d), stack vm, %s", FIB_N, DISPATCH_NAME);
+    bench_report(name, stack, n_calls);
+    bytecode_peephole(fib);
+    f64 peephole = bench_run(run_stack, fib);
+    snprintf(name, sizeof(name), "fib(%d), stack vm, peephole (x%.2f)", FIB_N, stack / peephole);
+    bench_report(name, peephole, n_calls);
+    f64 jit = bench_run(run_stack_jit, fib);
+    snprintf(name, sizeof(name), "fib(%d), stack vm, peephole, jit (x%.2f)", FIB_N, stack / jit);
+    bench_report(name, jit, n_calls);
+    f64 reg = bench_run(run_reg, reg_fib_test(&arena, FIB_N));
+    snprintf(name, sizeof(name), "fib(%d), register vm, %s (x%.2f)", FIB_N, DISPATCH_NAME,
+             stack / reg);
+    bench_report(name, reg, n_calls);
+
+    Bytecode *loop = loop_test(&arena, LOOP_N);
+    stack = bench_run(run_stack, loop);
+    snprintf(name, sizeof(name), "loop, stack vm, %s", DISPATCH_NAME);
+    bench_report(name, stack, LOOP_N);
+    bytecode_peephole(loop);
+    peephole = bench_run(run_stack, loop);
+    snprintf(name, sizeof(name), "loop, stack vm, peephole (x%.2f)", stack / peephole);
+    bench_report(name, peephole, LOOP_N);
+    reg = bench_run(run_reg, reg_loop_test(&arena, LOOP_N));
+    snprintf(name, sizeof(name), "loop, register vm, %s (x%.2f)", DISPATCH_NAME, stack / reg);
+    bench_report(name, reg, LOOP_N);
+
+    /* Stack VM only, before and after the peephole pass */
+    Bytecode *micro[] = { arith_test(&arena, LOOP_N), branch_test(&arena, LOOP_N) };
+    char *micro_names[] = { "arith", "branch" };
+    for (u32 i = 0; i < ARRAY_LENGTH(micro); i++) {
+        stack = bench_run(run_stack, micro[i]);
+        snprintf(name, sizeof(name), "%s, stack vm, %s", micro_names[i], DISPATCH_NAME);
+        bench_report(name, stack, LOOP_N);
+        bytecode_peephole(micro[i]);
+        peephole = bench_run(run_stack, micro[i]);
+        snprintf(name, sizeof(name), "%s, stack vm, peephole (x%.2f)", micro_names[i],
+                 stack / peephole);
+        bench_report(name, peephole, LOOP_N);
+    }
+
+    m_arena_release(&arena);
+    return 0;
+}
@@ -11,7 +11,13 @@ then
 fi
 
 #CFLAGS="-Isrc -Wall -Wpedantic -Wextra -Wshadow -std=c11 -03"
-CFLAGS="-Isrc -Wall -Wpedantic -Wextra -Wshadow -std=c11 -g"
+CFLAGS="-Isrc -Wall -Wpedantic -Wextra -Wshadow -std=c11 -D_DEFAULT_SOURCE -g -pthread"
+
+if [ "$1" = "profile" ]
+then
+    # Comptime VM profiler, for --comptime-profile
+    CFLAGS="$CFLAGS -O2 -DVM_PROFILE=1"
+fi
 #CFLAGS="-Isrc -Wall -Wpedantic -Wextra -Wshadow -std=c11 -g -fsanitize=address -fsanitize=undefined"
 
-cc $CFLAGS $SRCS -o "$OUT"
+cc $CFLAGS $SRCS -o "$OUT" -ldl
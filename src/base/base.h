@@ -13,6 +13,17 @@
 
 #define IS_BETWEEN(x, lower, upper) (((lower) <= (x)) && ((x) <= (upper)))
 
+/*
+ * Tags for arena allocation accounting, see m_arena_stats in sac_single.h.
+ * The compiler continues the numbering from MEM_TAG_BASE_LEN.
+ */
+typedef enum {
+    MEM_TAG_UNTAGGED = 0,
+    MEM_TAG_STRING,
+    MEM_TAG_NAG,
+    MEM_TAG_BASE_LEN,
+} BaseMemTag;
+
 // TODO: we assume NULL is 0x0 in many places. This holds true for every compiler I've ever seen,
 //       but its not guaranteed. So we should give an error if we detect it is in fact not 0.
 //       Same is true for page size. sac_single assumes a page size of 4096. Usually true, not
@@ -26,6 +26,8 @@
 #include "base/str.h"
 #include "nag.h"
 
+#define nag_alloc(arena, size) m_arena_alloc_tagged(arena, size, MEM_TAG_NAG)
+
 typedef NAG_Order (*GraphTraverse)(NAG_Graph *graph, NAG_Idx start_node, u8 *visited);
 
 
@@ -35,7 +37,8 @@ NAG_Graph nag_make_graph(Arena *persist, Arena *scratch, NAG_Idx n_nodes)
         .n_nodes = n_nodes,
         .scratch_arena = scratch,
         .persist_arena = persist,
-        .neighbor_list = m_arena_alloc(persist, sizeof(NAG_GraphNode) * n_nodes),
+        /* The arena may hand back memory it was cleared of, so the empty lists need zeroing */
+        .neighbor_list = m_arena_alloc_zero(persist, sizeof(NAG_GraphNode *) * n_nodes),
     };
     return graph;
 }
@@ -46,7 +49,7 @@ void nag_add_edge(NAG_Graph *graph, NAG_Idx from, NAG_Idx to)
     // NOTE: This is the most naive way we can add eges and probably quite poor for performance
     //       I will improve this if/when it becomes noticable.
     NAG_GraphNode *first = graph->neighbor_list[from];
-    NAG_GraphNode *new_node = m_arena_alloc(graph->persist_arena, sizeof(NAG_GraphNode));
+    NAG_GraphNode *new_node = nag_alloc(graph->persist_arena, sizeof(NAG_GraphNode));
     new_node->id = to;
     new_node->next = first;
     graph->neighbor_list[from] = new_node;
@@ -67,7 +70,7 @@ void nag_print(NAG_Graph *graph)
 
 static NAG_OrderList nag_traverse_all(NAG_Graph *graph, GraphTraverse traverse_func)
 {
-    u8 *visited = m_arena_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
+    u8 *visited = nag_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
     memset(visited, false, sizeof(NAG_Idx) * graph->n_nodes);
 
     NAG_OrderList result = { 0 };
@@ -90,16 +93,19 @@ static NAG_OrderList nag_traverse_all(NAG_Graph *graph, GraphTraverse traverse_f
     return result;
 }
 
-static inline bool linear_alloc_nodes(Arena *arena, u32 n)
+/*
+ * Grows an array of nodes from len to len + n. In place if it is the latest allocation on the
+ * arena, otherwise moved. Returns NULL if the arena is full.
+ */
+static inline NAG_Idx *grow_nodes(Arena *arena, NAG_Idx *nodes, u32 len, u32 n)
 {
-    void *r = m_arena_alloc_internal(arena, sizeof(NAG_Idx) * n, sizeof(NAG_Idx), false);
-    return r != NULL;
+    return m_arena_grow(arena, nodes, sizeof(NAG_Idx) * len, sizeof(NAG_Idx) * (len + n));
 }
 
 static NAG_Order nag_dfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visited)
 {
     /* This will grow linearly on the persist arena as we add nodes to the order */
-    NAG_Idx *ordered = m_arena_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
+    NAG_Idx *ordered = nag_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
     NAG_Idx ordered_len = 0;
 
     /* Everything we allocate on the scratch arena will be released before we returned */
@@ -108,7 +114,7 @@ static NAG_Order nag_dfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visi
     NAG_Idx stack_top = 1;
     /* Similar to ordered. Will grow linearly on the scratch arena as we add nodes to the stack */
     NAG_Idx *stack = m_arena_alloc_internal(graph->scratch_arena, sizeof(NAG_Idx) * stack_size,
-                                            sizeof(NAG_Idx), false);
+                                            sizeof(NAG_Idx), false, MEM_TAG_NAG);
     stack[0] = start_node;
 
     while (stack_top != 0) {
@@ -118,14 +124,16 @@ static NAG_Order nag_dfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visi
         }
         visited[current_node] = true;
         ordered[ordered_len++] = current_node;
-        if (!linear_alloc_nodes(graph->persist_arena, 1)) {
+        ordered = grow_nodes(graph->persist_arena, ordered, ordered_len, 1);
+        if (ordered == NULL) {
             /* Persist arena is full. Report error. */
         }
 
         for (NAG_GraphNode *n = graph->neighbor_list[current_node]; n != NULL; n = n->next) {
             stack[stack_top++] = n->id;
             if (stack_top == stack_size) {
-                if (!linear_alloc_nodes(graph->scratch_arena, NAG_STACK_GROW_SIZE)) {
+                stack = grow_nodes(graph->scratch_arena, stack, stack_size, NAG_STACK_GROW_SIZE);
+                if (stack == NULL) {
                     /* Scratch arena is full. Report error. */
                 }
                 stack_size += NAG_STACK_GROW_SIZE;
@@ -138,7 +146,7 @@ static NAG_Order nag_dfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visi
 
 NAG_Order nag_dfs_from(NAG_Graph *graph, NAG_Idx start_node)
 {
-    u8 *visited = m_arena_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
+    u8 *visited = nag_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
     memset(visited, false, sizeof(NAG_Idx) * graph->n_nodes);
     NAG_Order dfs_order = nag_dfs_internal(graph, start_node, visited);
     m_arena_clear(graph->scratch_arena);
@@ -153,7 +161,7 @@ NAG_OrderList nag_dfs(NAG_Graph *graph)
 static NAG_Order nag_bfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visited)
 {
     /* This will grow linearly on the persist arena as we add nodes to the order */
-    NAG_Idx *ordered = m_arena_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
+    NAG_Idx *ordered = nag_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
     NAG_Idx ordered_len = 0;
 
     /* Everything we allocate on the scratch arena will be released before we returned */
@@ -165,7 +173,8 @@ static NAG_Order nag_bfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visi
     /* Similar to ordered. Will grow linearly on the scratch arena if we need to increase the size
      */
     NAG_Idx *queue = m_arena_alloc_internal(
-        graph->scratch_arena, sizeof(NAG_Idx) * NAG_QUEUE_GROW_SIZE, sizeof(NAG_Idx), false);
+        graph->scratch_arena, sizeof(NAG_Idx) * NAG_QUEUE_GROW_SIZE, sizeof(NAG_Idx), false,
+        MEM_TAG_NAG);
     queue[0] = start_node;
 
     while (queue_low != queue_high) {
@@ -175,7 +184,8 @@ static NAG_Order nag_bfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visi
         }
         visited[current_node] = true;
         ordered[ordered_len++] = current_node;
-        if (!linear_alloc_nodes(graph->persist_arena, 1)) {
+        ordered = grow_nodes(graph->persist_arena, ordered, ordered_len, 1);
+        if (ordered == NULL) {
             /* Persist arena is full. Report error. */
         }
 
@@ -194,7 +204,8 @@ static NAG_Order nag_bfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visi
                     queue_low = 0;
                 }
                 /* Increase the allocation for the queue */
-                if (!linear_alloc_nodes(graph->scratch_arena, NAG_QUEUE_GROW_SIZE)) {
+                queue = grow_nodes(graph->scratch_arena, queue, queue_size, NAG_QUEUE_GROW_SIZE);
+                if (queue == NULL) {
                     /* Scratch arena is full. Report error. */
                 }
                 queue_size += NAG_QUEUE_GROW_SIZE;
@@ -207,7 +218,7 @@ static NAG_Order nag_bfs_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visi
 
 NAG_Order nag_bfs_from(NAG_Graph *graph, NAG_Idx start_node)
 {
-    u8 *visited = m_arena_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
+    u8 *visited = nag_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
     memset(visited, false, sizeof(NAG_Idx) * graph->n_nodes);
     NAG_Order bfs_order = nag_bfs_internal(graph, start_node, visited);
     m_arena_clear(graph->scratch_arena);
@@ -222,7 +233,7 @@ NAG_OrderList nag_bfs(NAG_Graph *graph)
 static NAG_Order nag_toposort_from_internal(NAG_Graph *graph, NAG_Idx start_node, u8 *visited)
 {
     /* This will grow linearly on the persist arena as we add nodes to the order */
-    NAG_Idx *ordered = m_arena_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
+    NAG_Idx *ordered = nag_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
     NAG_Idx ordered_len = 0;
 
     /* NOTE: Most of the code below here is just DFS + some backtracking */
@@ -233,14 +244,15 @@ static NAG_Order nag_toposort_from_internal(NAG_Graph *graph, NAG_Idx start_node
     NAG_Idx stack_top = 1;
     /* Similar to ordered. Will grow linearly on the scratch arena as we add nodes to the stack */
     NAG_Idx *stack = m_arena_alloc_internal(graph->scratch_arena, sizeof(NAG_Idx) * stack_size,
-                                            sizeof(NAG_Idx), false);
+                                            sizeof(NAG_Idx), false, MEM_TAG_NAG);
     stack[0] = start_node;
 
     while (stack_top != 0) {
         NAG_Idx current_node = stack[--stack_top];
         if (visited[current_node]) {
             ordered[ordered_len++] = current_node;
-            if (!linear_alloc_nodes(graph->persist_arena, 1)) {
+            ordered = grow_nodes(graph->persist_arena, ordered, ordered_len, 1);
+            if (ordered == NULL) {
                 /* Persist arena is full. Report error. */
             }
             continue;
@@ -250,7 +262,8 @@ static NAG_Order nag_toposort_from_internal(NAG_Graph *graph, NAG_Idx start_node
         stack[stack_top++] =
             current_node; /* Next time we pop this node all neighbours have been visited */
         if (stack_top == stack_size) {
-            if (!linear_alloc_nodes(graph->scratch_arena, NAG_STACK_GROW_SIZE)) {
+            stack = grow_nodes(graph->scratch_arena, stack, stack_size, NAG_STACK_GROW_SIZE);
+            if (stack == NULL) {
                 /* Scratch arena is full. Report error. */
             }
             stack_size += NAG_STACK_GROW_SIZE;
@@ -259,7 +272,8 @@ static NAG_Order nag_toposort_from_internal(NAG_Graph *graph, NAG_Idx start_node
         for (NAG_GraphNode *n = graph->neighbor_list[current_node]; n != NULL; n = n->next) {
             stack[stack_top++] = n->id;
             if (stack_top == stack_size) {
-                if (!linear_alloc_nodes(graph->scratch_arena, NAG_STACK_GROW_SIZE)) {
+                stack = grow_nodes(graph->scratch_arena, stack, stack_size, NAG_STACK_GROW_SIZE);
+                if (stack == NULL) {
                     /* Scratch arena is full. Report error. */
                 }
                 stack_size += NAG_STACK_GROW_SIZE;
@@ -273,12 +287,12 @@ static NAG_Order nag_toposort_from_internal(NAG_Graph *graph, NAG_Idx start_node
 NAG_Order nag_rev_toposort(NAG_Graph *graph)
 {
     NAG_OrderList all = nag_traverse_all(graph, nag_toposort_from_internal);
-    bool *included = m_arena_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
+    bool *included = nag_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
     memset(included, 0, sizeof(NAG_Idx) * graph->n_nodes);
 
     NAG_Order final;
     final.n_nodes = 0;
-    final.nodes = m_arena_alloc(graph->persist_arena, sizeof(NAG_Idx) * graph->n_nodes);
+    final.nodes = nag_alloc(graph->persist_arena, sizeof(NAG_Idx) * graph->n_nodes);
 
     for (u32 i = 0; i < all.n; i++) {
         NAG_Order current = all.orders[i];
@@ -330,13 +344,14 @@ static void nag_tarjan_scc_dfs(NAG_Graph *graph, NAG_Idx node, NAG_TarjanContext
     if (ctx->low_link[node] == ctx->discovery_time[node]) {
         NAG_Order scc = { 0 };
         /* This will grow linearly on the persist arena as we add nodes to the order */
-        scc.nodes = m_arena_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
+        scc.nodes = nag_alloc(graph->persist_arena, sizeof(NAG_Idx) * 1);
 
         while (1) {
             NAG_Idx top = ctx->stack[--ctx->stack_top];
             ctx->on_stack[top] = false;
             scc.nodes[scc.n_nodes++] = top;
-            if (!linear_alloc_nodes(graph->persist_arena, 1)) {
+            scc.nodes = grow_nodes(graph->persist_arena, scc.nodes, scc.n_nodes, 1);
+            if (scc.nodes == NULL) {
                 /* Persist arena is full. Report error. */
             }
             if (top == node)
@@ -360,10 +375,10 @@ NAG_OrderList nag_scc(NAG_Graph *graph)
     sccs.orders = malloc(sizeof(NAG_Order) * sccs.n);
 
     NAG_TarjanContext ctx;
-    ctx.stack = m_arena_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
-    ctx.on_stack = m_arena_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
-    ctx.low_link = m_arena_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
-    ctx.discovery_time = m_arena_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
+    ctx.stack = nag_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
+    ctx.on_stack = nag_alloc(graph->scratch_arena, sizeof(bool) * graph->n_nodes);
+    ctx.low_link = nag_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
+    ctx.discovery_time = nag_alloc(graph->scratch_arena, sizeof(NAG_Idx) * graph->n_nodes);
     ctx.time = 0;
     ctx.stack_top = 0;
     ctx.scratch_arena = graph->scratch_arena;
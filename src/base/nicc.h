@@ -25,6 +25,8 @@
 #include <string.h>
 #include <sys/types.h>
 
+#include "sac_single.h"
+
 /*
  * common
  */
@@ -109,54 +111,51 @@ bool arraylist_sort(struct arraylist_t *arr, compare_fn_t *cmp);
 /*
  * hashmap
  */
-/* return codes for insert() function */
-#define _HM_FULL 1
-#define _HM_OVERRIDE 2
-#define _HM_SUCCESS 3
+#define HM_STARTING_SIZE_LOG2 4 // the amount of starting slots. Must be >= HM_GROUP_WIDTH
+#define HM_GROUP_WIDTH 16 // control bytes probed at once
+#define HM_N_SLOTS(log2) ((u32)1 << (log2))
 
-#define HM_STARTING_BUCKETS_LOG2 3 // the amount of starting buckets
-#define HM_BUCKET_SIZE 6
-#define HM_OVERFLOW_SIZE 4
-#define N_BUCKETS(log2) (1 << (log2))
+/* control byte states. A full slot stores the lower 7 bits of the hash (h2) */
+#define HM_CTRL_EMPTY ((u8)0x80)
+#define HM_CTRL_DELETED ((u8)0xFE)
 
 /*
  * Quick note on the hashmap:
- * The hashmap impl. is a pretty standard dynamically growing hashmap. Every
- * bucket stores 6 entries by default. The aim of the hashmap implementation is
- * to be cache efficient and simple to use for any datatype and at any scale. It
- * takes major inspiration from the hashmap implemented in Go. NICC also
- * includes a fixed size linked-list hashtable called `ht`. The cache properties
- * of the fixed sized hashtable (ht) are likely to be noticably worse due to the
- * nature of linked list. It is also unlikely to scale particularly well.
+ * The hashmap is an open addressing table in the style of Abseil's Swiss table. Next to the
+ * entries lives an array of one byte control words, one per slot. A control byte is either empty,
+ * deleted (a tombstone) or holds 7 bits of the key's hash. Lookups probe groups of 16 control bytes
+ * at a time, which is a single compare and movemask with SSE2, and only touch entries whose 7 hash
+ * bits match. Groups are probed triangularly, which visits every group when the number of slots is
+ * a power of two. The control array has HM_GROUP_WIDTH trailing bytes mirroring the first group so
+ * a group load never has to wrap around.
+ *
+ * The hash function is a wyhash-style 64-bit multiply-mix which is fast on the short identifier
+ * keys the compiler uses. See https://github.com/wangyi-fudan/wyhash.
  *
- * The hashmap implementation was originally written to be a part of a
- * collaborative project with a friend of mine. It can also be found here
- * amongst some examples and correctness tests:
+ * The original bucketed hashmap was written to be a part of a collaborative project with a friend
+ * of mine. It can also be found here amongst some examples and correctness tests:
  * https://github.com/DHPS-Solutions/dhps-lib
  */
 
 struct hm_entry_t {
-    void *key; // if NULL then entry is considered unused
+    void *key;
     void *value;
     u32 key_size;
     u32 value_size;
-    u8 hash_extra; // used for faster comparison
-    u8 alloc_flag; // true if value is alloced
-                   // if sizeof bool and _Bool > 3 then this struct would be of
-                   // size 36 instead 32 due to struct padding. Therefore we use
-                   // one byte to be safe we don't waste any memory space.
-};
-
-struct hm_bucket_t {
-    struct hm_entry_t entries[HM_BUCKET_SIZE];
+    bool alloc_flag; // true if value is alloced
 };
 
 typedef struct hashmap_t HashMap;
 
 struct hashmap_t {
-    struct hm_bucket_t *buckets;
+    u8 *ctrl; // HM_N_SLOTS(size_log2) + HM_GROUP_WIDTH control bytes
+    struct hm_entry_t *entries;
     u8 size_log2;
     u32 len; // total items stored in the hashmap
+    u32 n_deleted; // tombstones. They count towards the load factor
+    struct m_arena *arena; // @NULLABLE. If set, slots, keys and alloced values live here
+    bool borrow_keys; // if true, keys are not copied and must outlive the map
+    u8 arena_tag; // allocation tag for the arenas accounting, see m_arena_stats
     // #ifdef HASHMAP_THREAD_SAFE
     //     pthread_mutex_t lock;
     // #endif
@@ -164,6 +163,16 @@ struct hashmap_t {
 
 void hashmap_init(struct hashmap_t *map);
 
+/*
+ * Slots, copied keys and alloced values are allocated on the arena instead of the heap. Nothing
+ * is ever freed, so hashmap_free() becomes a no-op and the memory is reclaimed with the arena.
+ * If borrow_keys is true, the map stores the key pointer as is, which is only safe when the key
+ * outlives the map (f.ex. interned identifiers).
+ */
+void hashmap_init_arena(struct hashmap_t *map, struct m_arena *arena, bool borrow_keys);
+void hashmap_init_arena_tagged(struct hashmap_t *map, struct m_arena *arena, bool borrow_keys,
+                               u8 arena_tag);
+
 void hashmap_free(struct hashmap_t *map);
 
 void hashmap_put(struct hashmap_t *map, void *key, u32 key_size, void *value, u32 val_size,
@@ -293,6 +302,108 @@ void linkedlist_print(struct linkedlist_t *ll);
  * linkedlist end
  */
 
+/*
+ * typed containers
+ */
+/*
+ * ARRAY_DEFINE and HASHMAP_DEFINE stamp out containers specialized for a single element type.
+ * Every function is static inline and the element size is a compile time constant, so element
+ * access compiles down to a plain indexed load instead of going through T_size and memcpy, and
+ * callers don't have to cast through void *.
+ *
+ * ARRAY_DEFINE(TypeInfoPtrArray, type_info_ptr_array, TypeInfo *) creates the type
+ * TypeInfoPtrArray and the functions type_info_ptr_array_init(), type_info_ptr_array_free(),
+ * type_info_ptr_array_append(), type_info_ptr_array_get() and type_info_ptr_array_set(). The data
+ * array may also be indexed directly.
+ */
+#define ARRAY_DEFINE(Name, prefix, T)                             \
+    typedef struct {                                              \
+        T *data;                                                  \
+        size_t size;                                              \
+        size_t cap;                                               \
+    } Name;                                                       \
+                                                                  \
+    static inline void prefix##_init(Name *arr)                   \
+    {                                                             \
+        arr->size = 0;                                            \
+        arr->cap = GROW_CAPACITY(0);                              \
+        arr->data = GROW_ARRAY(T, NULL, arr->cap);                \
+    }                                                             \
+                                                                  \
+    static inline void prefix##_free(Name *arr)                   \
+    {                                                             \
+        free(arr->data);                                          \
+    }                                                             \
+                                                                  \
+    static inline void prefix##_append(Name *arr, T val)          \
+    {                                                             \
+        if (arr->size >= arr->cap) {                              \
+            arr->cap = GROW_CAPACITY(arr->cap);                   \
+            arr->data = GROW_ARRAY(T, arr->data, arr->cap);       \
+        }                                                         \
+        arr->data[arr->size++] = val;                             \
+    }                                                             \
+                                                                  \
+    static inline T prefix##_get(Name *arr, size_t idx)           \
+    {                                                             \
+        assert(idx < arr->size);                                  \
+        return arr->data[idx];                                    \
+    }                                                             \
+                                                                  \
+    static inline void prefix##_set(Name *arr, size_t idx, T val) \
+    {                                                             \
+        assert(idx < arr->size);                                  \
+        arr->data[idx] = val;                                     \
+    }
+
+/*
+ * HASHMAP_DEFINE(SymbolMap, symbol_map, Symbol *) wraps a HashMap whose values are all of the
+ * pointer type V. Values are stored as is, so V must be a pointer (or fit in one).
+ */
+#define HASHMAP_DEFINE(Name, prefix, V)                                                 \
+    typedef struct {                                                                    \
+        HashMap map;                                                                    \
+    } Name;                                                                             \
+                                                                                        \
+    static inline void prefix##_init(Name *m)                                           \
+    {                                                                                   \
+        hashmap_init(&m->map);                                                          \
+    }                                                                                   \
+                                                                                        \
+    static inline void prefix##_init_arena(Name *m, struct m_arena *arena, bool borrow) \
+    {                                                                                   \
+        hashmap_init_arena(&m->map, arena, borrow);                                     \
+    }                                                                                   \
+                                                                                        \
+    static inline void prefix##_init_arena_tagged(Name *m, struct m_arena *arena,       \
+                                                  bool borrow, u8 tag)                  \
+    {                                                                                   \
+        hashmap_init_arena_tagged(&m->map, arena, borrow, tag);                         \
+    }                                                                                   \
+                                                                                        \
+    static inline void prefix##_free(Name *m)                                           \
+    {                                                                                   \
+        hashmap_free(&m->map);                                                          \
+    }                                                                                   \
+                                                                                        \
+    static inline V prefix##_get(Name *m, void *key, u32 key_size)                      \
+    {                                                                                   \
+        return (V)hashmap_get(&m->map, key, key_size);                                  \
+    }                                                                                   \
+                                                                                        \
+    static inline void prefix##_put(Name *m, void *key, u32 key_size, V value)          \
+    {                                                                                   \
+        hashmap_put(&m->map, key, key_size, (void *)value, sizeof(V), false);           \
+    }                                                                                   \
+                                                                                        \
+    static inline bool prefix##_rm(Name *m, void *key, u32 key_size)                    \
+    {                                                                                   \
+        return hashmap_rm(&m->map, key, key_size);                                      \
+    }
+/*
+ * typed containers end
+ */
+
 #endif /* NICC_NICC_H */
 
 #ifdef NICC_IMPLEMENTATION
@@ -336,111 +447,168 @@ bool nicc_data_eq(void *a, void *b, u32 T_size)
 
 #ifdef NICC_HASHMAP_IMPLEMENTATION
 
-static u32 hash_func_m(void *data, u32 size)
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HM_SECRET0 0xa0761d6478bd642full
+#define HM_SECRET1 0xe7037ed1a0b428dbull
+#define HM_SECRET2 0x8ebc6af09c88c6e3ull
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 hm_u128;
+
+static inline uint64_t hm_mix(uint64_t a, uint64_t b)
+{
+    hm_u128 r = (hm_u128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+#else
+static inline uint64_t hm_mix(uint64_t a, uint64_t b)
 {
-    /* gigahafting kok (legger dermed ikke så mye lit til det) */
-    u32 A = 1327217885;
-    u32 k = 0;
-    for (u32 i = 0; i < size; i++)
-        k += (k << 5) + ((u8 *)data)[i];
+    /* 64x64 -> 128 multiply from four 32-bit halves */
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+}
+#endif
 
-    return k * A;
+static inline uint64_t hm_read8(const u8 *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
-static inline u8 hm_hash_extra(u32 hash)
+static inline uint64_t hm_read4(const u8 *p)
 {
-    return (u8)(hash & ((1 << 8) - 1));
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
-static inline void entry_free(struct hm_entry_t *entry)
+static uint64_t hash_func_wy(const void *data, u32 size)
 {
-    free(entry->key);
-    if (entry->alloc_flag)
-        free(entry->value);
+    const u8 *p = data;
+    uint64_t seed = HM_SECRET0;
+    uint64_t a, b;
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (hm_read4(p) << 32) | hm_read4(p + ((size >> 3) << 2));
+            b = (hm_read4(p + size - 4) << 32) | hm_read4(p + size - 4 - ((size >> 3) << 2));
+        } else if (size > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        u32 i = size;
+        while (i > 16) {
+            seed = hm_mix(hm_read8(p) ^ HM_SECRET1, hm_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hm_read8(p + i - 16);
+        b = hm_read8(p + i - 8);
+    }
+    return hm_mix(HM_SECRET1 ^ size, hm_mix(a ^ HM_SECRET1, b ^ seed ^ HM_SECRET2));
 }
 
-static inline void insert_entry(struct hm_entry_t *found, struct hm_entry_t *new)
+static inline u32 hm_h1(uint64_t hash)
 {
-    // TODO: should we just set the value of found to be the value of new?
+    return (u32)(hash >> 7);
+}
 
-    if (found->key != NULL)
-        free(found->key);
-    found->key = malloc(new->key_size);
-    memcpy(found->key, new->key, new->key_size);
+static inline u8 hm_h2(uint64_t hash)
+{
+    return (u8)(hash & 0x7f);
+}
 
-    /*
-     * if already alloced space is sufficient, use that
-     * if space is not sufficient, realloc
-     */
-    if (!new->alloc_flag) {
-        if (found->alloc_flag)
-            free(found->value);
-        found->value = new->value;
-    } else {
-        if (!found->alloc_flag)
-            found->value = malloc(new->value_size);
-        else if (new->value_size > found->value_size)
-            found->value = realloc(found->value, new->value_size);
-        memcpy(found->value, new->value, new->value_size);
+static inline u32 hm_ctz(u32 mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (u32)__builtin_ctz(mask);
+#else
+    u32 n = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        n++;
     }
-
-    found->key_size = new->key_size;
-    found->value_size = new->value_size;
-    found->hash_extra = new->hash_extra;
-    found->alloc_flag = new->alloc_flag;
+    return n;
+#endif
 }
 
-static int insert(struct hm_bucket_t *bucket, struct hm_entry_t *new)
+/* Bitmask of the slots in the group starting at ctrl whose control byte equals value */
+static inline u32 hm_group_match(const u8 *ctrl, u8 value)
 {
-    /*
-     * Our hashmap implementation does not allow duplcate keys.
-     * Therefore, we cannot simply find the first empty entry and set the new
-     * entry here, we have to make sure the key we are inserting does not already
-     * exist somewhere else in the bucket. If we find a matching key, we simply
-     * override. If we do not find a matching entry, we insert the new entry in
-     * the first found empty entry.
-     */
-    struct hm_entry_t *found = NULL;
-    bool override = false;
-    for (u8 i = 0; i < HM_BUCKET_SIZE; i++) {
-        // TODO må jeg ta peker?
-        struct hm_entry_t *entry = &bucket->entries[i];
-        if (entry->key != NULL &&
-            new->hash_extra == entry->hash_extra &&new->key_size == entry->key_size) {
-            if (memcmp(new->key, entry->key, new->key_size) == 0) {
-                found = entry;
-                override = true;
-                break;
-            }
-        }
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)value)));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < HM_GROUP_WIDTH; i++) {
+        if (ctrl[i] == value)
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
 
-        if (found == NULL && entry->key == NULL)
-            found = entry;
+/* Empty and deleted both have the high bit set, full slots do not */
+static inline u32 hm_group_match_empty_or_deleted(const u8 *ctrl)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (u32)_mm_movemask_epi8(group);
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < HM_GROUP_WIDTH; i++) {
+        if (ctrl[i] & 0x80)
+            mask |= 1u << i;
     }
+    return mask;
+#endif
+}
 
-    if (found == NULL)
-        return _HM_FULL;
+static inline void *hm_alloc(struct hashmap_t *map, size_t size)
+{
+    if (map->arena != NULL)
+        return m_arena_alloc_tagged(map->arena, size, map->arena_tag);
+    return nicc_internal_realloc(NULL, size);
+}
 
-    insert_entry(found, new);
-    return override ? _HM_OVERRIDE : _HM_SUCCESS;
+static inline void entry_free(struct hashmap_t *map, struct hm_entry_t *entry)
+{
+    /* arena backed memory is reclaimed when the arena is */
+    if (map->arena != NULL)
+        return;
+    if (!map->borrow_keys)
+        free(entry->key);
+    if (entry->alloc_flag)
+        free(entry->value);
 }
 
-static struct hm_entry_t *get_from_bucket(struct hm_bucket_t *bucket, void *key, u32 key_size,
-                                          u8 hash_extra)
+static inline void set_ctrl(struct hashmap_t *map, u32 idx, u8 value)
 {
-    struct hm_entry_t entry;
-    for (u8 i = 0; i < HM_BUCKET_SIZE; i++) {
-        entry = bucket->entries[i];
-        if (entry.key == NULL)
-            continue;
-        if (key_size == entry.key_size && hash_extra == entry.hash_extra) {
-            // TODO: instead of memcmp, use a function that exits if a byte is not
-            // equal
-            if (memcmp(key, entry.key, key_size) == 0)
-                return &bucket->entries[i];
-        }
-    }
-    return NULL;
+    map->ctrl[idx] = value;
+    /* keep the trailing mirror of the first group in sync */
+    if (idx < HM_GROUP_WIDTH)
+        map->ctrl[HM_N_SLOTS(map->size_log2) + idx] = value;
+}
+
+static void alloc_slots(struct hashmap_t *map, u8 size_log2)
+{
+    u32 n_slots = HM_N_SLOTS(size_log2);
+    map->size_log2 = size_log2;
+    map->ctrl = hm_alloc(map, n_slots + HM_GROUP_WIDTH);
+    memset(map->ctrl, HM_CTRL_EMPTY, n_slots + HM_GROUP_WIDTH);
+    map->entries = hm_alloc(map, sizeof(struct hm_entry_t) * n_slots);
 }
 
 static struct hm_entry_t *get_entry(struct hashmap_t *map, void *key, u32 key_size)
@@ -448,11 +616,35 @@ static struct hm_entry_t *get_entry(struct hashmap_t *map, void *key, u32 key_si
     if (map->len == 0)
         return NULL;
 
-    u32 hash = hash_func_m(key, key_size);
-    u32 idx = hash >> (32 - map->size_log2);
-    u8 extra = hm_hash_extra(hash);
-    struct hm_bucket_t *bucket = &map->buckets[idx];
-    return get_from_bucket(bucket, key, key_size, extra);
+    uint64_t hash = hash_func_wy(key, key_size);
+    u8 h2 = hm_h2(hash);
+    u32 mask = HM_N_SLOTS(map->size_log2) - 1;
+    u32 pos = hm_h1(hash) & mask;
+    for (u32 stride = HM_GROUP_WIDTH;; stride += HM_GROUP_WIDTH) {
+        const u8 *group = map->ctrl + pos;
+        for (u32 match = hm_group_match(group, h2); match != 0; match &= match - 1) {
+            struct hm_entry_t *entry = &map->entries[(pos + hm_ctz(match)) & mask];
+            if (entry->key_size == key_size && memcmp(entry->key, key, key_size) == 0)
+                return entry;
+        }
+        /* an empty slot terminates the probe sequence */
+        if (hm_group_match(group, HM_CTRL_EMPTY) != 0)
+            return NULL;
+        pos = (pos + stride) & mask;
+    }
+}
+
+/* First empty or deleted slot in the probe sequence of hash */
+static u32 find_free_slot(struct hashmap_t *map, uint64_t hash)
+{
+    u32 mask = HM_N_SLOTS(map->size_log2) - 1;
+    u32 pos = hm_h1(hash) & mask;
+    for (u32 stride = HM_GROUP_WIDTH;; stride += HM_GROUP_WIDTH) {
+        u32 match = hm_group_match_empty_or_deleted(map->ctrl + pos);
+        if (match != 0)
+            return (pos + hm_ctz(match)) & mask;
+        pos = (pos + stride) & mask;
+    }
 }
 
 void *hashmap_get(struct hashmap_t *map, void *key, u32 key_size)
@@ -463,156 +655,167 @@ void *hashmap_get(struct hashmap_t *map, void *key, u32 key_size)
     return entry->value;
 }
 
-static void re_insert(u32 size_log2, struct hm_bucket_t *buckets, struct hm_entry_t *entry)
+static void resize(struct hashmap_t *map, u8 new_size_log2)
 {
-    u32 hash = hash_func_m(entry->key, entry->key_size);
-    u32 idx = hash >> (32 - size_log2);
-    insert(&buckets[idx], entry);
-}
+    assert(new_size_log2 < 32);
 
-static void increase(struct hashmap_t *map)
-{
-    // TODO: instead of moving all entries in one go, we can only move over some
-    // buckets
-    //       and invalidate the rest and move them once necesary
+    u8 *old_ctrl = map->ctrl;
+    struct hm_entry_t *old_entries = map->entries;
+    u32 old_n_slots = HM_N_SLOTS(map->size_log2);
+    alloc_slots(map, new_size_log2);
 
-    map->size_log2++;
-    assert(map->size_log2 < 32);
+    /* every key is unique, so entries can be moved as is without comparing keys */
+    for (u32 i = 0; i < old_n_slots; i++) {
+        if (old_ctrl[i] & 0x80)
+            continue;
+        uint64_t hash = hash_func_wy(old_entries[i].key, old_entries[i].key_size);
+        u32 idx = find_free_slot(map, hash);
+        set_ctrl(map, idx, hm_h2(hash));
+        map->entries[idx] = old_entries[i];
+    }
+    map->n_deleted = 0;
 
-    int n_buckets = N_BUCKETS(map->size_log2);
-    struct hm_bucket_t *new_buckets = malloc(sizeof(struct hm_bucket_t) * n_buckets);
-    for (int i = 0; i < n_buckets; i++) {
-        // NOTE: trenger det å være en peker?
-        struct hm_bucket_t *bucket = &new_buckets[i];
-        /* set all entries to NULL */
-        for (u8 j = 0; j < HM_BUCKET_SIZE; j++) {
-            bucket->entries[j].key = NULL;
-            bucket->entries[j].alloc_flag = false;
-        }
+    if (map->arena == NULL) {
+        free(old_ctrl);
+        free(old_entries);
     }
+}
 
-    /* move all entries into the new buckets */
-    int old_n_buckets = N_BUCKETS(map->size_log2 - 1);
-    for (int i = 0; i < old_n_buckets; i++) {
-        struct hm_bucket_t bucket = map->buckets[i];
-        for (u8 j = 0; j < HM_BUCKET_SIZE; j++) {
-            if (bucket.entries[j].key != NULL) {
-                re_insert(map->size_log2, new_buckets, &bucket.entries[j]);
-                entry_free(&bucket.entries[j]);
-            }
+static void set_value(struct hashmap_t *map, struct hm_entry_t *entry, void *value, u32 val_size,
+                      bool alloc_flag)
+{
+    /*
+     * if already alloced space is sufficient, use that
+     * if space is not sufficient, allocate new space
+     */
+    if (!alloc_flag) {
+        if (entry->alloc_flag && map->arena == NULL)
+            free(entry->value);
+        entry->value = value;
+    } else {
+        if (!entry->alloc_flag || val_size > entry->value_size) {
+            if (entry->alloc_flag && map->arena == NULL)
+                free(entry->value);
+            entry->value = hm_alloc(map, val_size);
         }
+        memcpy(entry->value, value, val_size);
     }
-
-    free(map->buckets);
-    map->buckets = new_buckets;
+    entry->value_size = val_size;
+    entry->alloc_flag = alloc_flag;
 }
 
 void hashmap_put(struct hashmap_t *map, void *key, u32 key_size, void *value, u32 val_size,
                  bool alloc_flag)
 {
-    double load_factor = (double)map->len / (N_BUCKETS(map->size_log2) * HM_BUCKET_SIZE);
+    /* our hashmap does not allow duplicate keys, so an existing entry is overridden */
+    struct hm_entry_t *existing = get_entry(map, key, key_size);
+    if (existing != NULL) {
+        set_value(map, existing, value, val_size, alloc_flag);
+        return;
+    }
 
-    if (load_factor >= 0.75)
-        increase(map);
+    /* keep the load factor, tombstones included, below 7/8 */
+    u32 n_slots = HM_N_SLOTS(map->size_log2);
+    if ((map->len + map->n_deleted + 1) * 8 > n_slots * 7) {
+        /* if mostly tombstones then rehashing in place is enough */
+        bool grow = (map->len + 1) * 2 > n_slots;
+        resize(map, grow ? map->size_log2 + 1 : map->size_log2);
+    }
 
-    u32 hash = hash_func_m(key, key_size);
-    u32 idx = hash >> (32 - map->size_log2);
-    u8 extra = hm_hash_extra(hash);
-    struct hm_entry_t new = { key, value, key_size, val_size, extra, alloc_flag };
-    int rc = insert(&map->buckets[idx], &new);
+    uint64_t hash = hash_func_wy(key, key_size);
+    u32 idx = find_free_slot(map, hash);
+    if (map->ctrl[idx] == HM_CTRL_DELETED)
+        map->n_deleted--;
+    set_ctrl(map, idx, hm_h2(hash));
 
-    if (rc == _HM_FULL) {
-        increase(map);
-        hashmap_put(map, key, key_size, value, val_size, alloc_flag);
+    struct hm_entry_t *entry = &map->entries[idx];
+    if (map->borrow_keys) {
+        entry->key = key;
+    } else {
+        entry->key = hm_alloc(map, key_size);
+        memcpy(entry->key, key, key_size);
     }
+    entry->key_size = key_size;
+    entry->alloc_flag = false;
+    set_value(map, entry, value, val_size, alloc_flag);
+    map->len++;
+}
 
-    if (rc == _HM_SUCCESS)
-        map->len++;
+static void hashmap_init_slots(struct hashmap_t *map)
+{
+    map->len = 0;
+    map->n_deleted = 0;
+    alloc_slots(map, HM_STARTING_SIZE_LOG2);
 }
 
 void hashmap_init(struct hashmap_t *map)
 {
-    map->len = 0;
-    map->size_log2 = HM_STARTING_BUCKETS_LOG2;
-
-    int n_buckets = N_BUCKETS(map->size_log2);
-    map->buckets = calloc(sizeof(struct hm_bucket_t), n_buckets);
-    for (int i = 0; i < n_buckets; i++) {
-        struct hm_bucket_t *bucket = &map->buckets[i];
-        /* set all entries to NULL */
-        for (u8 j = 0; j < HM_BUCKET_SIZE; j++) {
-            bucket->entries[j].key = NULL;
-            bucket->entries[j].alloc_flag = false;
-        }
-    }
+    map->arena = NULL;
+    map->borrow_keys = false;
+    map->arena_tag = 0;
+    hashmap_init_slots(map);
+}
+
+void hashmap_init_arena(struct hashmap_t *map, struct m_arena *arena, bool borrow_keys)
+{
+    hashmap_init_arena_tagged(map, arena, borrow_keys, 0);
+}
+
+void hashmap_init_arena_tagged(struct hashmap_t *map, struct m_arena *arena, bool borrow_keys,
+                               u8 arena_tag)
+{
+    map->arena = arena;
+    map->borrow_keys = borrow_keys;
+    map->arena_tag = arena_tag;
+    hashmap_init_slots(map);
 }
 
 bool hashmap_rm(struct hashmap_t *map, void *key, u32 key_size)
 {
     struct hm_entry_t *entry = get_entry(map, key, key_size);
-    if (entry == NULL) // || entry->value == NULL)
+    if (entry == NULL)
         return false;
 
-    free(entry->key);
-    entry->key = NULL;
-    if (entry->alloc_flag) {
-        free(entry->value);
-        entry->alloc_flag = false;
-    }
-
+    entry_free(map, entry);
+    entry->alloc_flag = false;
+    set_ctrl(map, (u32)(entry - map->entries), HM_CTRL_DELETED);
+    map->n_deleted++;
     map->len--;
     return true;
 }
 
 void hashmap_free(struct hashmap_t *map)
 {
-    int n_buckets = N_BUCKETS(map->size_log2);
-    for (int i = 0; i < n_buckets; i++) {
-        struct hm_bucket_t *bucket = &map->buckets[i];
-        /* set all entries to NULL */
-        for (u8 j = 0; j < HM_BUCKET_SIZE; j++) {
-            struct hm_entry_t *entry = &bucket->entries[j];
-            if (entry->key != NULL)
-                entry_free(entry);
-        }
+    if (map->arena != NULL)
+        return;
+
+    u32 n_slots = HM_N_SLOTS(map->size_log2);
+    for (u32 i = 0; i < n_slots; i++) {
+        if (!(map->ctrl[i] & 0x80))
+            entry_free(map, &map->entries[i]);
     }
 
-    free(map->buckets);
+    free(map->ctrl);
+    free(map->entries);
 }
 
 void hashmap_get_values(struct hashmap_t *map, void **return_ptr)
 {
     size_t count = 0;
-
-    for (int i = 0; i < N_BUCKETS(map->size_log2); i++) {
-        struct hm_bucket_t *bucket = &map->buckets[i];
-        for (int j = 0; j < HM_BUCKET_SIZE; j++) {
-            struct hm_entry_t entry = bucket->entries[j];
-            if (entry.key == NULL)
-                continue;
-
-            return_ptr[count++] = entry.value;
-            if (count == map->len)
-                return;
-        }
+    u32 n_slots = HM_N_SLOTS(map->size_log2);
+    for (u32 i = 0; i < n_slots && count < map->len; i++) {
+        if (!(map->ctrl[i] & 0x80))
+            return_ptr[count++] = map->entries[i].value;
     }
 }
 
 void hashmap_get_keys(struct hashmap_t *map, void **return_ptr)
 {
     size_t count = 0;
-
-    for (int i = 0; i < N_BUCKETS(map->size_log2); i++) {
-        struct hm_bucket_t *bucket = &map->buckets[i];
-        for (int j = 0; j < HM_BUCKET_SIZE; j++) {
-            struct hm_entry_t entry = bucket->entries[j];
-            if (entry.key == NULL)
-                continue;
-
-            return_ptr[count++] = entry.key;
-            if (count == map->len)
-                return;
-        }
+    u32 n_slots = HM_N_SLOTS(map->size_log2);
+    for (u32 i = 0; i < n_slots && count < map->len; i++) {
+        if (!(map->ctrl[i] & 0x80))
+            return_ptr[count++] = map->entries[i].key;
     }
 }
 
@@ -0,0 +1,279 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "base/pool.h"
+
+#define POOL_DEQUE_MASK (POOL_DEQUE_SIZE - 1)
+#define POOL_SPIN_ROUNDS 64
+#define POOL_ARENA_PAGES 256
+
+/* The worker running on this thread. NULL for threads that are not part of any pool. */
+static _Thread_local PoolWorker *current_worker = NULL;
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static PoolWorker *get_worker(ThreadPool *pool)
+{
+    if (current_worker != NULL && current_worker->pool == pool)
+        return current_worker;
+    return &pool->workers[pool->n_workers];
+}
+
+static void deque_init(PoolDeque *d)
+{
+    pthread_mutex_init(&d->lock, NULL);
+    d->top = 0;
+    d->bottom = 0;
+}
+
+static bool deque_push(PoolDeque *d, PoolJob job)
+{
+    pthread_mutex_lock(&d->lock);
+    bool full = d->bottom - d->top == POOL_DEQUE_SIZE;
+    if (!full)
+        d->jobs[d->bottom++ & POOL_DEQUE_MASK] = job;
+    pthread_mutex_unlock(&d->lock);
+    return !full;
+}
+
+static bool deque_pop(PoolDeque *d, PoolJob *job)
+{
+    pthread_mutex_lock(&d->lock);
+    bool empty = d->bottom == d->top;
+    if (!empty)
+        *job = d->jobs[--d->bottom & POOL_DEQUE_MASK];
+    pthread_mutex_unlock(&d->lock);
+    return !empty;
+}
+
+static bool deque_steal(PoolDeque *d, PoolJob *job)
+{
+    pthread_mutex_lock(&d->lock);
+    bool empty = d->bottom == d->top;
+    if (!empty)
+        *job = d->jobs[d->top++ & POOL_DEQUE_MASK];
+    pthread_mutex_unlock(&d->lock);
+    return !empty;
+}
+
+static void run_job(PoolWorker *w, PoolJob job)
+{
+    /*
+     * A job that waits on a group runs other jobs on the same worker in the meantime, so the
+     * arena is rolled back instead of cleared.
+     */
+    ArenaTmp tmp = m_arena_tmp_init(&w->arena);
+    job.func(job.arg, &w->arena, w->id);
+    m_arena_tmp_release(tmp);
+
+    if (job.group != NULL)
+        atomic_fetch_sub_explicit(&job.group->pending, 1, memory_order_release);
+}
+
+/* Pops a job from our own deque or steals one. Returns false if there was nothing to run. */
+static bool try_run_one(PoolWorker *w)
+{
+    ThreadPool *pool = w->pool;
+    PoolJob job;
+    bool found = deque_pop(&w->deque, &job);
+
+    if (!found && atomic_load_explicit(&pool->n_queued, memory_order_relaxed) != 0) {
+        /* xorshift, good enough to spread the thieves out */
+        w->rng ^= w->rng << 13;
+        w->rng ^= w->rng >> 17;
+        w->rng ^= w->rng << 5;
+        u32 n_deques = pool->n_workers + 1;
+        u32 start = w->rng % n_deques;
+        for (u32 i = 0; i < n_deques && !found; i++) {
+            PoolWorker *victim = &pool->workers[(start + i) % n_deques];
+            if (victim != w)
+                found = deque_steal(&victim->deque, &job);
+        }
+    }
+
+    if (!found)
+        return false;
+    atomic_fetch_sub(&pool->n_queued, 1);
+    run_job(w, job);
+    return true;
+}
+
+static void *worker_main(void *arg)
+{
+    PoolWorker *w = arg;
+    ThreadPool *pool = w->pool;
+    current_worker = w;
+
+    while (!atomic_load(&pool->stop)) {
+        if (try_run_one(w)) {
+            /* Between jobs. Also drops any blocks the arena had to chain on. */
+            m_arena_clear(&w->arena);
+            continue;
+        }
+
+        /* Spin for a bit before going to sleep as more work is often right around the corner */
+        for (u32 i = 0; i < POOL_SPIN_ROUNDS && atomic_load(&pool->n_queued) == 0; i++)
+            cpu_relax();
+        if (atomic_load(&pool->n_queued) != 0)
+            continue;
+
+        /*
+         * n_sleeping is bumped before n_queued is checked, and pool_submit bumps n_queued before
+         * checking n_sleeping, so one of us always sees the other and no wakeup is lost.
+         */
+        pthread_mutex_lock(&pool->sleep_lock);
+        atomic_fetch_add(&pool->n_sleeping, 1);
+        while (atomic_load(&pool->n_queued) == 0 && !atomic_load(&pool->stop))
+            pthread_cond_wait(&pool->sleep_cond, &pool->sleep_lock);
+        atomic_fetch_sub(&pool->n_sleeping, 1);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+
+    return NULL;
+}
+
+u32 pool_default_workers(void)
+{
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return n_cpus > 1 ? (u32)n_cpus - 1 : 0;
+}
+
+void pool_init(ThreadPool *pool, u32 n_workers)
+{
+    pool->n_workers = n_workers;
+    pool->workers = malloc(sizeof(PoolWorker) * (n_workers + 1));
+    atomic_init(&pool->n_queued, 0);
+    atomic_init(&pool->n_sleeping, 0);
+    atomic_init(&pool->stop, false);
+    pthread_mutex_init(&pool->sleep_lock, NULL);
+    pthread_cond_init(&pool->sleep_cond, NULL);
+
+    for (u32 i = 0; i <= n_workers; i++) {
+        PoolWorker *w = &pool->workers[i];
+        w->pool = pool;
+        w->id = i;
+        w->rng = 0x9E3779B9u * (i + 1);
+        deque_init(&w->deque);
+        m_arena_init_dynamic_flags(&w->arena, 1, POOL_ARENA_PAGES, SAC_FLAG_CHAINED);
+    }
+    /* The last worker slot is not a thread, it's for the caller */
+    for (u32 i = 0; i < n_workers; i++) {
+        pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]);
+    }
+}
+
+void pool_destroy(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->sleep_lock);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->sleep_cond);
+    pthread_mutex_unlock(&pool->sleep_lock);
+
+    for (u32 i = 0; i < pool->n_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (u32 i = 0; i <= pool->n_workers; i++) {
+        pthread_mutex_destroy(&pool->workers[i].deque.lock);
+        m_arena_release(&pool->workers[i].arena);
+    }
+    pthread_mutex_destroy(&pool->sleep_lock);
+    pthread_cond_destroy(&pool->sleep_cond);
+    free(pool->workers);
+}
+
+void pool_submit(ThreadPool *pool, PoolGroup *group, PoolFunc func, void *arg)
+{
+    PoolWorker *w = get_worker(pool);
+    PoolJob job = { .func = func, .arg = arg, .group = group };
+    if (group != NULL)
+        atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+
+    if (!deque_push(&w->deque, job)) {
+        /* Our deque is full, so there is plenty for the others to steal. Just run it. */
+        run_job(w, job);
+        return;
+    }
+
+    atomic_fetch_add(&pool->n_queued, 1);
+    if (atomic_load(&pool->n_sleeping) != 0) {
+        pthread_mutex_lock(&pool->sleep_lock);
+        pthread_cond_signal(&pool->sleep_cond);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
+
+void pool_group_wait(ThreadPool *pool, PoolGroup *group)
+{
+    PoolWorker *w = get_worker(pool);
+    while (atomic_load_explicit(&group->pending, memory_order_acquire) != 0) {
+        if (!try_run_one(w))
+            sched_yield();
+    }
+}
+
+typedef struct {
+    PoolForFunc func;
+    void *arg;
+    u32 start;
+    u32 end;
+} PoolForChunk;
+
+static void parallel_for_job(void *arg, Arena *scratch, u32 worker_id)
+{
+    PoolForChunk *chunk = arg;
+    chunk->func(chunk->arg, chunk->start, chunk->end, scratch, worker_id);
+}
+
+void pool_parallel_for(ThreadPool *pool, u32 n, u32 grain, PoolForFunc func, void *arg)
+{
+    if (n == 0)
+        return;
+    if (grain == 0) {
+        grain = n / ((pool->n_workers + 1) * 4);
+        if (grain == 0)
+            grain = 1;
+    }
+
+    PoolWorker *w = get_worker(pool);
+    u32 n_chunks = (n + grain - 1) / grain;
+    ArenaTmp tmp = m_arena_tmp_init(&w->arena);
+    PoolForChunk *chunks = m_arena_alloc(&w->arena, sizeof(PoolForChunk) * n_chunks);
+
+    PoolGroup group = { 0 };
+    for (u32 i = 0; i < n_chunks; i++) {
+        u32 start = i * grain;
+        u32 end = start + grain < n ? start + grain : n;
+        chunks[i] = (PoolForChunk){ .func = func, .arg = arg, .start = start, .end = end };
+        pool_submit(pool, &group, parallel_for_job, &chunks[i]);
+    }
+    pool_group_wait(pool, &group);
+    m_arena_tmp_release(tmp);
+}
+
+u32 pool_worker_id(ThreadPool *pool)
+{
+    return get_worker(pool)->id;
+}
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "base/sac_single.h"
+#include "base/types.h"
+
+/*
+ * Work-stealing thread pool.
+ *
+ * Every worker owns a deque of jobs. Workers push and pop jobs at the bottom of their own deque
+ * and steal from the top of the others when they run dry. The deques are guarded by a mutex each
+ * rather than being lock-free. There is no shared queue, so the locks are almost never contended.
+ *
+ * The thread that creates the pool gets a deque and an arena of its own. It can submit jobs and
+ * helps run them while it waits on a group. Only that thread may submit or wait from outside the
+ * pool.
+ *
+ * Every worker has an arena that jobs can use for scratch memory. Whatever a job allocates on it
+ * is released when the job returns.
+ */
+
+#define POOL_DEQUE_SIZE 1024 // must be a power of two
+
+/* scratch is the running worker's arena. worker_id is in [0, n_workers] */
+typedef void (*PoolFunc)(void *arg, Arena *scratch, u32 worker_id);
+/* Called with the index range [start, end) */
+typedef void (*PoolForFunc)(void *arg, u32 start, u32 end, Arena *scratch, u32 worker_id);
+
+/* Jobs submitted with a group can be waited on. Must be zero initialised. */
+typedef struct {
+    _Atomic u32 pending;
+} PoolGroup;
+
+typedef struct {
+    PoolFunc func;
+    void *arg;
+    PoolGroup *group; // @NULLABLE
+} PoolJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    u32 top; // thieves steal here
+    u32 bottom; // the owner pushes and pops here
+    PoolJob jobs[POOL_DEQUE_SIZE];
+} PoolDeque;
+
+typedef struct thread_pool_t ThreadPool;
+
+typedef struct {
+    ThreadPool *pool;
+    u32 id;
+    u32 rng; // for picking who to steal from
+    pthread_t thread;
+    PoolDeque deque;
+    Arena arena;
+} PoolWorker;
+
+struct thread_pool_t {
+    u32 n_workers; // threads spawned by the pool
+    PoolWorker *workers; // n_workers + 1. The last one belongs to the thread that created the pool
+    _Atomic u32 n_queued;
+    _Atomic u32 n_sleeping;
+    _Atomic bool stop;
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t sleep_cond;
+};
+
+/* n_workers can be 0, then every job runs on the calling thread when it waits */
+void pool_init(ThreadPool *pool, u32 n_workers);
+/* One worker per online CPU, minus the calling thread */
+u32 pool_default_workers(void);
+/* Waits for the workers to finish what they are running, unqueued jobs are dropped */
+void pool_destroy(ThreadPool *pool);
+
+void pool_submit(ThreadPool *pool, PoolGroup *group, PoolFunc func, void *arg);
+/* Runs queued jobs on the calling thread until every job in the group has finished */
+void pool_group_wait(ThreadPool *pool, PoolGroup *group);
+/*
+ * Splits [0, n) into chunks of grain indices and runs func over them in parallel. Returns when
+ * every chunk is done. A grain of 0 picks one that gives each worker a few chunks to balance.
+ */
+void pool_parallel_for(ThreadPool *pool, u32 n, u32 grain, PoolForFunc func, void *arg);
+
+/* Id of the calling thread in [0, n_workers]. n_workers if it's the thread that made the pool. */
+u32 pool_worker_id(ThreadPool *pool);
+
+#endif /* POOL_H */
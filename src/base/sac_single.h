@@ -46,19 +46,65 @@
 #define SAC_DEFAULT_ALIGNMENT (sizeof(void *))
 #endif
 
-typedef struct m_arena Arena;
-typedef struct m_arena_tmp ArenaTmp;
+/* Allocations can be tagged with a number below this. Tag 0 is used for untagged allocations. */
+#ifndef SAC_MAX_TAGS
+#define SAC_MAX_TAGS 64
+#endif
 
 /* types */
 typedef struct m_arena Arena;
 typedef struct m_arena_tmp ArenaTmp;
 
+/* flags for m_arena_init_dynamic_flags() */
+typedef enum {
+    /*
+     * Instead of failing when the reservation runs out, reserve more memory. The reservation is
+     * first extended in place so the arena stays contiguous. If the address space right after is
+     * taken, a new block is chained onto the arena.
+     */
+    SAC_FLAG_CHAINED = 1 << 0,
+    /* Prefault pages as they are committed instead of taking a page fault on first touch */
+    SAC_FLAG_POPULATE = 1 << 1,
+    /* Ask for transparent huge pages on the reservation */
+    SAC_FLAG_HUGE_PAGES = 1 << 2,
+    /* On m_arena_clear(), give pages beyond the starting pages back to the OS */
+    SAC_FLAG_DECOMMIT_ON_CLEAR = 1 << 3,
+} ArenaFlags;
+
+/*
+ * Allocation accounting. Only kept when enabled with m_arena_stats_enable() so that arenas nobody
+ * is looking at don't pay for it.
+ */
+struct m_arena_stats {
+    const char *name;
+    uint64_t n_allocs;
+    uint64_t bytes_requested;
+    uint64_t bytes_padding; // lost to alignment
+    uint64_t n_clears;
+    size_t peak_offset; // largest offset seen in any block
+    size_t pages_commited; // across all blocks
+    size_t peak_pages_commited;
+    size_t n_blocks; // blocks chained on
+    uint8_t last_tag; // in-place growth is accounted to the tag of the latest allocation
+    uint64_t tag_allocs[SAC_MAX_TAGS];
+    uint64_t tag_bytes[SAC_MAX_TAGS];
+};
+
+/* Describes a previous block of a chained arena. Lives at the start of the block after it. */
+struct m_arena_block {
+    uint8_t *memory;
+    size_t offset;
+    size_t max_pages;
+    size_t pages_commited;
+    struct m_arena_block *prev;
+};
+
 /*
  * generic memory arena that dynamically grows its committed size.
  * more complex memory arenas can be built using this as a base.
  */
 struct m_arena {
-    uint8_t *memory; // the backing memory
+    uint8_t *memory; // the backing memory of the current block
     size_t offset; // first unused position in the backing memory
     bool is_dynamic;
     union {
@@ -67,10 +113,15 @@ struct m_arena {
     };
     size_t page_size;
     size_t pages_commited; // how much of the backing memory is acutally "backing"
+    size_t pages_retained; // pages kept committed when decommitting on clear
+    uint32_t flags; // ArenaFlags
+    struct m_arena_block *prev; // @NULLABLE. Previous blocks of a chained arena
+    struct m_arena_stats *stats; // @NULLABLE
 };
 
 struct m_arena_tmp {
     struct m_arena *arena;
+    uint8_t *memory; // block the offset belongs to
     size_t offset;
 };
 
@@ -78,12 +129,31 @@ struct m_arena_tmp {
 /* functions */
 void m_arena_init(struct m_arena *arena, void *backing_memory, size_t backing_length);
 void m_arena_init_dynamic(struct m_arena *arena, size_t starting_pages, size_t max_pages);
+/* max_pages is the size of the first reservation when flags contains SAC_FLAG_CHAINED */
+void m_arena_init_dynamic_flags(struct m_arena *arena, size_t starting_pages, size_t max_pages,
+                                uint32_t flags);
 void m_arena_release(struct m_arena *arena);
+/* Starts accounting allocations into stats. The stats must outlive the arena. */
+void m_arena_stats_enable(struct m_arena *arena, struct m_arena_stats *stats, const char *name);
 
-void *m_arena_alloc_internal(struct m_arena *arena, size_t size, size_t align, bool zero);
-#define m_arena_alloc(arena, size) m_arena_alloc_internal(arena, size, SAC_DEFAULT_ALIGNMENT, false)
+void *m_arena_alloc_internal(struct m_arena *arena, size_t size, size_t align, bool zero,
+                             uint8_t tag);
+#define m_arena_alloc(arena, size) \
+    m_arena_alloc_internal(arena, size, SAC_DEFAULT_ALIGNMENT, false, 0)
 #define m_arena_alloc_zero(arena, size) \
-    m_arena_alloc_internal(arena, size, SAC_DEFAULT_ALIGNMENT, true)
+    m_arena_alloc_internal(arena, size, SAC_DEFAULT_ALIGNMENT, true, 0)
+#define m_arena_alloc_tagged(arena, size, tag) \
+    m_arena_alloc_internal(arena, size, SAC_DEFAULT_ALIGNMENT, false, tag)
+#define m_arena_alloc_zero_tagged(arena, size, tag) \
+    m_arena_alloc_internal(arena, size, SAC_DEFAULT_ALIGNMENT, true, tag)
+
+/*
+ * Grows the allocation at ptr from old_size to new_size bytes and returns its (possibly new)
+ * location. If ptr is the most recent allocation and there is room, it is grown in place.
+ * Otherwise the contents are copied to a new allocation. Use this instead of relying on
+ * consecutive allocations being contiguous, which does not hold across chained blocks.
+ */
+void *m_arena_grow(struct m_arena *arena, void *ptr, size_t old_size, size_t new_size);
 
 void m_arena_clear(struct m_arena *arena);
 void *m_arena_get(struct m_arena *arena, size_t byte_idx);
@@ -100,9 +170,9 @@ void *m_arena_get(struct m_arena *arena, size_t byte_idx);
 struct m_arena_tmp m_arena_tmp_init(struct m_arena *arena);
 void m_arena_tmp_release(struct m_arena_tmp tmp);
 /* cursed */
-#define ARENA_TMP(___arena)                                          \
-    for (size_t ___i = 0, ___offset = (___arena)->offset; ___i == 0; \
-         ___i += 1, (___arena)->offset = ___offset)
+#define ARENA_TMP(___arena)                                                          \
+    for (struct m_arena_tmp ___tmp = m_arena_tmp_init(___arena), *___once = &___tmp; \
+         ___once != NULL; m_arena_tmp_release(___tmp), ___once = NULL)
 
 
 #define arena_curr_ptr(arena) (uintptr_t)(arena)->memory + (uintptr_t)(arena)->offset
@@ -120,7 +190,41 @@ void m_arena_tmp_release(struct m_arena_tmp tmp);
 #include <unistd.h>
 /* IMPORT END */
 /* IMPL START */
+#ifdef MAP_FIXED_NOREPLACE
+#define SAC_MAP_NOREPLACE MAP_FIXED_NOREPLACE
+#else
+#define SAC_MAP_NOREPLACE 0
+#endif
+
 /* internal functions */
+static void m_arena_populate(struct m_arena *arena, uint8_t *start, size_t len)
+{
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(start, len, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    /* fallback: touch every page. Freshly committed pages are zero, so this changes nothing */
+    for (size_t i = 0; i < len; i += arena->page_size)
+        ((volatile uint8_t *)start)[i] = 0;
+}
+
+static uint8_t *m_arena_reserve(struct m_arena *arena, void *hint, size_t pages)
+{
+    /*
+     * NOTE: MAP_POPULATE does nothing for a PROT_NONE reservation, so SAC_FLAG_POPULATE is
+     *       handled when pages are committed instead.
+     */
+    int map_flags = MAP_PRIVATE | SAC_MAP_ANON | (hint != NULL ? SAC_MAP_NOREPLACE : 0);
+    uint8_t *memory = mmap(hint, pages * arena->page_size, PROT_NONE, map_flags, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if (arena->flags & SAC_FLAG_HUGE_PAGES)
+        madvise(memory, pages * arena->page_size, MADV_HUGEPAGE);
+#endif
+    return memory;
+}
+
 static bool m_arena_commit(struct m_arena *arena, size_t pages_to_commit)
 {
     assert(arena->is_dynamic);
@@ -129,12 +233,20 @@ static bool m_arena_commit(struct m_arena *arena, size_t pages_to_commit)
     if (arena->pages_commited + pages_to_commit > arena->max_pages)
         return false;
 
-    int rc = mprotect(arena->memory + (arena->pages_commited * arena->page_size),
-                      pages_to_commit * arena->page_size, PROT_READ | PROT_WRITE);
+    uint8_t *start = arena->memory + (arena->pages_commited * arena->page_size);
+    size_t len = pages_to_commit * arena->page_size;
+    int rc = mprotect(start, len, PROT_READ | PROT_WRITE);
     if (rc == -1)
         return false;
+    if (arena->flags & SAC_FLAG_POPULATE)
+        m_arena_populate(arena, start, len);
 
     arena->pages_commited += pages_to_commit;
+    if (arena->stats != NULL) {
+        arena->stats->pages_commited += pages_to_commit;
+        if (arena->stats->pages_commited > arena->stats->peak_pages_commited)
+            arena->stats->peak_pages_commited = arena->stats->pages_commited;
+    }
     return true;
 }
 
@@ -145,19 +257,111 @@ static bool m_arena_ensure_commited(struct m_arena *arena)
 
     /* know arena is dynamic */
     size_t memory_committed = arena->pages_commited * arena->page_size;
-    if (arena->offset < memory_committed)
+    if (arena->offset <= memory_committed)
         return true;
 
-    // TODO: this math can probably be optimized
-    size_t delta = arena->offset - memory_committed + 1;
-    size_t pages_to_commit = (delta / arena->page_size) + 1;
-    if (arena->pages_commited + pages_to_commit > arena->max_pages)
+    size_t pages_needed =
+        (arena->offset + arena->page_size - 1) / arena->page_size - arena->pages_commited;
+    size_t pages_available = arena->max_pages - arena->pages_commited;
+    if (pages_needed > pages_available)
         return false;
 
-    m_arena_commit(arena, pages_to_commit);
+    /* grow the committed memory geometrically to cut down on the number of mprotect calls */
+    size_t pages_to_commit = pages_needed > arena->pages_commited ? pages_needed
+                                                                   : arena->pages_commited;
+    if (pages_to_commit > pages_available)
+        pages_to_commit = pages_available;
+
+    return m_arena_commit(arena, pages_to_commit);
+}
+
+/* Makes room for at least min_bytes more in a chained arena */
+static bool m_arena_grow_reservation(struct m_arena *arena, size_t min_bytes)
+{
+    /* the reservation doubles every time it grows */
+    size_t min_pages = (min_bytes + sizeof(struct m_arena_block)) / arena->page_size + 1;
+    size_t pages = arena->max_pages > min_pages ? arena->max_pages : min_pages;
+
+    /* try to extend the reservation in place so the arena stays contiguous */
+    uint8_t *end = arena->memory + arena->max_pages * arena->page_size;
+    uint8_t *extension = m_arena_reserve(arena, end, pages);
+    if (extension == end) {
+        arena->max_pages += pages;
+        return true;
+    }
+    if (extension != NULL)
+        munmap(extension, pages * arena->page_size);
+
+    /* chain a new block */
+    uint8_t *memory = m_arena_reserve(arena, NULL, pages);
+    if (memory == NULL)
+        return false;
+
+    struct m_arena_block old = { .memory = arena->memory,
+                                 .offset = arena->offset,
+                                 .max_pages = arena->max_pages,
+                                 .pages_commited = arena->pages_commited,
+                                 .prev = arena->prev };
+    arena->memory = memory;
+    arena->max_pages = pages;
+    arena->pages_commited = 0;
+    arena->offset = sizeof(struct m_arena_block);
+    if (!m_arena_ensure_commited(arena)) {
+        /* nothing was committed, so going back to the old block is all there is to undo */
+        munmap(memory, pages * arena->page_size);
+        arena->memory = old.memory;
+        arena->offset = old.offset;
+        arena->max_pages = old.max_pages;
+        arena->pages_commited = old.pages_commited;
+        return false;
+    }
+    struct m_arena_block *block = (struct m_arena_block *)memory;
+    *block = old;
+    arena->prev = block;
+    if (arena->stats != NULL)
+        arena->stats->n_blocks++;
     return true;
 }
 
+/* Unmaps the current block of a chained arena and makes the previous block current */
+static void m_arena_pop_block(struct m_arena *arena)
+{
+    assert(arena->prev != NULL);
+    /* the block header lives inside the memory that is unmapped */
+    struct m_arena_block prev = *arena->prev;
+    munmap(arena->memory, arena->max_pages * arena->page_size);
+    if (arena->stats != NULL)
+        arena->stats->pages_commited -= arena->pages_commited;
+    arena->memory = prev.memory;
+    arena->offset = prev.offset;
+    arena->max_pages = prev.max_pages;
+    arena->pages_commited = prev.pages_commited;
+    arena->prev = prev.prev;
+}
+
+/* Unmaps every block but the current */
+static void m_arena_release_prev_blocks(struct m_arena *arena)
+{
+    if (arena->prev == NULL)
+        return;
+
+    struct m_arena_block block = *arena->prev;
+    while (1) {
+        /* the next header lives inside the memory that is unmapped */
+        bool has_prev = block.prev != NULL;
+        struct m_arena_block prev;
+        if (has_prev)
+            prev = *block.prev;
+        munmap(block.memory, block.max_pages * arena->page_size);
+        if (arena->stats != NULL)
+            arena->stats->pages_commited -= block.pages_commited;
+        if (!has_prev)
+            break;
+        block = prev;
+    }
+    arena->prev = NULL;
+}
+
 /*
  * stolen from:
  * https://www.gingerbill.org/article/2019/02/08/memory-allocation-strategies-002/
@@ -195,9 +399,18 @@ void m_arena_init(struct m_arena *arena, void *backing_memory, size_t backing_le
     arena->memory = backing_memory;
     arena->backing_length = backing_length;
     arena->offset = 0;
+    arena->flags = 0;
+    arena->prev = NULL;
+    arena->stats = NULL;
 }
 
 void m_arena_init_dynamic(struct m_arena *arena, size_t starting_pages, size_t max_pages)
+{
+    m_arena_init_dynamic_flags(arena, starting_pages, max_pages, 0);
+}
+
+void m_arena_init_dynamic_flags(struct m_arena *arena, size_t starting_pages, size_t max_pages,
+                                uint32_t flags)
 {
     assert(starting_pages <= max_pages);
 
@@ -206,10 +419,13 @@ void m_arena_init_dynamic(struct m_arena *arena, size_t starting_pages, size_t m
     arena->page_size = sysconf(_SC_PAGE_SIZE);
     arena->offset = 0;
     arena->pages_commited = 0;
+    arena->pages_retained = starting_pages;
+    arena->flags = flags;
+    arena->prev = NULL;
+    arena->stats = NULL;
 
-    arena->memory = mmap(NULL, arena->max_pages * arena->page_size, PROT_NONE,
-                         MAP_PRIVATE | SAC_MAP_ANON, -1, 0);
-    if (arena->memory == MAP_FAILED) {
+    arena->memory = m_arena_reserve(arena, NULL, arena->max_pages);
+    if (arena->memory == NULL) {
         fprintf(stderr, "sac: map failed in file %s on line %d\n", __FILE__, __LINE__);
         exit(1);
     }
@@ -224,15 +440,51 @@ void m_arena_release(struct m_arena *arena)
 
     /* the implementation does not manage the backing memory */
     if (!arena->is_dynamic)
+        return;
 
-        munmap(arena->memory, arena->max_pages);
+    m_arena_release_prev_blocks(arena);
+    munmap(arena->memory, arena->max_pages * arena->page_size);
+}
+
+void m_arena_stats_enable(struct m_arena *arena, struct m_arena_stats *stats, const char *name)
+{
+    memset(stats, 0, sizeof(struct m_arena_stats));
+    stats->name = name;
+    stats->peak_offset = arena->offset;
+    if (arena->is_dynamic) {
+        stats->pages_commited = arena->pages_commited;
+        for (struct m_arena_block *b = arena->prev; b != NULL; b = b->prev) {
+            stats->pages_commited += b->pages_commited;
+            stats->n_blocks++;
+        }
+        stats->peak_pages_commited = stats->pages_commited;
+    }
+    arena->stats = stats;
+}
+
+/* in-place growth (new_alloc false) only accounts for the extra bytes */
+static void m_arena_stats_record(struct m_arena_stats *stats, size_t size, size_t padding,
+                                 size_t offset, uint8_t tag, bool new_alloc)
+{
+    assert(tag < SAC_MAX_TAGS);
+    if (new_alloc) {
+        stats->n_allocs++;
+        stats->tag_allocs[tag]++;
+    }
+    stats->bytes_requested += size;
+    stats->bytes_padding += padding;
+    stats->tag_bytes[tag] += size;
+    stats->last_tag = tag;
+    if (offset > stats->peak_offset)
+        stats->peak_offset = offset;
 }
 
 /*
  * heavily modified, but inspired by:
  * https://www.gingerbill.org/article/2019/02/08/memory-allocation-strategies-002/
  */
-void *m_arena_alloc_internal(struct m_arena *arena, size_t size, size_t alignment, bool zero)
+void *m_arena_alloc_internal(struct m_arena *arena, size_t size, size_t alignment, bool zero,
+                             uint8_t tag)
 {
     /* curr_ptr will be the first non-used memory address */
     uintptr_t curr_ptr = (uintptr_t)arena->memory + (uintptr_t)arena->offset;
@@ -240,11 +492,20 @@ void *m_arena_alloc_internal(struct m_arena *arena, size_t size, size_t alignmen
     uintptr_t offset = align_forward(curr_ptr, alignment);
     /* change to relative offset from the first memory adress */
     offset -= (uintptr_t)arena->memory;
+    size_t old_offset = arena->offset;
     arena->offset = offset + size;
 
     bool success = m_arena_ensure_commited(arena);
-    if (!success)
-        return NULL;
+    if (!success) {
+        arena->offset = old_offset;
+        if (!(arena->flags & SAC_FLAG_CHAINED) ||
+            !m_arena_grow_reservation(arena, size + alignment))
+            return NULL;
+        return m_arena_alloc_internal(arena, size, alignment, zero, tag);
+    }
+
+    if (arena->stats != NULL)
+        m_arena_stats_record(arena->stats, size, offset - old_offset, arena->offset, tag, true);
 
     void *ptr = arena->memory + offset;
     if (zero)
@@ -253,9 +514,49 @@ void *m_arena_alloc_internal(struct m_arena *arena, size_t size, size_t alignmen
     return ptr;
 }
 
+void *m_arena_grow(struct m_arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    assert(new_size >= old_size);
+
+    uint8_t *end = (uint8_t *)ptr + old_size;
+    if (end == arena->memory + arena->offset) {
+        arena->offset += new_size - old_size;
+        if (m_arena_ensure_commited(arena)) {
+            if (arena->stats != NULL)
+                m_arena_stats_record(arena->stats, new_size - old_size, 0, arena->offset,
+                                     arena->stats->last_tag, false);
+            return ptr;
+        }
+        arena->offset -= new_size - old_size;
+    }
+
+    uint8_t tag = arena->stats != NULL ? arena->stats->last_tag : 0;
+    void *new_ptr = m_arena_alloc_internal(arena, new_size, SAC_DEFAULT_ALIGNMENT, false, tag);
+    if (new_ptr == NULL)
+        return NULL;
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
 void m_arena_clear(struct m_arena *arena)
 {
+    /* keep the most recent, and therefore largest, block */
+    m_arena_release_prev_blocks(arena);
     arena->offset = 0;
+    if (arena->stats != NULL)
+        arena->stats->n_clears++;
+
+    if (arena->is_dynamic && (arena->flags & SAC_FLAG_DECOMMIT_ON_CLEAR) &&
+        arena->pages_commited > arena->pages_retained) {
+        /* the OS reclaims the pages, they are committed again, zeroed, when the arena needs them */
+        size_t pages = arena->pages_commited - arena->pages_retained;
+        uint8_t *start = arena->memory + arena->pages_retained * arena->page_size;
+        madvise(start, pages * arena->page_size, MADV_DONTNEED);
+        mprotect(start, pages * arena->page_size, PROT_NONE);
+        arena->pages_commited = arena->pages_retained;
+        if (arena->stats != NULL)
+            arena->stats->pages_commited -= pages;
+    }
 }
 
 void *m_arena_get(struct m_arena *arena, size_t byte_idx)
@@ -268,11 +569,18 @@ void *m_arena_get(struct m_arena *arena, size_t byte_idx)
 
 struct m_arena_tmp m_arena_tmp_init(struct m_arena *arena)
 {
-    return (struct m_arena_tmp){ .arena = arena, .offset = arena->offset };
+    return (struct m_arena_tmp){ .arena = arena, .memory = arena->memory, .offset = arena->offset };
 }
 
 void m_arena_tmp_release(struct m_arena_tmp tmp)
 {
-    tmp.arena->offset = tmp.offset;
+    /* drop blocks chained on after the tmp was taken */
+    while (tmp.arena->memory != tmp.memory && tmp.arena->prev != NULL)
+        m_arena_pop_block(tmp.arena);
+    /* m_arena_clear() since may have dropped the block, or everything in it */
+    if (tmp.arena->memory != tmp.memory)
+        tmp.arena->offset = 0;
+    else if (tmp.offset < tmp.arena->offset)
+        tmp.arena->offset = tmp.offset;
 }
 #endif /* SAC_IMPLEMENTATION */
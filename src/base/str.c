@@ -54,6 +54,15 @@ u32 str_view_to_u32(Str8View view, bool *success)
     return (u32)result;
 }
 
+u64 str_hash(u64 hash, void *bytes, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= ((u8 *)bytes)[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
 Str8Builder make_str_builder(Arena *arena)
 {
     Str8Builder sb = {
@@ -62,7 +71,7 @@ Str8Builder make_str_builder(Arena *arena)
         .cap = 16,
     };
 
-    sb.str.str = m_arena_alloc(arena, sb.cap);
+    sb.str.str = m_arena_alloc_tagged(arena, sb.cap, MEM_TAG_STRING);
     return sb;
 }
 
@@ -70,7 +79,7 @@ void str_builder_append_u8(Str8Builder *sb, u8 c)
 {
     if (sb->str.len == sb->cap) {
         /* Double the allocation */
-        (void)m_arena_alloc(sb->arena, sb->cap);
+        sb->str.str = m_arena_grow(sb->arena, sb->str.str, sb->cap, sb->cap * 2);
         sb->cap *= 2;
     }
 
@@ -79,10 +88,14 @@ void str_builder_append_u8(Str8Builder *sb, u8 c)
 
 void str_builder_append_cstr(Str8Builder *sb, char *cstr, u32 len)
 {
-    while (sb->str.len + len > sb->cap) {
+    u32 new_cap = sb->cap;
+    while (sb->str.len + len > new_cap) {
         /* Double the allocation */
-        (void)m_arena_alloc(sb->arena, sb->cap);
-        sb->cap *= 2;
+        new_cap *= 2;
+    }
+    if (new_cap != sb->cap) {
+        sb->str.str = m_arena_grow(sb->arena, sb->str.str, sb->cap, new_cap);
+        sb->cap = new_cap;
     }
 
     memcpy((char *)(sb->str.str + sb->str.len), cstr, len);
@@ -174,7 +187,7 @@ u32 str_list_push(Str8List *list, Str8 str)
 u32 str_list_push_cstr(Arena *arena, Str8List *list, char *cstr)
 {
     size_t len = strlen(cstr);
-    u8 *str = m_arena_alloc(arena, len + 1);
+    u8 *str = m_arena_alloc_tagged(arena, len + 1, MEM_TAG_STRING);
     memcpy(str, cstr, len);
     str[len] = 0;
     return str_list_push(list, (Str8){ .len = len, .str = str });
@@ -74,6 +74,10 @@ typedef Str8 Str8View;
 
 u32 str_view_to_u32(Str8View view, bool *success);
 
+/* FNV-1a of len bytes, continuing from hash. Start from STR_HASH_SEED */
+#define STR_HASH_SEED 0xcbf29ce484222325
+u64 str_hash(u64 hash, void *bytes, size_t len);
+
 Str8Builder make_str_builder(Arena *arena);
 void str_builder_append_u8(Str8Builder *sb, u8 c);
 void str_builder_append_cstr(Str8Builder *sb, char *cstr, u32 len);
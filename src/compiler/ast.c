@@ -17,9 +17,13 @@
 #include "ast.h"
 #include "base/str.h"
 #include "lex.h"
+#include "mem_report.h"
 #include "type.h"
 #include <stdio.h>
 
+/* Every node is tagged with its kind so --mem-report can tell them apart */
+#define ast_alloc(a, type, kind) (type *)m_arena_alloc_tagged(a, sizeof(type), MEM_TAG_AST + (kind))
+
 char *node_kind_str_map[AST_NODE_TYPE_LEN] = {
     "EXPR_UNARY", "EXPR_BINARY", "EXPR_LITERAL",         "EXPR_CALL",   "STMT_WHILE",
     "STMT_IF",    "STMT_BREAK",  "STMT_CONTINUE",        "STMT_RETURN", "STMT_EXPR",
@@ -30,7 +34,7 @@ char *node_kind_str_map[AST_NODE_TYPE_LEN] = {
 /* Expressions */
 AstUnary *make_unary(Arena *a, AstExpr *expr, TokenKind op)
 {
-    AstUnary *unary = m_arena_alloc(a, sizeof(AstUnary));
+    AstUnary *unary = ast_alloc(a, AstUnary, EXPR_UNARY);
     unary->kind = EXPR_UNARY;
     unary->op = op;
     unary->expr = expr;
@@ -39,7 +43,7 @@ AstUnary *make_unary(Arena *a, AstExpr *expr, TokenKind op)
 
 AstBinary *make_binary(Arena *a, AstExpr *left, TokenKind op, AstExpr *right)
 {
-    AstBinary *binary = m_arena_alloc(a, sizeof(AstBinary));
+    AstBinary *binary = ast_alloc(a, AstBinary, EXPR_BINARY);
     binary->kind = EXPR_BINARY;
     binary->op = op;
     binary->left = left;
@@ -49,7 +53,7 @@ AstBinary *make_binary(Arena *a, AstExpr *left, TokenKind op, AstExpr *right)
 
 AstLiteral *make_literal(Arena *a, Token token)
 {
-    AstLiteral *literal = m_arena_alloc(a, sizeof(AstLiteral));
+    AstLiteral *literal = ast_alloc(a, AstLiteral, EXPR_LITERAL);
     literal->kind = EXPR_LITERAL;
     literal->literal = token.lexeme;
     if (token.kind == TOKEN_NUM) {
@@ -66,18 +70,19 @@ AstLiteral *make_literal(Arena *a, Token token)
 
 AstCall *make_call(Arena *a, bool is_comptime, Str8View identifier, AstList *args)
 {
-    AstCall *call = m_arena_alloc(a, sizeof(AstCall));
+    AstCall *call = ast_alloc(a, AstCall, EXPR_CALL);
     call->is_comptime = is_comptime;
     call->kind = EXPR_CALL;
     call->identifier = identifier;
     call->args = args;
+    call->target = NULL;
     return call;
 }
 
 /* Statements */
 AstWhile *make_while(Arena *a, AstExpr *condition, AstStmt *body)
 {
-    AstWhile *stmt = m_arena_alloc(a, sizeof(AstWhile));
+    AstWhile *stmt = ast_alloc(a, AstWhile, STMT_WHILE);
     stmt->kind = STMT_WHILE;
     stmt->condition = condition;
     stmt->body = body;
@@ -86,7 +91,7 @@ AstWhile *make_while(Arena *a, AstExpr *condition, AstStmt *body)
 
 AstIf *make_if(Arena *a, AstExpr *condition, AstStmt *then, AstStmt *else_)
 {
-    AstIf *stmt = m_arena_alloc(a, sizeof(AstIf));
+    AstIf *stmt = ast_alloc(a, AstIf, STMT_IF);
     stmt->kind = STMT_IF;
     stmt->condition = condition;
     stmt->then = then;
@@ -96,7 +101,7 @@ AstIf *make_if(Arena *a, AstExpr *condition, AstStmt *then, AstStmt *else_)
 
 AstSingle *make_single(Arena *a, AstStmtKind single_type, AstNode *node)
 {
-    AstSingle *stmt = m_arena_alloc(a, sizeof(AstSingle));
+    AstSingle *stmt = ast_alloc(a, AstSingle, single_type);
     stmt->kind = single_type;
     stmt->node = node;
     return stmt;
@@ -104,7 +109,7 @@ AstSingle *make_single(Arena *a, AstStmtKind single_type, AstNode *node)
 
 AstBlock *make_block(Arena *a, TypedIdentList declarations, AstList *stmts)
 {
-    AstBlock *stmt = m_arena_alloc(a, sizeof(AstBlock));
+    AstBlock *stmt = ast_alloc(a, AstBlock, STMT_BLOCK);
     stmt->kind = STMT_BLOCK;
     stmt->declarations = declarations;
     stmt->stmts = stmts;
@@ -113,7 +118,7 @@ AstBlock *make_block(Arena *a, TypedIdentList declarations, AstList *stmts)
 
 AstAssignment *make_assignment(Arena *a, AstExpr *left, AstExpr *right)
 {
-    AstAssignment *stmt = m_arena_alloc(a, sizeof(AstAssignment));
+    AstAssignment *stmt = ast_alloc(a, AstAssignment, STMT_ASSIGNMENT);
     stmt->kind = STMT_ASSIGNMENT;
     stmt->left = left;
     stmt->right = right;
@@ -124,7 +129,7 @@ AstAssignment *make_assignment(Arena *a, AstExpr *left, AstExpr *right)
 AstFunc *make_func(Arena *a, Str8View name, TypedIdentList params, AstStmt *body,
                    AstTypeInfo return_type)
 {
-    AstFunc *func = m_arena_alloc(a, sizeof(AstFunc));
+    AstFunc *func = ast_alloc(a, AstFunc, AST_FUNC);
     func->kind = AST_FUNC;
     func->name = name;
     func->parameters = params;
@@ -135,7 +140,7 @@ AstFunc *make_func(Arena *a, Str8View name, TypedIdentList params, AstStmt *body
 
 AstStruct *make_struct(Arena *a, Str8View name, TypedIdentList members)
 {
-    AstStruct *struct_decl = m_arena_alloc(a, sizeof(AstStruct));
+    AstStruct *struct_decl = ast_alloc(a, AstStruct, AST_STRUCT);
     struct_decl->kind = AST_STRUCT;
     struct_decl->name = name;
     struct_decl->members = members;
@@ -144,7 +149,7 @@ AstStruct *make_struct(Arena *a, Str8View name, TypedIdentList members)
 
 AstEnum *make_enum(Arena *a, Str8View name, TypedIdentList values)
 {
-    AstEnum *enum_decl = m_arena_alloc(a, sizeof(AstEnum));
+    AstEnum *enum_decl = ast_alloc(a, AstEnum, AST_ENUM);
     enum_decl->kind = AST_ENUM;
     enum_decl->name = name;
     enum_decl->members = values;
@@ -153,7 +158,7 @@ AstEnum *make_enum(Arena *a, Str8View name, TypedIdentList values)
 
 AstListNode *make_list_node(Arena *a, AstNode *this)
 {
-    AstListNode *node = m_arena_alloc(a, sizeof(AstListNode));
+    AstListNode *node = ast_alloc(a, AstListNode, AST_LIST);
     node->this = this;
     node->next = NULL;
     return node;
@@ -161,7 +166,7 @@ AstListNode *make_list_node(Arena *a, AstNode *this)
 
 AstList *make_list(Arena *a, AstNode *head)
 {
-    AstList *list = m_arena_alloc(a, sizeof(AstList));
+    AstList *list = ast_alloc(a, AstList, AST_LIST);
     list->kind = AST_LIST;
     list->head = make_list_node(a, head);
     list->tail = list->head;
@@ -181,7 +186,7 @@ void ast_list_push_back(AstList *list, AstListNode *node)
 
 AstTypedIdentList *make_typed_ident_list(Arena *a, TypedIdentList vars)
 {
-    AstTypedIdentList *node_var_list = m_arena_alloc(a, sizeof(AstTypedIdentList));
+    AstTypedIdentList *node_var_list = ast_alloc(a, AstTypedIdentList, AST_TYPED_IDENT_LIST);
     node_var_list->kind = AST_TYPED_IDENT_LIST;
     node_var_list->idents = vars;
     return node_var_list;
@@ -190,7 +195,7 @@ AstTypedIdentList *make_typed_ident_list(Arena *a, TypedIdentList vars)
 AstRoot *make_root(Arena *a, AstList vars, AstList funcs, AstList structs, AstList enums,
                    AstList calls)
 {
-    AstRoot *root = m_arena_alloc(a, sizeof(AstRoot));
+    AstRoot *root = ast_alloc(a, AstRoot, AST_ROOT);
     root->kind = AST_ROOT;
     root->vars = vars;
     root->funcs = funcs;
@@ -396,3 +401,133 @@ void ast_print(AstNode *head, u32 indent)
         ASSERT_NOT_REACHED;
     }
 }
+
+/* AST hash */
+static u64 hash_u64(u64 hash, u64 value)
+{
+    return str_hash(hash, &value, sizeof(value));
+}
+
+static u64 hash_str8(u64 hash, Str8 str)
+{
+    hash = hash_u64(hash, str.len);
+    return str_hash(hash, str.str, str.len);
+}
+
+static u64 hash_type_info(u64 hash, AstTypeInfo type_info)
+{
+    hash = hash_str8(hash, type_info.name);
+    hash = hash_u64(hash, type_info.is_array);
+    hash = hash_u64(hash, (u64)type_info.elements);
+    return hash_u64(hash, (u64)type_info.pointer_indirection);
+}
+
+static u64 hash_typed_var_list(u64 hash, TypedIdentList vars)
+{
+    hash = hash_u64(hash, vars.len);
+    for (u32 i = 0; i < vars.len; i++) {
+        hash = hash_str8(hash, vars.vars[i].name);
+        hash = hash_type_info(hash, vars.vars[i].ast_type_info);
+    }
+    return hash;
+}
+
+u64 ast_hash(u64 hash, AstNode *head)
+{
+    /* Tells a missing child apart from an empty one */
+    if (head == NULL) {
+        return hash_u64(hash, AST_NODE_TYPE_LEN);
+    }
+
+    /* Expressions, statements and nodes share one range of kinds, see the top of ast.h */
+    u32 kind = head->kind;
+    hash = hash_u64(hash, kind);
+    switch (kind) {
+    case EXPR_UNARY: {
+        AstUnary *unary = AS_UNARY(head);
+        hash = hash_u64(hash, unary->op);
+        hash = ast_hash(hash, (AstNode *)unary->expr);
+    } break;
+    case EXPR_BINARY: {
+        AstBinary *binary = AS_BINARY(head);
+        hash = hash_u64(hash, binary->op);
+        hash = ast_hash(hash, (AstNode *)binary->left);
+        hash = ast_hash(hash, (AstNode *)binary->right);
+    } break;
+    case EXPR_LITERAL: {
+        AstLiteral *lit = AS_LITERAL(head);
+        hash = hash_u64(hash, lit->lit_type);
+        hash = hash_str8(hash, lit->literal);
+    } break;
+    case EXPR_CALL: {
+        AstCall *call = AS_CALL(head);
+        hash = hash_u64(hash, call->is_comptime);
+        hash = hash_str8(hash, call->identifier);
+        hash = ast_hash(hash, (AstNode *)call->args);
+    } break;
+    case STMT_WHILE: {
+        AstWhile *stmt = AS_WHILE(head);
+        hash = ast_hash(hash, (AstNode *)stmt->condition);
+        hash = ast_hash(hash, (AstNode *)stmt->body);
+    } break;
+    case STMT_IF: {
+        AstIf *stmt = AS_IF(head);
+        hash = ast_hash(hash, (AstNode *)stmt->condition);
+        hash = ast_hash(hash, (AstNode *)stmt->then);
+        hash = ast_hash(hash, (AstNode *)stmt->else_);
+    } break;
+    case STMT_BREAK:
+    case STMT_CONTINUE:
+    case STMT_RETURN:
+    case STMT_EXPR:
+        hash = ast_hash(hash, AS_SINGLE(head)->node);
+        break;
+    case STMT_BLOCK: {
+        AstBlock *stmt = AS_BLOCK(head);
+        hash = hash_typed_var_list(hash, stmt->declarations);
+        hash = ast_hash(hash, (AstNode *)stmt->stmts);
+    } break;
+    case STMT_ASSIGNMENT: {
+        AstAssignment *stmt = AS_ASSIGNMENT(head);
+        hash = ast_hash(hash, (AstNode *)stmt->left);
+        hash = ast_hash(hash, (AstNode *)stmt->right);
+    } break;
+    case AST_FUNC: {
+        AstFunc *func = AS_FUNC(head);
+        hash = hash_str8(hash, func->name);
+        hash = hash_typed_var_list(hash, func->parameters);
+        hash = hash_type_info(hash, func->return_type);
+        hash = ast_hash(hash, (AstNode *)func->body);
+    } break;
+    case AST_STRUCT:
+        hash = hash_str8(hash, AS_STRUCT(head)->name);
+        hash = hash_typed_var_list(hash, AS_STRUCT(head)->members);
+        break;
+    case AST_ENUM:
+        hash = hash_str8(hash, AS_ENUM(head)->name);
+        hash = hash_typed_var_list(hash, AS_ENUM(head)->members);
+        break;
+    case STMT_PRINT:
+    case AST_LIST: {
+        AstList *list = AS_LIST(head);
+        for (AstListNode *node = list->head; node != NULL; node = node->next) {
+            hash = ast_hash(hash, node->this);
+        }
+        hash = ast_hash(hash, NULL);
+    } break;
+    case AST_TYPED_IDENT_LIST:
+        hash = hash_typed_var_list(hash, AS_TYPED_IDENT_LIST(head)->idents);
+        break;
+    case AST_ROOT: {
+        AstRoot *root = AS_ROOT(head);
+        hash = ast_hash(hash, (AstNode *)&root->vars);
+        hash = ast_hash(hash, (AstNode *)&root->funcs);
+        hash = ast_hash(hash, (AstNode *)&root->structs);
+        hash = ast_hash(hash, (AstNode *)&root->enums);
+        hash = ast_hash(hash, (AstNode *)&root->calls);
+    } break;
+    default:
+        ASSERT_NOT_REACHED;
+    }
+    return hash;
+}
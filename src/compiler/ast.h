@@ -146,6 +146,7 @@ typedef struct {
     TypeInfo *type; // @NULLABLE. Only set after typechecking.
     Str8 identifier;
     AstList *args; // @NULLABLE.
+    AstNode *target; // @NULLABLE. For @calls, the declaration following it which it annotates
 } AstCall;
 
 /* Statements */
@@ -283,6 +284,11 @@ AstRoot *make_root(Arena *a, AstList vars, AstList funcs, AstList structs, AstLi
                    AstList calls);
 
 void ast_print(AstNode *head, u32 indent);
+/*
+ * Structural hash of the subtree at head, continuing from hash. Only looks at what the source
+ * said, not at types or symbols filled in later, so equal declarations hash the same.
+ */
+u64 ast_hash(u64 hash, AstNode *head);
 
 
 #endif /* AST_H */
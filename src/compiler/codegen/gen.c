@@ -16,6 +16,7 @@
  */
 
 #include "base/str.h"
+#include "compiler/codegen/gen.h"
 #include "compiler/ast.h"
 #include "compiler/compiler.h"
 #include "compiler/error.h"
@@ -199,6 +200,9 @@ static void gen_expr(Compiler *compiler, AstExpr *head)
         case TOKEN_DOT:
             fprintf(f, ".");
             break;
+        case TOKEN_LBRACKET:
+            fprintf(f, "[");
+            break;
         case TOKEN_EQ:
             fprintf(f, "==");
             break;
@@ -214,7 +218,17 @@ static void gen_expr(Compiler *compiler, AstExpr *head)
         default:
             ASSERT_NOT_REACHED;
         }
-        gen_expr(compiler, expr->right);
+        /* Groupings in the source are only in the shape of the AST, so both sides get parens */
+        if (expr->op == TOKEN_DOT) {
+            gen_expr(compiler, expr->right);
+        } else {
+            fprintf(f, "(");
+            gen_expr(compiler, expr->right);
+            fprintf(f, ")");
+        }
+        if (expr->op == TOKEN_LBRACKET) {
+            fprintf(f, "]");
+        }
     } break;
     case EXPR_LITERAL: {
         AstLiteral *lit = AS_LITERAL(head);
@@ -397,12 +411,19 @@ static void gen_func(Compiler *compiler, Symbol *sym)
  */
 void transpile_to_c(Compiler *compiler)
 {
-    f = fopen("out.c", "w");
-    if (f == NULL) {
+    FILE *out = fopen("out.c", "w");
+    if (out == NULL) {
         Str8 msg = STR8_LIT("Could not open file out.c");
         error_msg_str8(compiler->e, msg);
         return;
     }
+    transpile_to_file(compiler, out);
+    fclose(out);
+}
+
+void transpile_to_file(Compiler *compiler, FILE *out)
+{
+    f = out;
 
     /* Prelude */
     write_base();
@@ -436,22 +457,22 @@ void transpile_to_c(Compiler *compiler)
 
     /* Generate structs */
     for (u32 i = 0; i < compiler->struct_types.size; i++) {
-        TypeInfoStruct *type_info = *(TypeInfoStruct **)arraylist_get(&compiler->struct_types, i);
+        TypeInfoStruct *type_info = compiler->struct_types.data[i];
         Symbol *sym = symt_find_sym(&compiler->symt_root, type_info->info.generated_by);
         gen_struct(compiler, sym);
     }
 
     fprintf(f, "\n");
 
-    /* Generate functions */
+    /* Generate functions. Compiler funcs only exist at compile time, see comptime/builtin.h */
     for (u32 i = 0; i < symt_root->sym_len; i++) {
         Symbol *sym = symt_root->symbols[i];
-        if (sym->kind == SYMBOL_FUNC) {
+        if (sym->kind == SYMBOL_FUNC && AS_FUNC(sym->node)->body != NULL) {
             gen_func(compiler, sym);
             fprintf(f, "\n\n");
         }
     }
 
     fprintf(f, "\n");
-    fclose(f);
+    f = NULL;
 }
@@ -19,7 +19,11 @@
 
 #include "compiler/compiler.h"
 #include "compiler/type.h"
+#include <stdio.h>
 
+/* Writes the program to out.c */
 void transpile_to_c(Compiler *compiler);
+/* Same, but to an open file, which is left open */
+void transpile_to_file(Compiler *compiler, FILE *out);
 
 #endif /* TYPE_H */
@@ -18,22 +18,45 @@
 #define COMPILER_H
 
 #include "base/nicc.h"
+#include "base/pool.h"
 #include "base/sac_single.h"
 #include "type.h"
 
 typedef struct error_handler_t ErrorHandler; // forward decl from error.h
 
 
+/* What runs compile time code */
+typedef enum {
+    COMPTIME_STACK_VM = 0,
+    COMPTIME_REG_VM,
+    COMPTIME_JIT, // The stack VM with hot functions compiled to machine code
+    COMPTIME_NATIVE, // Generated C built into a shared object, see comptime/native.h
+} ComptimeBackend;
+
+/* Set from the command line */
+typedef struct {
+    bool mem_report; // --mem-report
+    u32 n_threads; // --threads=N. 0 means one per CPU
+    ComptimeBackend comptime; // --comptime=stack|reg|jit|native
+    bool op_pairs; // --op-pairs, opcode pair counts of the bytecode before the peephole pass
+    bool comptime_profile; // --comptime-profile, needs a VM_PROFILE build. See comptime/profile.h
+    u64 comptime_fuel; // --comptime-fuel=N, 0 for no limit. See VMMeter in comptime/vm.h
+    u64 comptime_deadline_ms; // --comptime-deadline=MS, 0 for none
+    bool no_comptime_cache; // --no-comptime-cache, don't keep @call results between compilations
+    bool time_report; // --time-report
+} CompilerOptions;
+
 typedef struct compiler_t {
     Arena *pass_arena; // Temporary data which only persist for the duration of a single pass.
     Arena *persist_arena;
     ErrorHandler *e;
+    ThreadPool *pool;
 
     SymbolTable symt_root;
     Symbol *sym_null; // The null pointer constant
 
-    ArrayList all_types; // Holds TypeInfo **. Every base type lives here.
-    ArrayList struct_types; // Holds TypeInfoStruct **
+    TypeInfoPtrArray all_types; // Every base type lives here.
+    TypeInfoStructPtrArray struct_types;
 } Compiler;
 
 #endif /* COMPILER_H */
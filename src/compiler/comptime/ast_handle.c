@@ -0,0 +1,215 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/ast_handle.h"
+#include "base/str.h"
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(AST_NODE_TYPE_LEN <= 30, "The node kinds don't fit next to the handle flags");
+
+/*
+ * X(struct, field, how, what) for every field comptime code can get at. How is one of
+ *   WORD       a word below what, or any word if what is 0
+ *   READ_ONLY  a word comptime code can't change, like the kind of a node
+ *   INLINE     a what embedded in the struct
+ *   POINTER    a pointer to a what
+ *   NULLABLE   a pointer to a what, or null
+ */
+#define AST_FIELDS(X)                                     \
+    X(AstNode, kind, READ_ONLY, 0)                        \
+    X(AstExpr, kind, READ_ONLY, 0)                        \
+    X(AstStmt, kind, READ_ONLY, 0)                        \
+    X(AstUnary, kind, READ_ONLY, 0)                       \
+    X(AstUnary, op, WORD, TOKEN_TYPE_ENUM_COUNT)          \
+    X(AstUnary, expr, POINTER, AstExpr)                   \
+    X(AstBinary, kind, READ_ONLY, 0)                      \
+    X(AstBinary, left, POINTER, AstExpr)                  \
+    X(AstBinary, op, WORD, TOKEN_TYPE_ENUM_COUNT)         \
+    X(AstBinary, right, POINTER, AstExpr)                 \
+    X(AstLiteral, kind, READ_ONLY, 0)                     \
+    X(AstLiteral, lit_type, WORD, LIT_NULL + 1)           \
+    X(AstLiteral, literal, INLINE, Str8)                  \
+    X(AstCall, kind, READ_ONLY, 0)                        \
+    X(AstCall, is_comptime, WORD, 2)                      \
+    X(AstCall, identifier, INLINE, Str8)                  \
+    X(AstCall, args, NULLABLE, AstList)                   \
+    X(AstCall, target, NULLABLE, AstNode)                 \
+    X(AstWhile, kind, READ_ONLY, 0)                       \
+    X(AstWhile, condition, POINTER, AstExpr)              \
+    X(AstWhile, body, POINTER, AstStmt)                   \
+    X(AstIf, kind, READ_ONLY, 0)                          \
+    X(AstIf, condition, POINTER, AstExpr)                 \
+    X(AstIf, then, POINTER, AstStmt)                      \
+    X(AstIf, else_, NULLABLE, AstStmt)                    \
+    X(AstSingle, kind, READ_ONLY, 0)                      \
+    X(AstSingle, node, NULLABLE, AstNode)                 \
+    X(AstBlock, kind, READ_ONLY, 0)                       \
+    X(AstBlock, stmts, POINTER, AstList)                  \
+    X(AstAssignment, kind, READ_ONLY, 0)                  \
+    X(AstAssignment, left, POINTER, AstExpr)              \
+    X(AstAssignment, right, POINTER, AstExpr)             \
+    X(AstListNode, this, POINTER, AstNode)                \
+    X(AstListNode, next, NULLABLE, AstListNode)           \
+    X(AstList, kind, READ_ONLY, 0)                        \
+    X(AstList, head, NULLABLE, AstListNode)               \
+    X(AstList, tail, NULLABLE, AstListNode)               \
+    X(AstFunc, kind, READ_ONLY, 0)                        \
+    X(AstFunc, name, INLINE, Str8)                        \
+    X(AstFunc, body, NULLABLE, AstStmt)                   \
+    X(AstStruct, kind, READ_ONLY, 0)                      \
+    X(AstStruct, name, INLINE, Str8)                      \
+    X(AstEnum, kind, READ_ONLY, 0)                        \
+    X(AstEnum, name, INLINE, Str8)                        \
+    X(AstRoot, kind, READ_ONLY, 0)                        \
+    X(AstRoot, vars, INLINE, AstList)                     \
+    X(AstRoot, funcs, INLINE, AstList)                    \
+    X(AstRoot, structs, INLINE, AstList)                  \
+    X(AstRoot, enums, INLINE, AstList)                    \
+    X(AstRoot, calls, INLINE, AstList)                    \
+    X(Str8, len, READ_ONLY, 0)                            \
+    X(Str8, str, READ_ONLY, 0)                            \
+    X(Str8Builder, str, INLINE, Str8)                     \
+    X(Token, kind, WORD, TOKEN_TYPE_ENUM_COUNT)           \
+    X(Token, lexeme, INLINE, Str8)
+
+#define FIELD_SIZE(___type, ___field) sizeof(((___type *)0)->___field)
+#define AST_FIELD(___type, ___field, ___how, ___what)   \
+    { .type = #___type,                                 \
+      .field = #___field,                               \
+      .offset = offsetof(___type, ___field),            \
+      .size = FIELD_SIZE(___type, ___field),            \
+      .kinds = AST_KINDS_##___type,                     \
+      AST_FIELD_##___how(___what) },
+#define AST_FIELD_WORD(___limit) .limit = (___limit)
+#define AST_FIELD_READ_ONLY(___unused) .is_read_only = true
+#define AST_FIELD_INLINE(___what) \
+    .is_inline = true, .pointee = #___what, .pointee_kinds = AST_KINDS_##___what
+#define AST_FIELD_POINTER(___what) .pointee = #___what, .pointee_kinds = AST_KINDS_##___what
+#define AST_FIELD_NULLABLE(___what) \
+    .pointee = #___what, .pointee_kinds = AST_KINDS_##___what | AST_HANDLE_NULLABLE
+
+/* Other fields than inline ones are loaded and stored by their size */
+#define AST_FIELD_IS_INLINE_WORD 0
+#define AST_FIELD_IS_INLINE_READ_ONLY 0
+#define AST_FIELD_IS_INLINE_INLINE 1
+#define AST_FIELD_IS_INLINE_POINTER 0
+#define AST_FIELD_IS_INLINE_NULLABLE 0
+#define AST_FIELD_SIZE_CHECK(___type, ___field, ___how, ___what)                        \
+    _Static_assert(AST_FIELD_IS_INLINE_##___how || FIELD_SIZE(___type, ___field) == 1 ||     \
+                       FIELD_SIZE(___type, ___field) == 4 ||                            \
+                       FIELD_SIZE(___type, ___field) == 8,                              \
+                   #___type "." #___field " can't be loaded as a word");
+
+AST_FIELDS(AST_FIELD_SIZE_CHECK)
+
+AstField ast_fields[] = { AST_FIELDS(AST_FIELD) };
+u32 ast_fields_len = sizeof(ast_fields) / sizeof(ast_fields[0]);
+
+
+s32 ast_field_find(Str8 type, Str8 field)
+{
+    for (u32 i = 0; i < ast_fields_len; i++) {
+        AstField *f = &ast_fields[i];
+        if (strlen(f->type) == type.len && memcmp(f->type, type.str, type.len) == 0 &&
+            strlen(f->field) == field.len && memcmp(f->field, field.str, field.len) == 0) {
+            return (s32)i;
+        }
+    }
+    return -1;
+}
+
+bool ast_handle_type(Str8 type)
+{
+    return ast_handle_kinds(type) != 0;
+}
+
+u32 ast_handle_kinds(Str8 type)
+{
+    for (u32 i = 0; i < ast_fields_len; i++) {
+        if (strlen(ast_fields[i].type) == type.len &&
+            memcmp(ast_fields[i].type, type.str, type.len) == 0) {
+            return ast_fields[i].kinds;
+        }
+    }
+    return 0;
+}
+
+bool ast_handle_valid(u32 kinds, BytecodeWord handle)
+{
+    if (handle == 0) {
+        return (kinds & AST_HANDLE_NULLABLE) != 0;
+    }
+    if ((kinds & AST_HANDLE_UNTAGGED) != 0) {
+        return true;
+    }
+    AstNodeKind kind = ((AstNode *)(uintptr_t)handle)->kind;
+    return kind < AST_NODE_TYPE_LEN && (kinds & AST_KIND(kind)) != 0;
+}
+
+bool ast_field_storable(AstField *field, BytecodeWord value)
+{
+    if (field->is_read_only) {
+        return false;
+    }
+    if (field->pointee != NULL) {
+        return ast_handle_valid(field->pointee_kinds, value);
+    }
+    return field->limit == 0 || (value >= 0 && value < field->limit);
+}
+
+BytecodeWord ast_field_load(AstField *field, BytecodeWord handle)
+{
+    u8 *at = (u8 *)(uintptr_t)handle + field->offset;
+    if (field->is_inline) {
+        return (BytecodeWord)(uintptr_t)at;
+    }
+    switch (field->size) {
+    case 1:
+        return *at;
+    case 4: {
+        u32 value;
+        memcpy(&value, at, sizeof(value));
+        return value;
+    }
+    default: {
+        BytecodeWord value;
+        memcpy(&value, at, sizeof(value));
+        return value;
+    }
+    }
+}
+
+void ast_field_store(AstField *field, BytecodeWord handle, BytecodeWord value)
+{
+    u8 *at = (u8 *)(uintptr_t)handle + field->offset;
+    if (field->is_inline) {
+        memcpy(at, (void *)(uintptr_t)value, field->size);
+        return;
+    }
+    switch (field->size) {
+    case 1:
+        *at = (u8)value;
+        break;
+    case 4: {
+        u32 narrow = (u32)value;
+        memcpy(at, &narrow, sizeof(narrow));
+    } break;
+    default:
+        memcpy(at, &value, sizeof(value));
+        break;
+    }
+}
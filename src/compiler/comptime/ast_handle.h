@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef AST_HANDLE_H
+#define AST_HANDLE_H
+
+#include "base/types.h"
+#include "compiler/ast.h"
+#include "compiler/comptime/bytecode.h"
+
+/*
+ * AST handles in the VM.
+ *
+ * A handle is a word holding the address of a node in the persist arena, or of a struct embedded
+ * in one, like the name of an AstFunc. Comptime code gets one for the declaration a call
+ * annotates and reads and writes the node through it in place, nothing is copied into VM memory.
+ *
+ * On the language side a handle is a pointer to a struct named like the one in ast.h, declared by
+ * the program with the members it uses. Member access on those compiles to OP_LOADF and OP_STOREF
+ * with the index of the field in ast_fields, which is generated from the structs in ast.h with
+ * offsetof(). The VM checks the kind of the node against the struct before every access, so a
+ * handle used as the wrong kind of node stops the run instead of reading garbage.
+ *
+ * Structs without a kind can't be checked, so handles are only made by the compiler: typecheck
+ * holds the declared members to the fields in ast.h and allows no arithmetic on handles, and
+ * OP_STOREF checks that what is stored into a pointer field is what the field points at.
+ */
+
+/*
+ * What a handle may point at: a bit per AstNodeKind, or AST_HANDLE_UNTAGGED for structs without a
+ * kind, like Str8. Handles are never null unless AST_HANDLE_NULLABLE is set.
+ */
+#define AST_KIND(___k) (1u << (___k))
+#define AST_KIND_RANGE(___first, ___last) ((AST_KIND(___last) << 1) - AST_KIND(___first))
+#define AST_HANDLE_UNTAGGED (1u << 31)
+#define AST_HANDLE_NULLABLE (1u << 30)
+
+#define AST_KINDS_AstNode AST_KIND_RANGE(EXPR_UNARY, AST_NODE_TYPE_LEN - 1)
+#define AST_KINDS_AstExpr AST_KIND_RANGE(EXPR_UNARY, EXPR_TYPE_LEN - 1)
+#define AST_KINDS_AstStmt AST_KIND_RANGE(STMT_WHILE, STMT_TYPE_LEN - 1)
+#define AST_KINDS_AstUnary AST_KIND(EXPR_UNARY)
+#define AST_KINDS_AstBinary AST_KIND(EXPR_BINARY)
+#define AST_KINDS_AstLiteral AST_KIND(EXPR_LITERAL)
+#define AST_KINDS_AstCall AST_KIND(EXPR_CALL)
+#define AST_KINDS_AstWhile AST_KIND(STMT_WHILE)
+#define AST_KINDS_AstIf AST_KIND(STMT_IF)
+#define AST_KINDS_AstSingle AST_KIND_RANGE(STMT_BREAK, STMT_EXPR)
+#define AST_KINDS_AstBlock AST_KIND(STMT_BLOCK)
+#define AST_KINDS_AstAssignment AST_KIND(STMT_ASSIGNMENT)
+#define AST_KINDS_AstList (AST_KIND(AST_LIST) | AST_KIND(STMT_PRINT))
+#define AST_KINDS_AstFunc AST_KIND(AST_FUNC)
+#define AST_KINDS_AstStruct AST_KIND(AST_STRUCT)
+#define AST_KINDS_AstEnum AST_KIND(AST_ENUM)
+#define AST_KINDS_AstRoot AST_KIND(AST_ROOT)
+#define AST_KINDS_AstListNode AST_HANDLE_UNTAGGED
+#define AST_KINDS_Str8 AST_HANDLE_UNTAGGED
+#define AST_KINDS_Str8Builder AST_HANDLE_UNTAGGED
+#define AST_KINDS_Token AST_HANDLE_UNTAGGED
+
+typedef struct {
+    char *type; // Name of the struct in ast.h
+    char *field;
+    u32 offset;
+    u32 size;
+    u32 kinds; // AST_KINDS_ of the struct
+    /*
+     * Inline fields are structs embedded in the node. Loading one gives a handle to it, storing
+     * one copies size bytes from the handle. Other fields are loaded and stored as a word.
+     */
+    bool is_inline;
+    /* Like the kind of a node, changing it would make the node something it wasn't allocated as */
+    bool is_read_only;
+    u32 limit; // Words stored must be below it, unless it is 0
+    /*
+     * The struct an inline field holds or a pointer field points at, and the AST_KINDS_ a handle
+     * stored into the field must have. NULL for fields that are words.
+     */
+    char *pointee;
+    u32 pointee_kinds;
+} AstField;
+
+extern AstField ast_fields[];
+extern u32 ast_fields_len;
+
+/* Index into ast_fields, or -1 if type has no field by that name */
+s32 ast_field_find(Str8 type, Str8 field);
+/* True if type is the name of a struct in ast_fields */
+bool ast_handle_type(Str8 type);
+/* The AST_KINDS_ of a struct in ast_fields, or 0 if type isn't one */
+u32 ast_handle_kinds(Str8 type);
+/* False if handle is null or points at a kind of node that isn't in kinds */
+bool ast_handle_valid(u32 kinds, BytecodeWord handle);
+/* False if value can't be stored into the field, see AstField */
+bool ast_field_storable(AstField *field, BytecodeWord value);
+BytecodeWord ast_field_load(AstField *field, BytecodeWord handle);
+void ast_field_store(AstField *field, BytecodeWord handle, BytecodeWord value);
+
+#endif /* AST_HANDLE_H */
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/builtin.h"
+#include "base/str.h"
+#include "compiler/ast.h"
+#include "compiler/comptime/ast_handle.h"
+#include "compiler/lex.h"
+#include "compiler/mem_report.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ARG(___i, ___type) ((___type)(uintptr_t)args[(___i)])
+#define HANDLE(___ptr) ((BytecodeWord)(uintptr_t)(___ptr))
+
+static bool is_token_kind(BytecodeWord kind)
+{
+    return kind >= 0 && kind < TOKEN_TYPE_ENUM_COUNT;
+}
+
+/* AST constructors */
+static bool b_make_token(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    if (!is_token_kind(args[0])) {
+        return false;
+    }
+    Token *token = m_arena_alloc_tagged(arena, sizeof(Token), MEM_TAG_COMPTIME);
+    *token = (Token){ .kind = (TokenKind)args[0], .lexeme = *ARG(1, Str8 *) };
+    *result = HANDLE(token);
+    return true;
+}
+
+static bool b_make_literal(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    *result = HANDLE(make_literal(arena, *ARG(0, Token *)));
+    return true;
+}
+
+static bool b_make_unary(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    if (!is_token_kind(args[1])) {
+        return false;
+    }
+    *result = HANDLE(make_unary(arena, ARG(0, AstExpr *), (TokenKind)args[1]));
+    return true;
+}
+
+static bool b_make_binary(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    if (!is_token_kind(args[1])) {
+        return false;
+    }
+    *result = HANDLE(make_binary(arena, ARG(0, AstExpr *), (TokenKind)args[1], ARG(2, AstExpr *)));
+    return true;
+}
+
+static bool b_make_call(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    *result = HANDLE(make_call(arena, false, *ARG(0, Str8 *), ARG(1, AstList *)));
+    return true;
+}
+
+static bool b_make_while(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    *result = HANDLE(make_while(arena, ARG(0, AstExpr *), ARG(1, AstStmt *)));
+    return true;
+}
+
+static bool b_make_if(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    *result = HANDLE(make_if(arena, ARG(0, AstExpr *), ARG(1, AstStmt *), ARG(2, AstStmt *)));
+    return true;
+}
+
+/* Only the kinds that are AstSingles, a print is an AstList */
+static bool b_make_single(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    if (!IS_BETWEEN(args[0], STMT_BREAK, STMT_EXPR)) {
+        return false;
+    }
+    *result = HANDLE(make_single(arena, (AstStmtKind)args[0], ARG(1, AstNode *)));
+    return true;
+}
+
+/* A print is a list of what it prints with its own kind, like the parser makes them */
+static bool b_make_print(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    AstList *print = make_list(arena, ARG(0, AstNode *));
+    print->kind = (AstNodeKind)STMT_PRINT;
+    *result = HANDLE(print);
+    return true;
+}
+
+static bool b_make_assignment(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    *result = HANDLE(make_assignment(arena, ARG(0, AstExpr *), ARG(1, AstExpr *)));
+    return true;
+}
+
+static bool b_make_list_node(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    *result = HANDLE(make_list_node(arena, ARG(0, AstNode *)));
+    return true;
+}
+
+static bool b_make_list(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    *result = HANDLE(make_list(arena, ARG(0, AstNode *)));
+    return true;
+}
+
+/* Returns the list, so the call can be assigned back to where the list came from */
+static bool b_ast_list_push_back(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    (void)arena;
+    ast_list_push_back(ARG(0, AstList *), ARG(1, AstListNode *));
+    *result = args[0];
+    return true;
+}
+
+/* Str8Builder ops. The appends return the builder */
+static bool b_make_str_builder(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    (void)args;
+    Str8Builder *sb = m_arena_alloc_tagged(arena, sizeof(Str8Builder), MEM_TAG_COMPTIME);
+    *sb = make_str_builder(arena);
+    *result = HANDLE(sb);
+    return true;
+}
+
+static bool b_str_builder_append_u8(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    (void)arena;
+    if (!IS_BETWEEN(args[1], 0, U8_MAX)) {
+        return false;
+    }
+    str_builder_append_u8(ARG(0, Str8Builder *), (u8)args[1]);
+    *result = args[0];
+    return true;
+}
+
+static bool b_str_builder_append_str8(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    (void)arena;
+    str_builder_append_str8(ARG(0, Str8Builder *), *ARG(1, Str8 *));
+    *result = args[0];
+    return true;
+}
+
+static bool b_str_builder_append_int(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    (void)arena;
+    char digits[24];
+    int len = snprintf(digits, sizeof(digits), "%ld", args[1]);
+    str_builder_append_cstr(ARG(0, Str8Builder *), digits, (u32)len);
+    *result = args[0];
+    return true;
+}
+
+/* Zero terminated, so the string can be the lexeme of a literal */
+static bool b_str_builder_end(Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    Str8 *str = m_arena_alloc_tagged(arena, sizeof(Str8), MEM_TAG_COMPTIME);
+    *str = str_builder_end(ARG(0, Str8Builder *), true);
+    *result = HANDLE(str);
+    return true;
+}
+
+#define WORD { NULL, 0 }
+#define TYPE(___type) { #___type, AST_KINDS_##___type }
+#define NULLABLE(___type) { #___type, AST_KINDS_##___type | AST_HANDLE_NULLABLE }
+
+Builtin builtins[] = {
+    { "make_token", b_make_token, 2, { WORD, TYPE(Str8) }, TYPE(Token) },
+    { "make_literal", b_make_literal, 1, { TYPE(Token) }, TYPE(AstLiteral) },
+    { "make_unary", b_make_unary, 2, { TYPE(AstExpr), WORD }, TYPE(AstUnary) },
+    { "make_binary", b_make_binary, 3, { TYPE(AstExpr), WORD, TYPE(AstExpr) },
+      TYPE(AstBinary) },
+    { "make_call", b_make_call, 2, { TYPE(Str8), NULLABLE(AstList) }, TYPE(AstCall) },
+    { "make_while", b_make_while, 2, { TYPE(AstExpr), TYPE(AstStmt) }, TYPE(AstWhile) },
+    { "make_if", b_make_if, 3, { TYPE(AstExpr), TYPE(AstStmt), NULLABLE(AstStmt) },
+      TYPE(AstIf) },
+    { "make_single", b_make_single, 2, { WORD, NULLABLE(AstNode) }, TYPE(AstSingle) },
+    { "make_print", b_make_print, 1, { TYPE(AstExpr) }, TYPE(AstList) },
+    { "make_assignment", b_make_assignment, 2, { TYPE(AstExpr), TYPE(AstExpr) },
+      TYPE(AstAssignment) },
+    { "make_list_node", b_make_list_node, 1, { TYPE(AstNode) }, TYPE(AstListNode) },
+    { "make_list", b_make_list, 1, { TYPE(AstNode) }, TYPE(AstList) },
+    { "ast_list_push_back", b_ast_list_push_back, 2, { TYPE(AstList), TYPE(AstListNode) },
+      TYPE(AstList) },
+    { "make_str_builder", b_make_str_builder, 0, { WORD }, TYPE(Str8Builder) },
+    { "str_builder_append_u8", b_str_builder_append_u8, 2, { TYPE(Str8Builder), WORD },
+      TYPE(Str8Builder) },
+    { "str_builder_append_str8", b_str_builder_append_str8, 2,
+      { TYPE(Str8Builder), TYPE(Str8) }, TYPE(Str8Builder) },
+    { "str_builder_append_int", b_str_builder_append_int, 2, { TYPE(Str8Builder), WORD },
+      TYPE(Str8Builder) },
+    { "str_builder_end", b_str_builder_end, 1, { TYPE(Str8Builder) }, TYPE(Str8) },
+};
+u32 builtins_len = sizeof(builtins) / sizeof(builtins[0]);
+
+
+s32 builtin_find(Str8 name)
+{
+    for (u32 i = 0; i < builtins_len; i++) {
+        if (strlen(builtins[i].name) == name.len &&
+            memcmp(builtins[i].name, name.str, name.len) == 0) {
+            return (s32)i;
+        }
+    }
+    return -1;
+}
+
+VMStop builtin_call(Builtin *builtin, Arena *arena, BytecodeWord *args, BytecodeWord *result)
+{
+    if (arena == NULL) {
+        return VM_STOP_NOT_COMPTIME;
+    }
+    for (u32 i = 0; i < builtin->n_params; i++) {
+        BuiltinType *param = &builtin->params[i];
+        if (param->type != NULL && !ast_handle_valid(param->kinds, args[i])) {
+            return VM_STOP_BAD_HANDLE;
+        }
+    }
+    return builtin->func(arena, args, result) ? VM_STOP_NONE : VM_STOP_BAD_ARGUMENT;
+}
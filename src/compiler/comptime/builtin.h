@@ -0,0 +1,68 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include "base/sac_single.h"
+#include "base/types.h"
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/vm.h"
+
+/*
+ * Native functions behind the `compiler func` declarations of a program.
+ *
+ * A compiler func has no body. Calls to one compile to OP_CALLN with the index of the builtin by
+ * the same name, and the VM calls it with the arguments in place on its stack. The result takes
+ * the place of the first argument, like for OP_CALL, so there is no frame and nothing is copied.
+ *
+ * The builtins are the AST constructors from ast.c and the Str8Builder ops, so metaprograms build
+ * nodes at native speed. Nodes and strings are allocated on the arena of the VM, the persist
+ * arena during @calls, so they live as long as the AST they are put in. Handle arguments are
+ * checked against params before the call, see ast_handle_valid().
+ *
+ * The declaration of a compiler func must match the signature of the builtin, typecheck rejects
+ * one that passes a word as a handle or a handle to a different struct.
+ */
+
+#define BUILTIN_MAX_PARAMS 4
+
+/* Returns false if an argument that isn't a handle was out of range */
+typedef bool (*BuiltinFunc)(Arena *arena, BytecodeWord *args, BytecodeWord *result);
+
+/* A parameter or the result of a builtin, a handle to the struct in ast.h named type or a word */
+typedef struct {
+    char *type; // NULL for words
+    u32 kinds; // AST_KINDS_ of the struct, with AST_HANDLE_NULLABLE if the handle may be null
+} BuiltinType;
+
+typedef struct {
+    char *name;
+    BuiltinFunc func;
+    u16 n_params;
+    BuiltinType params[BUILTIN_MAX_PARAMS];
+    BuiltinType result;
+} Builtin;
+
+extern Builtin builtins[];
+extern u32 builtins_len;
+
+/* Index into builtins, or -1 if there is none by that name */
+s32 builtin_find(Str8 name);
+/* Checks the arguments at args and calls builtin. arena is NULL outside of @calls */
+VMStop builtin_call(Builtin *builtin, Arena *arena, BytecodeWord *args, BytecodeWord *result);
+
+#endif /* BUILTIN_H */
@@ -16,58 +16,326 @@
  */
 #include "compiler/comptime/bytecode.h"
 #include "compiler/ast.h"
+#include "compiler/comptime/ast_handle.h"
+#include "compiler/comptime/builtin.h"
+#include "compiler/comptime/vm.h"
+#include "compiler/mem_report.h"
 #include "compiler/type.h"
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 char *op_code_str_map[OP_TYPE_LEN] = {
-    "OP_ADDW", "OP_SUBW",  "OP_MULW",   "OP_DIVW",  "OP_LSHIFT", "OP_RSHIFT", "OP_GE",
-    "OP_LE",   "OP_NOT",   "OP_JMP",    "OP_BIZ",   "OP_BNZ",    "OP_CONSW",  "OP_PUSHN",
-    "OP_POPN", "OP_LOADL", "OP_STOREL", "OP_PRINT", "OP_RETURN",
+    "OP_ADDW",  "OP_SUBW",   "OP_MULW",  "OP_DIVW",  "OP_LSHIFT", "OP_RSHIFT", "OP_GE",
+    "OP_LE",    "OP_NOT",    "OP_JMP",   "OP_JMPW",  "OP_BIZ",    "OP_BNZ",    "OP_BIZW",
+    "OP_BNZW",  "OP_BEQ",    "OP_BNE",   "OP_BLE",   "OP_BGE",    "OP_CONSW",  "OP_PUSHN",
+    "OP_POPN",  "OP_LOADL",  "OP_STOREL", "OP_INCL", "OP_CALL",   "OP_CALLN",  "OP_RET",
+    "OP_LOADF", "OP_STOREF", "OP_LOADM", "OP_STOREM", "OP_MEMCPY", "OP_MEMSET", "OP_ALLOC",
+    "OP_FREE",  "OP_PRINT",
 };
 
+#define BYTECODE_INITIAL_CAP 4096
+
+
+u32 bytecode_op_len(OpCode op)
+{
+    switch (op) {
+    case OP_PRINT:
+        return 1 + sizeof(u8);
+    case OP_JMP:
+    case OP_BIZ:
+    case OP_BNZ:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLE:
+    case OP_BGE:
+    case OP_POPN:
+    case OP_PUSHN:
+    case OP_LOADL:
+    case OP_STOREL:
+    case OP_CALL:
+    case OP_CALLN:
+    case OP_RET:
+    case OP_LOADF:
+    case OP_STOREF:
+        return 1 + sizeof(BytecodeImm);
+    case OP_INCL:
+        return 1 + 2 * sizeof(BytecodeImm);
+    case OP_LOADM:
+    case OP_STOREM:
+        return 1 + sizeof(BytecodeImm) + sizeof(u8);
+    case OP_JMPW:
+    case OP_BIZW:
+    case OP_BNZW:
+    case OP_MEMCPY:
+    case OP_MEMSET:
+    case OP_ALLOC:
+    case OP_FREE:
+        return 1 + sizeof(BytecodeWideImm);
+    case OP_CONSW:
+        return 1 + sizeof(BytecodeWord);
+    default:
+        return 1;
+    }
+}
+
+BytecodeFunc *bytecode_func_at(Bytecode *b, u32 offset)
+{
+    /* The one starting closest before offset */
+    BytecodeFunc *func = NULL;
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        if (b->funcs[i].code_offset <= offset &&
+            (func == NULL || b->funcs[i].code_offset > func->code_offset)) {
+            func = &b->funcs[i];
+        }
+    }
+    assert(func != NULL);
+    return func;
+}
+
+u32 bytecode_func_end(Bytecode *b, BytecodeFunc *func)
+{
+    /* The next function starts there */
+    u32 end = b->code_offset;
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        if (b->funcs[i].code_offset > func->code_offset && b->funcs[i].code_offset < end) {
+            end = b->funcs[i].code_offset;
+        }
+    }
+    return end;
+}
+
+/* How many words the instruction at offset leaves on the stack, minus what it takes off */
+static s32 op_stack_effect(Bytecode *b, u32 offset)
+{
+    BytecodeImm imm;
+    memcpy(&imm, b->code + offset + 1, sizeof(imm));
+    switch ((OpCode)b->code[offset]) {
+    case OP_CONSW:
+    case OP_LOADL:
+    case OP_ALLOC:
+        return 1;
+    case OP_ADDW:
+    case OP_SUBW:
+    case OP_MULW:
+    case OP_DIVW:
+    case OP_LSHIFT:
+    case OP_RSHIFT:
+    case OP_GE:
+    case OP_LE:
+    case OP_BIZ:
+    case OP_BNZ:
+    case OP_BIZW:
+    case OP_BNZW:
+    case OP_STOREL:
+        return -1;
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLE:
+    case OP_BGE:
+    case OP_STOREF:
+    case OP_STOREM:
+    case OP_MEMCPY:
+    case OP_MEMSET:
+        return -2;
+    case OP_PUSHN:
+        return imm;
+    case OP_POPN:
+        return -(s32)imm;
+    case OP_PRINT:
+        return -(s32)b->code[offset + 1];
+    /* The result takes the place of the arguments */
+    case OP_CALL:
+        return 1 - (s32)b->funcs[imm].n_params;
+    case OP_CALLN:
+        return 1 - (s32)builtins[imm].n_params;
+    default:
+        return 0;
+    }
+}
+
+/* Where the instruction at offset may continue other than the next one, or U32_MAX */
+static u32 op_branch_target(Bytecode *b, u32 offset)
+{
+    switch (b->code[offset]) {
+    case OP_JMP:
+    case OP_BIZ:
+    case OP_BNZ:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLE:
+    case OP_BGE: {
+        s16 distance;
+        memcpy(&distance, b->code + offset + 1, sizeof(distance));
+        return offset + 1 + sizeof(BytecodeImm) + distance;
+    }
+    case OP_JMPW:
+    case OP_BIZW:
+    case OP_BNZW: {
+        s32 distance;
+        memcpy(&distance, b->code + offset + 1, sizeof(distance));
+        return offset + 1 + sizeof(BytecodeWideImm) + distance;
+    }
+    default:
+        return U32_MAX;
+    }
+}
+
+/*
+ * Follows every path through the function with the number of words on the stack, starting at 0
+ * right above the frame header. The compiler leaves the same number on every path to an
+ * instruction, but the deepest is kept anyway, and anything deeper than the stack is cut off.
+ */
+static u32 func_max_stack(Bytecode *b, BytecodeFunc *func)
+{
+    u32 start = func->code_offset;
+    u32 len = bytecode_func_end(b, func) - start;
+    s32 *depth = malloc(sizeof(s32) * len); // At each instruction, -1 until reached
+    bool *queued = calloc(len, sizeof(bool));
+    u32 *work = malloc(sizeof(u32) * len);
+    u32 n_work = 0;
+    memset(depth, 0xff, sizeof(s32) * len);
+    s32 max = 0;
+
+    depth[0] = 0;
+    work[n_work++] = 0;
+    queued[0] = true;
+    while (n_work > 0) {
+        u32 at = work[--n_work];
+        queued[at] = false;
+        OpCode op = b->code[start + at];
+        s32 after = depth[at] + op_stack_effect(b, start + at);
+        max = after > max ? after : max;
+        if (max >= STACK_MAX) {
+            break;
+        }
+        u32 target = op_branch_target(b, start + at);
+        u32 next[2] = { at + bytecode_op_len(op), target == U32_MAX ? len : target - start };
+        bool falls_through = op != OP_RET && op != OP_JMP && op != OP_JMPW;
+        for (u32 i = falls_through ? 0 : 1; i < 2; i++) {
+            /* Targets before the start wrap around to past the end */
+            u32 to = next[i];
+            if (to >= len) {
+                continue;
+            }
+            if (depth[to] < after) {
+                depth[to] = after;
+                if (!queued[to]) {
+                    work[n_work++] = to;
+                    queued[to] = true;
+                }
+            }
+        }
+    }
+    free(depth);
+    free(queued);
+    free(work);
+    return (u32)(max < STACK_MAX ? max : STACK_MAX);
+}
+
+void bytecode_max_stack(Bytecode *b)
+{
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        b->funcs[i].max_stack = func_max_stack(b, &b->funcs[i]);
+    }
+}
+
 
 /* Bytecode dissasembler */
-static void disassemble_instruction(Bytecode *b)
+u32 disassemble_instruction(Bytecode *b, u32 offset)
 {
-    OpCode instruction = b->code[b->code_offset];
-    printf("%04d %s", b->code_offset, op_code_str_map[instruction]);
-    b->code_offset++;
+    OpCode instruction = b->code[offset];
+    printf("%04d %s", offset, op_code_str_map[instruction]);
+    offset++;
     switch (instruction) {
     case OP_PRINT: {
-        u8 n_args = b->code[b->code_offset];
-        b->code_offset++;
+        u8 n_args = b->code[offset];
+        offset++;
         printf(" args %d", n_args);
     }; break;
+    case OP_JMP:
     case OP_BIZ:
     case OP_BNZ:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLE:
+    case OP_BGE: {
+        s16 distance = *(s16 *)(b->code + offset);
+        offset += sizeof(BytecodeImm);
+        printf(" %d (%04d)", distance, (s32)offset + distance);
+    }; break;
     case OP_POPN:
     case OP_PUSHN:
     case OP_LOADL:
-    case OP_STOREL: {
-        BytecodeImm value = *(BytecodeImm *)(b->code + b->code_offset);
-        b->code_offset += sizeof(BytecodeImm);
+    case OP_STOREL:
+    case OP_CALL:
+    case OP_RET: {
+        BytecodeImm value = *(BytecodeImm *)(b->code + offset);
+        offset += sizeof(BytecodeImm);
         printf(" %d", value);
     }; break;
-    // case OP_JMP:
+    case OP_CALLN: {
+        Builtin *builtin = &builtins[*(BytecodeImm *)(b->code + offset)];
+        offset += sizeof(BytecodeImm);
+        printf(" %s", builtin->name);
+    }; break;
+    case OP_LOADF:
+    case OP_STOREF: {
+        AstField *field = &ast_fields[*(BytecodeImm *)(b->code + offset)];
+        offset += sizeof(BytecodeImm);
+        printf(" %s.%s", field->type, field->field);
+    }; break;
+    case OP_INCL: {
+        BytecodeImm slot = *(BytecodeImm *)(b->code + offset);
+        BytecodeImm delta = *(BytecodeImm *)(b->code + offset + sizeof(BytecodeImm));
+        offset += 2 * sizeof(BytecodeImm);
+        printf(" %d %d", slot, (s16)delta);
+    }; break;
+    case OP_LOADM:
+    case OP_STOREM: {
+        BytecodeImm at = *(BytecodeImm *)(b->code + offset);
+        MemWidth width = b->code[offset + sizeof(BytecodeImm)];
+        offset += sizeof(BytecodeImm) + sizeof(u8);
+        printf(" +%d %c%d", at, width & MEM_SIGNED ? 's' : 'u', (width & MEM_SIZE_MASK) * 8);
+    }; break;
+    case OP_MEMCPY:
+    case OP_MEMSET:
+    case OP_ALLOC:
+    case OP_FREE: {
+        BytecodeWideImm n_bytes = *(BytecodeWideImm *)(b->code + offset);
+        offset += sizeof(BytecodeWideImm);
+        printf(" %u", n_bytes);
+    }; break;
+    case OP_JMPW:
+    case OP_BIZW:
+    case OP_BNZW: {
+        s32 distance = *(s32 *)(b->code + offset);
+        offset += sizeof(BytecodeWideImm);
+        printf(" %d (%04d)", distance, (s32)offset + distance);
+    }; break;
     case OP_CONSW: {
-        BytecodeWord value = *(BytecodeWord *)(b->code + b->code_offset);
-        b->code_offset += sizeof(BytecodeWord);
+        BytecodeWord value = *(BytecodeWord *)(b->code + offset);
+        offset += sizeof(BytecodeWord);
         printf(" %ld", value);
     }; break;
     default:
         break;
     }
+    return offset;
 }
 
-void disassemble(Bytecode b)
+void disassemble(Bytecode *b)
 {
     printf("--- bytecode ---\n");
-    u32 code_offset_end = b.code_offset;
-    b.code_offset = 0;
-    while (b.code_offset < code_offset_end) {
-        disassemble_instruction(&b);
+    u32 offset = 0;
+    while (offset < b->code_offset) {
+        for (u32 i = 0; i < b->n_funcs; i++) {
+            if (b->funcs[i].code_offset == offset)
+                printf("%.*s:\n", STR8VIEW_PRINT(b->funcs[i].name));
+        }
+        offset = disassemble_instruction(b, offset);
         putchar('\n');
     }
     printf("--- bytecode end ---\n");
@@ -75,8 +343,38 @@ void disassemble(Bytecode b)
 
 
 /* Bytecode assembler */
+void bytecode_init(Bytecode *b, Arena *arena)
+{
+    b->arena = arena;
+    b->code_offset = 0;
+    b->code_cap = BYTECODE_INITIAL_CAP;
+    b->code = m_arena_alloc_tagged(arena, b->code_cap, MEM_TAG_BYTECODE);
+    b->funcs = NULL;
+    b->n_funcs = 0;
+    b->entry = 0;
+    b->globals_size = 0;
+}
+
+/* Makes sure there is room for n more bytes, growing the code segment if there is not */
+static void bytecode_reserve(Bytecode *b, u32 n)
+{
+    if (b->code_offset + n <= b->code_cap)
+        return;
+
+    u32 new_cap = b->code_cap * 2;
+    while (new_cap < b->code_offset + n)
+        new_cap *= 2;
+    b->code = m_arena_grow(b->arena, b->code, b->code_cap, new_cap);
+    if (b->code == NULL) {
+        fprintf(stderr, "bytecode: out of memory growing the code segment to %u bytes\n", new_cap);
+        exit(1);
+    }
+    b->code_cap = new_cap;
+}
+
 static u32 writeu8(Bytecode *b, u8 byte)
 {
+    bytecode_reserve(b, sizeof(u8));
     b->code[b->code_offset] = byte;
     b->code_offset++;
     return b->code_offset;
@@ -84,95 +382,447 @@ static u32 writeu8(Bytecode *b, u8 byte)
 
 static u32 writew(Bytecode *b, BytecodeWord v)
 {
-    *(BytecodeWord *)(b->code + b->code_offset) = v;
+    bytecode_reserve(b, sizeof(BytecodeWord));
+    memcpy(b->code + b->code_offset, &v, sizeof(BytecodeWord));
     b->code_offset += sizeof(BytecodeWord);
     return b->code_offset;
 }
 
 static void writei(Bytecode *b, BytecodeImm v)
 {
-    *(BytecodeImm *)(b->code + b->code_offset) = v;
+    bytecode_reserve(b, sizeof(BytecodeImm));
+    memcpy(b->code + b->code_offset, &v, sizeof(BytecodeImm));
     b->code_offset += sizeof(BytecodeImm);
 }
 
-static void patchw(Bytecode *b, u32 offset, BytecodeWord value)
+static void write_wide_imm(Bytecode *b, BytecodeWideImm v)
+{
+    bytecode_reserve(b, sizeof(BytecodeWideImm));
+    memcpy(b->code + b->code_offset, &v, sizeof(BytecodeWideImm));
+    b->code_offset += sizeof(BytecodeWideImm);
+}
+
+typedef struct {
+    u32 imm_offset; // Where the branch imm is
+    u32 idx; // Index into BytecodeCompiler.wide_branches
+    bool wide;
+} ForwardBranch;
+
+typedef struct branch_patch_t BranchPatch;
+struct branch_patch_t {
+    ForwardBranch branch;
+    BranchPatch *next;
+};
+
+/*
+ * A place in the code that branches go to. Branches to a label that is not bound yet are kept on
+ * a patch list and pointed at it once bind_label() is called.
+ */
+typedef struct {
+    bool bound;
+    u32 offset; // Where the label is, once bound
+    BranchPatch *patches;
+} Label;
+
+#define LABEL_NEW ((Label){ .bound = false, .offset = 0, .patches = NULL })
+
+static OpCode wide_branch_op(OpCode op)
 {
-    *(BytecodeWord *)(b->code + offset) = value;
+    switch (op) {
+    case OP_JMP:
+        return OP_JMPW;
+    case OP_BIZ:
+        return OP_BIZW;
+    case OP_BNZ:
+        return OP_BNZW;
+    default:
+        ASSERT_NOT_REACHED;
+        return op;
+    }
 }
 
-static void patchi(Bytecode *b, u32 offset, BytecodeImm value)
+static void mark_branch_wide(BytecodeCompiler *compiler, u32 idx)
 {
-    *(BytecodeImm *)(b->code + offset) = value;
+    if (idx >= compiler->wide_branches_cap) {
+        u32 new_cap = compiler->wide_branches_cap == 0 ? 64 : compiler->wide_branches_cap;
+        while (new_cap <= idx)
+            new_cap *= 2;
+        bool *wide_branches = m_arena_alloc_zero_tagged(compiler->arena, sizeof(bool) * new_cap,
+                                                        MEM_TAG_BYTECODE);
+        if (compiler->wide_branches_cap != 0)
+            memcpy(wide_branches, compiler->wide_branches, compiler->wide_branches_cap);
+        compiler->wide_branches = wide_branches;
+        compiler->wide_branches_cap = new_cap;
+    }
+    compiler->wide_branches[idx] = true;
 }
 
-static Locals *make_locals(Locals *parent)
+/* Points a forward branch at the current end of the code */
+static void patch_forward_branch(BytecodeCompiler *compiler, ForwardBranch branch)
 {
-    Locals *locals = malloc(sizeof(Locals));
-    locals->parent = parent;
-    hashmap_init(&locals->map);
-    return locals;
+    Bytecode *b = compiler->bytecode;
+    if (branch.wide) {
+        BytecodeWideImm distance = b->code_offset - branch.imm_offset - sizeof(BytecodeWideImm);
+        memcpy(b->code + branch.imm_offset, &distance, sizeof(distance));
+        return;
+    }
+
+    u32 distance = b->code_offset - branch.imm_offset - sizeof(BytecodeImm);
+    if (distance > I16_MAX) {
+        /* Widening it here would shift everything after it, so compile everything again */
+        mark_branch_wide(compiler, branch.idx);
+        compiler->needs_relaxing = true;
+        return;
+    }
+    BytecodeImm imm = (BytecodeImm)distance;
+    memcpy(b->code + branch.imm_offset, &imm, sizeof(imm));
 }
 
-static BytecodeImm find_ident_offset(BytecodeCompiler *compiler, Str8 ident)
+/*
+ * Writes a branch to the label. op is the short form, OP_JMP, OP_BIZ or OP_BNZ. Backward branches
+ * know how far they go and pick the form that reaches. Forward branches use the wide form if an
+ * earlier attempt at compiling found that the short one can't reach.
+ */
+static void emit_branch(BytecodeCompiler *compiler, OpCode op, Label *label)
 {
-    for (Locals *locals = compiler->locals; locals; locals = locals->parent) {
-        void *offset = hashmap_get(&locals->map, ident.str, ident.len);
-        if (offset != NULL) {
-            return (BytecodeImm)offset - 1;
+    Bytecode *b = compiler->bytecode;
+    if (label->bound) {
+        s64 distance = (s64)label->offset - (s64)(b->code_offset + 1 + sizeof(BytecodeImm));
+        if (distance >= I16_MIN) {
+            writeu8(b, op);
+            writei(b, (BytecodeImm)(s16)distance);
+        } else {
+            distance = (s64)label->offset - (s64)(b->code_offset + 1 + sizeof(BytecodeWideImm));
+            writeu8(b, wide_branch_op(op));
+            write_wide_imm(b, (BytecodeWideImm)(s32)distance);
         }
+        return;
+    }
+
+    ForwardBranch branch = { .idx = compiler->n_branches++ };
+    branch.wide = branch.idx < compiler->wide_branches_cap && compiler->wide_branches[branch.idx];
+    if (branch.wide) {
+        branch.imm_offset = writeu8(b, wide_branch_op(op));
+        write_wide_imm(b, 0);
+    } else {
+        branch.imm_offset = writeu8(b, op);
+        writei(b, 0);
+    }
+    BranchPatch *patch = m_arena_alloc_tagged(compiler->arena, sizeof(BranchPatch),
+                                              MEM_TAG_BYTECODE);
+    *patch = (BranchPatch){ .branch = branch, .next = label->patches };
+    label->patches = patch;
+}
+
+/* Puts the label at the current end of the code */
+static void bind_label(BytecodeCompiler *compiler, Label *label)
+{
+    assert(!label->bound);
+    label->bound = true;
+    label->offset = compiler->bytecode->code_offset;
+    for (BranchPatch *patch = label->patches; patch != NULL; patch = patch->next) {
+        patch_forward_branch(compiler, patch->branch);
+    }
+    label->patches = NULL;
+}
+
+void func_table_init(HashMap *funcs, Arena *arena)
+{
+    /* Keys are symbol names which outlive the bytecode compiler */
+    hashmap_init_arena_tagged(funcs, arena, true, MEM_TAG_BYTECODE);
+}
+
+void func_table_put(HashMap *funcs, Str8 name, u32 idx)
+{
+    hashmap_put(funcs, name.str, name.len, (void *)(uintptr_t)(idx + 1), sizeof(void *), false);
+}
+
+u32 func_table_get(HashMap *funcs, Str8 name)
+{
+    void *idx = hashmap_get(funcs, name.str, name.len);
+    assert(idx != NULL && "Call to a function without a body");
+    return (u32)(uintptr_t)idx - 1;
+}
+
+/* Where a parameter or local is relative to bp. Locals come after the frame header. */
+static BytecodeImm frame_offset(Symbol *sym)
+{
+    assert(sym->kind == SYMBOL_PARAM || sym->kind == SYMBOL_LOCAL_VAR);
+    u32 offset = sym->frame_slot;
+    if (sym->kind == SYMBOL_LOCAL_VAR)
+        offset += FRAME_HEADER_WORDS;
+    assert(offset <= U16_MAX);
+    return (BytecodeImm)offset;
+}
+
+/*
+ * Structs and arrays live on the heap, where their value is their address. Structs named like the
+ * ones in ast.h are handles instead, see ast_handle.h.
+ */
+static bool is_aggregate(TypeInfo *t)
+{
+    return (t->kind == TYPE_STRUCT && !ast_handle_type(t->generated_by)) || t->kind == TYPE_ARRAY;
+}
+
+static u32 type_size(TypeInfo *t)
+{
+    return (type_info_bit_size(t) + 7) / 8;
+}
+
+/* What the heap hands out for a value of type t, see HEAP_NULL_BYTES */
+static u32 heap_size(TypeInfo *t)
+{
+    return (type_size(t) + sizeof(BytecodeWord) - 1) & ~(u32)(sizeof(BytecodeWord) - 1);
+}
+
+static MemWidth mem_width(TypeInfo *t)
+{
+    switch (t->kind) {
+    case TYPE_INTEGER: {
+        TypeInfoInteger *integer = (TypeInfoInteger *)t;
+        return (MemWidth)(integer->bit_size / 8) | (integer->is_signed ? MEM_SIGNED : 0);
+    }
+    case TYPE_BOOL:
+        return MEM_8;
+    case TYPE_ENUM:
+        return MEM_32;
+    default:
+        return MEM_64;
+    }
+}
+
+static void bytecode_compiler_init(BytecodeCompiler *compiler, Arena *arena, Bytecode *bytecode)
+{
+    compiler->arena = arena;
+    compiler->bytecode = bytecode;
+    compiler->flags = BCF_LOAD_IDENT;
+    func_table_init(&compiler->funcs, arena);
+    hashmap_init_arena_tagged(&compiler->globals, arena, true, MEM_TAG_BYTECODE);
+    compiler->func = NULL;
+    compiler->heap_bytes = 0;
+    compiler->temp_bytes = 0;
+    compiler->wide_branches = NULL;
+    compiler->wide_branches_cap = 0;
+    compiler->n_branches = 0;
+    compiler->needs_relaxing = false;
+}
+
+static void ast_expr_to_bytecode(BytecodeCompiler *compiler, AstExpr *head);
+
+static void mark_unsupported(BytecodeCompiler *compiler, void *node, char *msg)
+{
+    if (compiler->func->unsupported == NULL) {
+        compiler->func->unsupported = node;
+        compiler->func->unsupported_msg = msg;
+    }
+}
+
+/* Stands in for an expression there is no code for. Loads push 0 and stores drop the value */
+static void emit_unsupported(BytecodeCompiler *compiler, AstExpr *expr, char *msg)
+{
+    mark_unsupported(compiler, expr, msg);
+    if (compiler->flags == BCF_STORE_IDENT) {
+        writeu8(compiler->bytecode, OP_POPN);
+        writei(compiler->bytecode, 1);
+    } else {
+        writeu8(compiler->bytecode, OP_CONSW);
+        writew(compiler->bytecode, 0);
     }
-    ASSERT_NOT_REACHED;
 }
 
-static void bytecode_compiler_init(BytecodeCompiler *compiler)
+/* Compiles head for its value, even if it is the target of an assignment */
+static void ast_expr_to_value(BytecodeCompiler *compiler, AstExpr *head)
 {
+    BytecodeCompilerFlags flags = compiler->flags;
     compiler->flags = BCF_LOAD_IDENT;
-    compiler->bytecode.code_offset = 0;
-    compiler->locals = make_locals(NULL);
+    ast_expr_to_bytecode(compiler, head);
+    compiler->flags = flags;
 }
 
-static void bytecode_compiler_free(BytecodeCompiler *compiler)
+/*
+ * Loads or stores the value of type t at offset from the address on top of the stack. A struct
+ * or array is its address, so it is loaded by adding the offset and stored by copying it there.
+ */
+static void emit_heap_access(BytecodeCompiler *compiler, u32 offset, TypeInfo *t)
+{
+    Bytecode *b = compiler->bytecode;
+    if (is_aggregate(t) || offset > U16_MAX) {
+        if (offset != 0) {
+            writeu8(b, OP_CONSW);
+            writew(b, offset);
+            writeu8(b, OP_ADDW);
+        }
+        offset = 0;
+    }
+    if (is_aggregate(t)) {
+        if (compiler->flags == BCF_STORE_IDENT) {
+            writeu8(b, OP_MEMCPY);
+            write_wide_imm(b, type_size(t));
+        }
+        return;
+    }
+    writeu8(b, compiler->flags == BCF_STORE_IDENT ? OP_STOREM : OP_LOADM);
+    writei(b, (BytecodeImm)offset);
+    writeu8(b, mem_width(t));
+}
+
+/* Globals get the next free address on the heap the first time they are used */
+static u32 global_address(BytecodeCompiler *compiler, Symbol *sym)
+{
+    void *address = hashmap_get(&compiler->globals, sym->name.str, sym->name.len);
+    if (address != NULL) {
+        return (u32)(uintptr_t)address;
+    }
+    Bytecode *b = compiler->bytecode;
+    u32 new_address = HEAP_NULL_BYTES + b->globals_size;
+    b->globals_size += heap_size(sym->type_info);
+    hashmap_put(&compiler->globals, sym->name.str, sym->name.len,
+                (void *)(uintptr_t)new_address, sizeof(void *), false);
+    return new_address;
+}
+
+static void ast_ident_to_bytecode(BytecodeCompiler *compiler, Symbol *sym)
+{
+    Bytecode *b = compiler->bytecode;
+    if (sym->kind == SYMBOL_GLOBAL_VAR) {
+        writeu8(b, OP_CONSW);
+        writew(b, global_address(compiler, sym));
+        emit_heap_access(compiler, 0, sym->type_info);
+        return;
+    }
+    if (!is_aggregate(sym->type_info)) {
+        writeu8(b, compiler->flags == BCF_STORE_IDENT ? OP_STOREL : OP_LOADL);
+        writei(b, frame_offset(sym));
+        return;
+    }
+    /* The slot holds the address */
+    writeu8(b, OP_LOADL);
+    writei(b, frame_offset(sym));
+    emit_heap_access(compiler, 0, sym->type_info);
+}
+
+/*
+ * Enum members are their index in the enum. Members of structs named like the ones in ast.h are
+ * read and written in place through the handle the LHS evaluates to, see ast_handle.h. Other
+ * structs are on the heap, and their members at the offset typegen gave them.
+ */
+static void ast_member_to_bytecode(BytecodeCompiler *compiler, AstBinary *expr)
 {
-    for (Locals *locals = compiler->locals; locals; locals = locals->parent) {
-        hashmap_free(&locals->map);
-        free(locals);
+    AstLiteral *member = AS_LITERAL(expr->right);
+    TypeInfo *t = expr->left->type;
+    if (t->kind == TYPE_ENUM) {
+        writeu8(compiler->bytecode, OP_CONSW);
+        writew(compiler->bytecode, member->sym->seq_no);
+        return;
+    }
+    if (t->kind == TYPE_POINTER && ((TypeInfoPointer *)t)->level_of_indirection == 1) {
+        t = ((TypeInfoPointer *)t)->pointer_to;
+    }
+    if (t->kind != TYPE_STRUCT) {
+        emit_unsupported(compiler, (AstExpr *)expr, "member access on this type not supported");
+        return;
+    }
+    s32 field = ast_field_find(t->generated_by, member->literal);
+    if (field == -1 && !is_aggregate(t)) {
+        emit_unsupported(compiler, (AstExpr *)expr, "member is not a field of the AST node");
+        return;
     }
+    ast_expr_to_value(compiler, expr->left);
+    if (field != -1) {
+        writeu8(compiler->bytecode, compiler->flags == BCF_STORE_IDENT ? OP_STOREF : OP_LOADF);
+        writei(compiler->bytecode, (BytecodeImm)field);
+        return;
+    }
+    TypeInfoStructMember *m = ((TypeInfoStruct *)t)->members[member->sym->seq_no];
+    emit_heap_access(compiler, m->offset / 8, m->type);
+}
+
+/* Elements are laid out one after the other from the address of the array */
+static void ast_index_to_bytecode(BytecodeCompiler *compiler, AstBinary *expr)
+{
+    TypeInfo *element = ((TypeInfoArray *)expr->left->type)->element_type;
+    ast_expr_to_value(compiler, expr->right);
+    writeu8(compiler->bytecode, OP_CONSW);
+    writew(compiler->bytecode, type_size(element));
+    writeu8(compiler->bytecode, OP_MULW);
+    ast_expr_to_value(compiler, expr->left);
+    writeu8(compiler->bytecode, OP_ADDW);
+    emit_heap_access(compiler, 0, element);
 }
 
 static void ast_expr_to_bytecode(BytecodeCompiler *compiler, AstExpr *head)
 {
     switch (head->kind) {
     default:
-        printf("Ast expr not handled\n");
+        emit_unsupported(compiler, head, "expression not supported");
         break;
+    case EXPR_UNARY: {
+        AstUnary *expr = AS_UNARY(head);
+        if (expr->op == TOKEN_AMPERSAND && is_aggregate(expr->expr->type)) {
+            /* Already an address */
+            ast_expr_to_value(compiler, expr->expr);
+        } else if (expr->op == TOKEN_STAR && !ast_handle_type(head->type->generated_by)) {
+            ast_expr_to_value(compiler, expr->expr);
+            emit_heap_access(compiler, 0, head->type);
+        } else {
+            emit_unsupported(compiler, head,
+                             expr->op == TOKEN_AMPERSAND
+                                 ? "taking the address of a value that is not on the heap"
+                                 : "unary operator not supported");
+        }
+    } break;
     case EXPR_BINARY: {
         AstBinary *expr = AS_BINARY(head);
-        // NOTE: we only support integers right now
-        assert(expr->type->kind == TYPE_INTEGER);
+        if (expr->op == TOKEN_DOT) {
+            ast_member_to_bytecode(compiler, expr);
+            break;
+        }
+        if (expr->op == TOKEN_LBRACKET) {
+            ast_index_to_bytecode(compiler, expr);
+            break;
+        }
+        // NOTE: we only support integers, enums and comparing handles right now
+        assert(expr->type->kind == TYPE_INTEGER || expr->type->kind == TYPE_ENUM ||
+               expr->type->kind == TYPE_POINTER);
         ast_expr_to_bytecode(compiler, expr->right);
         ast_expr_to_bytecode(compiler, expr->left);
         switch (expr->op) {
         default:
-            printf("Binary op not handled\n");
+            /* Leaves one of the operands in place of the result */
+            mark_unsupported(compiler, head, "binary operator not supported");
+            writeu8(compiler->bytecode, OP_POPN);
+            writei(compiler->bytecode, 1);
             break;
         case TOKEN_PLUS:
-            writeu8(&compiler->bytecode, OP_ADDW);
+            writeu8(compiler->bytecode, OP_ADDW);
             break;
         case TOKEN_MINUS:
-            writeu8(&compiler->bytecode, OP_SUBW);
+            writeu8(compiler->bytecode, OP_SUBW);
+            break;
+        case TOKEN_STAR:
+            writeu8(compiler->bytecode, OP_MULW);
+            break;
+        case TOKEN_SLASH:
+            writeu8(compiler->bytecode, OP_DIVW);
+            break;
+        case TOKEN_LSHIFT:
+            writeu8(compiler->bytecode, OP_LSHIFT);
+            break;
+        case TOKEN_RSHIFT:
+            writeu8(compiler->bytecode, OP_RSHIFT);
             break;
         case TOKEN_EQ:
-            writeu8(&compiler->bytecode, OP_SUBW);
-            writeu8(&compiler->bytecode, OP_NOT);
+            writeu8(compiler->bytecode, OP_SUBW);
+            writeu8(compiler->bytecode, OP_NOT);
             break;
         case TOKEN_NEQ:
-            writeu8(&compiler->bytecode, OP_SUBW);
+            writeu8(compiler->bytecode, OP_SUBW);
             break;
         case TOKEN_GREATER:
-            writeu8(&compiler->bytecode, OP_GE);
+            writeu8(compiler->bytecode, OP_GE);
             break;
         case TOKEN_LESS:
-            writeu8(&compiler->bytecode, OP_LE);
+            writeu8(compiler->bytecode, OP_LE);
             break;
         }
     } break;
@@ -180,23 +830,109 @@ static void ast_expr_to_bytecode(BytecodeCompiler *compiler, AstExpr *head)
         AstLiteral *expr = AS_LITERAL(head);
         if (expr->lit_type == LIT_NUM) {
             u32 literal = str_view_to_u32(expr->literal, NULL);
-            writeu8(&compiler->bytecode, OP_CONSW);
-            writew(&compiler->bytecode, literal);
+            writeu8(compiler->bytecode, OP_CONSW);
+            writew(compiler->bytecode, literal);
         } else if (expr->lit_type == LIT_IDENT) {
-            writeu8(&compiler->bytecode, compiler->flags == BCF_STORE_IDENT ? OP_STOREL : OP_LOADL);
-            writei(&compiler->bytecode, find_ident_offset(compiler, expr->sym->name));
+            ast_ident_to_bytecode(compiler, expr->sym);
+        } else if (expr->lit_type == LIT_NULL) {
+            writeu8(compiler->bytecode, OP_CONSW);
+            writew(compiler->bytecode, 0);
         } else {
-            printf("Ast literal expr kind not handled\n");
+            emit_unsupported(compiler, head, "literal not supported");
+        }
+    } break;
+    case EXPR_CALL: {
+        AstCall *call = AS_CALL(head);
+        /* Arguments are pushed in order and become the first slots of the callees frame */
+        BytecodeCompilerFlags flags = compiler->flags;
+        compiler->flags = BCF_LOAD_IDENT;
+        u32 n_args = 0;
+        if (call->args != NULL) {
+            for (AstListNode *n = call->args->head; n != NULL; n = n->next) {
+                ast_expr_to_bytecode(compiler, (AstExpr *)n->this);
+                n_args++;
+            }
+        }
+        compiler->flags = flags;
+        if (hashmap_get(&compiler->funcs, call->identifier.str, call->identifier.len) != NULL) {
+            writeu8(compiler->bytecode, OP_CALL);
+            writei(compiler->bytecode,
+                   (BytecodeImm)func_table_get(&compiler->funcs, call->identifier));
+            /* A returned struct or array is left on the heap until the statement ends */
+            if (is_aggregate(head->type)) {
+                compiler->temp_bytes += heap_size(head->type);
+            }
+            break;
         }
+        /* Functions without a body are compiler funcs */
+        s32 builtin = builtin_find(call->identifier);
+        if (builtin == -1 || builtins[builtin].n_params != n_args) {
+            mark_unsupported(compiler, head, "no compiler func with that name and arguments");
+            writeu8(compiler->bytecode, OP_POPN);
+            writei(compiler->bytecode, (BytecodeImm)n_args);
+            writeu8(compiler->bytecode, OP_CONSW);
+            writew(compiler->bytecode, 0);
+            break;
+        }
+        writeu8(compiler->bytecode, OP_CALLN);
+        writei(compiler->bytecode, (BytecodeImm)builtin);
     } break;
     };
 }
 
+static void emit_free(BytecodeCompiler *compiler, u32 n_bytes)
+{
+    if (n_bytes != 0) {
+        writeu8(compiler->bytecode, OP_FREE);
+        write_wide_imm(compiler->bytecode, n_bytes);
+    }
+}
+
+/* Gives back the structs and arrays returned to the statement so far */
+static void emit_free_temps(BytecodeCompiler *compiler)
+{
+    emit_free(compiler, compiler->temp_bytes);
+    compiler->temp_bytes = 0;
+}
+
+/*
+ * Gives the structs and arrays declared in symt their memory, zeroed. The allocations are next to
+ * each other, so one OP_MEMSET from the first covers them all. Returns how many bytes it took.
+ */
+static u32 alloc_aggregates(BytecodeCompiler *compiler, SymbolTable *symt)
+{
+    Bytecode *b = compiler->bytecode;
+    Symbol *first = NULL;
+    u32 n_bytes = 0;
+    for (u32 i = 0; i < symt->sym_len; i++) {
+        Symbol *sym = symt->symbols[i];
+        if (sym->kind != SYMBOL_LOCAL_VAR || !is_aggregate(sym->type_info)) {
+            continue;
+        }
+        first = first == NULL ? sym : first;
+        writeu8(b, OP_ALLOC);
+        write_wide_imm(b, heap_size(sym->type_info));
+        writeu8(b, OP_STOREL);
+        writei(b, frame_offset(sym));
+        n_bytes += heap_size(sym->type_info);
+    }
+    if (first != NULL) {
+        writeu8(b, OP_CONSW);
+        writew(b, 0);
+        writeu8(b, OP_LOADL);
+        writei(b, frame_offset(first));
+        writeu8(b, OP_MEMSET);
+        write_wide_imm(b, n_bytes);
+    }
+    compiler->heap_bytes += n_bytes;
+    return n_bytes;
+}
+
 static void ast_stmt_to_bytecode(BytecodeCompiler *compiler, AstStmt *head)
 {
     switch (head->kind) {
     default:
-        printf("Ast stmt %d not handled\n", head->kind);
+        mark_unsupported(compiler, head, "statement not supported");
         break;
     case STMT_ASSIGNMENT: {
         AstAssignment *assignment = AS_ASSIGNMENT(head);
@@ -204,71 +940,63 @@ static void ast_stmt_to_bytecode(BytecodeCompiler *compiler, AstStmt *head)
         compiler->flags = BCF_STORE_IDENT;
         ast_expr_to_bytecode(compiler, assignment->left);
         compiler->flags = BCF_LOAD_IDENT;
+        emit_free_temps(compiler);
     } break;
     case STMT_IF: {
         AstIf *if_ = AS_IF(head);
-        u32 endif_target;
+        Label else_label = LABEL_NEW;
+        Label end_label = LABEL_NEW;
         ast_expr_to_bytecode(compiler, if_->condition);
+        emit_free_temps(compiler);
         /* If false, jump to the else branch */
-        u32 else_target = writeu8(&compiler->bytecode, OP_BIZ);
-        writei(&compiler->bytecode, 0);
+        emit_branch(compiler, OP_BIZ, &else_label);
         /* If branch */
         ast_stmt_to_bytecode(compiler, if_->then);
         /* Skip the else branch */
         if (if_->else_) {
-            endif_target = writeu8(&compiler->bytecode, OP_CONSW);
-            writew(&compiler->bytecode, 0);
-            writeu8(&compiler->bytecode, OP_JMP);
+            emit_branch(compiler, OP_JMP, &end_label);
         }
         /* Else branch */
-        patchi(&compiler->bytecode, else_target,
-               compiler->bytecode.code_offset - else_target - sizeof(BytecodeImm));
+        bind_label(compiler, &else_label);
         if (if_->else_) {
             ast_stmt_to_bytecode(compiler, if_->else_);
-            /* Path the jump to end target */
-            patchw(&compiler->bytecode, endif_target, compiler->bytecode.code_offset);
+            bind_label(compiler, &end_label);
         }
 
     } break;
     case STMT_WHILE: {
         AstWhile *while_ = AS_WHILE(head);
-        u32 condition_target = compiler->bytecode.code_offset;
+        Label condition_label = LABEL_NEW;
+        Label end_label = LABEL_NEW;
+        bind_label(compiler, &condition_label);
         ast_expr_to_bytecode(compiler, while_->condition);
+        emit_free_temps(compiler);
         /* If condition is zero, skip body */
-        u32 end_target = writeu8(&compiler->bytecode, OP_BIZ);
-        writei(&compiler->bytecode, 0);
+        emit_branch(compiler, OP_BIZ, &end_label);
         /* Loop body */
         ast_stmt_to_bytecode(compiler, while_->body);
         /* Jump back to the condition */
-        writeu8(&compiler->bytecode, OP_CONSW);
-        writew(&compiler->bytecode, (BytecodeWord)condition_target);
-        writeu8(&compiler->bytecode, OP_JMP);
-        /* Patch the skip body jump */
-        patchi(&compiler->bytecode, end_target,
-               compiler->bytecode.code_offset - end_target - sizeof(BytecodeImm));
+        emit_branch(compiler, OP_JMP, &condition_label);
+        bind_label(compiler, &end_label);
     } break;
     case STMT_BLOCK: {
         AstBlock *block = AS_BLOCK(head);
         bool no_new_syms = block->symt_local->sym_len == 0;
-        u32 var_space_in_words = 0;
+        u32 n_vars = 0;
+        u32 heap_bytes = 0;
         if (!no_new_syms) {
-            compiler->locals = make_locals(compiler->locals);
-            /* Make space for each local variable */
-            u32 var_space = 0;
+            /*
+             * Every local gets a word in the frame. They are released when the block ends. The
+             * binder gave them the slots right above the locals of the enclosing blocks, which
+             * is where the stack is when the block starts.
+             */
             SymbolTable *symt = block->symt_local;
             for (u32 i = 0; i < symt->sym_len; i++) {
-                Symbol *sym = symt->symbols[i];
-                if (sym->kind == SYMBOL_LOCAL_VAR) {
-                    hashmap_put(&compiler->locals->map, sym->name.str, sym->name.len,
-                                (void *)(compiler->bytecode.code_offset + var_space + 1),
-                                sizeof(void *), false);
-                    // TODO: align? Question of performance.
-                    var_space += type_info_bit_size(sym->type_info);
-                }
+                n_vars += symt->symbols[i]->kind == SYMBOL_LOCAL_VAR;
             }
-            var_space_in_words = (var_space + sizeof(BytecodeWord) - 1) / sizeof(BytecodeWord);
-            writeu8(&compiler->bytecode, OP_PUSHN);
-            writei(&compiler->bytecode, (BytecodeImm)var_space_in_words);
+            writeu8(compiler->bytecode, OP_PUSHN);
+            writei(compiler->bytecode, (BytecodeImm)n_vars);
+            heap_bytes = alloc_aggregates(compiler, symt);
         }
 
         AstList *stmt = block->stmts;
@@ -277,14 +1005,49 @@ static void ast_stmt_to_bytecode(BytecodeCompiler *compiler, AstStmt *head)
         }
 
         if (!no_new_syms) {
-            writeu8(&compiler->bytecode, OP_POPN);
-            writei(&compiler->bytecode, (BytecodeImm)var_space_in_words);
-            Locals *old = compiler->locals;
-            compiler->locals = old->parent;
-            hashmap_free(&old->map);
-            free(old);
+            emit_free(compiler, heap_bytes);
+            compiler->heap_bytes -= heap_bytes;
+            writeu8(compiler->bytecode, OP_POPN);
+            writei(compiler->bytecode, (BytecodeImm)n_vars);
         }
     } break;
+    case STMT_RETURN: {
+        AstSingle *stmt = AS_SINGLE(head);
+        if (stmt->node != NULL) {
+            ast_expr_to_bytecode(compiler, (AstExpr *)stmt->node);
+        } else {
+            writeu8(compiler->bytecode, OP_CONSW);
+            writew(compiler->bytecode, 0);
+        }
+        /* The blocks it returns from don't get to give back what they allocated */
+        emit_free(compiler, compiler->heap_bytes + compiler->temp_bytes);
+        compiler->temp_bytes = 0;
+        if (stmt->node != NULL && is_aggregate(((AstExpr *)stmt->node)->type)) {
+            /*
+             * The value is in memory that was just given back, so it is copied down to where the
+             * allocations of the function started. That memory now belongs to the caller, and
+             * allocating it again gives back its address without touching what was copied.
+             */
+            u32 n_bytes = heap_size(((AstExpr *)stmt->node)->type);
+            writeu8(compiler->bytecode, OP_ALLOC);
+            write_wide_imm(compiler->bytecode, n_bytes);
+            writeu8(compiler->bytecode, OP_MEMCPY);
+            write_wide_imm(compiler->bytecode, n_bytes);
+            writeu8(compiler->bytecode, OP_FREE);
+            write_wide_imm(compiler->bytecode, n_bytes);
+            writeu8(compiler->bytecode, OP_ALLOC);
+            write_wide_imm(compiler->bytecode, n_bytes);
+        }
+        writeu8(compiler->bytecode, OP_RET);
+        writei(compiler->bytecode, compiler->func->n_params);
+    } break;
+    case STMT_EXPR: {
+        /* A call whose result is thrown away */
+        ast_expr_to_bytecode(compiler, (AstExpr *)AS_SINGLE(head)->node);
+        writeu8(compiler->bytecode, OP_POPN);
+        writei(compiler->bytecode, 1);
+        emit_free_temps(compiler);
+    } break;
     case STMT_PRINT: {
         AstList *stmt = AS_LIST(head);
         u8 n_args = 0;
@@ -292,98 +1055,486 @@ static void ast_stmt_to_bytecode(BytecodeCompiler *compiler, AstStmt *head)
             n_args++;
             ast_expr_to_bytecode(compiler, (AstExpr *)n->this);
         }
-        writeu8(&compiler->bytecode, OP_PRINT);
-        writeu8(&compiler->bytecode, n_args);
+        writeu8(compiler->bytecode, OP_PRINT);
+        writeu8(compiler->bytecode, n_args);
+        emit_free_temps(compiler);
     } break;
     }
 }
 
-void ast_func_to_bytecode(BytecodeCompiler *compiler, AstFunc *func)
+static void ast_func_to_bytecode(BytecodeCompiler *compiler, AstFunc *func, BytecodeFunc *bfunc)
 {
     assert(func->body != NULL);
+    Bytecode *b = compiler->bytecode;
+    bfunc->code_offset = b->code_offset;
+    compiler->func = bfunc;
+    compiler->heap_bytes = 0;
+    compiler->temp_bytes = 0;
+
+    /*
+     * Structs and arrays are passed by their address. The callee copies them so the caller's
+     * stay as they are. The parameters are found through the scope of the body, so a body that
+     * is a single statement uses them in place.
+     */
+    SymbolTable *params = NULL;
+    if (func->body->kind == STMT_BLOCK) {
+        params = AS_BLOCK(func->body)->symt_local->parent;
+    }
+    for (u32 i = 0; params != NULL && i < params->sym_len; i++) {
+        Symbol *sym = params->symbols[i];
+        if (sym->kind != SYMBOL_PARAM || !is_aggregate(sym->type_info)) {
+            continue;
+        }
+        writeu8(b, OP_LOADL);
+        writei(b, frame_offset(sym));
+        writeu8(b, OP_ALLOC);
+        write_wide_imm(b, heap_size(sym->type_info));
+        writeu8(b, OP_STOREL);
+        writei(b, frame_offset(sym));
+        writeu8(b, OP_LOADL);
+        writei(b, frame_offset(sym));
+        writeu8(b, OP_MEMCPY);
+        write_wide_imm(b, type_size(sym->type_info));
+        compiler->heap_bytes += heap_size(sym->type_info);
+    }
+
     ast_stmt_to_bytecode(compiler, func->body);
-    writeu8(&compiler->bytecode, OP_RETURN);
+    /* Falling of the end returns 0 */
+    emit_free(compiler, compiler->heap_bytes);
+    writeu8(compiler->bytecode, OP_CONSW);
+    writew(compiler->bytecode, 0);
+    writeu8(compiler->bytecode, OP_RET);
+    writei(compiler->bytecode, bfunc->n_params);
 }
 
-Bytecode ast_to_bytecode(AstRoot *root)
+/* Compiles every function with a body. Execution starts at main, or the first function. */
+Bytecode *ast_to_bytecode(Arena *arena, AstRoot *root)
 {
     assert(root->funcs.head != NULL);
+    Bytecode *bytecode = m_arena_alloc_tagged(arena, sizeof(Bytecode), MEM_TAG_BYTECODE);
+    bytecode_init(bytecode, arena);
     BytecodeCompiler compiler;
-    bytecode_compiler_init(&compiler);
+    bytecode_compiler_init(&compiler, arena, bytecode);
 
-    ast_func_to_bytecode(&compiler, AS_FUNC(root->funcs.head->this));
+    /* Fill in the function table up front so calls can refer to functions defined later */
+    u32 n_funcs = 0;
+    for (AstListNode *n = root->funcs.head; n != NULL; n = n->next) {
+        n_funcs += AS_FUNC(n->this)->body != NULL;
+    }
+    bytecode->funcs = m_arena_alloc_tagged(arena, sizeof(BytecodeFunc) * n_funcs,
+                                           MEM_TAG_BYTECODE);
+    for (AstListNode *n = root->funcs.head; n != NULL; n = n->next) {
+        AstFunc *func = AS_FUNC(n->this);
+        if (func->body == NULL) {
+            continue;
+        }
+        u32 idx = bytecode->n_funcs++;
+        bytecode->funcs[idx] = (BytecodeFunc){ .name = func->name,
+                                               .n_params = (u16)func->parameters.len };
+        func_table_put(&compiler.funcs, func->name, idx);
+        if (STR8VIEW_EQUAL(func->name, STR8_LIT("main"))) {
+            bytecode->entry = idx;
+        }
+    }
+    assert(n_funcs > 0);
+
+    /*
+     * Every attempt widens at least one more branch, and branches never go back to being short,
+     * so this terminates. In practice programs that need a second attempt are very rare.
+     */
+    while (1) {
+        u32 idx = 0;
+        for (AstListNode *n = root->funcs.head; n != NULL; n = n->next) {
+            AstFunc *func = AS_FUNC(n->this);
+            if (func->body != NULL) {
+                ast_func_to_bytecode(&compiler, func, &bytecode->funcs[idx++]);
+            }
+        }
+        if (!compiler.needs_relaxing)
+            break;
+        bytecode->code_offset = 0;
+        compiler.n_branches = 0;
+        compiler.needs_relaxing = false;
+    }
+    bytecode_max_stack(bytecode);
 
-    bytecode_compiler_free(&compiler);
-    return compiler.bytecode;
+    return bytecode;
 }
 
-Bytecode fib_test(void)
+Bytecode *fib_test(Arena *arena, BytecodeWord n)
 {
     /*
     func fib(n: s32): s32
     begin
-        if n = 0 then return 0
-        if n = 1 then return 1
-        return fib(n - 1) + fib(n - 2)
+        if n < 2 then return n
+        return fib(n - 2) + fib(n - 1)
     end
 
     func main(): s32
     begin
-        print fib(20)
-        return 0
+        return fib(n)
     end
     */
 
-    Bytecode b = { 0 };
+    Bytecode *b = m_arena_alloc_tagged(arena, sizeof(Bytecode), MEM_TAG_BYTECODE);
+    bytecode_init(b, arena);
+    b->n_funcs = 2;
+    b->funcs = m_arena_alloc_tagged(arena, sizeof(BytecodeFunc) * b->n_funcs, MEM_TAG_BYTECODE);
+    b->funcs[0] = (BytecodeFunc){ .name = STR8_LIT("fib"), .n_params = 1 };
+    b->funcs[1] = (BytecodeFunc){ .name = STR8_LIT("main"), .n_params = 0 };
+    b->entry = 1;
+    /* Only for the branches */
+    BytecodeCompiler compiler;
+    bytecode_compiler_init(&compiler, arena, b);
+    Label else_label = LABEL_NEW;
+
+    /* fib */
+    b->funcs[0].code_offset = b->code_offset;
+    // n < 2
+    writeu8(b, OP_CONSW);
+    writew(b, 2);
+    writeu8(b, OP_LOADL);
+    writei(b, 0);
+    writeu8(b, OP_LE);
+    emit_branch(&compiler, OP_BIZ, &else_label);
+    // return n
+    writeu8(b, OP_LOADL);
+    writei(b, 0);
+    writeu8(b, OP_RET);
+    writei(b, 1);
+    bind_label(&compiler, &else_label);
+    // fib(n - 2)
+    writeu8(b, OP_CONSW);
+    writew(b, 2);
+    writeu8(b, OP_LOADL);
+    writei(b, 0);
+    writeu8(b, OP_SUBW);
+    writeu8(b, OP_CALL);
+    writei(b, 0);
+    // fib(n - 1)
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, 0);
+    writeu8(b, OP_SUBW);
+    writeu8(b, OP_CALL);
+    writei(b, 0);
+    // return fib(n - 2) + fib(n - 1)
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_RET);
+    writei(b, 1);
+
+    /* main */
+    b->funcs[1].code_offset = b->code_offset;
+    writeu8(b, OP_CONSW);
+    writew(b, n);
+    writeu8(b, OP_CALL);
+    writei(b, 0);
+    writeu8(b, OP_RET);
+    writei(b, 0);
+
+    bytecode_max_stack(b);
+    return b;
+}
+
+Bytecode *loop_test(Arena *arena, BytecodeWord n)
+{
     /*
-       var i: s32
+    func main(): s32
+    begin
+        var i: s32, sum: s32
         i := 0
-        while i < 10 do
+        sum := 0
+        while i < n do
         begin
-            print i
+            sum := sum + i
             i := i + 1
         end
-     */
+        return sum
+    end
+    */
+
+    Bytecode *b = m_arena_alloc_tagged(arena, sizeof(Bytecode), MEM_TAG_BYTECODE);
+    bytecode_init(b, arena);
+    b->n_funcs = 1;
+    b->funcs = m_arena_alloc_tagged(arena, sizeof(BytecodeFunc), MEM_TAG_BYTECODE);
+    b->funcs[0] = (BytecodeFunc){ .name = STR8_LIT("main"), .n_params = 0, .code_offset = 0 };
+    b->entry = 0;
+    BytecodeImm i = FRAME_HEADER_WORDS;
+    BytecodeImm sum = FRAME_HEADER_WORDS + 1;
+    BytecodeCompiler compiler;
+    bytecode_compiler_init(&compiler, arena, b);
+    Label loop_label = LABEL_NEW;
+    Label end_label = LABEL_NEW;
+
+    writeu8(b, OP_PUSHN);
+    writei(b, 2);
+    // i := 0, sum := 0
+    writeu8(b, OP_CONSW);
+    writew(b, 0);
+    writeu8(b, OP_STOREL);
+    writei(b, i);
+    writeu8(b, OP_CONSW);
+    writew(b, 0);
+    writeu8(b, OP_STOREL);
+    writei(b, sum);
+
+    // while i < n
+    bind_label(&compiler, &loop_label);
+    writeu8(b, OP_CONSW);
+    writew(b, n);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_LE);
+    emit_branch(&compiler, OP_BIZ, &end_label);
+    // sum := sum + i
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_LOADL);
+    writei(b, sum);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_STOREL);
+    writei(b, sum);
+    // i := i + 1
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_STOREL);
+    writei(b, i);
+    emit_branch(&compiler, OP_JMP, &loop_label);
+    bind_label(&compiler, &end_label);
+
+    // return sum
+    writeu8(b, OP_LOADL);
+    writei(b, sum);
+    writeu8(b, OP_RET);
+    writei(b, 0);
+
+    bytecode_max_stack(b);
+    return b;
+}
 
-    // var i: s32
-    writeu8(&b, OP_PUSHN);
-    writei(&b, 1);
-    // i := 0
-    writeu8(&b, OP_CONSW);
-    writew(&b, 0);
-    writeu8(&b, OP_STOREL);
-    writei(&b, 0);
-
-    // i < 10 -> 10 - i == 0
-    u32 if_start = b.code_offset;
-    writeu8(&b, OP_LOADL);
-    writei(&b, 0);
-    writeu8(&b, OP_CONSW);
-    writew(&b, 10);
-    writeu8(&b, OP_SUBW);
-    u32 else_target = writeu8(&b, OP_BIZ);
-    writei(&b, 0);
-
-    // print i
-    writeu8(&b, OP_LOADL);
-    writei(&b, 0);
-    writeu8(&b, OP_PRINT);
-    writeu8(&b, 1);
+Bytecode *arith_test(Arena *arena, BytecodeWord n)
+{
+    /*
+    func main(): s32
+    begin
+        var i: s32, x: s32
+        i := 0
+        x := 0
+        while i < n do
+        begin
+            x := (x * 3 + i * 5 - (x >> 3)) >> 2
+            i := i + 1
+        end
+        return x
+    end
+    */
+
+    Bytecode *b = m_arena_alloc_tagged(arena, sizeof(Bytecode), MEM_TAG_BYTECODE);
+    bytecode_init(b, arena);
+    b->n_funcs = 1;
+    b->funcs = m_arena_alloc_tagged(arena, sizeof(BytecodeFunc), MEM_TAG_BYTECODE);
+    b->funcs[0] = (BytecodeFunc){ .name = STR8_LIT("main"), .n_params = 0, .code_offset = 0 };
+    b->entry = 0;
+    BytecodeImm i = FRAME_HEADER_WORDS;
+    BytecodeImm x = FRAME_HEADER_WORDS + 1;
+    BytecodeCompiler compiler;
+    bytecode_compiler_init(&compiler, arena, b);
+    Label loop_label = LABEL_NEW;
+    Label end_label = LABEL_NEW;
+
+    writeu8(b, OP_PUSHN);
+    writei(b, 2);
+    // i := 0, x := 0
+    writeu8(b, OP_CONSW);
+    writew(b, 0);
+    writeu8(b, OP_STOREL);
+    writei(b, i);
+    writeu8(b, OP_CONSW);
+    writew(b, 0);
+    writeu8(b, OP_STOREL);
+    writei(b, x);
+
+    // while i < n
+    bind_label(&compiler, &loop_label);
+    writeu8(b, OP_CONSW);
+    writew(b, n);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_LE);
+    emit_branch(&compiler, OP_BIZ, &end_label);
+    // x := (x * 3 + i * 5 - (x >> 3)) >> 2
+    writeu8(b, OP_CONSW);
+    writew(b, 2);
+    writeu8(b, OP_CONSW);
+    writew(b, 3);
+    writeu8(b, OP_LOADL);
+    writei(b, x);
+    writeu8(b, OP_RSHIFT);
+    writeu8(b, OP_CONSW);
+    writew(b, 5);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_MULW);
+    writeu8(b, OP_CONSW);
+    writew(b, 3);
+    writeu8(b, OP_LOADL);
+    writei(b, x);
+    writeu8(b, OP_MULW);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_SUBW);
+    writeu8(b, OP_RSHIFT);
+    writeu8(b, OP_STOREL);
+    writei(b, x);
+    // i := i + 1
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_STOREL);
+    writei(b, i);
+    emit_branch(&compiler, OP_JMP, &loop_label);
+    bind_label(&compiler, &end_label);
+
+    // return x
+    writeu8(b, OP_LOADL);
+    writei(b, x);
+    writeu8(b, OP_RET);
+    writei(b, 0);
+
+    bytecode_max_stack(b);
+    return b;
+}
+
+Bytecode *branch_test(Arena *arena, BytecodeWord n)
+{
+    /*
+    func main(): s32
+    begin
+        var i: s32, even: s32, odd: s32, big: s32
+        i := 0
+        even := 0
+        odd := 0
+        big := 0
+        while i < n do
+        begin
+            if (i >> 1 << 1) = i then even := even + 1 else odd := odd + 1
+            if i > n / 2 then big := big + 1
+            i := i + 1
+        end
+        return odd + big
+    end
+    */
+
+    Bytecode *b = m_arena_alloc_tagged(arena, sizeof(Bytecode), MEM_TAG_BYTECODE);
+    bytecode_init(b, arena);
+    b->n_funcs = 1;
+    b->funcs = m_arena_alloc_tagged(arena, sizeof(BytecodeFunc), MEM_TAG_BYTECODE);
+    b->funcs[0] = (BytecodeFunc){ .name = STR8_LIT("main"), .n_params = 0, .code_offset = 0 };
+    b->entry = 0;
+    BytecodeImm i = FRAME_HEADER_WORDS;
+    BytecodeImm even = FRAME_HEADER_WORDS + 1;
+    BytecodeImm odd = FRAME_HEADER_WORDS + 2;
+    BytecodeImm big = FRAME_HEADER_WORDS + 3;
+    BytecodeCompiler compiler;
+    bytecode_compiler_init(&compiler, arena, b);
+    Label loop_label = LABEL_NEW;
+    Label end_label = LABEL_NEW;
+    Label else_label = LABEL_NEW;
+    Label endif_label = LABEL_NEW;
+    Label skip_label = LABEL_NEW;
 
+    writeu8(b, OP_PUSHN);
+    writei(b, 4);
+    // i := 0, even := 0, odd := 0, big := 0
+    for (BytecodeImm slot = i; slot <= big; slot++) {
+        writeu8(b, OP_CONSW);
+        writew(b, 0);
+        writeu8(b, OP_STOREL);
+        writei(b, slot);
+    }
+
+    // while i < n
+    bind_label(&compiler, &loop_label);
+    writeu8(b, OP_CONSW);
+    writew(b, n);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_LE);
+    emit_branch(&compiler, OP_BIZ, &end_label);
+    // if (i >> 1 << 1) = i
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_RSHIFT);
+    writeu8(b, OP_LSHIFT);
+    writeu8(b, OP_SUBW);
+    writeu8(b, OP_NOT);
+    emit_branch(&compiler, OP_BIZ, &else_label);
+    // even := even + 1
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, even);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_STOREL);
+    writei(b, even);
+    emit_branch(&compiler, OP_JMP, &endif_label);
+    // else odd := odd + 1
+    bind_label(&compiler, &else_label);
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, odd);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_STOREL);
+    writei(b, odd);
+    bind_label(&compiler, &endif_label);
+    // if i > n / 2
+    writeu8(b, OP_CONSW);
+    writew(b, n / 2);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_GE);
+    emit_branch(&compiler, OP_BIZ, &skip_label);
+    // big := big + 1
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, big);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_STOREL);
+    writei(b, big);
+    bind_label(&compiler, &skip_label);
     // i := i + 1
-    writeu8(&b, OP_LOADL);
-    writei(&b, 0);
-    writeu8(&b, OP_CONSW);
-    writew(&b, 1);
-    writeu8(&b, OP_ADDW);
-    writeu8(&b, OP_STOREL);
-    writei(&b, 0);
-
-    writeu8(&b, OP_CONSW);
-    writew(&b, (BytecodeWord)if_start);
-    writeu8(&b, OP_JMP);
-    patchi(&b, else_target, b.code_offset - else_target - sizeof(BytecodeImm));
-
-    writeu8(&b, OP_RETURN);
+    writeu8(b, OP_CONSW);
+    writew(b, 1);
+    writeu8(b, OP_LOADL);
+    writei(b, i);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_STOREL);
+    writei(b, i);
+    emit_branch(&compiler, OP_JMP, &loop_label);
+    bind_label(&compiler, &end_label);
+
+    // return odd + big
+    writeu8(b, OP_LOADL);
+    writei(b, big);
+    writeu8(b, OP_LOADL);
+    writei(b, odd);
+    writeu8(b, OP_ADDW);
+    writeu8(b, OP_RET);
+    writei(b, 0);
+
+    bytecode_max_stack(b);
     return b;
 }
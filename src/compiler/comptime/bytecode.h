@@ -19,11 +19,13 @@
 
 
 #include "base/nicc.h"
+#include "base/sac_single.h"
 #include "base/types.h"
 #include "compiler/ast.h"
 
 typedef s64 BytecodeWord;
 typedef u16 BytecodeImm; // Value immeditely preceeding certain instructions
+typedef u32 BytecodeWideImm; // Used by the long form of instructions when an imm is too small
 
 typedef enum {
     /* arithmetic */
@@ -37,10 +39,21 @@ typedef enum {
     OP_LE, // pop a and pop b. Push 1 if a =< b
     OP_NOT,
 
-    /* Branching */
-    OP_JMP, // pop and uppdate ip
+    /*
+     * Branching. The imm is a signed offset from the end of the instruction, an s16 in the short
+     * forms and an s32 in the wide ones.
+     */
+    OP_JMP, // add imm to ip
+    OP_JMPW, // OP_JMP with a wide imm
     OP_BIZ, // pop and add imm to ip if popped value is zero
     OP_BNZ, // pop and add imm to ip if popped value is not zero
+    OP_BIZW, // OP_BIZ with a wide imm
+    OP_BNZW, // OP_BNZ with a wide imm
+    /* Compare and branch. Pop a and pop b, add imm to ip if the comparison holds */
+    OP_BEQ,
+    OP_BNE,
+    OP_BLE,
+    OP_BGE,
 
     /* stack operations */
     OP_CONSW, // push next word
@@ -48,9 +61,29 @@ typedef enum {
     OP_POPN, // remove space for n words on
     OP_LOADL, // push value at next imm + bp
     OP_STOREL, // pop and store value at next imm + bp
+    OP_INCL, // add the second imm, as an s16, to the value at first imm + bp
+
+    /* Functions */
+    OP_CALL, // call the function with the index in the next imm. Arguments are on the stack
+    OP_CALLN, // OP_CALL for the builtin with the index in the next imm, see builtin.h
+    OP_RET, // pop the return value, tear down the frame and push it back. Next imm is n_params
+
+    /* AST handles, see ast_handle.h. The imm is the index of the field in ast_fields */
+    OP_LOADF, // pop a handle and push the field
+    OP_STOREF, // pop a handle and a value, and store the value in the field
+
+    /*
+     * The heap, see HEAP_NULL_BYTES. Loads and stores add the imm to the address, and the MemWidth
+     * in the byte after it says how much they touch.
+     */
+    OP_LOADM, // pop an address and push what is at imm + address
+    OP_STOREM, // pop an address and a value, and store the value at imm + address
+    OP_MEMCPY, // pop dst and pop src, and copy the next wide imm of bytes from src to dst
+    OP_MEMSET, // pop dst and pop a byte, and set the next wide imm of bytes at dst to it
+    OP_ALLOC, // push the address of the next wide imm of bytes, allocated on top of the heap
+    OP_FREE, // give back the next wide imm of bytes on top of the heap
 
     OP_PRINT,
-    OP_RETURN,
 
     OP_TYPE_LEN,
 } OpCode;
@@ -58,18 +91,70 @@ typedef enum {
 
 extern char *op_code_str_map[OP_TYPE_LEN];
 
+/* Size in bytes, and if the value is sign extended when loaded */
+typedef enum {
+    MEM_8 = 1,
+    MEM_16 = 2,
+    MEM_32 = 4,
+    MEM_64 = 8,
+    MEM_SIZE_MASK = 0xf,
+    MEM_SIGNED = 0x10,
+} MemWidth;
+
+
+/*
+ * A frame on the VM stack, with bp pointing at the first argument:
+ *   bp + 0 .. n_params - 1     arguments, pushed by the caller
+ *   bp + n_params              return address, as an offset into the code
+ *   bp + n_params + 1          the caller's bp
+ *   bp + n_params + 2 ..       locals
+ */
+#define FRAME_HEADER_WORDS 2
+#define FRAME_NO_RETURN -1 // Return address of the entry function, returning from it halts the VM
+
+/*
+ * The heap of a run, where globals, structs and arrays live. Addresses are offsets into it, so the
+ * VM can check them against what is allocated. The first HEAP_NULL_BYTES are never handed out, so
+ * 0 is null. Then come the globals, and on top of them what OP_ALLOC hands out. A block or function
+ * gives back what it allocated with OP_FREE when it ends, so the heap grows and shrinks like the
+ * stack. A struct or array that is returned is copied down to where the callee's allocations
+ * started, and the caller gives it back when the statement with the call ends. Sizes are rounded
+ * up to whole words to keep everything aligned.
+ */
+#define HEAP_NULL_BYTES 8
 
 typedef struct {
-    // TODO: Pool allocated or something
-    u8 code[4096];
-    u32 code_offset;
-} Bytecode;
+    Str8 name;
+    u32 code_offset; // Where the function starts
+    u16 n_params;
+    /*
+     * Most words the function has on the stack above its frame header, locals and temporaries,
+     * so a call can check up front that the whole frame fits. See bytecode_max_stack()
+     */
+    u32 max_stack;
+    /*
+     * @NULLABLE. First node the compiler has no code for, and why. The function still compiles,
+     * with the node standing in for a 0, but must not be run. See comptime_check_compiled()
+     */
+    AstNode *unsupported;
+    char *unsupported_msg;
+} BytecodeFunc;
 
-typedef struct locals_t Locals;
-struct locals_t {
-    HashMap map; // Key: Symbol identfier, Value: code_offset + 1 (so we can use 0x0 as NULL).
-    Locals *parent;
-};
+/*
+ * Code segment that grows on its arena as instructions are written. Always passed around by
+ * pointer. The code may move when it grows, so don't hold on to pointers into it while writing.
+ * All functions in a program share one code segment and are found through the function table.
+ */
+typedef struct {
+    u8 *code;
+    u32 code_offset; // Where the next instruction is written, i.e. the length of the code
+    u32 code_cap;
+    Arena *arena;
+    BytecodeFunc *funcs; // OP_CALL imms index into this
+    u32 n_funcs;
+    u32 entry; // Function the VM starts in
+    u32 globals_size; // In bytes. Globals come first on the heap, right after the null bytes
+} Bytecode;
 
 typedef enum {
     BCF_STORE_IDENT = 1,
@@ -77,15 +162,58 @@ typedef enum {
 } BytecodeCompilerFlags;
 
 typedef struct {
-    Bytecode bytecode;
-    Locals *locals; /* NOTE: Root Locals object also stores global functions and variables */
+    Arena *arena;
+    Bytecode *bytecode;
+    HashMap funcs; // See func_table_init()
     BytecodeCompilerFlags flags;
+    BytecodeFunc *func; // Function being compiled
+    HashMap globals; // Global name to its address, laid out as they are first used
+    u32 heap_bytes; // Allocated by the function being compiled so far, given back on return
+    u32 temp_bytes; // Structs and arrays returned to the statement being compiled
+    /*
+     * Forward branches are emitted in the short form unless they are known to need the wide one.
+     * If a short branch can't reach its target it is marked here and the function is compiled
+     * again. Indexed by the order the branches are emitted in.
+     */
+    bool *wide_branches;
+    u32 wide_branches_cap;
+    u32 n_branches;
+    bool needs_relaxing;
 } BytecodeCompiler;
 
 
-Bytecode ast_to_bytecode(AstRoot *root);
-void disassemble(Bytecode b);
-
-Bytecode fib_test(void);
+/*
+ * Function name to its index in the function table + 1, so 0x0 can be NULL. Calls are resolved by
+ * name since AstCall has no symbol. Parameters and locals need no lookup, they carry the frame
+ * slot the binder gave them.
+ */
+void func_table_init(HashMap *funcs, Arena *arena);
+void func_table_put(HashMap *funcs, Str8 name, u32 idx);
+u32 func_table_get(HashMap *funcs, Str8 name);
+void bytecode_init(Bytecode *b, Arena *arena);
+Bytecode *ast_to_bytecode(Arena *arena, AstRoot *root);
+void disassemble(Bytecode *b);
+/* Prints one instruction, without a newline, and returns the offset of the next */
+u32 disassemble_instruction(Bytecode *b, u32 offset);
+/* Size of the instruction, operands included */
+u32 bytecode_op_len(OpCode op);
+/* The function the code at offset belongs to */
+BytecodeFunc *bytecode_func_at(Bytecode *b, u32 offset);
+/* Where the code of func ends, functions are laid out one after the other */
+u32 bytecode_func_end(Bytecode *b, BytecodeFunc *func);
+/*
+ * Fills in max_stack of every function once the code is done. The peephole pass can run after,
+ * fusing instructions never takes more stack.
+ */
+void bytecode_max_stack(Bytecode *b);
+
+/* fib(n) by hand, for testing and benchmarking the VM */
+Bytecode *fib_test(Arena *arena, BytecodeWord n);
+/* Sums 0 to n - 1 in a while loop */
+Bytecode *loop_test(Arena *arena, BytecodeWord n);
+/* Loop with a long arithmetic expression in the body */
+Bytecode *arith_test(Arena *arena, BytecodeWord n);
+/* Loop with an if/else and an if in the body */
+Bytecode *branch_test(Arena *arena, BytecodeWord n);
 
 #endif /* BYTECODE_H */
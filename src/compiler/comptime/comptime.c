@@ -0,0 +1,611 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/comptime.h"
+#include "base/nag.h"
+#include "base/pool.h"
+#include "base/str.h"
+#include "compiler/comptime/ast_handle.h"
+#include "compiler/comptime/peephole.h"
+#include "compiler/error.h"
+#include "compiler/mem_report.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A file in COMPTIME_CACHE_DIR, named after its key */
+typedef struct {
+    char magic[4]; // COMPTIME_ENTRY_MAGIC
+    u32 version; // COMPTIME_CACHE_VERSION
+    u64 key;
+    BytecodeWord value;
+} ComptimeEntry;
+
+#define COMPTIME_ENTRY_MAGIC "MGCR"
+
+
+static void comptime_error(Compiler *c, AstCall *call, char *msg)
+{
+    Str8Builder sb = make_str_builder(error_handler_arena(c->e));
+    str_builder_append_u8(&sb, '@');
+    str_builder_append_str8(&sb, call->identifier);
+    str_builder_append_cstr(&sb, ": ", 2);
+    str_builder_append_cstr(&sb, msg, (u32)strlen(msg));
+    error_msg_str8(c->e, str_builder_end(&sb, true));
+}
+
+static BytecodeImm read_imm(u8 *at)
+{
+    BytecodeImm imm;
+    memcpy(&imm, at, sizeof(imm));
+    return imm;
+}
+
+static bool func_is_pure(Bytecode *b, u32 func_idx, bool *pure)
+{
+    BytecodeFunc *func = &b->funcs[func_idx];
+    u32 end = bytecode_func_end(b, func);
+    for (u32 offset = func->code_offset; offset < end; offset += bytecode_op_len(b->code[offset])) {
+        OpCode op = b->code[offset];
+        /*
+         * What a handle reaches isn't part of the key, and a node may change under it. Builtins
+         * allocate on the persist arena, which only the calling thread may do.
+         */
+        if (op == OP_PRINT || op == OP_LOADF || op == OP_STOREF || op == OP_CALLN ||
+            (op == OP_CALL && !pure[read_imm(&b->code[offset + 1])])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Every function starts out pure, then impurity spreads from callees to callers */
+static bool *find_pure_funcs(Bytecode *b, Arena *arena)
+{
+    bool *pure = m_arena_alloc_array(arena, bool, b->n_funcs);
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        pure[i] = true;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (u32 i = 0; i < b->n_funcs; i++) {
+            if (pure[i] && !func_is_pure(b, i, pure)) {
+                pure[i] = false;
+                changed = true;
+            }
+        }
+    }
+    return pure;
+}
+
+/* Marks func_idx and everything it can call */
+static void mark_reachable(Bytecode *b, u32 func_idx, bool *reachable)
+{
+    reachable[func_idx] = true;
+    BytecodeFunc *func = &b->funcs[func_idx];
+    u32 end = bytecode_func_end(b, func);
+    for (u32 offset = func->code_offset; offset < end; offset += bytecode_op_len(b->code[offset])) {
+        if (b->code[offset] == OP_CALL) {
+            BytecodeImm callee = read_imm(&b->code[offset + 1]);
+            if (!reachable[callee]) {
+                mark_reachable(b, callee, reachable);
+            }
+        }
+    }
+}
+
+/* First function marked in reachable with code the bytecode compiler had none for */
+static BytecodeFunc *find_unsupported(Bytecode *b, bool *reachable)
+{
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        if (reachable[i] && b->funcs[i].unsupported != NULL) {
+            return &b->funcs[i];
+        }
+    }
+    return NULL;
+}
+
+BytecodeFunc *comptime_find_unsupported(Compiler *c, Bytecode *b, u32 func_idx)
+{
+    bool *reachable = m_arena_alloc_array_zero(c->pass_arena, bool, b->n_funcs);
+    mark_reachable(b, func_idx, reachable);
+    return find_unsupported(b, reachable);
+}
+
+/* True if the reachable code can change the AST, through a handle or with a builtin */
+static bool may_rewrite(Bytecode *b, bool *reachable)
+{
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        if (!reachable[i]) {
+            continue;
+        }
+        BytecodeFunc *func = &b->funcs[i];
+        u32 end = bytecode_func_end(b, func);
+        for (u32 offset = func->code_offset; offset < end;
+             offset += bytecode_op_len(b->code[offset])) {
+            if (b->code[offset] == OP_STOREF || b->code[offset] == OP_CALLN) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static u64 hash_code(u64 hash, Bytecode *b, bool *reachable)
+{
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        if (reachable[i]) {
+            BytecodeFunc *func = &b->funcs[i];
+            u32 end = bytecode_func_end(b, func);
+            hash = str_hash(hash, func->name.str, func->name.len);
+            hash = str_hash(hash, b->code + func->code_offset, end - func->code_offset);
+        }
+    }
+    return hash;
+}
+
+static u32 find_func(Bytecode *b, Str8 name)
+{
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        if (STR8VIEW_EQUAL(b->funcs[i].name, name)) {
+            return i;
+        }
+    }
+    return b->n_funcs;
+}
+
+/*
+ * Only integer literals for now, there is nothing else the VM can take. A function with one more
+ * parameter than the call has arguments gets a handle to the declaration the call annotates as
+ * its first argument, see ast_handle.h. Handles can't be made up from literals, and the
+ * declaration can only be passed as a struct with a kind that the VM can check.
+ */
+static bool eval_args(Compiler *c, AstCall *call, AstFunc *decl, BytecodeWord **args, u32 *n_args,
+                      bool *takes_target)
+{
+    u32 n_literals = 0;
+    if (call->args != NULL) {
+        for (AstListNode *n = call->args->head; n != NULL; n = n->next) {
+            n_literals++;
+        }
+    }
+    u32 n_params = decl->parameters.len;
+    *takes_target = n_literals + 1 == n_params;
+    *n_args = n_literals + *takes_target;
+    if (*n_args != n_params) {
+        comptime_error(c, call, "Wrong number of arguments");
+        return false;
+    }
+    *args = m_arena_alloc_array(c->pass_arena, BytecodeWord, *n_args);
+    u32 i = 0;
+    if (*takes_target) {
+        u32 kinds = ast_handle_kinds(decl->parameters.vars[0].ast_type_info.name);
+        if (kinds == 0 || (kinds & AST_HANDLE_UNTAGGED) != 0 ||
+            decl->parameters.vars[0].ast_type_info.pointer_indirection > 1) {
+            comptime_error(c, call, "The declaration is passed as a handle to a node");
+            return false;
+        }
+        (*args)[i++] = (BytecodeWord)(uintptr_t)call->target;
+    }
+    if (call->args == NULL) {
+        return true;
+    }
+    for (AstListNode *n = call->args->head; n != NULL; n = n->next) {
+        AstLiteral *lit = AS_LITERAL(n->this);
+        AstTypeInfo param = decl->parameters.vars[i].ast_type_info;
+        if (lit->kind != EXPR_LITERAL || lit->lit_type != LIT_NUM ||
+            (ast_handle_type(param.name) && param.pointer_indirection <= 1)) {
+            comptime_error(c, call, "Arguments must be integer literals");
+            return false;
+        }
+        (*args)[i++] = str_view_to_u32(lit->literal, NULL);
+    }
+    return true;
+}
+
+static void entry_path(ComptimeCache *cache, u64 key, char *path, size_t len)
+{
+    snprintf(path, len, "%s/%016lx", cache->dir, key);
+}
+
+static bool disk_get(ComptimeCache *cache, u64 key, BytecodeWord *value)
+{
+    char path[256];
+    entry_path(cache, key, path, sizeof(path));
+    FILE *in = fopen(path, "rb");
+    if (in == NULL) {
+        return false;
+    }
+    ComptimeEntry entry;
+    bool ok = fread(&entry, sizeof(entry), 1, in) == 1 &&
+              memcmp(entry.magic, COMPTIME_ENTRY_MAGIC, sizeof(entry.magic)) == 0 &&
+              entry.version == COMPTIME_CACHE_VERSION && entry.key == key;
+    fclose(in);
+    *value = entry.value;
+    return ok;
+}
+
+/* The cache is only an optimization, so if it can't be written it is turned off */
+static void disk_put(ComptimeCache *cache, u64 key, BytecodeWord value)
+{
+    char path[256];
+    char tmp_path[272];
+    entry_path(cache, key, path, sizeof(path));
+    /* Compilations sharing the directory each write their own file, the rename picks one */
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+    ComptimeEntry entry = { .version = COMPTIME_CACHE_VERSION, .key = key, .value = value };
+    memcpy(entry.magic, COMPTIME_ENTRY_MAGIC, sizeof(entry.magic));
+
+    /* The directory is made on the first write, so compilations without calls leave no trace */
+    if ((mkdir(NATIVE_CACHE_DIR, 0755) != 0 && errno != EEXIST) ||
+        (mkdir(cache->dir, 0755) != 0 && errno != EEXIST)) {
+        fprintf(stderr, "metagenc: could not create %s: %s\n", cache->dir, strerror(errno));
+        cache->dir = NULL;
+        return;
+    }
+    FILE *out = fopen(tmp_path, "wb");
+    bool ok = out != NULL && fwrite(&entry, sizeof(entry), 1, out) == 1;
+    if (out != NULL) {
+        ok = fclose(out) == 0 && ok;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "metagenc: could not write %s: %s\n", path, strerror(errno));
+        remove(tmp_path);
+        cache->dir = NULL;
+    }
+}
+
+static void remember(ComptimeCache *cache, u64 key, BytecodeWord value)
+{
+    ComptimeResult *result = m_arena_alloc_struct(cache->arena, ComptimeResult);
+    *result = (ComptimeResult){ .key = key, .value = value };
+    comptime_result_map_put(&cache->results, &result->key, sizeof(result->key), result);
+}
+
+void comptime_cache_init(ComptimeCache *cache, Arena *persist_arena, char *dir)
+{
+    cache->arena = persist_arena;
+    comptime_result_map_init_arena_tagged(&cache->results, persist_arena, true, MEM_TAG_COMPTIME);
+    cache->dir = dir;
+    cache->hits = 0;
+    cache->disk_hits = 0;
+    cache->misses = 0;
+}
+
+/* One @call, from when it is resolved until its result is applied */
+typedef struct {
+    AstCall *call;
+    u32 func_idx;
+    BytecodeWord *args;
+    bool pure;
+    u32 returns_handle; // AST_KINDS_ of the handle the call returns, or 0 if it returns a word
+    bool may_rewrite; // Can store through a handle or make nodes, see may_rewrite()
+    u64 key; // Only for pure calls
+    ComptimeResult *memoized; // @NULLABLE. Found in the results of an earlier iteration
+    bool on_disk; // value came from the cache dir
+    s32 same_as; // An earlier call with the same key, or -1
+    AstNode **reads; // The declarations the call depends on, see call_reads()
+    u32 n_reads;
+    u32 wave;
+    VMMeter meter;
+    BytecodeWord value;
+} ComptimeJob;
+
+typedef struct {
+    Bytecode *b;
+    ComptimeJob **jobs;
+    CompilerOptions *options;
+    Arena *heaps; // One for every worker of the pool, see run_call()
+} ComptimeWave;
+
+/*
+ * What a call reads: the declaration it annotates, which a call can replace, and the declarations
+ * of every function its code can reach. funcs maps bytecode function indices to their AstFunc.
+ */
+static void call_reads(ComptimeJob *job, Arena *arena, AstNode **funcs, bool *reachable, u32 n)
+{
+    job->reads = m_arena_alloc(arena, sizeof(AstNode *) * (n + 1));
+    job->n_reads = 0;
+    if (job->call->target != NULL) {
+        job->reads[job->n_reads++] = job->call->target;
+    }
+    for (u32 i = 0; i < n; i++) {
+        if (reachable[i]) {
+            job->reads[job->n_reads++] = funcs[i];
+        }
+    }
+}
+
+static bool job_reads(ComptimeJob *job, AstNode *node)
+{
+    for (u32 i = 0; i < job->n_reads; i++) {
+        if (job->reads[i] == node) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Two calls conflict if either can replace a declaration the other reads */
+static bool jobs_conflict(ComptimeJob *a, ComptimeJob *b)
+{
+    return (a->call->target != NULL && job_reads(b, a->call->target)) ||
+           (b->call->target != NULL && job_reads(a, b->call->target));
+}
+
+static void run_wave_jobs(void *arg, u32 start, u32 end, Arena *scratch, u32 worker_id)
+{
+    (void)scratch;
+    ComptimeWave *wave = arg;
+    for (u32 i = start; i < end; i++) {
+        ComptimeJob *job = wave->jobs[i];
+        vm_meter_init(&job->meter, wave->options->comptime_fuel,
+                      wave->options->comptime_deadline_ms);
+        /* Pure code calls no builtins, so it never needs an arena */
+        job->value = run_call(wave->b, NULL, &wave->heaps[worker_id], &job->meter, job->func_idx,
+                              job->args);
+    }
+}
+
+/* Resolves a call and looks it up in the caches. Returns false if it was reported as an error */
+static bool prepare_job(Compiler *c, Bytecode *b, bool *pure, AstNode **funcs, ComptimeCache *cache,
+                        ComptimeJob *job)
+{
+    AstCall *call = job->call;
+    job->func_idx = find_func(b, call->identifier);
+    if (job->func_idx == b->n_funcs) {
+        comptime_error(c, call, "No function with a body by that name");
+        return false;
+    }
+    AstFunc *decl = AS_FUNC(funcs[job->func_idx]);
+    u32 n_args;
+    bool takes_target;
+    if (!eval_args(c, call, decl, &job->args, &n_args, &takes_target)) {
+        return false;
+    }
+
+    bool *reachable = m_arena_alloc_array_zero(c->pass_arena, bool, b->n_funcs);
+    mark_reachable(b, job->func_idx, reachable);
+    BytecodeFunc *unsupported = find_unsupported(b, reachable);
+    if (unsupported != NULL) {
+        /* Its bytecode has a 0 where the node is, running it would give the wrong result */
+        char msg[256];
+        snprintf(msg, sizeof(msg), "@%.*s: Can't run %.*s, %s", STR8VIEW_PRINT(call->identifier),
+                 STR8VIEW_PRINT(unsupported->name), unsupported->unsupported_msg);
+        error_node(c->e, msg, unsupported->unsupported);
+        return false;
+    }
+    call_reads(job, c->pass_arena, funcs, reachable, b->n_funcs);
+    job->may_rewrite = may_rewrite(b, reachable);
+    /* Handles are addresses in this compilation, they can't be kept for the next one */
+    job->returns_handle = decl->return_type.pointer_indirection <= 1
+                              ? ast_handle_kinds(decl->return_type.name)
+                              : 0;
+    job->pure = pure[job->func_idx] && !takes_target && job->returns_handle == 0;
+    job->memoized = NULL;
+    job->on_disk = false;
+    job->same_as = -1;
+    if (job->pure) {
+        u32 version = COMPTIME_CACHE_VERSION;
+        job->key = str_hash(STR_HASH_SEED, &version, sizeof(version));
+        job->key = hash_code(job->key, b, reachable);
+        job->key = str_hash(job->key, job->args, sizeof(BytecodeWord) * n_args);
+        job->key = ast_hash(job->key, call->target);
+        job->memoized = comptime_result_map_get(&cache->results, &job->key, sizeof(job->key));
+        if (job->memoized == NULL && cache->dir != NULL) {
+            job->on_disk = disk_get(cache, job->key, &job->value);
+        }
+    }
+    return true;
+}
+
+/*
+ * On the calling thread, in the order of the calls, so the output doesn't depend on scheduling.
+ * Returns true if the call ran and may have changed the AST.
+ */
+static bool apply_job(Compiler *c, Bytecode *b, ComptimeCache *cache, CompilerOptions *options,
+                      Arena *heap, ComptimeJob *job, ComptimeJob *jobs)
+{
+    Str8 name = job->call->identifier;
+    if (job->memoized != NULL) {
+        cache->hits++;
+        printf("@%.*s = %ld (memoized)\n", STR8VIEW_PRINT(name), job->memoized->value);
+        return false;
+    }
+    if (job->on_disk) {
+        cache->disk_hits++;
+        printf("@%.*s = %ld (cached)\n", STR8VIEW_PRINT(name), job->value);
+        remember(cache, job->key, job->value);
+        return false;
+    }
+    if (job->same_as != -1) {
+        /* Only counts as memoized if the first one made it into the results */
+        ComptimeResult *result = comptime_result_map_get(&cache->results, &job->key,
+                                                         sizeof(job->key));
+        if (result != NULL) {
+            cache->hits++;
+            printf("@%.*s = %ld (memoized)\n", STR8VIEW_PRINT(name), result->value);
+            return false;
+        }
+        job->meter = jobs[job->same_as].meter;
+        job->value = jobs[job->same_as].value;
+    }
+    if (!job->pure) {
+        vm_meter_init(&job->meter, options->comptime_fuel, options->comptime_deadline_ms);
+        job->value = run_call(b, c->persist_arena, heap, &job->meter, job->func_idx, job->args);
+    }
+    if (job->meter.stop != VM_STOP_NONE) {
+        Str8Builder sb = make_str_builder(c->pass_arena);
+        str_builder_append_u8(&sb, '@');
+        str_builder_append_str8(&sb, name);
+        comptime_report_stop(c, b, &job->meter, str_builder_end(&sb, true),
+                             options->comptime_deadline_ms);
+        return false;
+    }
+    if (job->returns_handle != 0) {
+        /* Printed as the kind of node it points at, untagged structs have none */
+        AstNode *node = (AstNode *)(uintptr_t)job->value;
+        char *what = "handle";
+        if (node == NULL) {
+            what = "null";
+        } else if ((job->returns_handle & AST_HANDLE_UNTAGGED) == 0) {
+            what = node_kind_str_map[node->kind];
+        }
+        printf("@%.*s = %s\n", STR8VIEW_PRINT(name), what);
+    } else {
+        printf("@%.*s = %ld\n", STR8VIEW_PRINT(name), job->value);
+    }
+    if (job->pure) {
+        cache->misses++;
+        remember(cache, job->key, job->value);
+        if (cache->dir != NULL) {
+            disk_put(cache, job->key, job->value);
+        }
+    }
+    return job->may_rewrite;
+}
+
+bool comptime_run_calls(Compiler *c, AstRoot *root, ComptimeCache *cache, CompilerOptions *options)
+{
+    if (root->calls.head == NULL) {
+        return false;
+    }
+    Bytecode *b = ast_to_bytecode(c->pass_arena, root);
+    bytecode_peephole(b);
+    bool *pure = find_pure_funcs(b, c->pass_arena);
+    /* Same order as ast_to_bytecode() gives the functions their indices */
+    AstNode **funcs = m_arena_alloc(c->pass_arena, sizeof(AstNode *) * b->n_funcs);
+    u32 n_funcs = 0;
+    for (AstListNode *n = root->funcs.head; n != NULL; n = n->next) {
+        if (AS_FUNC(n->this)->body != NULL) {
+            funcs[n_funcs++] = n->this;
+        }
+    }
+
+    u32 n_jobs = 0;
+    for (AstListNode *n = root->calls.head; n != NULL; n = n->next) {
+        n_jobs++;
+    }
+    ComptimeJob *jobs = m_arena_alloc(c->pass_arena, sizeof(ComptimeJob) * n_jobs);
+    n_jobs = 0;
+    for (AstListNode *n = root->calls.head; n != NULL; n = n->next) {
+        ComptimeJob *job = &jobs[n_jobs];
+        job->call = AS_CALL(n->this);
+        n_jobs += prepare_job(c, b, pure, funcs, cache, job);
+    }
+    assert(n_jobs <= U16_MAX);
+
+    /*
+     * An edge goes from every call to the later calls it conflicts with. A call runs in the wave
+     * after the last call it depends on, so the calls in a wave are independent of each other.
+     * A call that reuses the result of an earlier one also depends on it.
+     */
+    NAG_Graph graph = nag_make_graph(c->pass_arena, c->pass_arena, (NAG_Idx)n_jobs);
+    for (u32 i = 0; i < n_jobs; i++) {
+        for (u32 j = i + 1; j < n_jobs; j++) {
+            bool same_key = jobs[i].pure && jobs[j].pure && jobs[i].key == jobs[j].key;
+            bool reuses = same_key && jobs[i].same_as == -1 && jobs[j].same_as == -1;
+            if (reuses) {
+                jobs[j].same_as = (s32)i;
+            }
+            if (reuses || jobs_conflict(&jobs[i], &jobs[j])) {
+                nag_add_edge(&graph, (NAG_Idx)i, (NAG_Idx)j);
+            }
+        }
+    }
+    u32 n_waves = 0;
+    for (u32 i = 0; i < n_jobs; i++) {
+        jobs[i].wave = 0;
+    }
+    for (u32 i = 0; i < n_jobs; i++) {
+        for (NAG_GraphNode *edge = graph.neighbor_list[i]; edge != NULL; edge = edge->next) {
+            u32 wave = jobs[i].wave + 1;
+            jobs[edge->id].wave = wave > jobs[edge->id].wave ? wave : jobs[edge->id].wave;
+        }
+        n_waves = jobs[i].wave + 1 > n_waves ? jobs[i].wave + 1 : n_waves;
+    }
+
+    /* Pure calls that have to run go to the pool, the rest is done when the wave is applied */
+    ComptimeJob **to_run = m_arena_alloc(c->pass_arena, sizeof(ComptimeJob *) * n_jobs);
+    ComptimeWave wave = { .b = b, .jobs = to_run, .options = options };
+    /* The thread that made the pool is the last worker, and applies the waves */
+    u32 n_heaps = c->pool->n_workers + 1;
+    wave.heaps = m_arena_alloc(c->pass_arena, sizeof(Arena) * n_heaps);
+    for (u32 i = 0; i < n_heaps; i++) {
+        vm_heap_init(&wave.heaps[i]);
+    }
+    bool changed = false;
+    for (u32 w = 0; w < n_waves; w++) {
+        u32 n_run = 0;
+        for (u32 i = 0; i < n_jobs; i++) {
+            ComptimeJob *job = &jobs[i];
+            if (job->wave == w && job->pure && job->memoized == NULL && !job->on_disk &&
+                job->same_as == -1) {
+                to_run[n_run++] = job;
+            }
+        }
+        pool_parallel_for(c->pool, n_run, 1, run_wave_jobs, &wave);
+        for (u32 i = 0; i < n_jobs; i++) {
+            if (jobs[i].wave == w) {
+                changed |= apply_job(c, b, cache, options, &wave.heaps[n_heaps - 1], &jobs[i],
+                                     jobs);
+            }
+        }
+    }
+    for (u32 i = 0; i < n_heaps; i++) {
+        m_arena_release(&wave.heaps[i]);
+    }
+
+    error_handler_merge(c->e);
+    return changed;
+}
+
+void comptime_report_stop(Compiler *c, Bytecode *b, VMMeter *meter, Str8 call, u64 deadline_ms)
+{
+    char why[64];
+    if (meter->stop == VM_STOP_FUEL) {
+        snprintf(why, sizeof(why), "ran out of fuel (%lu)", meter->fuel);
+    } else if (meter->stop == VM_STOP_BAD_HANDLE) {
+        snprintf(why, sizeof(why), "used a null handle or one to the wrong kind of node");
+    } else if (meter->stop == VM_STOP_BAD_ARGUMENT) {
+        snprintf(why, sizeof(why), "passed a compiler func an argument out of range");
+    } else if (meter->stop == VM_STOP_NOT_COMPTIME) {
+        snprintf(why, sizeof(why), "called a compiler func outside of an @call");
+    } else if (meter->stop == VM_STOP_BAD_ADDRESS) {
+        snprintf(why, sizeof(why), "used a null pointer or one past what is allocated");
+    } else if (meter->stop == VM_STOP_HEAP_FULL) {
+        snprintf(why, sizeof(why), "ran out of heap");
+    } else if (meter->stop == VM_STOP_STACK_OVERFLOW) {
+        snprintf(why, sizeof(why), "ran out of stack");
+    } else if (meter->stop == VM_STOP_DIV_ZERO) {
+        snprintf(why, sizeof(why), "divided by zero");
+    } else {
+        snprintf(why, sizeof(why), "ran past its deadline of %lu ms", deadline_ms);
+    }
+    Str8 at = bytecode_func_at(b, meter->stop_offset)->name;
+    char msg[256];
+    int len = snprintf(msg, sizeof(msg), "Comptime call to %.*s %s at %04u in %.*s, after %lu fuel",
+                       STR8VIEW_PRINT(call), why, meter->stop_offset, STR8VIEW_PRINT(at),
+                       vm_meter_used(meter));
+    Str8Builder sb = make_str_builder(error_handler_arena(c->e));
+    str_builder_append_cstr(&sb, msg, len < (int)sizeof(msg) ? (u32)len : sizeof(msg) - 1);
+    error_msg_str8(c->e, str_builder_end(&sb, true));
+    error_handler_merge(c->e);
+}
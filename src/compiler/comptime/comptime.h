@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef COMPTIME_H
+#define COMPTIME_H
+
+#include "base/nicc.h"
+#include "base/sac_single.h"
+#include "base/types.h"
+#include "compiler/ast.h"
+#include "compiler/compiler.h"
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/native.h"
+#include "compiler/comptime/vm.h"
+
+/*
+ * Runs the @calls of a program on the stack VM, after typechecking.
+ *
+ * The pipeline goes back from here to type and symbol generation until the AST stops changing, so
+ * the same call on the same declaration comes up again and again. Calls to pure functions are
+ * memoized across those iterations. A function is pure if it doesn't print and only calls pure
+ * functions, there is nothing else comptime code can have an effect on. The result is keyed on:
+ *   the code of the function and every function it can reach
+ *   the argument values
+ *   ast_hash() of the declaration the call annotates
+ * so a call is only run again once one of them changed.
+ *
+ * Results are also kept in COMPTIME_CACHE_DIR, one file per key, so a later compilation skips the
+ * calls whose inputs are the same as last time. Entries are written to a temporary file first and
+ * renamed into place, so compilations running side by side never see half an entry.
+ *
+ * A call reads the declaration it annotates and the functions its code can reach, and can replace
+ * the declaration it annotates. Two calls depend on each other if one can replace something the
+ * other reads, and the later one in the source has to wait for the earlier one. The calls are
+ * split into waves along that graph. The pure calls of a wave run in parallel, each on its own VM
+ * on the thread pool. Then the results of the wave are applied on the calling thread in the order
+ * of the calls, which is also where the impure calls run, so the output and errors come out the
+ * same no matter how the calls were scheduled.
+ */
+
+#define COMPTIME_CACHE_DIR NATIVE_CACHE_DIR "/comptime"
+#define COMPTIME_CACHE_VERSION 2 // Part of every key, bump it when keys or entries change
+
+typedef struct {
+    u64 key;
+    BytecodeWord value; // What the function returned. Becomes the returned AST once there is one
+} ComptimeResult;
+
+HASHMAP_DEFINE(ComptimeResultMap, comptime_result_map, ComptimeResult *)
+
+typedef struct {
+    Arena *arena; // Persist arena, the results live as long as the compilation
+    ComptimeResultMap results; // Keys point at ComptimeResult.key
+    char *dir; // @NULLABLE. Where results are kept between compilations
+    u32 hits; // Found in results
+    u32 disk_hits; // Found in dir
+    u32 misses;
+} ComptimeCache;
+
+void comptime_cache_init(ComptimeCache *cache, Arena *persist_arena, char *dir);
+/*
+ * Runs every call in root->calls, bounded by the fuel and deadline in options. Failures are
+ * reported as compiler errors. Returns true if a call changed the AST.
+ */
+bool comptime_run_calls(Compiler *c, AstRoot *root, ComptimeCache *cache, CompilerOptions *options);
+/*
+ * @NULLABLE. First function func_idx can reach with code the bytecode compiler had none for, see
+ * BytecodeFunc.unsupported. Calls to func_idx are reported instead of run if there is one.
+ */
+BytecodeFunc *comptime_find_unsupported(Compiler *c, Bytecode *b, u32 func_idx);
+/* Turns a run stopped by its meter into a compiler error that names call and where it stopped */
+void comptime_report_stop(Compiler *c, Bytecode *b, VMMeter *meter, Str8 call, u64 deadline_ms);
+
+#endif /* COMPTIME_H */
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+/*
+ * Instruction dispatch for the VM loops.
+ *
+ * With VM_COMPUTED_GOTO every handler ends in its own indirect jump through a table of label
+ * addresses (labels as values, a GCC and Clang extension). Each handler then gets its own entry in
+ * the branch predictor, which learns which instruction tends to follow which. Otherwise the loop
+ * is a plain switch, where every instruction goes through the one shared indirect jump.
+ *
+ * Defaults to computed gotos on compilers that support them. Build with -DVM_COMPUTED_GOTO=0 to
+ * get the switch.
+ *
+ * A VM loop looks like:
+ *   VM_DISPATCH(opcode, table) {
+ *   VM_CASE(OP_FOO): ...; VM_NEXT(opcode, table);
+ *   VM_DEFAULT: ...
+ *   }
+ * where opcode is an expression that fetches the next opcode and table maps every possible
+ * opcode to VM_LABEL(op), or VM_DEFAULT_LABEL for unused ones.
+ */
+
+#ifndef VM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+#endif
+
+#if VM_COMPUTED_GOTO
+#define VM_DISPATCH(___opcode, ___table) goto *(___table)[(___opcode)];
+#define VM_NEXT(___opcode, ___table) goto *(___table)[(___opcode)]
+#define VM_CASE(___op) vm_label_##___op
+#define VM_DEFAULT vm_label_default
+#define VM_LABEL(___op) [___op] = &&vm_label_##___op
+#define VM_DEFAULT_LABEL &&vm_label_default
+#else
+#define VM_DISPATCH(___opcode, ___table) \
+    while (1)                            \
+        switch (___opcode)
+#define VM_NEXT(___opcode, ___table) break
+#define VM_CASE(___op) case ___op
+#define VM_DEFAULT default
+#endif
+
+/* For the slow paths inside a handler, so the compiler moves them out of the way */
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_UNLIKELY(___cond) __builtin_expect(!!(___cond), 0)
+#else
+#define VM_UNLIKELY(___cond) (___cond)
+#endif
+
+#endif /* DISPATCH_H */
@@ -0,0 +1,651 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/jit.h"
+#include "compiler/comptime/vm.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+Jit *jit_new(MetagenVM *vm)
+{
+    Bytecode *b = vm->b;
+    Jit *jit = malloc(sizeof(Jit));
+    jit->native = calloc(b->n_funcs, sizeof(JitFunc));
+    jit->stack_limit = vm->stack + STACK_MAX;
+    jit->fuel = &vm->meter->slice;
+    jit->vm = vm;
+    jit->calls = calloc(b->n_funcs, sizeof(u32));
+    jit->rejected = calloc(b->n_funcs, sizeof(bool));
+    jit->regions = NULL;
+    return jit;
+}
+
+void jit_release(Jit *jit)
+{
+    JitRegion *region = jit->regions;
+    while (region != NULL) {
+        JitRegion *next = region->next;
+#if JIT_SUPPORTED
+        munmap(region->mem, region->size);
+#endif
+        free(region);
+        region = next;
+    }
+    free(jit->native);
+    free(jit->calls);
+    free(jit->rejected);
+    free(jit);
+}
+
+_Noreturn void jit_abort(Jit *jit)
+{
+    longjmp(jit->abort, 1);
+}
+
+/* Called from compiled code that can't go on, offset is of the instruction. See emit_stop() */
+static void jit_stop(Jit *jit, u32 offset, VMStop stop)
+{
+    VMMeter *meter = jit->vm->meter;
+    meter->stop = stop;
+    meter->stop_offset = offset;
+    jit_abort(jit);
+}
+
+/* Called from compiled code when a charge finds the slice empty, offset is of the instruction */
+static void jit_refuel(Jit *jit, u32 offset)
+{
+    VMMeter *meter = jit->vm->meter;
+    if (!vm_meter_refill(meter)) {
+        meter->stop_offset = offset;
+        jit_abort(jit);
+    }
+}
+
+BytecodeWord jit_call(BytecodeWord *bp, Jit *jit, u32 func_idx)
+{
+    JitFunc native = jit_lookup(jit, func_idx);
+    if (native != NULL) {
+        return native(bp, jit);
+    }
+    return vm_call(jit, func_idx, bp);
+}
+
+#if JIT_SUPPORTED
+
+typedef struct {
+    u8 *code;
+    u32 len;
+    u32 cap;
+} Emitter;
+
+/* A rel32 to fill in once every instruction has been placed */
+typedef struct {
+    u32 at; // Of the rel32 in the machine code
+    u32 target; // Bytecode offset
+} JitFixup;
+
+typedef enum {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    RSP = 4,
+    RBP = 5,
+    RSI = 6,
+    RDI = 7,
+    R12 = 12,
+    R13 = 13,
+    R14 = 14,
+    R15 = 15,
+} Reg;
+
+/* Where the state of vm_loop() lives in compiled code. All callee saved */
+#define TOS RBX
+#define BP R12
+#define SP R13
+#define JIT R14
+#define LIMIT R15
+
+/* Opcodes that take a ModRM byte. Two byte ones start with 0x0f */
+#define X_ADD 0x03 // add r, r/m
+#define X_SUB 0x2b // sub r, r/m
+#define X_CMP 0x3b // cmp r, r/m
+#define X_CMP_MR 0x39 // cmp r/m, r
+#define X_IMUL 0x0faf // imul r, r/m
+#define X_MOV 0x8b // mov r, r/m
+#define X_MOV_MR 0x89 // mov r/m, r
+#define X_LEA 0x8d
+#define X_TEST 0x85
+#define X_MOVZX8 0x0fb6
+#define X_ALU_IMM 0x81 // The ModRM reg field picks the op, 0 is add
+#define X_ALU_IMM8 0x83
+#define X_SHIFT_CL 0xd3 // 4 is shl, 7 is sar
+#define X_IDIV 0xf7 // With 7 in the ModRM reg field
+
+/* Condition codes, jcc is 0x0f 0x80 + cc and setcc is 0x0f 0x90 + cc */
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_L 0xc
+#define CC_GE 0xd
+#define CC_LE 0xe
+#define CC_G 0xf
+
+static void emit_u8(Emitter *e, u8 byte)
+{
+    if (e->len == e->cap) {
+        e->cap = e->cap == 0 ? 256 : e->cap * 2;
+        e->code = realloc(e->code, e->cap);
+    }
+    e->code[e->len++] = byte;
+}
+
+static void emit_u32(Emitter *e, u32 value)
+{
+    for (u32 i = 0; i < 4; i++) {
+        emit_u8(e, (u8)(value >> (8 * i)));
+    }
+}
+
+static void emit_u64(Emitter *e, u64 value)
+{
+    emit_u32(e, (u32)value);
+    emit_u32(e, (u32)(value >> 32));
+}
+
+/* REX.W and the opcode */
+static void emit_rex_op(Emitter *e, u32 op, u8 reg, Reg rm)
+{
+    emit_u8(e, 0x48 | (reg >> 3) << 2 | rm >> 3);
+    if (op > 0xff) {
+        emit_u8(e, (u8)(op >> 8));
+    }
+    emit_u8(e, (u8)op);
+}
+
+/* op reg, [base + disp] or the other way around, depending on op */
+static void emit_mem(Emitter *e, u32 op, u8 reg, Reg base, s32 disp)
+{
+    emit_rex_op(e, op, reg, base);
+    /* rbp and r13 have no form without displacement */
+    u8 mod = disp == 0 && (base & 7) != RBP ? 0 : disp >= -128 && disp <= 127 ? 1 : 2;
+    emit_u8(e, (u8)(mod << 6 | (reg & 7) << 3 | (base & 7)));
+    /* rsp and r12 need a SIB byte */
+    if ((base & 7) == RSP) {
+        emit_u8(e, 0x24);
+    }
+    if (mod == 1) {
+        emit_u8(e, (u8)disp);
+    } else if (mod == 2) {
+        emit_u32(e, (u32)disp);
+    }
+}
+
+/* op reg, rm with two registers */
+static void emit_reg(Emitter *e, u32 op, u8 reg, Reg rm)
+{
+    emit_rex_op(e, op, reg, rm);
+    emit_u8(e, (u8)(0xc0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+static void emit_add_imm(Emitter *e, Reg reg, s32 imm)
+{
+    if (imm >= -128 && imm <= 127) {
+        emit_reg(e, X_ALU_IMM8, 0, reg);
+        emit_u8(e, (u8)imm);
+    } else {
+        emit_reg(e, X_ALU_IMM, 0, reg);
+        emit_u32(e, (u32)imm);
+    }
+}
+
+static void emit_mov_imm(Emitter *e, Reg reg, BytecodeWord value)
+{
+    if (value >= I32_MIN && value <= I32_MAX) {
+        /* Sign extended imm32 */
+        emit_reg(e, 0xc7, 0, reg);
+        emit_u32(e, (u32)value);
+    } else {
+        emit_u8(e, 0x48 | reg >> 3);
+        emit_u8(e, 0xb8 | (reg & 7));
+        emit_u64(e, (u64)value);
+    }
+}
+
+static void emit_push(Emitter *e, Reg reg)
+{
+    if (reg >= 8) {
+        emit_u8(e, 0x41);
+    }
+    emit_u8(e, 0x50 | (reg & 7));
+}
+
+static void emit_pop(Emitter *e, Reg reg)
+{
+    if (reg >= 8) {
+        emit_u8(e, 0x41);
+    }
+    emit_u8(e, 0x58 | (reg & 7));
+}
+
+/* Calls a C function through rax */
+static void emit_call_abs(Emitter *e, u64 address)
+{
+    emit_mov_imm(e, RAX, (BytecodeWord)address);
+    emit_u8(e, 0xff);
+    emit_u8(e, 0xd0);
+}
+
+/* jmp, or jcc if cc is not -1, to a bytecode offset */
+static void emit_jump(Emitter *e, int cc, u32 target, JitFixup **fixups, u32 *n_fixups)
+{
+    if (cc == -1) {
+        emit_u8(e, 0xe9);
+    } else {
+        emit_u8(e, 0x0f);
+        emit_u8(e, (u8)(0x80 | cc));
+    }
+    *fixups = realloc(*fixups, (*n_fixups + 1) * sizeof(JitFixup));
+    (*fixups)[(*n_fixups)++] = (JitFixup){ .at = e->len, .target = target };
+    emit_u32(e, 0);
+}
+
+/* tos = tos op b, where b is below tos. See the arithmetic in vm_loop() */
+static void emit_binary(Emitter *e, u32 op)
+{
+    emit_mem(e, op, TOS, SP, -8);
+    emit_add_imm(e, SP, -8);
+}
+
+/* tos = tos cc b */
+static void emit_compare(Emitter *e, int cc)
+{
+    emit_mem(e, X_CMP, TOS, SP, -8);
+    /* setcc al, then movzx rbx, al */
+    emit_u8(e, 0x0f);
+    emit_u8(e, (u8)(0x90 | cc));
+    emit_u8(e, 0xc0);
+    emit_reg(e, X_MOVZX8, TOS, RAX);
+    emit_add_imm(e, SP, -8);
+}
+
+/* PUSH() in vm_loop(), the new tos is written after */
+static void emit_push_tos(Emitter *e)
+{
+    emit_mem(e, X_MOV_MR, TOS, SP, 0);
+    emit_add_imm(e, SP, 8);
+}
+
+/* Drops n values and sets the flags for the branch before that, see emit_branch() */
+static void emit_drop_keep_flags(Emitter *e, s32 n)
+{
+    emit_mem(e, X_MOV, TOS, SP, -8 * n);
+    emit_mem(e, X_LEA, SP, SP, -8 * n);
+}
+
+/* One unit of fuel, see VMMeter. Only rbx and r12 to r15 are live between instructions */
+static void emit_charge(Emitter *e, u32 offset)
+{
+    emit_mem(e, X_MOV, RAX, JIT, offsetof(Jit, fuel));
+    emit_mem(e, X_ALU_IMM8, 5, RAX, 0); // sub qword [rax], 1
+    emit_u8(e, 1);
+    emit_u8(e, 0x79); // jns over the call
+    u32 skip_at = e->len;
+    emit_u8(e, 0);
+    emit_reg(e, X_MOV_MR, JIT, RDI);
+    emit_u8(e, 0xbe); // mov esi, imm32
+    emit_u32(e, offset);
+    emit_call_abs(e, (u64)(uintptr_t)jit_refuel);
+    e->code[skip_at] = (u8)(e->len - skip_at - 1);
+}
+
+/* Stops the run unless the flags hold cc, see jit_stop() */
+static void emit_stop(Emitter *e, int cc, u32 offset, VMStop stop)
+{
+    emit_u8(e, (u8)(0x70 | cc)); // jcc over the call
+    u32 skip_at = e->len;
+    emit_u8(e, 0);
+    emit_reg(e, X_MOV_MR, JIT, RDI);
+    emit_u8(e, 0xbe); // mov esi, imm32
+    emit_u32(e, offset);
+    emit_u8(e, 0xba); // mov edx, imm32
+    emit_u32(e, stop);
+    emit_call_abs(e, (u64)(uintptr_t)jit_stop);
+    e->code[skip_at] = (u8)(e->len - skip_at - 1);
+}
+
+/*
+ * A branch to a bytecode offset, cc is -1 for an unconditional one. Taking it backward costs
+ * fuel, so a conditional one is turned around to skip over the charge and a jmp.
+ */
+static void emit_branch(Emitter *e, int cc, u32 at, u32 target, JitFixup **fixups,
+                        u32 *n_fixups)
+{
+    if (target >= at) {
+        emit_jump(e, cc, target, fixups, n_fixups);
+        return;
+    }
+    u32 skip_at = 0;
+    if (cc != -1) {
+        emit_u8(e, (u8)(0x70 | (cc ^ 1))); // jncc rel8
+        skip_at = e->len;
+        emit_u8(e, 0);
+    }
+    emit_charge(e, at);
+    emit_jump(e, -1, target, fixups, n_fixups);
+    if (cc != -1) {
+        e->code[skip_at] = (u8)(e->len - skip_at - 1);
+    }
+}
+
+static inline u16 code_imm(u8 *at)
+{
+    BytecodeImm value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static inline u32 code_wide_imm(u8 *at)
+{
+    BytecodeWideImm value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+/*
+ * Verifies and translates one function. Returns NULL if the function has an op without a
+ * template or the bytecode does not check out: an unknown op, an instruction running past the
+ * end, a branch that does not land on an instruction of the function or code that falls off the
+ * end.
+ */
+static JitFunc jit_compile(Jit *jit, u32 func_idx)
+{
+    Bytecode *b = jit->vm->b;
+    BytecodeFunc *func = &b->funcs[func_idx];
+    u32 start = func->code_offset;
+    u32 end = bytecode_func_end(b, func);
+    /* Machine code offset of each instruction, U32_MAX inside of instructions */
+    u32 *native_at = malloc((end - start) * sizeof(u32));
+    memset(native_at, 0xff, (end - start) * sizeof(u32));
+    JitFixup *fixups = NULL;
+    u32 n_fixups = 0;
+    Emitter e = { 0 };
+    JitFunc native = NULL;
+
+    /* Prologue. Five pushes and the return address keep rsp 16 byte aligned for calls */
+    emit_push(&e, RBX);
+    emit_push(&e, R12);
+    emit_push(&e, R13);
+    emit_push(&e, R14);
+    emit_push(&e, R15);
+    emit_reg(&e, X_MOV_MR, RDI, BP);
+    emit_reg(&e, X_MOV_MR, RSI, JIT);
+    emit_mem(&e, X_MOV, LIMIT, JIT, offsetof(Jit, stack_limit));
+    /* The frame header is unused, but keeps the locals where the bytecode expects them */
+    emit_mem(&e, X_LEA, SP, BP, 8 * (func->n_params + 1));
+    emit_u8(&e, 0x31); // xor ebx, ebx
+    emit_u8(&e, 0xdb);
+
+    OpCode op = OP_TYPE_LEN;
+    for (u32 at = start; at < end; at += bytecode_op_len(op)) {
+        op = b->code[at];
+        if (op >= OP_TYPE_LEN || at + bytecode_op_len(op) > end) {
+            goto done;
+        }
+        native_at[at - start] = e.len;
+        u8 *imm = b->code + at + 1;
+        /* Branch targets are relative to the end of the instruction */
+        u32 next = at + bytecode_op_len(op);
+
+        switch (op) {
+        case OP_CONSW: {
+            BytecodeWord value;
+            memcpy(&value, imm, sizeof(value));
+            emit_push_tos(&e);
+            emit_mov_imm(&e, TOS, value);
+            break;
+        }
+
+        case OP_ADDW:
+            emit_binary(&e, X_ADD);
+            break;
+        case OP_SUBW:
+            emit_binary(&e, X_SUB);
+            break;
+        case OP_MULW:
+            emit_binary(&e, X_IMUL);
+            break;
+        case OP_DIVW: {
+            /* Both of the cases idiv traps on are handled like OP_DIVW in vm_loop() */
+            emit_mem(&e, X_MOV, RCX, SP, -8);
+            emit_reg(&e, X_TEST, RCX, RCX);
+            emit_stop(&e, CC_NE, at, VM_STOP_DIV_ZERO);
+            emit_reg(&e, X_ALU_IMM8, 7, RCX); // cmp rcx, -1
+            emit_u8(&e, 0xff);
+            emit_u8(&e, 0x75); // jne over the neg and the jmp
+            emit_u8(&e, 5);
+            emit_reg(&e, X_IDIV, 3, TOS); // neg rbx
+            emit_u8(&e, 0xeb); // jmp over the idiv
+            emit_u8(&e, 11);
+            /* mov rax, rbx; cqo; idiv rcx; mov rbx, rax */
+            emit_reg(&e, X_MOV_MR, TOS, RAX);
+            emit_u8(&e, 0x48);
+            emit_u8(&e, 0x99);
+            emit_reg(&e, X_IDIV, 7, RCX);
+            emit_reg(&e, X_MOV_MR, RAX, TOS);
+            emit_add_imm(&e, SP, -8);
+            break;
+        }
+        case OP_LSHIFT:
+        case OP_RSHIFT:
+            emit_mem(&e, X_MOV, RCX, SP, -8);
+            emit_reg(&e, X_SHIFT_CL, op == OP_LSHIFT ? 4 : 7, TOS);
+            emit_add_imm(&e, SP, -8);
+            break;
+        case OP_GE:
+            emit_compare(&e, CC_G);
+            break;
+        case OP_LE:
+            emit_compare(&e, CC_L);
+            break;
+        case OP_NOT:
+            /* test rbx, rbx; sete al; movzx rbx, al */
+            emit_reg(&e, X_TEST, TOS, TOS);
+            emit_u8(&e, 0x0f);
+            emit_u8(&e, 0x90 | CC_E);
+            emit_u8(&e, 0xc0);
+            emit_reg(&e, X_MOVZX8, TOS, RAX);
+            break;
+
+        case OP_JMP:
+            emit_branch(&e, -1, at, next + (s16)code_imm(imm), &fixups, &n_fixups);
+            break;
+        case OP_JMPW:
+            emit_branch(&e, -1, at, next + (s32)code_wide_imm(imm), &fixups, &n_fixups);
+            break;
+        case OP_BIZ:
+        case OP_BNZ:
+        case OP_BIZW:
+        case OP_BNZW: {
+            s32 offset = op == OP_BIZ || op == OP_BNZ ? (s16)code_imm(imm)
+                                                      : (s32)code_wide_imm(imm);
+            emit_reg(&e, X_TEST, TOS, TOS);
+            emit_drop_keep_flags(&e, 1);
+            emit_branch(&e, op == OP_BIZ || op == OP_BIZW ? CC_E : CC_NE, at, next + offset,
+                        &fixups, &n_fixups);
+            break;
+        }
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BLE:
+        case OP_BGE: {
+            int cc = op == OP_BEQ ? CC_E : op == OP_BNE ? CC_NE : op == OP_BLE ? CC_LE : CC_GE;
+            emit_mem(&e, X_CMP, TOS, SP, -8);
+            emit_drop_keep_flags(&e, 2);
+            emit_branch(&e, cc, at, next + (s16)code_imm(imm), &fixups, &n_fixups);
+            break;
+        }
+
+        case OP_PUSHN:
+        case OP_POPN: {
+            s32 n = code_imm(imm);
+            emit_mem(&e, X_MOV_MR, TOS, SP, 0);
+            emit_add_imm(&e, SP, 8 * (op == OP_PUSHN ? n : -n));
+            emit_mem(&e, X_MOV, TOS, SP, 0);
+            break;
+        }
+        case OP_STOREL:
+            /* Stores after the drop, then reloads tos in case the local is on top now */
+            emit_reg(&e, X_MOV_MR, TOS, RAX);
+            emit_add_imm(&e, SP, -8);
+            emit_mem(&e, X_MOV_MR, RAX, BP, 8 * code_imm(imm));
+            emit_mem(&e, X_MOV, TOS, SP, 0);
+            break;
+        case OP_LOADL:
+            emit_push_tos(&e);
+            emit_mem(&e, X_MOV, TOS, BP, 8 * code_imm(imm));
+            break;
+        case OP_INCL: {
+            /* Spills tos and reloads it in case the local is on top */
+            s16 delta = (s16)code_imm(imm + sizeof(BytecodeImm));
+            emit_mem(&e, X_MOV_MR, TOS, SP, 0);
+            emit_mem(&e, X_ALU_IMM, 0, BP, 8 * code_imm(imm));
+            emit_u32(&e, (u32)(s32)delta);
+            emit_mem(&e, X_MOV, TOS, SP, 0);
+            break;
+        }
+
+        case OP_CALL: {
+            u32 callee = code_imm(imm);
+            if (callee >= b->n_funcs) {
+                goto done;
+            }
+            s32 args = 8 * (1 - (s32)b->funcs[callee].n_params);
+            emit_charge(&e, at);
+            /* Same check as OP_CALL in vm_loop(), on the top of the callee's frame */
+            emit_mem(&e, X_LEA, RAX, SP,
+                     8 * (s32)(FRAME_HEADER_WORDS + b->funcs[callee].max_stack));
+            emit_reg(&e, X_CMP_MR, LIMIT, RAX);
+            emit_stop(&e, CC_B, at, VM_STOP_STACK_OVERFLOW);
+            emit_mem(&e, X_MOV_MR, TOS, SP, 0);
+            emit_mem(&e, X_LEA, RDI, SP, args);
+            emit_reg(&e, X_MOV_MR, JIT, RSI);
+            /* Straight into the callee if it is compiled, else through jit_call(bp, jit, callee) */
+            emit_mem(&e, X_MOV, RAX, JIT, offsetof(Jit, native));
+            emit_mem(&e, X_MOV, RAX, RAX, 8 * callee);
+            emit_reg(&e, X_TEST, RAX, RAX);
+            emit_u8(&e, 0x75); // jnz over the next 15 bytes
+            emit_u8(&e, 15);
+            emit_u8(&e, 0xba); // mov edx, imm32
+            emit_u32(&e, callee);
+            emit_u8(&e, 0x48); // mov rax, imm64
+            emit_u8(&e, 0xb8);
+            emit_u64(&e, (u64)(uintptr_t)jit_call);
+            emit_u8(&e, 0xff); // call rax
+            emit_u8(&e, 0xd0);
+            /* Like after OP_RET, the value takes the place of the first argument */
+            emit_mem(&e, X_LEA, SP, SP, args);
+            emit_reg(&e, X_MOV_MR, RAX, TOS);
+            break;
+        }
+        case OP_RET:
+            emit_reg(&e, X_MOV_MR, TOS, RAX);
+            emit_pop(&e, R15);
+            emit_pop(&e, R14);
+            emit_pop(&e, R13);
+            emit_pop(&e, R12);
+            emit_pop(&e, RBX);
+            emit_u8(&e, 0xc3);
+            break;
+
+        /* I/O bound, leave it to the interpreter */
+        case OP_PRINT:
+        default:
+            goto done;
+        }
+    }
+    if (op != OP_RET && op != OP_JMP && op != OP_JMPW) {
+        goto done;
+    }
+
+    for (u32 i = 0; i < n_fixups; i++) {
+        if (fixups[i].target < start || fixups[i].target >= end ||
+            native_at[fixups[i].target - start] == U32_MAX) {
+            goto done;
+        }
+        u32 rel = native_at[fixups[i].target - start] - (fixups[i].at + 4);
+        memcpy(e.code + fixups[i].at, &rel, sizeof(rel));
+    }
+
+    /* Written while writable, then made executable. A page or more per function */
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (e.len + page - 1) / page * page;
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        goto done;
+    }
+    memcpy(mem, e.code, e.len);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        goto done;
+    }
+    JitRegion *region = malloc(sizeof(JitRegion));
+    *region = (JitRegion){ .mem = mem, .size = size, .next = jit->regions };
+    jit->regions = region;
+    /* ISO C has no conversion from an object pointer to a function pointer */
+    _Static_assert(sizeof(native) == sizeof(mem), "function pointers must fit in a void *");
+    memcpy(&native, &mem, sizeof(native));
+
+done:
+    free(native_at);
+    free(fixups);
+    free(e.code);
+    return native;
+}
+
+#else
+
+static JitFunc jit_compile(Jit *jit, u32 func_idx)
+{
+    (void)jit;
+    (void)func_idx;
+    (void)jit_stop;
+    (void)jit_refuel;
+    return NULL;
+}
+
+#endif /* JIT_SUPPORTED */
+
+JitFunc jit_lookup(Jit *jit, u32 func_idx)
+{
+    if (jit->native[func_idx] != NULL || jit->rejected[func_idx]) {
+        return jit->native[func_idx];
+    }
+    if (++jit->calls[func_idx] < JIT_CALL_THRESHOLD) {
+        return NULL;
+    }
+    jit->native[func_idx] = jit_compile(jit, func_idx);
+    jit->rejected[func_idx] = jit->native[func_idx] == NULL;
+    return jit->native[func_idx];
+}
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef JIT_H
+#define JIT_H
+
+#include <setjmp.h>
+
+#include "base/types.h"
+#include "compiler/comptime/bytecode.h"
+
+/*
+ * Baseline JIT for the stack VM.
+ *
+ * The interpreter counts calls per function. Once a function has been called JIT_CALL_THRESHOLD
+ * times its bytecode is verified and translated to x86-64, one fixed template per opcode, into
+ * pages that are mapped writable while the code is written and then executable. Functions that
+ * fail verification or use an op without a template (PRINT, which is not worth it) are marked
+ * rejected and stay in the interpreter.
+ *
+ * Compiled code keeps the interpreter's state in callee saved registers, tos in rbx, bp in r12
+ * and sp in r13, and uses the same frame layout on the same VM stack, so the two can call each
+ * other. A call into compiled code returns the value like OP_RET would, the caller then drops the
+ * frame. Compiled code calls compiled code directly and goes through jit_call() otherwise. Fuel is
+ * charged in the same places as in the interpreter, see VMMeter.
+ *
+ * Everything is interpreted on other targets than x86-64 Linux.
+ */
+
+#define JIT_CALL_THRESHOLD 64
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+typedef struct jit_t Jit;
+typedef struct metagen_vm_t MetagenVM; // See vm.h
+typedef BytecodeWord (*JitFunc)(BytecodeWord *bp, Jit *jit);
+
+typedef struct jit_region_t JitRegion;
+struct jit_region_t {
+    void *mem;
+    size_t size;
+    JitRegion *next;
+};
+
+struct jit_t {
+    JitFunc *native; // Per function, NULL until compiled. Read by the compiled code
+    BytecodeWord *stack_limit; // End of the stack, no frame may reach it. Read by compiled code
+    s64 *fuel; // Slice of the VM's meter. Charged by the compiled code
+    MetagenVM *vm; // Everything runs on its stack
+    u32 *calls; // Per function
+    bool *rejected; // Per function, stays interpreted
+    JitRegion *regions; // Executable memory, for jit_release()
+    jmp_buf abort; // Where jit_abort() unwinds to
+};
+
+
+Jit *jit_new(MetagenVM *vm);
+void jit_release(Jit *jit);
+
+/* Counts a call to func_idx. Returns the compiled code, compiling it once it is hot, or NULL */
+JitFunc jit_lookup(Jit *jit, u32 func_idx);
+
+/* Calls func_idx, compiled or not. Compiled code calls uncompiled functions through this */
+BytecodeWord jit_call(BytecodeWord *bp, Jit *jit, u32 func_idx);
+
+/* Unwinds all compiled and interpreted frames back to run_jit() */
+_Noreturn void jit_abort(Jit *jit);
+
+#endif /* JIT_H */
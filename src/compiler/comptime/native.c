@@ -0,0 +1,107 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/native.h"
+#include "base/str.h"
+#include "compiler/codegen/gen.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* Compiles source into so_path. Goes through a temporary file so a failed build leaves no entry */
+static bool native_build(char *source, size_t len, char *so_path)
+{
+    if (mkdir(NATIVE_CACHE_DIR, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "metagenc: could not create %s: %s\n", NATIVE_CACHE_DIR, strerror(errno));
+        return false;
+    }
+
+    char c_path[256];
+    char tmp_path[256];
+    /* Per process, so compilations building the same entry at once don't share files */
+    snprintf(c_path, sizeof(c_path), "%s.%d.c", so_path, (int)getpid());
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", so_path, (int)getpid());
+    FILE *out = fopen(c_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "metagenc: could not open %s: %s\n", c_path, strerror(errno));
+        return false;
+    }
+    fwrite(source, 1, len, out);
+    fclose(out);
+
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), NATIVE_CC " -o %s %s", tmp_path, c_path);
+    int rc = system(cmd);
+    remove(c_path);
+    if (rc != 0 || rename(tmp_path, so_path) != 0) {
+        fprintf(stderr, "metagenc: '%s' failed\n", cmd);
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+bool native_run(Compiler *compiler, BytecodeWord *result)
+{
+    char *source;
+    size_t len;
+    FILE *out = open_memstream(&source, &len);
+    if (out == NULL) {
+        fprintf(stderr, "metagenc: open_memstream: %s\n", strerror(errno));
+        return false;
+    }
+    transpile_to_file(compiler, out);
+    fprintf(out, "__attribute__((visibility(\"default\"))) s64 %s(void)\n", NATIVE_ENTRY_SYMBOL);
+    fprintf(out, "{\n  return main();\n}\n");
+    fclose(out);
+
+    /* Names the cache entry, so it also changes with the C compiler */
+    u64 hash = str_hash(STR_HASH_SEED, NATIVE_CC, strlen(NATIVE_CC));
+    hash = str_hash(hash, source, len);
+    char so_path[128];
+    snprintf(so_path, sizeof(so_path), "%s/%016lx.so", NATIVE_CACHE_DIR, hash);
+    bool cached = access(so_path, R_OK) == 0;
+    bool built = cached || native_build(source, len, so_path);
+    free(source);
+    if (!built) {
+        return false;
+    }
+
+    /* A path with a slash in it is not looked up in the library path */
+    void *handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "metagenc: %s\n", dlerror());
+        return false;
+    }
+    void *sym = dlsym(handle, NATIVE_ENTRY_SYMBOL);
+    if (sym == NULL) {
+        fprintf(stderr, "metagenc: %s\n", dlerror());
+        dlclose(handle);
+        return false;
+    }
+    /* ISO C has no conversion from an object pointer to a function pointer */
+    NativeEntry entry;
+    _Static_assert(sizeof(entry) == sizeof(sym), "function pointers must fit in a void *");
+    memcpy(&entry, &sym, sizeof(entry));
+    *result = entry();
+    dlclose(handle);
+    return true;
+}
@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include "base/types.h"
+#include "compiler/compiler.h"
+#include "compiler/comptime/bytecode.h"
+
+/*
+ * Native tier for comptime code.
+ *
+ * The program is translated to C by the same code as transpile_to_c() and built into a shared
+ * object by the system C compiler, which is then loaded with dlopen(). Objects are cached in
+ * NATIVE_CACHE_DIR under a hash of the generated C and the compile command, so cc only runs when
+ * the program changes.
+ *
+ * Everything in the object is hidden except NATIVE_ENTRY_SYMBOL, a NativeEntry that calls main.
+ * That is the whole interface between the compiler and the object.
+ *
+ * Native code runs on the C stack without the checks of the VMs, so runaway recursion crashes or,
+ * once cc turns it into a loop, never ends.
+ */
+
+#define NATIVE_CACHE_DIR "metagen-cache"
+#define NATIVE_CC "cc -O2 -shared -fPIC -fvisibility=hidden -w"
+#define NATIVE_ENTRY_SYMBOL "metagen_comptime_entry"
+
+typedef s64 (*NativeEntry)(void);
+
+
+/*
+ * Runs the entry function natively and stores what it returned in result. Returns false, after
+ * saying why on stderr, if the object could not be built or loaded. Nothing has run then.
+ */
+bool native_run(Compiler *compiler, BytecodeWord *result);
+
+#endif /* NATIVE_H */
@@ -0,0 +1,291 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/peephole.h"
+#include "compiler/mem_report.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_TARGET U32_MAX
+
+typedef struct {
+    u32 offset; // Of the branch imm in the rewritten code
+    u32 target; // In the original code
+    bool wide;
+} Fixup;
+
+typedef struct {
+    Bytecode *b;
+    bool *is_target; // Indexed by offset in the original code
+    u32 at[4]; // Offsets of the instructions in the last match
+    u32 n; // Length of the last match
+    u32 end; // Offset right after the last match
+} Matcher;
+
+
+static BytecodeImm read_imm(Bytecode *b, u32 offset)
+{
+    BytecodeImm value;
+    memcpy(&value, b->code + offset, sizeof(value));
+    return value;
+}
+
+static BytecodeWideImm read_wide_imm(Bytecode *b, u32 offset)
+{
+    BytecodeWideImm value;
+    memcpy(&value, b->code + offset, sizeof(value));
+    return value;
+}
+
+static BytecodeWord read_word(Bytecode *b, u32 offset)
+{
+    BytecodeWord value;
+    memcpy(&value, b->code + offset, sizeof(value));
+    return value;
+}
+
+static bool is_wide_branch(OpCode op)
+{
+    return op == OP_JMPW || op == OP_BIZW || op == OP_BNZW;
+}
+
+/* Where the instruction at offset may continue other than the next instruction */
+static u32 branch_target(Bytecode *b, u32 offset)
+{
+    switch (b->code[offset]) {
+    case OP_JMP:
+    case OP_BIZ:
+    case OP_BNZ:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLE:
+    case OP_BGE:
+        return offset + 1 + sizeof(BytecodeImm) + (s16)read_imm(b, offset + 1);
+    case OP_JMPW:
+    case OP_BIZW:
+    case OP_BNZW:
+        return offset + 1 + sizeof(BytecodeWideImm) + (s32)read_wide_imm(b, offset + 1);
+    default:
+        return NO_TARGET;
+    }
+}
+
+/*
+ * True if the instructions starting at offset have the given opcodes and none but the first is
+ * a branch target. Fills in m->at and m->end.
+ */
+static bool match(Matcher *m, u32 offset, u32 n, const u8 *ops)
+{
+    assert(n <= ARRAY_LENGTH(m->at));
+    for (u32 i = 0; i < n; i++) {
+        if (offset >= m->b->code_offset || m->b->code[offset] != ops[i])
+            return false;
+        if (i > 0 && m->is_target[offset])
+            return false;
+        m->at[i] = offset;
+        offset += bytecode_op_len(ops[i]);
+    }
+    m->n = n;
+    m->end = offset;
+    return true;
+}
+
+#define MATCH(___m, ___offset, ...) \
+    match(___m, ___offset, sizeof((u8[]){ __VA_ARGS__ }), (u8[]){ __VA_ARGS__ })
+
+/* CONSW k; LOADL s; ADDW; STOREL s in either operand order, or with SUBW and LOADL first */
+static bool match_incl(Matcher *m, u32 offset, BytecodeImm *slot, BytecodeImm *delta)
+{
+    u32 consw;
+    u32 loadl;
+    bool is_sub;
+    if (MATCH(m, offset, OP_CONSW, OP_LOADL, OP_ADDW, OP_STOREL) ||
+        MATCH(m, offset, OP_CONSW, OP_LOADL, OP_SUBW, OP_STOREL)) {
+        /* The right operand is pushed first, so this is local + k or local - k */
+        consw = m->at[0];
+        loadl = m->at[1];
+        is_sub = m->b->code[m->at[2]] == OP_SUBW;
+    } else if (MATCH(m, offset, OP_LOADL, OP_CONSW, OP_ADDW, OP_STOREL)) {
+        consw = m->at[1];
+        loadl = m->at[0];
+        is_sub = false;
+    } else {
+        return false;
+    }
+
+    *slot = read_imm(m->b, loadl + 1);
+    if (read_imm(m->b, m->at[3] + 1) != *slot)
+        return false;
+    BytecodeWord k = read_word(m->b, consw + 1);
+    if (is_sub)
+        k = -k;
+    if (k < I16_MIN || k > I16_MAX)
+        return false;
+    *delta = (BytecodeImm)(s16)k;
+    return true;
+}
+
+/* Compare and the BIZ that consumes the result, fused. OP_TYPE_LEN if there is none. */
+static OpCode match_compare_branch(Matcher *m, u32 offset)
+{
+    if (MATCH(m, offset, OP_SUBW, OP_NOT, OP_BIZ))
+        return OP_BNE;
+    if (MATCH(m, offset, OP_SUBW, OP_BIZ))
+        return OP_BEQ;
+    /* OP_LE pushes a < b and OP_GE pushes a > b, so branching on false is the opposite */
+    if (MATCH(m, offset, OP_LE, OP_BIZ))
+        return OP_BGE;
+    if (MATCH(m, offset, OP_GE, OP_BIZ))
+        return OP_BLE;
+    if (MATCH(m, offset, OP_NOT, OP_BIZ))
+        return OP_BNZ;
+    if (MATCH(m, offset, OP_NOT, OP_BNZ))
+        return OP_BIZ;
+    return OP_TYPE_LEN;
+}
+
+static void apply_fixup(Bytecode *b, u32 *new_offset, Fixup fixup)
+{
+    u32 target = new_offset[fixup.target];
+    if (fixup.wide) {
+        s32 distance = (s32)(target - fixup.offset - sizeof(BytecodeWideImm));
+        memcpy(b->code + fixup.offset, &distance, sizeof(distance));
+        return;
+    }
+    /* Nothing grows, so a branch that reached before still does */
+    s64 distance = (s64)target - (s64)(fixup.offset + sizeof(BytecodeImm));
+    assert(distance >= I16_MIN && distance <= I16_MAX);
+    BytecodeImm imm = (BytecodeImm)(s16)distance;
+    memcpy(b->code + fixup.offset, &imm, sizeof(imm));
+}
+
+void bytecode_peephole(Bytecode *b)
+{
+    u32 len = b->code_offset;
+    bool *is_target = m_arena_alloc_zero_tagged(b->arena, len + 1, MEM_TAG_BYTECODE);
+    u32 *new_offset = m_arena_alloc_tagged(b->arena, sizeof(u32) * (len + 1), MEM_TAG_BYTECODE);
+
+    /* Find every branch target so nothing is fused across one */
+    u32 n_branches = 0;
+    for (u32 offset = 0; offset < len; offset += bytecode_op_len(b->code[offset])) {
+        u32 target = branch_target(b, offset);
+        if (target != NO_TARGET) {
+            assert(target <= len);
+            is_target[target] = true;
+            n_branches++;
+        }
+    }
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        is_target[b->funcs[i].code_offset] = true;
+    }
+
+    /*
+     * Rewrite in place. Every instruction is written at or before where it was read from and is
+     * never longer than what it replaces, so the writes never catch up with the reads.
+     */
+    Fixup *fixups = m_arena_alloc_tagged(b->arena, sizeof(Fixup) * (n_branches + 1),
+                                         MEM_TAG_BYTECODE);
+    u32 n_fixups = 0;
+    Matcher m = { .b = b, .is_target = is_target };
+    u32 out = 0;
+    u32 offset = 0;
+    while (offset < len) {
+        new_offset[offset] = out;
+        BytecodeImm slot;
+        BytecodeImm delta;
+        OpCode branch_op;
+
+        if (match_incl(&m, offset, &slot, &delta)) {
+            b->code[out] = OP_INCL;
+            memcpy(b->code + out + 1, &slot, sizeof(slot));
+            memcpy(b->code + out + 1 + sizeof(slot), &delta, sizeof(delta));
+            out += bytecode_op_len(OP_INCL);
+            offset = m.end;
+        } else if ((branch_op = match_compare_branch(&m, offset)) != OP_TYPE_LEN) {
+            /* The branch is always last */
+            u32 target = branch_target(b, m.at[m.n - 1]);
+            b->code[out] = branch_op;
+            fixups[n_fixups++] = (Fixup){ .offset = out + 1, .target = target, .wide = false };
+            out += bytecode_op_len(branch_op);
+            offset = m.end;
+        } else {
+            OpCode op = b->code[offset];
+            u32 op_len = bytecode_op_len(op);
+            u32 target = branch_target(b, offset);
+            if (target != NO_TARGET) {
+                fixups[n_fixups++] = (Fixup){ .offset = out + 1,
+                                              .target = target,
+                                              .wide = is_wide_branch(op) };
+            }
+            memmove(b->code + out, b->code + offset, op_len);
+            out += op_len;
+            offset += op_len;
+        }
+    }
+    new_offset[len] = out;
+
+    for (u32 i = 0; i < n_fixups; i++) {
+        apply_fixup(b, new_offset, fixups[i]);
+    }
+    for (u32 i = 0; i < b->n_funcs; i++) {
+        b->funcs[i].code_offset = new_offset[b->funcs[i].code_offset];
+    }
+    b->code_offset = out;
+}
+
+
+typedef struct {
+    u8 first;
+    u8 second;
+    u32 count;
+} OpPair;
+
+static int op_pair_cmp(const void *a, const void *b)
+{
+    u32 count_a = ((OpPair *)a)->count;
+    u32 count_b = ((OpPair *)b)->count;
+    return (count_a < count_b) - (count_a > count_b);
+}
+
+void bytecode_print_op_pairs(Bytecode *b)
+{
+    u32 counts[OP_TYPE_LEN][OP_TYPE_LEN] = { 0 };
+    u32 prev = NO_TARGET;
+    for (u32 offset = 0; offset < b->code_offset; offset += bytecode_op_len(b->code[offset])) {
+        if (prev != NO_TARGET)
+            counts[b->code[prev]][b->code[offset]]++;
+        prev = offset;
+    }
+
+    OpPair pairs[OP_TYPE_LEN * OP_TYPE_LEN];
+    u32 n_pairs = 0;
+    for (u32 i = 0; i < OP_TYPE_LEN; i++) {
+        for (u32 j = 0; j < OP_TYPE_LEN; j++) {
+            if (counts[i][j] != 0)
+                pairs[n_pairs++] = (OpPair){ .first = i, .second = j, .count = counts[i][j] };
+        }
+    }
+    qsort(pairs, n_pairs, sizeof(OpPair), op_pair_cmp);
+
+    printf("--- opcode pairs ---\n");
+    for (u32 i = 0; i < n_pairs; i++) {
+        printf("%6u %s %s\n", pairs[i].count, op_code_str_map[pairs[i].first],
+               op_code_str_map[pairs[i].second]);
+    }
+    printf("--- opcode pairs end ---\n");
+}
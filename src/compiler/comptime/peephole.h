@@ -0,0 +1,39 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "compiler/comptime/bytecode.h"
+
+/*
+ * Peephole optimizer for the stack VM bytecode.
+ *
+ * Fuses the sequences ast_to_bytecode() emits most often into superinstructions:
+ *   CONSW k; LOADL s; ADDW; STOREL s     -> INCL s k     (also LOADL first, and SUBW with -k)
+ *   LE; BIZ / GE; BIZ                    -> BGE / BLE
+ *   SUBW; NOT; BIZ / SUBW; BIZ           -> BNE / BEQ
+ *   NOT; BIZ / NOT; BNZ                  -> BNZ / BIZ
+ * Patterns were picked from the output of bytecode_print_op_pairs() on the e2e programs.
+ * Nothing is fused across a branch target. The code only shrinks, so it is rewritten in place and
+ * short branches stay short.
+ */
+void bytecode_peephole(Bytecode *b);
+
+/* Prints how often each pair of adjacent opcodes occurs, most common first */
+void bytecode_print_op_pairs(Bytecode *b);
+
+#endif /* PEEPHOLE_H */
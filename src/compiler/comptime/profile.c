@@ -0,0 +1,146 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOT_LOOPS_MAX 10
+
+
+void vm_profile_init(VMProfile *p, Bytecode *b)
+{
+    p->b = b;
+    p->slots = calloc(b->code_offset, sizeof(VMProfileSlot));
+    p->prev = VM_PROFILE_NONE;
+    p->last = 0;
+}
+
+void vm_profile_release(VMProfile *p)
+{
+    free(p->slots);
+}
+
+typedef struct {
+    OpCode op;
+    u64 count;
+    u64 cycles;
+} OpTotal;
+
+typedef struct {
+    u32 head;
+    u32 end;
+    u64 iterations;
+    u64 cycles;
+} HotLoop;
+
+static int op_total_by_cycles(const void *a, const void *b)
+{
+    u64 x = ((OpTotal *)a)->cycles;
+    u64 y = ((OpTotal *)b)->cycles;
+    return (x < y) - (x > y);
+}
+
+static int hot_loop_by_cycles(const void *a, const void *b)
+{
+    u64 x = ((HotLoop *)a)->cycles;
+    u64 y = ((HotLoop *)b)->cycles;
+    return (x < y) - (x > y);
+}
+
+static f64 percent(u64 part, u64 total)
+{
+    return total == 0 ? 0.0 : 100.0 * (f64)part / (f64)total;
+}
+
+void vm_profile_report(VMProfile *p)
+{
+    Bytecode *b = p->b;
+    u64 total = 0;
+    for (u32 offset = 0; offset < b->code_offset; offset++) {
+        total += p->slots[offset].cycles;
+    }
+
+    /* The disassembly, with the loops marked at their heads */
+    printf("--- comptime profile ---\n");
+    printf("%10s %14s %6s\n", "count", VM_PROFILE_UNIT, "%");
+    OpTotal ops[OP_TYPE_LEN] = { 0 };
+    u32 offset = 0;
+    while (offset < b->code_offset) {
+        for (u32 i = 0; i < b->n_funcs; i++) {
+            if (b->funcs[i].code_offset == offset)
+                printf("%.*s:\n", STR8VIEW_PRINT(b->funcs[i].name));
+        }
+        VMProfileSlot *slot = &p->slots[offset];
+        OpCode op = b->code[offset];
+        ops[op].count += slot->count;
+        ops[op].cycles += slot->cycles;
+        if (slot->count == 0) {
+            printf("%10s %14s %6s  ", "", "", "");
+        } else {
+            printf("%10lu %14lu %6.2f  ", slot->count, slot->cycles,
+                   percent(slot->cycles, total));
+        }
+        offset = disassemble_instruction(b, offset);
+        if (slot->loop_iterations > 0) {
+            printf("    <- loop to %04d, %lu back edges", slot->loop_end, slot->loop_iterations);
+        }
+        putchar('\n');
+    }
+
+    printf("--- opcodes by %s ---\n", VM_PROFILE_UNIT);
+    printf("%-10s %10s %14s %6s %8s\n", "op", "count", VM_PROFILE_UNIT, "%", "average");
+    for (u32 i = 0; i < OP_TYPE_LEN; i++) {
+        ops[i].op = (OpCode)i;
+    }
+    qsort(ops, OP_TYPE_LEN, sizeof(OpTotal), op_total_by_cycles);
+    for (u32 i = 0; i < OP_TYPE_LEN && ops[i].count > 0; i++) {
+        printf("%-10s %10lu %14lu %6.2f %8.1f\n", op_code_str_map[ops[i].op], ops[i].count,
+               ops[i].cycles, percent(ops[i].cycles, total),
+               (f64)ops[i].cycles / (f64)ops[i].count);
+    }
+
+    /* A loop is its head up to and including the furthest branch back to it */
+    u32 n_loops = 0;
+    for (u32 i = 0; i < b->code_offset; i++) {
+        n_loops += p->slots[i].loop_iterations > 0;
+    }
+    HotLoop *loops = malloc((n_loops + 1) * sizeof(HotLoop));
+    n_loops = 0;
+    for (u32 head = 0; head < b->code_offset; head++) {
+        VMProfileSlot *slot = &p->slots[head];
+        if (slot->loop_iterations == 0) {
+            continue;
+        }
+        HotLoop *loop = &loops[n_loops++];
+        *loop = (HotLoop){ .head = head,
+                           .end = slot->loop_end,
+                           .iterations = slot->loop_iterations };
+        for (u32 i = head; i <= slot->loop_end; i++) {
+            loop->cycles += p->slots[i].cycles;
+        }
+    }
+    qsort(loops, n_loops, sizeof(HotLoop), hot_loop_by_cycles);
+    printf("--- hot loops ---\n");
+    for (u32 i = 0; i < n_loops && i < HOT_LOOPS_MAX; i++) {
+        Str8 name = bytecode_func_at(b, loops[i].head)->name;
+        printf("%04d-%04d in %.*s: %lu iterations, %lu %s, %.2f%%\n", loops[i].head, loops[i].end,
+               STR8VIEW_PRINT(name), loops[i].iterations, loops[i].cycles, VM_PROFILE_UNIT,
+               percent(loops[i].cycles, total));
+    }
+    printf("--- comptime profile end ---\n");
+    free(loops);
+}
@@ -0,0 +1,128 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "base/types.h"
+#include "compiler/comptime/bytecode.h"
+
+/*
+ * Profiler for the stack VM.
+ *
+ * Only built in with VM_PROFILE, since it costs two timestamps and some bookkeeping per
+ * instruction. ./build.sh profile sets it, and --comptime-profile then runs the stack VM with a
+ * VMProfile and prints the report.
+ *
+ * Every dispatch charges the cycles since the previous dispatch to the previous instruction, by
+ * offset, so the report can be laid over the disassembly. The cycles of the bookkeeping itself are
+ * left out. A taken backward branch marks its target as the head of a loop, and the loop is taken
+ * to span from there to the furthest branch back to it. Cycles spent in callees are not counted
+ * towards the loops that call them.
+ */
+
+#ifndef VM_PROFILE
+#define VM_PROFILE 0
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define vm_profile_clock() __rdtsc()
+#define VM_PROFILE_UNIT "cycles"
+#else
+#include <time.h>
+static inline u64 vm_profile_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000 + (u64)now.tv_nsec;
+}
+#define VM_PROFILE_UNIT "ns"
+#endif
+
+#define VM_PROFILE_NONE U32_MAX
+
+/* Per bytecode offset. Only offsets where an instruction starts are used */
+typedef struct {
+    u64 count;
+    u64 cycles;
+    u64 loop_iterations; // Taken backward branches to here
+    u32 loop_end; // Offset of the furthest backward branch to here
+} VMProfileSlot;
+
+typedef struct {
+    Bytecode *b;
+    VMProfileSlot *slots; // One per byte of code
+    u32 prev; // Offset of the instruction being timed, or VM_PROFILE_NONE
+    u64 last; // When it was dispatched
+} VMProfile;
+
+
+void vm_profile_init(VMProfile *p, Bytecode *b);
+void vm_profile_release(VMProfile *p);
+
+/* Prints the disassembly with counts and cycles, then the opcodes and the loops by cycles */
+void vm_profile_report(VMProfile *p);
+
+static inline bool vm_profile_is_branch(OpCode op)
+{
+    switch (op) {
+    case OP_JMP:
+    case OP_JMPW:
+    case OP_BIZ:
+    case OP_BNZ:
+    case OP_BIZW:
+    case OP_BNZW:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLE:
+    case OP_BGE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Called on every dispatch with the offset of the instruction about to run */
+static inline void vm_profile_step(VMProfile *p, u32 offset)
+{
+    u64 now = vm_profile_clock();
+    if (p->prev != VM_PROFILE_NONE) {
+        VMProfileSlot *prev = &p->slots[p->prev];
+        prev->cycles += now - p->last;
+        if (offset < p->prev && vm_profile_is_branch(p->b->code[p->prev])) {
+            VMProfileSlot *head = &p->slots[offset];
+            head->loop_iterations++;
+            if (head->loop_end < p->prev) {
+                head->loop_end = p->prev;
+            }
+        }
+    }
+    p->slots[offset].count++;
+    p->prev = offset;
+    p->last = vm_profile_clock();
+}
+
+/* Charges the last instruction once the VM halts */
+static inline void vm_profile_stop(VMProfile *p)
+{
+    if (p->prev != VM_PROFILE_NONE) {
+        p->slots[p->prev].cycles += vm_profile_clock() - p->last;
+        p->prev = VM_PROFILE_NONE;
+    }
+}
+
+#endif /* PROFILE_H */
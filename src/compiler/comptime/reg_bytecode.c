@@ -0,0 +1,503 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/reg_bytecode.h"
+#include "compiler/ast.h"
+#include "compiler/mem_report.h"
+#include "compiler/type.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char *reg_op_str_map[ROP_TYPE_LEN] = {
+    "LOADI", "LOADK",  "MOV", "ADD", "SUB", "MUL", "DIV",  "LSHIFT", "RSHIFT", "LT",
+    "GT",    "EQ",     "NE",  "NOT", "JMP", "BZ",  "BNZ",  "CALL",   "RET",    "PRINT",
+};
+
+#define REG_CODE_INITIAL_CAP 1024
+#define REG_CONSTS_INITIAL_CAP 64
+
+
+/* Disassembler */
+void reg_disassemble(RegBytecode *b)
+{
+    printf("--- register bytecode ---\n");
+    for (u32 offset = 0; offset < b->len;) {
+        for (u32 i = 0; i < b->n_funcs; i++) {
+            if (b->funcs[i].code_offset == offset)
+                printf("%.*s: (%d regs)\n", STR8VIEW_PRINT(b->funcs[i].name), b->funcs[i].n_regs);
+        }
+        RegInstr instr = b->code[offset];
+        RegOp op = REG_OP(instr);
+        printf("%04d %-6s", offset, reg_op_str_map[op]);
+        offset++;
+        switch (op) {
+        case ROP_LOADI:
+            printf(" r%d %d", REG_A(instr), REG_SBX(instr));
+            break;
+        case ROP_LOADK:
+            printf(" r%d k%d (%ld)", REG_A(instr), REG_BX(instr), b->consts[REG_BX(instr)]);
+            break;
+        case ROP_MOV:
+        case ROP_NOT:
+            printf(" r%d r%d", REG_A(instr), REG_B(instr));
+            break;
+        case ROP_JMP:
+            printf(" %d", (s32)b->code[offset]);
+            offset++;
+            break;
+        case ROP_BZ:
+        case ROP_BNZ:
+            printf(" r%d %d", REG_A(instr), (s32)b->code[offset]);
+            offset++;
+            break;
+        case ROP_CALL:
+            printf(" r%d %.*s", REG_A(instr), STR8VIEW_PRINT(b->funcs[REG_BX(instr)].name));
+            break;
+        case ROP_RET:
+            printf(" r%d", REG_A(instr));
+            break;
+        case ROP_PRINT:
+            printf(" r%d n %d", REG_A(instr), REG_B(instr));
+            break;
+        default:
+            printf(" r%d r%d r%d", REG_A(instr), REG_B(instr), REG_C(instr));
+            break;
+        }
+        putchar('\n');
+    }
+    printf("--- register bytecode end ---\n");
+}
+
+
+/* Assembler */
+static void reg_bytecode_init(RegBytecode *b, Arena *arena)
+{
+    b->arena = arena;
+    b->len = 0;
+    b->cap = REG_CODE_INITIAL_CAP;
+    b->code = m_arena_alloc_tagged(arena, sizeof(RegInstr) * b->cap, MEM_TAG_BYTECODE);
+    b->n_consts = 0;
+    b->consts_cap = REG_CONSTS_INITIAL_CAP;
+    b->consts =
+        m_arena_alloc_tagged(arena, sizeof(BytecodeWord) * b->consts_cap, MEM_TAG_BYTECODE);
+    b->funcs = NULL;
+    b->n_funcs = 0;
+    b->entry = 0;
+}
+
+static u32 emit(RegBytecode *b, RegInstr instr)
+{
+    if (b->len == b->cap) {
+        b->code = m_arena_grow(b->arena, b->code, sizeof(RegInstr) * b->cap,
+                               sizeof(RegInstr) * b->cap * 2);
+        if (b->code == NULL) {
+            fprintf(stderr, "bytecode: out of memory growing the code segment\n");
+            exit(1);
+        }
+        b->cap *= 2;
+    }
+    b->code[b->len] = instr;
+    return b->len++;
+}
+
+/* Emits a jump or branch to be patched later. Returns where the offset goes. */
+static u32 emit_forward_jump(RegBytecode *b, RegInstr instr)
+{
+    emit(b, instr);
+    return emit(b, 0);
+}
+
+/* Emits a jump or branch to code that has already been emitted */
+static void emit_backward_jump(RegBytecode *b, RegInstr instr, u32 target)
+{
+    emit(b, instr);
+    emit(b, (RegInstr)(s32)(target - (b->len + 1)));
+}
+
+/* Points the jump or branch at the current end of the code */
+static void patch_jump(RegBytecode *b, u32 offset_at)
+{
+    assert(offset_at < b->len);
+    b->code[offset_at] = (RegInstr)(s32)(b->len - (offset_at + 1));
+}
+
+static u16 add_const(RegBytecode *b, BytecodeWord value)
+{
+    for (u32 i = 0; i < b->n_consts; i++) {
+        if (b->consts[i] == value)
+            return (u16)i;
+    }
+    assert(b->n_consts < U16_MAX && "Too many constants");
+    if (b->n_consts == b->consts_cap) {
+        b->consts = m_arena_grow(b->arena, b->consts, sizeof(BytecodeWord) * b->consts_cap,
+                                 sizeof(BytecodeWord) * b->consts_cap * 2);
+        b->consts_cap *= 2;
+    }
+    b->consts[b->n_consts] = value;
+    return (u16)b->n_consts++;
+}
+
+
+/* AST to register bytecode */
+/* Parameters and locals live in the register with the number of their frame slot */
+static u8 local_reg(Symbol *sym)
+{
+    assert(sym->kind == SYMBOL_PARAM || sym->kind == SYMBOL_LOCAL_VAR);
+    assert(sym->frame_slot < REG_MAX);
+    return (u8)sym->frame_slot;
+}
+
+static bool is_local(AstExpr *expr)
+{
+    if (expr->kind != EXPR_LITERAL || AS_LITERAL(expr)->lit_type != LIT_IDENT)
+        return false;
+    Symbol *sym = AS_LITERAL(expr)->sym;
+    return sym->kind == SYMBOL_PARAM || sym->kind == SYMBOL_LOCAL_VAR;
+}
+
+static u8 alloc_reg(RegCompiler *c)
+{
+    if (c->next_reg >= REG_MAX) {
+        fprintf(stderr, "bytecode: %.*s needs more than %d registers\n",
+                STR8VIEW_PRINT(c->func->name), REG_MAX);
+        exit(1);
+    }
+    u8 reg = (u8)c->next_reg++;
+    if (c->next_reg > c->func->n_regs)
+        c->func->n_regs = (u16)c->next_reg;
+    return reg;
+}
+
+static void load_const(RegBytecode *b, u8 dst, BytecodeWord value)
+{
+    if (value >= I16_MIN && value <= I16_MAX) {
+        emit(b, REG_ABX(ROP_LOADI, dst, (s16)value));
+    } else {
+        emit(b, REG_ABX(ROP_LOADK, dst, add_const(b, value)));
+    }
+}
+
+/*
+ * Compiles the expression and returns the register that holds its value. With a dst of REG_ANY,
+ * locals are used in place and other values go in a new temporary. Otherwise the value is put in
+ * dst, which is only written by the last instruction so it can also be read by the expression.
+ */
+static u8 reg_expr(RegCompiler *c, AstExpr *head, s32 dst)
+{
+    switch (head->kind) {
+    default:
+        printf("Ast expr not handled\n");
+        return dst == REG_ANY ? alloc_reg(c) : (u8)dst;
+    case EXPR_BINARY: {
+        AstBinary *expr = AS_BINARY(head);
+        assert(expr->type->kind == TYPE_INTEGER);
+        u32 top = c->next_reg;
+        u8 left = reg_expr(c, expr->left, REG_ANY);
+        u8 right = reg_expr(c, expr->right, REG_ANY);
+        c->next_reg = top;
+        u8 result = dst == REG_ANY ? alloc_reg(c) : (u8)dst;
+        RegOp op;
+        switch (expr->op) {
+        default:
+            printf("Binary op not handled\n");
+            return result;
+        case TOKEN_PLUS:
+            op = ROP_ADD;
+            break;
+        case TOKEN_MINUS:
+            op = ROP_SUB;
+            break;
+        case TOKEN_STAR:
+            op = ROP_MUL;
+            break;
+        case TOKEN_SLASH:
+            op = ROP_DIV;
+            break;
+        case TOKEN_LSHIFT:
+            op = ROP_LSHIFT;
+            break;
+        case TOKEN_RSHIFT:
+            op = ROP_RSHIFT;
+            break;
+        case TOKEN_EQ:
+            op = ROP_EQ;
+            break;
+        case TOKEN_NEQ:
+            op = ROP_NE;
+            break;
+        case TOKEN_GREATER:
+            op = ROP_GT;
+            break;
+        case TOKEN_LESS:
+            op = ROP_LT;
+            break;
+        }
+        emit(c->b, REG_ABC(op, result, left, right));
+        return result;
+    }
+    case EXPR_LITERAL: {
+        AstLiteral *expr = AS_LITERAL(head);
+        if (is_local(head)) {
+            u8 reg = local_reg(expr->sym);
+            if (dst == REG_ANY || dst == reg)
+                return reg;
+            emit(c->b, REG_ABC(ROP_MOV, dst, reg, 0));
+            return (u8)dst;
+        }
+        u8 result = dst == REG_ANY ? alloc_reg(c) : (u8)dst;
+        if (expr->lit_type == LIT_NUM) {
+            load_const(c->b, result, str_view_to_u32(expr->literal, NULL));
+        } else {
+            printf("Ast literal expr kind not handled\n");
+        }
+        return result;
+    }
+    case EXPR_CALL: {
+        AstCall *call = AS_CALL(head);
+        /* The arguments go in consecutive registers at the top of the frame */
+        u32 base = c->next_reg;
+        if (call->args != NULL) {
+            for (AstListNode *n = call->args->head; n != NULL; n = n->next) {
+                u8 arg = alloc_reg(c);
+                reg_expr(c, (AstExpr *)n->this, arg);
+            }
+        }
+        /* The callees frame may go past this frames registers, so the call always has one */
+        if (base == c->next_reg)
+            alloc_reg(c);
+        emit(c->b, REG_ABX(ROP_CALL, base, (u16)func_table_get(&c->funcs, call->identifier)));
+        c->next_reg = base + 1;
+        if (dst == REG_ANY || dst == (s32)base)
+            return (u8)base;
+        emit(c->b, REG_ABC(ROP_MOV, dst, base, 0));
+        c->next_reg = base;
+        return (u8)dst;
+    }
+    };
+}
+
+static void reg_stmt(RegCompiler *c, AstStmt *head)
+{
+    /* Temporaries only live for the duration of a statement */
+    u32 top = c->next_reg;
+
+    switch (head->kind) {
+    default:
+        printf("Ast stmt %d not handled\n", head->kind);
+        break;
+    case STMT_ASSIGNMENT: {
+        AstAssignment *assignment = AS_ASSIGNMENT(head);
+        /* Only locals live in registers, stores to memory have no instructions yet */
+        if (!is_local(assignment->left)) {
+            printf("Assignment target not handled\n");
+            break;
+        }
+        u8 reg = local_reg(AS_LITERAL(assignment->left)->sym);
+        reg_expr(c, assignment->right, reg);
+    } break;
+    case STMT_IF: {
+        AstIf *if_ = AS_IF(head);
+        u8 cond = reg_expr(c, if_->condition, REG_ANY);
+        c->next_reg = top;
+        u32 else_jump = emit_forward_jump(c->b, REG_ABC(ROP_BZ, cond, 0, 0));
+        reg_stmt(c, if_->then);
+        if (if_->else_) {
+            u32 end_jump = emit_forward_jump(c->b, REG_ABC(ROP_JMP, 0, 0, 0));
+            patch_jump(c->b, else_jump);
+            reg_stmt(c, if_->else_);
+            patch_jump(c->b, end_jump);
+        } else {
+            patch_jump(c->b, else_jump);
+        }
+    } break;
+    case STMT_WHILE: {
+        AstWhile *while_ = AS_WHILE(head);
+        u32 condition_target = c->b->len;
+        u8 cond = reg_expr(c, while_->condition, REG_ANY);
+        c->next_reg = top;
+        u32 end_jump = emit_forward_jump(c->b, REG_ABC(ROP_BZ, cond, 0, 0));
+        reg_stmt(c, while_->body);
+        emit_backward_jump(c->b, REG_ABC(ROP_JMP, 0, 0, 0), condition_target);
+        patch_jump(c->b, end_jump);
+    } break;
+    case STMT_BLOCK: {
+        AstBlock *block = AS_BLOCK(head);
+        /* The registers of the locals are released at the end of this statement, as temporaries are */
+        SymbolTable *symt = block->symt_local;
+        for (u32 i = 0; i < symt->sym_len; i++) {
+            Symbol *sym = symt->symbols[i];
+            if (sym->kind == SYMBOL_LOCAL_VAR) {
+                u8 reg = alloc_reg(c);
+                assert(reg == local_reg(sym));
+                (void)reg;
+            }
+        }
+        for (AstListNode *n = block->stmts->head; n != NULL; n = n->next) {
+            reg_stmt(c, (AstStmt *)n->this);
+        }
+    } break;
+    case STMT_RETURN: {
+        AstSingle *stmt = AS_SINGLE(head);
+        u8 result;
+        if (stmt->node != NULL) {
+            result = reg_expr(c, (AstExpr *)stmt->node, REG_ANY);
+        } else {
+            result = alloc_reg(c);
+            load_const(c->b, result, 0);
+        }
+        emit(c->b, REG_ABC(ROP_RET, result, 0, 0));
+    } break;
+    case STMT_EXPR:
+        reg_expr(c, (AstExpr *)AS_SINGLE(head)->node, REG_ANY);
+        break;
+    case STMT_PRINT: {
+        AstList *stmt = AS_LIST(head);
+        u8 n_args = 0;
+        for (AstListNode *n = stmt->head; n != NULL; n = n->next) {
+            n_args++;
+            reg_expr(c, (AstExpr *)n->this, alloc_reg(c));
+        }
+        emit(c->b, REG_ABC(ROP_PRINT, top, n_args, 0));
+    } break;
+    }
+
+    c->next_reg = top;
+}
+
+static void reg_func(RegCompiler *c, AstFunc *func, RegFunc *rfunc)
+{
+    assert(func->body != NULL);
+    rfunc->code_offset = c->b->len;
+    rfunc->n_regs = rfunc->n_params;
+    c->func = rfunc;
+    c->next_reg = rfunc->n_params;
+
+    reg_stmt(c, func->body);
+    /* Falling of the end returns 0 */
+    u8 result = alloc_reg(c);
+    load_const(c->b, result, 0);
+    emit(c->b, REG_ABC(ROP_RET, result, 0, 0));
+}
+
+RegBytecode *ast_to_reg_bytecode(Arena *arena, AstRoot *root)
+{
+    assert(root->funcs.head != NULL);
+    RegBytecode *b = m_arena_alloc_tagged(arena, sizeof(RegBytecode), MEM_TAG_BYTECODE);
+    reg_bytecode_init(b, arena);
+    RegCompiler c = { .arena = arena, .b = b };
+    func_table_init(&c.funcs, arena);
+
+    /* Same as for the stack bytecode, the function table is filled in first */
+    u32 n_funcs = 0;
+    for (AstListNode *n = root->funcs.head; n != NULL; n = n->next) {
+        n_funcs += AS_FUNC(n->this)->body != NULL;
+    }
+    b->funcs = m_arena_alloc_tagged(arena, sizeof(RegFunc) * n_funcs, MEM_TAG_BYTECODE);
+    for (AstListNode *n = root->funcs.head; n != NULL; n = n->next) {
+        AstFunc *func = AS_FUNC(n->this);
+        if (func->body == NULL) {
+            continue;
+        }
+        u32 idx = b->n_funcs++;
+        b->funcs[idx] = (RegFunc){ .name = func->name, .n_params = (u16)func->parameters.len };
+        func_table_put(&c.funcs, func->name, idx);
+        if (STR8VIEW_EQUAL(func->name, STR8_LIT("main"))) {
+            b->entry = idx;
+        }
+    }
+    assert(n_funcs > 0);
+
+    u32 idx = 0;
+    for (AstListNode *n = root->funcs.head; n != NULL; n = n->next) {
+        AstFunc *func = AS_FUNC(n->this);
+        if (func->body != NULL) {
+            reg_func(&c, func, &b->funcs[idx++]);
+        }
+    }
+
+    return b;
+}
+
+RegBytecode *reg_fib_test(Arena *arena, BytecodeWord n)
+{
+    RegBytecode *b = m_arena_alloc_tagged(arena, sizeof(RegBytecode), MEM_TAG_BYTECODE);
+    reg_bytecode_init(b, arena);
+    b->n_funcs = 2;
+    b->funcs = m_arena_alloc_tagged(arena, sizeof(RegFunc) * b->n_funcs, MEM_TAG_BYTECODE);
+    b->funcs[0] = (RegFunc){ .name = STR8_LIT("fib"), .n_params = 1, .n_regs = 4 };
+    b->funcs[1] = (RegFunc){ .name = STR8_LIT("main"), .n_params = 0, .n_regs = 1 };
+    b->entry = 1;
+
+    /* fib */
+    b->funcs[0].code_offset = b->len;
+    // if n < 2 then return n
+    emit(b, REG_ABX(ROP_LOADI, 1, 2));
+    emit(b, REG_ABC(ROP_LT, 1, 0, 1));
+    u32 else_jump = emit_forward_jump(b, REG_ABC(ROP_BZ, 1, 0, 0));
+    emit(b, REG_ABC(ROP_RET, 0, 0, 0));
+    patch_jump(b, else_jump);
+    // r1 = fib(n - 2)
+    emit(b, REG_ABX(ROP_LOADI, 2, 2));
+    emit(b, REG_ABC(ROP_SUB, 1, 0, 2));
+    emit(b, REG_ABX(ROP_CALL, 1, 0));
+    // r2 = fib(n - 1)
+    emit(b, REG_ABX(ROP_LOADI, 3, 1));
+    emit(b, REG_ABC(ROP_SUB, 2, 0, 3));
+    emit(b, REG_ABX(ROP_CALL, 2, 0));
+    // return r1 + r2
+    emit(b, REG_ABC(ROP_ADD, 1, 1, 2));
+    emit(b, REG_ABC(ROP_RET, 1, 0, 0));
+
+    /* main */
+    b->funcs[1].code_offset = b->len;
+    load_const(b, 0, n);
+    emit(b, REG_ABX(ROP_CALL, 0, 0));
+    emit(b, REG_ABC(ROP_RET, 0, 0, 0));
+
+    return b;
+}
+
+RegBytecode *reg_loop_test(Arena *arena, BytecodeWord n)
+{
+    RegBytecode *b = m_arena_alloc_tagged(arena, sizeof(RegBytecode), MEM_TAG_BYTECODE);
+    reg_bytecode_init(b, arena);
+    b->n_funcs = 1;
+    b->funcs = m_arena_alloc_tagged(arena, sizeof(RegFunc), MEM_TAG_BYTECODE);
+    b->funcs[0] = (RegFunc){ .name = STR8_LIT("main"), .n_params = 0, .n_regs = 4 };
+    b->entry = 0;
+
+    /* r0 is i, r1 is sum and r3 holds n */
+    emit(b, REG_ABX(ROP_LOADI, 0, 0));
+    emit(b, REG_ABX(ROP_LOADI, 1, 0));
+    load_const(b, 3, n);
+    // while i < n
+    u32 loop_start = b->len;
+    emit(b, REG_ABC(ROP_LT, 2, 0, 3));
+    u32 end_jump = emit_forward_jump(b, REG_ABC(ROP_BZ, 2, 0, 0));
+    // sum := sum + i
+    emit(b, REG_ABC(ROP_ADD, 1, 1, 0));
+    // i := i + 1
+    emit(b, REG_ABX(ROP_LOADI, 2, 1));
+    emit(b, REG_ABC(ROP_ADD, 0, 0, 2));
+    emit_backward_jump(b, REG_ABC(ROP_JMP, 0, 0, 0), loop_start);
+    patch_jump(b, end_jump);
+    emit(b, REG_ABC(ROP_RET, 1, 0, 0));
+
+    return b;
+}
@@ -0,0 +1,128 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef REG_BYTECODE_H
+#define REG_BYTECODE_H
+
+#include "base/sac_single.h"
+#include "base/types.h"
+#include "compiler/ast.h"
+#include "compiler/comptime/bytecode.h"
+
+/*
+ * Bytecode for the register VM.
+ *
+ * Instructions are three-address and operate on the registers of the current frame. Every
+ * instruction is one 32-bit word:
+ *   ABC: op:8 A:8 B:8 C:8
+ *   ABx: op:8 A:8 Bx:16
+ * Jumps and branches are followed by one more word holding a signed offset, in words, from the
+ * end of the instruction. So there are no short and long forms of them.
+ *
+ * Parameters are the first registers of a frame, then come the locals and then temporaries.
+ * A call slides the frame up so that the arguments the caller put in R[A], R[A + 1], ... become
+ * R0, R1, ... of the callee. The return value ends up in R[A] of the caller.
+ */
+
+typedef u32 RegInstr;
+
+#define REG_MAX 256 // Per frame, since A, B and C are a byte each
+#define REG_ANY -1 // Let the compiler pick the destination register
+
+#define REG_OP(___i) ((RegOp)((___i) & 0xff))
+#define REG_A(___i) (((___i) >> 8) & 0xff)
+#define REG_B(___i) (((___i) >> 16) & 0xff)
+#define REG_C(___i) ((___i) >> 24)
+#define REG_BX(___i) ((___i) >> 16)
+#define REG_SBX(___i) ((s16)((___i) >> 16))
+
+#define REG_ABC(___op, ___a, ___b, ___c) \
+    ((RegInstr)(___op) | (RegInstr)(___a) << 8 | (RegInstr)(___b) << 16 | (RegInstr)(___c) << 24)
+#define REG_ABX(___op, ___a, ___bx) \
+    ((RegInstr)(___op) | (RegInstr)(___a) << 8 | (RegInstr)(u16)(___bx) << 16)
+
+typedef enum {
+    ROP_LOADI, // R[A] = sBx
+    ROP_LOADK, // R[A] = K[Bx]
+    ROP_MOV, // R[A] = R[B]
+
+    /* arithmetic, R[A] = R[B] op R[C] */
+    ROP_ADD,
+    ROP_SUB,
+    ROP_MUL,
+    ROP_DIV,
+    ROP_LSHIFT,
+    ROP_RSHIFT,
+    ROP_LT,
+    ROP_GT,
+    ROP_EQ,
+    ROP_NE,
+    ROP_NOT, // R[A] = !R[B]
+
+    /* Branching. The offset is in the next word */
+    ROP_JMP,
+    ROP_BZ, // branch if R[A] is zero
+    ROP_BNZ, // branch if R[A] is not zero
+
+    /* Functions */
+    ROP_CALL, // call function Bx with its arguments in R[A] and onwards. Result goes in R[A]
+    ROP_RET, // return R[A]
+
+    ROP_PRINT, // print R[A] to R[A + B - 1]
+
+    ROP_TYPE_LEN,
+} RegOp;
+
+extern char *reg_op_str_map[ROP_TYPE_LEN];
+
+typedef struct {
+    Str8 name;
+    u32 code_offset; // In words
+    u16 n_params;
+    u16 n_regs; // Size of the frame
+} RegFunc;
+
+typedef struct {
+    RegInstr *code;
+    u32 len;
+    u32 cap;
+    Arena *arena;
+    BytecodeWord *consts; // Constants that don't fit in a LOADI
+    u32 n_consts;
+    u32 consts_cap;
+    RegFunc *funcs; // CALL Bx indexes into this
+    u32 n_funcs;
+    u32 entry;
+} RegBytecode;
+
+typedef struct {
+    Arena *arena;
+    RegBytecode *b;
+    HashMap funcs; // See func_table_init()
+    RegFunc *func; // Function being compiled
+    u32 next_reg; // Registers below this are in use
+} RegCompiler;
+
+
+RegBytecode *ast_to_reg_bytecode(Arena *arena, AstRoot *root);
+void reg_disassemble(RegBytecode *b);
+
+/* Same program as fib_test() */
+RegBytecode *reg_fib_test(Arena *arena, BytecodeWord n);
+/* Same program as loop_test() */
+RegBytecode *reg_loop_test(Arena *arena, BytecodeWord n);
+
+#endif /* REG_BYTECODE_H */
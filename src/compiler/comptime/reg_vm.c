@@ -0,0 +1,187 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "compiler/comptime/reg_vm.h"
+#include "compiler/comptime/reg_bytecode.h"
+#include "compiler/comptime/dispatch.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/* Fetches the next instruction for the dispatch in reg_run() */
+#define NEXT_OPCODE REG_OP(instr = *ip++)
+#define NEXT() VM_NEXT(NEXT_OPCODE, dispatch_table)
+
+#if VM_COMPUTED_GOTO
+/* See vm_loop() in vm.c */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+
+BytecodeWord reg_run(RegBytecode *b)
+{
+#if VM_COMPUTED_GOTO
+    static void *dispatch_table[256] = {
+        [0 ... 255] = VM_DEFAULT_LABEL,
+        VM_LABEL(ROP_LOADI),  VM_LABEL(ROP_LOADK),  VM_LABEL(ROP_MOV), VM_LABEL(ROP_ADD),
+        VM_LABEL(ROP_SUB),    VM_LABEL(ROP_MUL),    VM_LABEL(ROP_DIV), VM_LABEL(ROP_LSHIFT),
+        VM_LABEL(ROP_RSHIFT), VM_LABEL(ROP_LT),     VM_LABEL(ROP_GT),  VM_LABEL(ROP_EQ),
+        VM_LABEL(ROP_NE),     VM_LABEL(ROP_NOT),    VM_LABEL(ROP_JMP), VM_LABEL(ROP_BZ),
+        VM_LABEL(ROP_BNZ),    VM_LABEL(ROP_CALL),   VM_LABEL(ROP_RET), VM_LABEL(ROP_PRINT),
+    };
+    _Static_assert(ROP_TYPE_LEN == 20, "dispatch_table is missing an opcode");
+#endif
+
+    /* Too large for the C stack together with the callers */
+    RegVM *vm = malloc(sizeof(RegVM));
+    vm->b = b;
+    BytecodeWord result = 0;
+
+    RegFunc *entry = &b->funcs[b->entry];
+    assert(entry->n_params == 0 && entry->n_regs <= REG_STACK_MAX);
+    vm->frames[0] = (RegFrame){ .return_ip = NULL, .regs = NULL };
+    vm->n_frames = 1;
+
+    /* The hot state is kept in locals so it can live in machine registers */
+    RegInstr *ip = b->code + entry->code_offset;
+    BytecodeWord *r = vm->regs;
+
+    RegInstr instr;
+    VM_DISPATCH(NEXT_OPCODE, dispatch_table)
+    {
+    VM_CASE(ROP_LOADI) :
+        r[REG_A(instr)] = REG_SBX(instr);
+        NEXT();
+    VM_CASE(ROP_LOADK) :
+        r[REG_A(instr)] = b->consts[REG_BX(instr)];
+        NEXT();
+    VM_CASE(ROP_MOV) :
+        r[REG_A(instr)] = r[REG_B(instr)];
+        NEXT();
+
+    /* Arithmetic */
+    VM_CASE(ROP_ADD) :
+        r[REG_A(instr)] = r[REG_B(instr)] + r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_SUB) :
+        r[REG_A(instr)] = r[REG_B(instr)] - r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_MUL) :
+        r[REG_A(instr)] = r[REG_B(instr)] * r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_DIV) : {
+        /* Like OP_DIVW in vm_loop(), but without a meter to stop the run on */
+        BytecodeWord divisor = r[REG_C(instr)];
+        if (divisor == 0) {
+            printf("Division by zero\n");
+            goto vm_loop_done;
+        }
+        r[REG_A(instr)] = divisor == -1 ? (BytecodeWord)(0 - (u64)r[REG_B(instr)])
+                                        : r[REG_B(instr)] / divisor;
+        NEXT();
+    }
+    VM_CASE(ROP_LSHIFT) :
+        r[REG_A(instr)] = r[REG_B(instr)] << r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_RSHIFT) :
+        r[REG_A(instr)] = r[REG_B(instr)] >> r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_LT) :
+        r[REG_A(instr)] = r[REG_B(instr)] < r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_GT) :
+        r[REG_A(instr)] = r[REG_B(instr)] > r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_EQ) :
+        r[REG_A(instr)] = r[REG_B(instr)] == r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_NE) :
+        r[REG_A(instr)] = r[REG_B(instr)] != r[REG_C(instr)];
+        NEXT();
+    VM_CASE(ROP_NOT) :
+        r[REG_A(instr)] = !r[REG_B(instr)];
+        NEXT();
+
+    /* Branching */
+    VM_CASE(ROP_JMP) : {
+        s32 offset = (s32)*ip++;
+        ip += offset;
+        NEXT();
+    }
+    VM_CASE(ROP_BZ) : {
+        s32 offset = (s32)*ip++;
+        if (r[REG_A(instr)] == 0)
+            ip += offset;
+        NEXT();
+    }
+    VM_CASE(ROP_BNZ) : {
+        s32 offset = (s32)*ip++;
+        if (r[REG_A(instr)] != 0)
+            ip += offset;
+        NEXT();
+    }
+
+    /* Functions */
+    VM_CASE(ROP_CALL) : {
+        RegFunc *func = &b->funcs[REG_BX(instr)];
+        BytecodeWord *callee_regs = r + REG_A(instr);
+        if (callee_regs + func->n_regs > vm->regs + REG_STACK_MAX ||
+            vm->n_frames == REG_FRAMES_MAX) {
+            printf("Stack overflow\n");
+            goto vm_loop_done;
+        }
+        vm->frames[vm->n_frames++] = (RegFrame){ .return_ip = ip, .regs = r };
+        r = callee_regs;
+        ip = b->code + func->code_offset;
+        NEXT();
+    }
+    VM_CASE(ROP_RET) : {
+        BytecodeWord value = r[REG_A(instr)];
+        RegFrame *frame = &vm->frames[--vm->n_frames];
+        if (frame->return_ip == NULL) {
+            result = value;
+            goto vm_loop_done;
+        }
+        /* R0 of the callee is where the caller wants the result */
+        r[0] = value;
+        r = frame->regs;
+        ip = frame->return_ip;
+        NEXT();
+    }
+
+    VM_CASE(ROP_PRINT) : {
+        for (u32 i = 0; i < REG_B(instr); i++) {
+            printf("%ld ", r[REG_A(instr) + i]);
+        }
+        printf("\n");
+        NEXT();
+    }
+
+    VM_DEFAULT:
+        printf("Unknown opcode %d\n", REG_OP(instr));
+        goto vm_loop_done;
+    }
+
+vm_loop_done:
+    free(vm);
+    return result;
+}
+
+#if VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
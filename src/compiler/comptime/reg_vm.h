@@ -0,0 +1,41 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef REG_VM_H
+#define REG_VM_H
+
+#include "compiler/comptime/reg_bytecode.h"
+
+#define REG_STACK_MAX (1 << 14) // Registers of every live frame, in words
+#define REG_FRAMES_MAX 4096
+
+typedef struct {
+    RegInstr *return_ip; // NULL for the entry function
+    BytecodeWord *regs; // The callers registers
+} RegFrame;
+
+typedef struct {
+    RegBytecode *b;
+    BytecodeWord regs[REG_STACK_MAX];
+    RegFrame frames[REG_FRAMES_MAX];
+    u32 n_frames;
+} RegVM;
+
+
+/* Runs the entry function and returns what it returned */
+BytecodeWord reg_run(RegBytecode *b);
+
+#endif /* REG_VM_H */
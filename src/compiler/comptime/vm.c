@@ -15,173 +15,731 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "compiler/comptime/vm.h"
+#include "compiler/comptime/ast_handle.h"
 #include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/builtin.h"
+#include "compiler/comptime/dispatch.h"
+#include "compiler/comptime/jit.h"
+#include "compiler/comptime/profile.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 
-static BytecodeWord readw(MetagenVM *vm)
+/* Operands are not aligned in the code */
+static inline BytecodeWord read_BytecodeWord(u8 *ip)
 {
-    BytecodeWord value = *(BytecodeWord *)vm->ip;
-    vm->ip += sizeof(BytecodeWord);
+    BytecodeWord value;
+    memcpy(&value, ip, sizeof(value));
     return value;
 }
 
-static BytecodeImm readi(MetagenVM *vm)
+static inline BytecodeImm read_BytecodeImm(u8 *ip)
 {
-    BytecodeImm value = *(BytecodeImm *)vm->ip;
-    vm->ip += sizeof(BytecodeImm);
+    BytecodeImm value;
+    memcpy(&value, ip, sizeof(value));
     return value;
 }
 
-static u8 read_u8(MetagenVM *vm)
+static inline BytecodeWideImm read_BytecodeWideImm(u8 *ip)
 {
-    u8 value = *vm->ip;
-    vm->ip++;
+    BytecodeWideImm value;
+    memcpy(&value, ip, sizeof(value));
     return value;
 }
 
-/* Stack operations */
-static void pushn(MetagenVM *vm, BytecodeImm n)
+static inline u8 read_u8(u8 *ip)
 {
-    // TODO: zero init?
-    vm->sp += sizeof(BytecodeWord) * n;
+    return *ip;
 }
 
-static void pushw(MetagenVM *vm, BytecodeWord value)
+/* True if the n_bytes from address are allocated on the heap */
+static inline bool heap_valid(Arena *heap, BytecodeWord address, u64 n_bytes)
 {
-    *(BytecodeWord *)vm->sp = value;
-    vm->sp += sizeof(BytecodeWord);
+    return address >= HEAP_NULL_BYTES && (u64)address <= heap->offset &&
+           n_bytes <= heap->offset - (u64)address;
 }
 
-static BytecodeWord popw(MetagenVM *vm)
+static inline BytecodeWord heap_load(u8 *at, MemWidth width)
 {
-    vm->sp -= sizeof(BytecodeWord);
-    return *(BytecodeWord *)vm->sp;
+    switch ((u8)width) {
+    case MEM_8:
+        return *at;
+    case MEM_8 | MEM_SIGNED:
+        return (s8)*at;
+    case MEM_16: {
+        u16 value;
+        memcpy(&value, at, sizeof(value));
+        return value;
+    }
+    case MEM_16 | MEM_SIGNED: {
+        s16 value;
+        memcpy(&value, at, sizeof(value));
+        return value;
+    }
+    case MEM_32: {
+        u32 value;
+        memcpy(&value, at, sizeof(value));
+        return value;
+    }
+    case MEM_32 | MEM_SIGNED: {
+        s32 value;
+        memcpy(&value, at, sizeof(value));
+        return value;
+    }
+    default: {
+        BytecodeWord value;
+        memcpy(&value, at, sizeof(value));
+        return value;
+    }
+    }
 }
 
-static BytecodeWord popn(MetagenVM *vm, BytecodeImm n)
+static inline void heap_store(u8 *at, MemWidth width, BytecodeWord value)
 {
-    vm->sp -= sizeof(BytecodeWord) * n;
-    return *vm->sp;
+    switch (width & MEM_SIZE_MASK) {
+    case MEM_8:
+        *at = (u8)value;
+        break;
+    case MEM_16: {
+        u16 narrow = (u16)value;
+        memcpy(at, &narrow, sizeof(narrow));
+    } break;
+    case MEM_32: {
+        u32 narrow = (u32)value;
+        memcpy(at, &narrow, sizeof(narrow));
+    } break;
+    default:
+        memcpy(at, &value, sizeof(value));
+        break;
+    }
 }
 
-static BytecodeWord loadw(MetagenVM *vm, BytecodeImm bp_offset)
+/*
+ * ip, sp and bp are locals in vm_loop() rather than fields of MetagenVM so the compiler can keep
+ * them in registers. Everything below operates on those locals.
+ *
+ * The top of the stack is cached in tos. Every value below it is in memory, up to but not
+ * including sp, which is where tos belongs. The copy of tos in memory is stale unless it was
+ * just spilled, so ops that index the stack through bp must spill it first.
+ */
+#define READ(___type) (ip += sizeof(___type), read_##___type(ip - sizeof(___type)))
+#define PUSH(___value) (*sp++ = tos, tos = (___value))
+#define DROP() (tos = *--sp)
+#define SPILL() (*sp = tos)
+
+/* One unit of fuel, see VMMeter. ___len is the length of the instruction charging */
+#define CHARGE(___len)                                                       \
+    if (VM_UNLIKELY(--slice < 0)) {                                          \
+        meter->slice = slice;                                                \
+        if (!vm_meter_refill(meter)) {                                       \
+            meter->stop_offset = (u32)(ip - bytecode->code) - (u32)(___len); \
+            goto vm_stopped;                                                 \
+        }                                                                    \
+        slice = meter->slice;                                                \
+    }
+
+/* Stops the run in the op that was just read */
+#define STOP(___stop, ___op)                                                      \
+    do {                                                                          \
+        meter->stop = (___stop);                                                  \
+        meter->stop_offset = (u32)(ip - bytecode->code) - bytecode_op_len(___op); \
+        goto vm_stopped;                                                          \
+    } while (0)
+
+/* Backward branches are charged, they are what lets a loop run on */
+#define BRANCH(___offset, ___len) \
+    do {                          \
+        if ((___offset) < 0) {    \
+            CHARGE(___len);       \
+        }                         \
+        ip += (___offset);        \
+    } while (0)
+
+/* Fetches the next opcode for the dispatch in vm_loop() */
+#if VM_PROFILE
+#define NEXT_OPCODE                                                                 \
+    ((profile != NULL ? vm_profile_step(profile, (u32)(ip - bytecode->code)) : (void)0), \
+     instruction = *ip++)
+#else
+#define NEXT_OPCODE (instruction = *ip++)
+#endif
+#define NEXT() VM_NEXT(NEXT_OPCODE, dispatch_table)
+
+#if VM_COMPUTED_GOTO
+/*
+ * Labels as values and range designators are GNU extensions. The range designator sets every
+ * entry to the default label before the opcodes override theirs.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+
+/*
+ * Runs func_idx, with its arguments at bp, until it returns. Calls go through vm->jit if it is
+ * set, and may land in compiled code. vm->profile is only used with VM_PROFILE.
+ */
+static BytecodeWord vm_loop(MetagenVM *vm, BytecodeWord *bp, u32 func_idx)
 {
-    return vm->stack[vm->bp + bp_offset];
+#if VM_COMPUTED_GOTO
+    static void *dispatch_table[256] = {
+        [0 ... 255] = VM_DEFAULT_LABEL,
+        VM_LABEL(OP_ADDW),   VM_LABEL(OP_SUBW),   VM_LABEL(OP_MULW),   VM_LABEL(OP_DIVW),
+        VM_LABEL(OP_LSHIFT), VM_LABEL(OP_RSHIFT), VM_LABEL(OP_GE),     VM_LABEL(OP_LE),
+        VM_LABEL(OP_NOT),    VM_LABEL(OP_JMP),    VM_LABEL(OP_JMPW),   VM_LABEL(OP_BIZ),
+        VM_LABEL(OP_BNZ),    VM_LABEL(OP_BIZW),   VM_LABEL(OP_BNZW),   VM_LABEL(OP_BEQ),
+        VM_LABEL(OP_BNE),    VM_LABEL(OP_BLE),    VM_LABEL(OP_BGE),    VM_LABEL(OP_CONSW),
+        VM_LABEL(OP_PUSHN),  VM_LABEL(OP_POPN),   VM_LABEL(OP_LOADL),  VM_LABEL(OP_STOREL),
+        VM_LABEL(OP_INCL),   VM_LABEL(OP_CALL),   VM_LABEL(OP_CALLN),  VM_LABEL(OP_RET),
+        VM_LABEL(OP_LOADF),  VM_LABEL(OP_STOREF), VM_LABEL(OP_LOADM),  VM_LABEL(OP_STOREM),
+        VM_LABEL(OP_MEMCPY), VM_LABEL(OP_MEMSET), VM_LABEL(OP_ALLOC),  VM_LABEL(OP_FREE),
+        VM_LABEL(OP_PRINT),
+    };
+    _Static_assert(OP_TYPE_LEN == 37, "dispatch_table is missing an opcode");
+#endif
+
+    Bytecode *bytecode = vm->b;
+    BytecodeWord *stack = vm->stack;
+    VMMeter *meter = vm->meter;
+    /* Kept in a local like the rest of the hot state, meter->slice is only current across calls */
+    s64 slice = meter->slice;
+    VMProfile *profile = vm->profile;
+    Jit *jit = vm->jit;
+    Arena *heap = vm->heap;
+    BytecodeWord result = 0;
+    (void)profile;
+
+    BytecodeFunc *entry = &bytecode->funcs[func_idx];
+    /* The function returns to nowhere */
+    bp[entry->n_params] = FRAME_NO_RETURN;
+    bp[entry->n_params + 1] = 0;
+    BytecodeWord *sp = &bp[entry->n_params + 1];
+    BytecodeWord tos = *sp;
+    u8 *ip = bytecode->code + entry->code_offset;
+
+    OpCode instruction;
+    VM_DISPATCH(NEXT_OPCODE, dispatch_table)
+    {
+    VM_CASE(OP_CONSW) : {
+        PUSH(READ(BytecodeWord));
+        NEXT();
+    }
+
+    /* Arithmetic. The left operand is on top of the stack. */
+    VM_CASE(OP_ADDW) : {
+        BytecodeWord b = *--sp;
+        tos = tos + b;
+        NEXT();
+    }
+    VM_CASE(OP_SUBW) : {
+        BytecodeWord b = *--sp;
+        tos = tos - b;
+        NEXT();
+    }
+    VM_CASE(OP_MULW) : {
+        BytecodeWord b = *--sp;
+        tos = tos * b;
+        NEXT();
+    }
+    VM_CASE(OP_DIVW) : {
+        BytecodeWord b = *--sp;
+        if (VM_UNLIKELY(b == 0)) {
+            STOP(VM_STOP_DIV_ZERO, OP_DIVW);
+        }
+        /* The one quotient that doesn't fit traps in hardware, it wraps like the other ops */
+        tos = b == -1 ? (BytecodeWord)(0 - (u64)tos) : tos / b;
+        NEXT();
+    }
+    VM_CASE(OP_LSHIFT) : {
+        BytecodeWord b = *--sp;
+        tos = tos << b;
+        NEXT();
+    }
+    VM_CASE(OP_RSHIFT) : {
+        BytecodeWord b = *--sp;
+        tos = tos >> b;
+        NEXT();
+    }
+    VM_CASE(OP_GE) : {
+        BytecodeWord b = *--sp;
+        tos = tos > b;
+        NEXT();
+    }
+    VM_CASE(OP_LE) : {
+        BytecodeWord b = *--sp;
+        tos = tos < b;
+        NEXT();
+    }
+    VM_CASE(OP_NOT) : {
+        tos = !tos;
+        NEXT();
+    }
+
+    /* Branching */
+    VM_CASE(OP_JMP) : {
+        s16 offset = (s16)READ(BytecodeImm);
+        BRANCH(offset, 1 + sizeof(BytecodeImm));
+        NEXT();
+    }
+    VM_CASE(OP_JMPW) : {
+        s32 offset = (s32)READ(BytecodeWideImm);
+        BRANCH(offset, 1 + sizeof(BytecodeWideImm));
+        NEXT();
+    }
+    VM_CASE(OP_BIZ) : {
+        s16 offset = (s16)READ(BytecodeImm);
+        BytecodeWord a = tos;
+        DROP();
+        if (a == 0) {
+            BRANCH(offset, 1 + sizeof(BytecodeImm));
+        }
+        NEXT();
+    }
+    VM_CASE(OP_BNZ) : {
+        s16 offset = (s16)READ(BytecodeImm);
+        BytecodeWord a = tos;
+        DROP();
+        if (a != 0) {
+            BRANCH(offset, 1 + sizeof(BytecodeImm));
+        }
+        NEXT();
+    }
+    VM_CASE(OP_BIZW) : {
+        s32 offset = (s32)READ(BytecodeWideImm);
+        BytecodeWord a = tos;
+        DROP();
+        if (a == 0) {
+            BRANCH(offset, 1 + sizeof(BytecodeWideImm));
+        }
+        NEXT();
+    }
+    VM_CASE(OP_BNZW) : {
+        s32 offset = (s32)READ(BytecodeWideImm);
+        BytecodeWord a = tos;
+        DROP();
+        if (a != 0) {
+            BRANCH(offset, 1 + sizeof(BytecodeWideImm));
+        }
+        NEXT();
+    }
+
+    /* Compare and branch, from the peephole optimizer */
+    VM_CASE(OP_BEQ) : {
+        s16 offset = (s16)READ(BytecodeImm);
+        BytecodeWord a = tos;
+        BytecodeWord b = *--sp;
+        DROP();
+        if (a == b) {
+            BRANCH(offset, 1 + sizeof(BytecodeImm));
+        }
+        NEXT();
+    }
+    VM_CASE(OP_BNE) : {
+        s16 offset = (s16)READ(BytecodeImm);
+        BytecodeWord a = tos;
+        BytecodeWord b = *--sp;
+        DROP();
+        if (a != b) {
+            BRANCH(offset, 1 + sizeof(BytecodeImm));
+        }
+        NEXT();
+    }
+    VM_CASE(OP_BLE) : {
+        s16 offset = (s16)READ(BytecodeImm);
+        BytecodeWord a = tos;
+        BytecodeWord b = *--sp;
+        DROP();
+        if (a <= b) {
+            BRANCH(offset, 1 + sizeof(BytecodeImm));
+        }
+        NEXT();
+    }
+    VM_CASE(OP_BGE) : {
+        s16 offset = (s16)READ(BytecodeImm);
+        BytecodeWord a = tos;
+        BytecodeWord b = *--sp;
+        DROP();
+        if (a >= b) {
+            BRANCH(offset, 1 + sizeof(BytecodeImm));
+        }
+        NEXT();
+    }
+
+    /* Stack operations */
+    VM_CASE(OP_PUSHN) : {
+        // TODO: zero init?
+        SPILL();
+        sp += READ(BytecodeImm);
+        tos = *sp;
+        NEXT();
+    }
+    VM_CASE(OP_POPN) : {
+        SPILL();
+        sp -= READ(BytecodeImm);
+        tos = *sp;
+        NEXT();
+    }
+    VM_CASE(OP_STOREL) : {
+        BytecodeImm bp_offset = READ(BytecodeImm);
+        BytecodeWord value = tos;
+        DROP();
+        BytecodeWord *local = bp + bp_offset;
+        *local = value;
+        /* The local may be what is on top of the stack now */
+        if (local == sp) {
+            tos = value;
+        }
+        NEXT();
+    }
+    VM_CASE(OP_LOADL) : {
+        BytecodeImm bp_offset = READ(BytecodeImm);
+        /* Spills tos, so the local is up to date in memory even if it was on top */
+        PUSH(bp[bp_offset]);
+        NEXT();
+    }
+    VM_CASE(OP_INCL) : {
+        BytecodeImm bp_offset = READ(BytecodeImm);
+        s16 delta = (s16)READ(BytecodeImm);
+        BytecodeWord *local = bp + bp_offset;
+        if (local == sp) {
+            tos += delta;
+        } else {
+            *local += delta;
+        }
+        NEXT();
+    }
+
+    VM_CASE(OP_PRINT) : {
+        u8 n_args = READ(u8);
+        /* Once spilled the arguments are in memory in the order they were pushed */
+        SPILL();
+        BytecodeWord *args = sp + 1 - n_args;
+        for (u8 i = 0; i < n_args; i++) {
+            printf("%ld ", args[i]);
+        }
+        printf("\n");
+        sp = args - 1;
+        tos = *sp;
+        NEXT();
+    }
+
+    /* Functions */
+    VM_CASE(OP_CALL) : {
+        BytecodeImm callee = READ(BytecodeImm);
+        BytecodeFunc *func = &bytecode->funcs[callee];
+        CHARGE(1 + sizeof(BytecodeImm));
+        /* The callee's frame header goes right above sp, and everything it pushes above that */
+        if (VM_UNLIKELY(stack + STACK_MAX - sp <= FRAME_HEADER_WORDS + func->max_stack)) {
+            STOP(VM_STOP_STACK_OVERFLOW, OP_CALL);
+        }
+        /* The arguments and the frame header must be in memory for the callee */
+        SPILL();
+        BytecodeWord *callee_bp = sp + 1 - func->n_params;
+        JitFunc native = jit != NULL ? jit_lookup(jit, callee) : NULL;
+        if (native != NULL) {
+            /* Returns like OP_RET below, except the frame is already gone */
+            meter->slice = slice;
+            tos = native(callee_bp, jit);
+            slice = meter->slice;
+            sp = callee_bp;
+            NEXT();
+        }
+        sp[1] = ip - bytecode->code;
+        sp[2] = bp - stack;
+        sp += 2;
+        tos = *sp;
+        bp = callee_bp;
+        ip = bytecode->code + func->code_offset;
+        NEXT();
+    }
+    VM_CASE(OP_CALLN) : {
+        Builtin *builtin = &builtins[READ(BytecodeImm)];
+        /* Like OP_PRINT the arguments are read in place, then the result replaces them */
+        SPILL();
+        BytecodeWord *args = sp + 1 - builtin->n_params;
+        VMStop stop = builtin_call(builtin, vm->arena, args, &tos);
+        if (VM_UNLIKELY(stop != VM_STOP_NONE)) {
+            meter->stop = stop;
+            meter->stop_offset = (u32)(ip - bytecode->code) - (1 + sizeof(BytecodeImm));
+            goto vm_stopped;
+        }
+        sp = args;
+        NEXT();
+    }
+    VM_CASE(OP_RET) : {
+        BytecodeImm n_params = READ(BytecodeImm);
+        BytecodeWord value = tos;
+        BytecodeWord return_offset = bp[n_params];
+        BytecodeWord caller_bp = bp[n_params + 1];
+        /* Drops the arguments, the header, the locals and any temporaries */
+        sp = bp;
+        bp = stack + caller_bp;
+        if (return_offset == FRAME_NO_RETURN) {
+            result = value;
+            goto vm_loop_done;
+        }
+        ip = bytecode->code + return_offset;
+        /* The value takes the place of the first argument */
+        tos = value;
+        NEXT();
+    }
+
+    /* AST handles */
+    VM_CASE(OP_LOADF) : {
+        AstField *field = &ast_fields[READ(BytecodeImm)];
+        if (VM_UNLIKELY(!ast_handle_valid(field->kinds, tos))) {
+            goto vm_bad_handle;
+        }
+        tos = ast_field_load(field, tos);
+        NEXT();
+    }
+    VM_CASE(OP_STOREF) : {
+        AstField *field = &ast_fields[READ(BytecodeImm)];
+        BytecodeWord handle = tos;
+        BytecodeWord value = *--sp;
+        if (VM_UNLIKELY(!ast_handle_valid(field->kinds, handle) ||
+                        !ast_field_storable(field, value))) {
+            goto vm_bad_handle;
+        }
+        ast_field_store(field, handle, value);
+        DROP();
+        NEXT();
+    }
+
+    /* Heap */
+    VM_CASE(OP_LOADM) : {
+        BytecodeImm offset = READ(BytecodeImm);
+        MemWidth width = READ(u8);
+        if (VM_UNLIKELY(!heap_valid(heap, tos, offset + (width & MEM_SIZE_MASK)))) {
+            STOP(VM_STOP_BAD_ADDRESS, OP_LOADM);
+        }
+        tos = heap_load(heap->memory + tos + offset, width);
+        NEXT();
+    }
+    VM_CASE(OP_STOREM) : {
+        BytecodeImm offset = READ(BytecodeImm);
+        MemWidth width = READ(u8);
+        BytecodeWord address = tos;
+        BytecodeWord value = *--sp;
+        if (VM_UNLIKELY(!heap_valid(heap, address, offset + (width & MEM_SIZE_MASK)))) {
+            STOP(VM_STOP_BAD_ADDRESS, OP_STOREM);
+        }
+        heap_store(heap->memory + address + offset, width, value);
+        DROP();
+        NEXT();
+    }
+    VM_CASE(OP_MEMCPY) : {
+        BytecodeWideImm n_bytes = READ(BytecodeWideImm);
+        BytecodeWord dst = tos;
+        BytecodeWord src = *--sp;
+        if (VM_UNLIKELY(!heap_valid(heap, dst, n_bytes) || !heap_valid(heap, src, n_bytes))) {
+            STOP(VM_STOP_BAD_ADDRESS, OP_MEMCPY);
+        }
+        memmove(heap->memory + dst, heap->memory + src, n_bytes);
+        DROP();
+        NEXT();
+    }
+    VM_CASE(OP_MEMSET) : {
+        BytecodeWideImm n_bytes = READ(BytecodeWideImm);
+        BytecodeWord dst = tos;
+        BytecodeWord value = *--sp;
+        if (VM_UNLIKELY(!heap_valid(heap, dst, n_bytes))) {
+            STOP(VM_STOP_BAD_ADDRESS, OP_MEMSET);
+        }
+        memset(heap->memory + dst, (u8)value, n_bytes);
+        DROP();
+        NEXT();
+    }
+    VM_CASE(OP_ALLOC) : {
+        BytecodeWideImm n_bytes = READ(BytecodeWideImm);
+        u8 *at = m_arena_alloc_internal(heap, n_bytes, sizeof(BytecodeWord), false, 0);
+        if (VM_UNLIKELY(at == NULL)) {
+            STOP(VM_STOP_HEAP_FULL, OP_ALLOC);
+        }
+        PUSH(at - heap->memory);
+        NEXT();
+    }
+    VM_CASE(OP_FREE) : {
+        /*
+         * The compiler pairs every OP_ALLOC with one of these, in the opposite order. What a
+         * function returns is given back by the caller.
+         */
+        heap->offset -= READ(BytecodeWideImm);
+        NEXT();
+    }
+
+    VM_DEFAULT:
+        printf("Unknown opcode %d\n", instruction);
+        if (jit != NULL) {
+            jit_abort(jit);
+        }
+        goto vm_loop_done;
+    }
+
+vm_bad_handle:
+    meter->stop = VM_STOP_BAD_HANDLE;
+    meter->stop_offset = (u32)(ip - bytecode->code) - (1 + sizeof(BytecodeImm));
+vm_stopped:
+    meter->slice = slice;
+    if (jit != NULL) {
+        jit_abort(jit);
+    }
+    return result;
+
+vm_loop_done:
+    meter->slice = slice;
+    return result;
+}
+
+#if VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+BytecodeWord run(Bytecode *bytecode)
+{
+    VMMeter meter;
+    vm_meter_init(&meter, 0, 0);
+    return run_with(bytecode, &meter, NULL, false);
+}
+
+void vm_heap_init(Arena *heap)
+{
+    m_arena_init_dynamic(heap, 1, VM_HEAP_MAX_PAGES);
 }
 
-static void storew(MetagenVM *vm, BytecodeImm bp_offset, BytecodeWord value)
+/* Sets aside the null bytes and the globals, zeroed. Returns false if they don't fit */
+static bool heap_begin(MetagenVM *vm, u32 func_idx)
 {
-    vm->stack[vm->bp + bp_offset] = value;
+    u32 n_bytes = HEAP_NULL_BYTES + vm->b->globals_size;
+    if (m_arena_alloc_internal(vm->heap, n_bytes, sizeof(BytecodeWord), true, 0) == NULL) {
+        vm->meter->stop = VM_STOP_HEAP_FULL;
+        vm->meter->stop_offset = vm->b->funcs[func_idx].code_offset;
+        return false;
+    }
+    return true;
 }
 
-u32 run(Bytecode bytecode)
+/* The check OP_CALL makes, for the function a run starts in */
+static bool stack_begin(MetagenVM *vm, u32 func_idx)
+{
+    BytecodeFunc *func = &vm->b->funcs[func_idx];
+    if (func->n_params + 1 + func->max_stack >= STACK_MAX) {
+        vm->meter->stop = VM_STOP_STACK_OVERFLOW;
+        vm->meter->stop_offset = func->code_offset;
+        return false;
+    }
+    return true;
+}
+
+BytecodeWord run_with(Bytecode *bytecode, VMMeter *meter, VMProfile *profile, bool jit)
 {
     MetagenVM vm;
+    Arena heap;
+    vm_heap_init(&heap);
     vm.b = bytecode;
-    vm.ip = bytecode.code;
-    vm.sp = (u8 *)vm.stack;
-    vm.bp = 0;
     vm.flags = 0;
+    vm.meter = meter;
+    vm.arena = NULL;
+    vm.heap = &heap;
+    vm.profile = profile;
+    vm.jit = NULL;
+    assert(bytecode->funcs[bytecode->entry].n_params == 0);
 
-    while (1) {
-        // printf(">%d %s\n", vm.ip - bytecode.code, op_code_str_map[*vm.ip]);
-        OpCode instruction;
-        switch (instruction = *vm.ip++) {
-        case OP_CONSW: {
-            BytecodeWord value = readw(&vm);
-            pushw(&vm, value);
-        }; break;
-
-        /* Arithmetic */
-        case OP_ADDW:
-            pushw(&vm, popw(&vm) + popw(&vm));
-            break;
-        case OP_SUBW:
-            pushw(&vm, popw(&vm) - popw(&vm));
-            break;
-        case OP_MULW:
-            pushw(&vm, popw(&vm) * popw(&vm));
-            break;
-        case OP_DIVW:
-            pushw(&vm, popw(&vm) / popw(&vm));
-            break;
-        case OP_LSHIFT:
-            pushw(&vm, popw(&vm) << popw(&vm));
-            break;
-        case OP_RSHIFT:
-            pushw(&vm, popw(&vm) >> popw(&vm));
-            break;
-        case OP_GE:
-            pushw(&vm, popw(&vm) > popw(&vm));
-            break;
-        case OP_LE:
-            pushw(&vm, popw(&vm) < popw(&vm));
-            break;
-        case OP_NOT:
-            pushw(&vm, !popw(&vm));
-            break;
-
-        case OP_JMP:
-            vm.ip = bytecode.code + popw(&vm);
-            break;
-        case OP_BIZ: {
-            BytecodeImm target = readi(&vm);
-            if (popw(&vm) == 0) {
-                vm.ip += target;
-            }
-        } break;
-        case OP_BNZ: {
-            BytecodeImm target = readi(&vm);
-            if (popw(&vm) != 0) {
-                vm.ip += target;
-            }
-        } break;
-
-        case OP_PUSHN: {
-            BytecodeImm n_words = readi(&vm);
-            pushn(&vm, n_words);
-        } break;
-        case OP_POPN: {
-            BytecodeImm n_words = readi(&vm);
-            popn(&vm, n_words);
-        } break;
-        case OP_STOREL: {
-            BytecodeImm bp_offset = readi(&vm);
-            BytecodeWord value = popw(&vm);
-            storew(&vm, bp_offset, value);
-        } break;
-        case OP_LOADL: {
-            BytecodeImm bp_offset = readi(&vm);
-            pushw(&vm, loadw(&vm, bp_offset));
-        } break;
-
-        case OP_PRINT: {
-            u8 n_args = read_u8(&vm);
-            /* Must first pop unto an array to maintain correct printing order */
-            BytecodeWord args[n_args];
-            for (u8 i = 0; i < n_args; i++) {
-                BytecodeWord value = popw(&vm);
-                args[i] = value;
-            }
-            for (u8 i = n_args; i > 0; i--) {
-                printf("%ld ", args[i - 1]);
-            }
-            printf("\n");
-        } break;
-
-        case OP_RETURN: {
-            goto vm_loop_done;
+    BytecodeWord result = 0;
+    if (!stack_begin(&vm, bytecode->entry) || !heap_begin(&vm, bytecode->entry)) {
+        /* Nothing ran */
+    } else if (jit) {
+        vm.jit = jit_new(&vm);
+        if (setjmp(vm.jit->abort) != 0) {
+            jit_release(vm.jit);
+            m_arena_release(&heap);
+            return 0;
         }
-        default:
-            printf("Unknown opcode %d\n", instruction);
-            goto vm_loop_done;
+        result = vm_loop(&vm, vm.stack, bytecode->entry);
+        jit_release(vm.jit);
+    } else {
+        result = vm_loop(&vm, vm.stack, bytecode->entry);
+    }
+    if (profile != NULL) {
+        vm_profile_stop(profile);
+    }
+    m_arena_release(&heap);
+    return result;
+}
+
+BytecodeWord run_call(Bytecode *bytecode, Arena *arena, Arena *heap, VMMeter *meter,
+                      u32 func_idx, BytecodeWord *args)
+{
+    MetagenVM vm;
+    vm.b = bytecode;
+    vm.arena = arena;
+    vm.heap = heap;
+    vm.flags = 0;
+    vm.meter = meter;
+    vm.profile = NULL;
+    vm.jit = NULL;
+    BytecodeWord result = 0;
+    if (stack_begin(&vm, func_idx) && heap_begin(&vm, func_idx)) {
+        /* The arguments are where the caller would have pushed them */
+        memcpy(vm.stack, args, sizeof(BytecodeWord) * bytecode->funcs[func_idx].n_params);
+        result = vm_loop(&vm, vm.stack, func_idx);
+    }
+    m_arena_clear(heap);
+    return result;
+}
+
+BytecodeWord vm_call(Jit *jit, u32 func_idx, BytecodeWord *bp)
+{
+    return vm_loop(jit->vm, bp, func_idx);
+}
+
+static u64 clock_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000 + (u64)now.tv_nsec;
+}
+
+void vm_meter_init(VMMeter *m, u64 fuel, u64 deadline_ms)
+{
+    m->fuel = fuel;
+    m->granted = 0;
+    m->deadline = deadline_ms == 0 ? 0 : clock_ns() + deadline_ms * 1000000;
+    m->stop = VM_STOP_NONE;
+    m->stop_offset = 0;
+    /* Without bounds the slice is never used up, so there is nothing to check */
+    m->slice = fuel == 0 && deadline_ms == 0 ? I64_MAX : 0;
+}
+
+bool vm_meter_refill(VMMeter *m)
+{
+    if (m->deadline != 0 && clock_ns() >= m->deadline) {
+        m->stop = VM_STOP_DEADLINE;
+        return false;
+    }
+    u64 grant = VM_FUEL_SLICE;
+    if (m->fuel != 0) {
+        if (m->granted >= m->fuel) {
+            m->stop = VM_STOP_FUEL;
+            return false;
+        }
+        if (m->fuel - m->granted < grant) {
+            grant = m->fuel - m->granted;
         }
     }
+    m->granted += grant;
+    /* The charge that found the slice empty takes the first unit */
+    m->slice = (s64)grant - 1;
+    return true;
+}
 
-vm_loop_done:
-    // final = stack_pop(&vm);
-    // printf("%d\n", final);
-    return 0;
+u64 vm_meter_used(VMMeter *m)
+{
+    /* Without bounds the slice starts out at I64_MAX and is never refilled */
+    if (m->fuel == 0 && m->deadline == 0) {
+        return (u64)(I64_MAX - m->slice);
+    }
+    return m->granted - (u64)(m->slice < 0 ? 0 : m->slice);
 }
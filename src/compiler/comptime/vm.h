@@ -18,26 +18,87 @@
 #define VM_H
 
 #include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/jit.h"
+#include "compiler/comptime/profile.h"
 
-#define STACK_MAX 1024
+#define STACK_MAX (1 << 14) // In words
+#define VM_HEAP_MAX_PAGES (1 << 16) // Reserved for the heap of a run, see HEAP_NULL_BYTES
 
 typedef enum {
     VM_FLAG_NEG = 1 << 0,
     VM_FLAG_ZERO = 1 << 1,
 } VMFlags;
 
+/*
+ * Bounds the work of one comptime run, so code that never stops becomes a compiler error.
+ *
+ * Fuel is charged per basic block rather than per instruction, and only where the code can go on
+ * for longer than its length: one unit for every call and every backward branch taken. The VM and
+ * compiled code just decrement slice, and only call vm_meter_refill() once it runs out. That hands
+ * out the next VM_FUEL_SLICE units of the budget and checks the deadline, so the clock is only
+ * read once a slice.
+ */
+#define VM_FUEL_SLICE 4096
+
+typedef enum {
+    VM_STOP_NONE = 0,
+    VM_STOP_FUEL,
+    VM_STOP_DEADLINE,
+    VM_STOP_BAD_HANDLE, // An AST handle was null or used as the wrong kind of node
+    VM_STOP_BAD_ARGUMENT, // A builtin got an argument it can't take
+    VM_STOP_NOT_COMPTIME, // A builtin was called with no arena to allocate on
+    VM_STOP_BAD_ADDRESS, // A load, store or copy went outside of what is allocated on the heap
+    VM_STOP_HEAP_FULL,
+    VM_STOP_STACK_OVERFLOW, // A call had no room for the frame of the callee
+    VM_STOP_DIV_ZERO,
+} VMStop;
+
 typedef struct {
-    Bytecode b;
-    u8 *ip;
+    s64 slice; // Fuel left of the current slice. Negative once a charge finds it empty
+    u64 fuel; // Budget, 0 for none
+    u64 granted; // Handed out in slices so far
+    u64 deadline; // Nanoseconds on CLOCK_MONOTONIC, 0 for none
+    VMStop stop; // Why the run was stopped
+    u32 stop_offset; // Of the instruction that found the meter empty
+} VMMeter;
 
+struct metagen_vm_t {
+    Bytecode *b;
+    /* ip, sp and bp live in locals of vm_loop() */
     BytecodeWord stack[STACK_MAX];
-    u8 *sp;
-    u8 bp;
-
     VMFlags flags;
-} MetagenVM;
+    VMMeter *meter;
+    Arena *arena; // NULL outside of @calls. Where builtins allocate, see builtin.h
+    Arena *heap; // Globals, structs and arrays, see HEAP_NULL_BYTES
+    VMProfile *profile; // NULL unless profiling
+    Jit *jit; // NULL unless compiling hot functions
+};
+
 
+/* fuel and deadline_ms of 0 leave that out. With neither the meter never runs out */
+void vm_meter_init(VMMeter *m, u64 fuel, u64 deadline_ms);
+/* Called by a charge that found the slice empty. Returns false if the run must stop */
+bool vm_meter_refill(VMMeter *m);
+u64 vm_meter_used(VMMeter *m);
 
-u32 run(Bytecode b);
+/* Runs the entry function and returns what it returned */
+BytecodeWord run(Bytecode *b);
+/*
+ * Same, bounded by meter, which says why if it stopped the run. profile records the run if not
+ * NULL and built with VM_PROFILE. With jit set hot functions are compiled to machine code, see
+ * jit.h.
+ */
+BytecodeWord run_with(Bytecode *b, VMMeter *meter, VMProfile *profile, bool jit);
+/*
+ * Runs func_idx with args, one per parameter, instead of the entry function. Builtins allocate on
+ * arena. The run gets heap, from vm_heap_init(), and clears it when it returns so the next call can
+ * have it.
+ */
+BytecodeWord run_call(Bytecode *b, Arena *arena, Arena *heap, VMMeter *meter, u32 func_idx,
+                      BytecodeWord *args);
+/* The heap has to stay in one piece, addresses are offsets into it */
+void vm_heap_init(Arena *heap);
+/* Interprets func_idx with its arguments at bp, for calls from compiled code */
+BytecodeWord vm_call(Jit *jit, u32 func_idx, BytecodeWord *bp);
 
 #endif /* VM_H */
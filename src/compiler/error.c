@@ -20,44 +20,138 @@
 #include "base/sac_single.h"
 #include "base/str.h"
 #include "lex.h"
+#include "mem_report.h"
+#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
-void error_handler_init(ErrorHandler *e, char *input, char *file_name)
+/* The buffer and item errors made on this thread go to */
+static _Thread_local u32 bound_buffer = 0;
+static _Thread_local u32 bound_item = 0;
+
+void error_handler_init(ErrorHandler *e, char *input, char *file_name, u32 n_threads)
 {
-    m_arena_init_dynamic(&e->arena, 1, 100);
+    assert(n_threads > 0);
     e->input = input;
     e->file_name = file_name;
-    e->n_errors = 0;
+    atomic_init(&e->n_errors, 0);
+    e->n_buffers = n_threads;
+    e->buffers = malloc(sizeof(ErrorBuffer) * n_threads);
+    for (u32 i = 0; i < n_threads; i++) {
+        ErrorBuffer *b = &e->buffers[i];
+        m_arena_init_dynamic_flags(&b->arena, 1, 100, SAC_FLAG_CHAINED);
+        b->seq = 0;
+        b->head = NULL;
+        b->tail = NULL;
+    }
     e->head = NULL;
     e->tail = NULL;
 }
 
 void error_handler_release(ErrorHandler *e)
 {
-    m_arena_release(&e->arena);
+    for (u32 i = 0; i < e->n_buffers; i++) {
+        m_arena_release(&e->buffers[i].arena);
+    }
+    free(e->buffers);
 }
 
 void error_handler_reset(ErrorHandler *e)
 {
-    m_arena_clear(&e->arena);
-    e->n_errors = 0;
+    for (u32 i = 0; i < e->n_buffers; i++) {
+        ErrorBuffer *b = &e->buffers[i];
+        m_arena_clear(&b->arena);
+        b->seq = 0;
+        b->head = NULL;
+        b->tail = NULL;
+    }
+    atomic_store(&e->n_errors, 0);
     e->head = NULL;
     e->tail = NULL;
 }
 
+void error_handler_bind_thread(ErrorHandler *e, u32 buffer_idx, u32 item)
+{
+    (void)e;
+    assert(buffer_idx < e->n_buffers);
+    bound_buffer = buffer_idx;
+    bound_item = item;
+}
+
+static int error_cmp(const void *a, const void *b)
+{
+    CompilerError *ea = *(CompilerError **)a;
+    CompilerError *eb = *(CompilerError **)b;
+    if (ea->item != eb->item)
+        return ea->item < eb->item ? -1 : 1;
+    /* Errors for one item all come from the same thread, so seq is unique among them */
+    if (ea->seq != eb->seq)
+        return ea->seq < eb->seq ? -1 : 1;
+    return 0;
+}
+
+void error_handler_merge(ErrorHandler *e)
+{
+    u32 n_new = 0;
+    for (u32 i = 0; i < e->n_buffers; i++) {
+        for (CompilerError *err = e->buffers[i].head; err != NULL; err = err->next) {
+            n_new++;
+        }
+    }
+    if (n_new == 0)
+        return;
+
+    CompilerError **sorted = malloc(sizeof(CompilerError *) * n_new);
+    u32 n = 0;
+    for (u32 i = 0; i < e->n_buffers; i++) {
+        ErrorBuffer *b = &e->buffers[i];
+        for (CompilerError *err = b->head; err != NULL; err = err->next) {
+            sorted[n++] = err;
+        }
+        b->head = NULL;
+        b->tail = NULL;
+    }
+    qsort(sorted, n_new, sizeof(CompilerError *), error_cmp);
+
+    /* Capped after sorting, so which errors are kept doesn't depend on scheduling either */
+    u32 n_merged = 0;
+    for (CompilerError *err = e->head; err != NULL; err = err->next) {
+        n_merged++;
+    }
+    for (u32 i = 0; i < n_new && n_merged < ERROR_HANDLER_MAX_ERRORS; i++, n_merged++) {
+        CompilerError *error = sorted[i];
+        error->next = NULL;
+        if (e->head == NULL) {
+            e->head = error;
+        } else {
+            e->tail->next = error;
+        }
+        e->tail = error;
+    }
+    free(sorted);
+    atomic_store(&e->n_errors, n_merged);
+}
+
+Arena *error_handler_arena(ErrorHandler *e)
+{
+    return &e->buffers[bound_buffer].arena;
+}
 
 static void append_err(ErrorHandler *e, Str8 msg)
 {
-    CompilerError *error = m_arena_alloc(&e->arena, sizeof(CompilerError));
+    atomic_fetch_add(&e->n_errors, 1);
+    ErrorBuffer *b = &e->buffers[bound_buffer];
+    CompilerError *error = m_arena_alloc_tagged(&b->arena, sizeof(CompilerError), MEM_TAG_ERROR);
     error->next = NULL;
     error->msg = msg;
-    if (e->head == NULL) {
-        e->head = error;
+    error->item = bound_item;
+    error->seq = b->seq++;
+    if (b->head == NULL) {
+        b->head = error;
     } else {
-        e->tail->next = error;
+        b->tail->next = error;
     }
-    e->tail = error;
-    e->n_errors += 1;
+    b->tail = error;
 }
 
 void error_msg_str8(ErrorHandler *e, Str8 msg)
@@ -67,42 +161,42 @@ void error_msg_str8(ErrorHandler *e, Str8 msg)
 
 void error_lex(ErrorHandler *e, char *msg, Point start, Point end)
 {
-    Str8Builder sb = make_str_builder(&e->arena);
+    Str8Builder sb = make_str_builder(error_handler_arena(e));
     str_builder_sprintf(&sb, "[%s @ line %d] ", 2, e->file_name, end.l);
     str_builder_append_cstr(&sb, msg, strlen(msg));
-    Str8 str = str_builder_end(&sb, false);
+    Str8 str = str_builder_end(&sb, true);
     append_err(e, str);
 }
 
 void error_parse(ErrorHandler *e, char *msg, Token guilty)
 {
-    Str8Builder sb = make_str_builder(&e->arena);
+    Str8Builder sb = make_str_builder(error_handler_arena(e));
     str_builder_sprintf(&sb, "[%s @ line %d] ", 2, e->file_name, guilty.end);
     str_builder_append_cstr(&sb, msg, strlen(msg));
-    Str8 str = str_builder_end(&sb, false);
+    Str8 str = str_builder_end(&sb, true);
     append_err(e, str);
 }
 
 
 void error_node(ErrorHandler *e, char *msg, AstNode *guilty)
 {
-    Str8Builder sb = make_str_builder(&e->arena);
+    Str8Builder sb = make_str_builder(error_handler_arena(e));
     str_builder_sprintf(&sb, "[%s @ line %d] ", 2, e->file_name, -1);
     str_builder_append_cstr(&sb, msg, strlen(msg));
-    Str8 str = str_builder_end(&sb, false);
+    Str8 str = str_builder_end(&sb, true);
     append_err(e, str);
 }
 
 void error_sym(ErrorHandler *e, char *msg, Str8 name)
 {
     // TODO: print occurence of this type
-    Str8Builder sb = make_str_builder(&e->arena);
+    Str8Builder sb = make_str_builder(error_handler_arena(e));
     str_builder_sprintf(&sb, "[%s:%d] ", 2, e->file_name, -1);
     str_builder_append_cstr(&sb, (char *)name.str, name.len);
     str_builder_append_u8(&sb, ':');
     str_builder_append_u8(&sb, ' ');
     str_builder_append_cstr(&sb, msg, strlen(msg));
-    Str8 str = str_builder_end(&sb, false);
+    Str8 str = str_builder_end(&sb, true);
     append_err(e, str);
 }
 
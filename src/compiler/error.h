@@ -17,33 +17,60 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <stdatomic.h>
+
 #include "ast.h"
 #include "base/sac_single.h"
 #include "base/str.h"
 #include "lex.h"
 #include "type.h"
 
-#define ERROR_HANDLER_MAX_ERRORS 64 // Just give up after this
+#define ERROR_HANDLER_MAX_ERRORS 64 // Errors past this are dropped
 
 typedef struct compiler_error_t CompilerError;
 struct compiler_error_t {
     CompilerError *next;
     // ErrorCode code;
     Str8 msg;
+    u32 item; // Top-level item being processed when the error was made. Used for ordering.
+    u32 seq; // Order the error was made in on its thread
 };
 
-typedef struct error_handler_t {
+/* Errors made by a single thread since the last merge */
+typedef struct {
     Arena arena;
+    u32 seq;
+    CompilerError *head;
+    CompilerError *tail;
+} ErrorBuffer;
+
+/*
+ * Every thread appends errors to its own buffer, so making an error never needs a lock. The
+ * buffers are merged into the head/tail list by error_handler_merge() at the end of each pass.
+ * Within a pass, errors are ordered by the top-level item they were made while processing, and
+ * then by the order they were made in. Items are numbered in source order and each item is only
+ * processed by one thread, so the order is the same however the work was spread out.
+ */
+typedef struct error_handler_t {
     char *input;
     char *file_name;
-    u32 n_errors;
-    CompilerError *head;
+    _Atomic u32 n_errors; // Made so far. A merge keeps ERROR_HANDLER_MAX_ERRORS at most
+    u32 n_buffers;
+    ErrorBuffer *buffers;
+    CompilerError *head; // Merged errors
     CompilerError *tail;
 } ErrorHandler;
 
-void error_handler_init(ErrorHandler *e, char *input, char *file_name);
+/* n_threads is the number of threads that can make errors at the same time */
+void error_handler_init(ErrorHandler *e, char *input, char *file_name, u32 n_threads);
 void error_handler_release(ErrorHandler *e);
 void error_handler_reset(ErrorHandler *e);
+/* Errors made on the calling thread go to the given buffer and are ordered by item */
+void error_handler_bind_thread(ErrorHandler *e, u32 buffer_idx, u32 item);
+/* Moves the errors from every buffer onto the head/tail list. Not thread safe. */
+void error_handler_merge(ErrorHandler *e);
+/* Arena for error messages made on the calling thread */
+Arena *error_handler_arena(ErrorHandler *e);
 
 void error_msg_str8(ErrorHandler *e, Str8 msg);
 void error_lex(ErrorHandler *e, char *msg, Point start, Point end);
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "ast.h"
+#include "mem_report.h"
+
+static char *mem_tag_str_map[MEM_TAG_AST] = {
+    "untagged", "string", "nag", "TypeInfo", "symbol", "error", "bytecode", "comptime",
+};
+
+static char *mem_tag_name(u32 tag)
+{
+    if (tag >= MEM_TAG_AST)
+        return node_kind_str_map[tag - MEM_TAG_AST];
+    return mem_tag_str_map[tag];
+}
+
+/* Adds the stats of another arena in the same family to total */
+static void mem_stats_add(struct m_arena_stats *total, struct m_arena_stats *s)
+{
+    total->n_allocs += s->n_allocs;
+    total->bytes_requested += s->bytes_requested;
+    total->bytes_padding += s->bytes_padding;
+    total->n_clears += s->n_clears;
+    if (s->peak_offset > total->peak_offset)
+        total->peak_offset = s->peak_offset;
+    total->pages_commited += s->pages_commited;
+    total->peak_pages_commited += s->peak_pages_commited;
+    total->n_blocks += s->n_blocks;
+    for (u32 tag = 0; tag < MEM_TAG_LEN; tag++) {
+        total->tag_allocs[tag] += s->tag_allocs[tag];
+        total->tag_bytes[tag] += s->tag_bytes[tag];
+    }
+}
+
+void mem_report_print(struct m_arena_stats *stats, u32 n_stats)
+{
+    printf("--- memory report ---\n");
+    for (u32 i = 0; i < n_stats;) {
+        struct m_arena_stats *s = &stats[i];
+        struct m_arena_stats total = *s;
+        u32 n_arenas = 1;
+        for (i++; i < n_stats && strcmp(stats[i].name, s->name) == 0; i++, n_arenas++) {
+            mem_stats_add(&total, &stats[i]);
+        }
+        if (n_arenas == 1) {
+            printf("%s:\n", s->name);
+        } else {
+            printf("%s (%u arenas):\n", s->name, n_arenas);
+        }
+        s = &total;
+        printf("    allocs %lu, requested %lu B, padding %lu B, peak offset %zu B\n",
+               (unsigned long)s->n_allocs, (unsigned long)s->bytes_requested,
+               (unsigned long)s->bytes_padding, s->peak_offset);
+        printf("    pages committed %zu (peak %zu), blocks chained %zu, clears %lu\n",
+               s->pages_commited, s->peak_pages_commited, s->n_blocks,
+               (unsigned long)s->n_clears);
+        for (u32 tag = 0; tag < MEM_TAG_LEN; tag++) {
+            if (s->tag_allocs[tag] == 0 && s->tag_bytes[tag] == 0)
+                continue;
+            printf("      %-22s %8lu allocs %10lu B\n", mem_tag_name(tag),
+                   (unsigned long)s->tag_allocs[tag], (unsigned long)s->tag_bytes[tag]);
+        }
+    }
+    printf("--- memory report end ---\n");
+}
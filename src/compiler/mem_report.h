@@ -0,0 +1,43 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MEM_REPORT_H
+#define MEM_REPORT_H
+
+#include "ast.h"
+#include "base/base.h"
+#include "base/sac_single.h"
+
+/* Allocation tags used by the compiler. Continues from the tags in base.h. */
+typedef enum {
+    MEM_TAG_TYPE_INFO = MEM_TAG_BASE_LEN,
+    MEM_TAG_SYMBOL,
+    MEM_TAG_ERROR,
+    MEM_TAG_BYTECODE,
+    MEM_TAG_COMPTIME,
+    MEM_TAG_AST, // MEM_TAG_AST + AstNodeKind
+    MEM_TAG_LEN = MEM_TAG_AST + AST_NODE_TYPE_LEN,
+} MemTag;
+
+_Static_assert(MEM_TAG_LEN <= SAC_MAX_TAGS, "Too many allocation tags for sac");
+
+/*
+ * Prints a per-arena, per-tag breakdown of the given arena stats. Arenas next to each other with
+ * the same name are printed as one, with their stats added up and the largest peak offset.
+ */
+void mem_report_print(struct m_arena_stats *stats, u32 n_stats);
+
+#endif /* MEM_REPORT_H */
@@ -21,6 +21,7 @@
 #include "base/sac_single.h"
 #include "error.h"
 #include "lex.h"
+#include "mem_report.h"
 #include "parser.h"
 
 TokenKind token_precedences[TOKEN_TYPE_ENUM_COUNT] = {
@@ -471,18 +472,22 @@ static AstStmt *parse_stmt(Parser *parser)
 
 static TypedIdentList parse_variable_list(Parser *parser, bool allow_array_types, bool typed)
 {
-    TypedIdentList typed_vars = { .vars = m_arena_alloc_struct(parser->arena, TypedIdent),
-                                  .len = 0 };
+    TypedIdentList typed_vars = {
+        .vars = m_arena_alloc_tagged(parser->arena, sizeof(TypedIdent),
+                                     MEM_TAG_AST + AST_TYPED_IDENT_LIST),
+        .len = 0,
+    };
 
-    TypedIdent *indices_head = typed_vars.vars;
     do {
         /*
          * If not first iteration of loop then we need to consume the comma we already peeked and
-         * allocate space for the next identifier.
+         * grow the list to make space for the next identifier.
          */
         if (typed_vars.len != 0) {
             next_token(parser);
-            indices_head = m_arena_alloc_struct(parser->arena, TypedIdent);
+            typed_vars.vars = m_arena_grow(parser->arena, typed_vars.vars,
+                                           sizeof(TypedIdent) * typed_vars.len,
+                                           sizeof(TypedIdent) * (typed_vars.len + 1));
         }
         Token identifier = consume_or_err(parser, TOKEN_IDENTIFIER, "Expected variable name");
         AstTypeInfo type_info = { 0 };
@@ -490,9 +495,7 @@ static TypedIdentList parse_variable_list(Parser *parser, bool allow_array_types
             type_info = parse_type(parser, allow_array_types);
         }
         TypedIdent new = { .name = identifier.lexeme, .ast_type_info = type_info };
-        /* Alloc space for next TypedVar, store current, update len and head */
-        *indices_head = new;
-        typed_vars.len++;
+        typed_vars.vars[typed_vars.len++] = new;
     } while (peek_token(parser).kind == TOKEN_COMMA);
 
     return typed_vars;
@@ -505,10 +508,16 @@ static TypedIdentList parse_local_decl_list(Parser *parser)
     while (match_token(parser, TOKEN_VAR)) {
         TypedIdentList next_identifiers = parse_variable_list(parser, false, true);
         /*
-         * Since parse_variable_list ensures the identifiers are stored contigiously, and we do no
-         * other allocations on the parser arena, consequetive retain this contigious property.
+         * parse_type may have allocated on the parser arena in between, so the lists are not
+         * necessarily contiguous. Append the next identifiers to the list we have.
          */
-        identifiers.len += next_identifiers.len;
+        u32 new_len = identifiers.len + next_identifiers.len;
+        identifiers.vars = m_arena_grow(parser->arena, identifiers.vars,
+                                        sizeof(TypedIdent) * identifiers.len,
+                                        sizeof(TypedIdent) * new_len);
+        memcpy(identifiers.vars + identifiers.len, next_identifiers.vars,
+               sizeof(TypedIdent) * next_identifiers.len);
+        identifiers.len = new_len;
     }
     return identifiers;
 }
@@ -534,6 +543,14 @@ static AstFunc *parse_func(Parser *parser, bool require_body)
     return func;
 }
 
+/* Gives the @calls from calls and on the declaration they annotate */
+static void bind_calls(AstListNode *calls, AstNode *target)
+{
+    for (AstListNode *n = calls; n != NULL; n = n->next) {
+        AS_CALL(n->this)->target = target;
+    }
+}
+
 static AstRoot *parse_root(Parser *parser)
 {
     AstList vars = { .kind = AST_LIST, .head = NULL, .tail = NULL };
@@ -541,6 +558,7 @@ static AstRoot *parse_root(Parser *parser)
     AstList structs = { .kind = AST_LIST, .head = NULL, .tail = NULL };
     AstList enums = { .kind = AST_LIST, .head = NULL, .tail = NULL };
     AstList calls = { .kind = AST_LIST, .head = NULL, .tail = NULL };
+    AstListNode *unbound_calls = NULL; // @calls since the last declaration
 
     Token next;
     while ((next = next_token(parser)).kind != TOKEN_EOF) {
@@ -551,17 +569,23 @@ static AstRoot *parse_root(Parser *parser)
             AstTypedIdentList *node_vars = make_typed_ident_list(parser->arena, v);
             AstListNode *node_node = make_list_node(parser->arena, (AstNode *)node_vars);
             ast_list_push_back(&vars, node_node);
+            bind_calls(unbound_calls, (AstNode *)node_vars);
+            unbound_calls = NULL;
         }; break;
         case TOKEN_COMPILER: {
             consume_or_err(parser, TOKEN_FUNC, "Expected a function");
             AstFunc *func = parse_func(parser, false);
             AstListNode *func_node = make_list_node(parser->arena, (AstNode *)func);
             ast_list_push_back(&funcs, func_node);
+            bind_calls(unbound_calls, (AstNode *)func);
+            unbound_calls = NULL;
         }; break;
         case TOKEN_FUNC: {
             AstFunc *func = parse_func(parser, true);
             AstListNode *func_node = make_list_node(parser->arena, (AstNode *)func);
             ast_list_push_back(&funcs, func_node);
+            bind_calls(unbound_calls, (AstNode *)func);
+            unbound_calls = NULL;
         }; break;
         case TOKEN_STRUCT: {
             Token name = consume_or_err(parser, TOKEN_IDENTIFIER, "Expected struct name");
@@ -570,6 +594,8 @@ static AstRoot *parse_root(Parser *parser)
             AstStruct *struct_decl = make_struct(parser->arena, name.lexeme, members);
             AstListNode *node_node = make_list_node(parser->arena, (AstNode *)struct_decl);
             ast_list_push_back(&structs, node_node);
+            bind_calls(unbound_calls, (AstNode *)struct_decl);
+            unbound_calls = NULL;
         }; break;
         case TOKEN_ENUM: {
             Token name = consume_or_err(parser, TOKEN_IDENTIFIER, "Expected enum name");
@@ -578,6 +604,8 @@ static AstRoot *parse_root(Parser *parser)
             AstEnum *enum_decl = make_enum(parser->arena, name.lexeme, values);
             AstListNode *node_node = make_list_node(parser->arena, (AstNode *)enum_decl);
             ast_list_push_back(&enums, node_node);
+            bind_calls(unbound_calls, (AstNode *)enum_decl);
+            unbound_calls = NULL;
         }; break;
         case TOKEN_AT: {
             Token function_identifier =
@@ -585,6 +613,9 @@ static AstRoot *parse_root(Parser *parser)
             AstCall *call = parse_call(parser, function_identifier, true);
             AstListNode *call_node = make_list_node(parser->arena, (AstNode *)call);
             ast_list_push_back(&calls, call_node);
+            if (unbound_calls == NULL) {
+                unbound_calls = call_node;
+            }
         }; break;
         default: {
             error_parse(parser->lexer.e, "Illegal first token. Expected var, struct or func", next);
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "time_report.h"
+
+static char *phase_str_map[PHASE_LEN] = {
+    "parse", "typegen", "infer", "typecheck", "comptime calls", "run main", "codegen",
+};
+
+static u64 now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000 + (u64)now.tv_nsec;
+}
+
+void time_report_init(TimeReport *r)
+{
+    for (u32 i = 0; i < PHASE_LEN; i++) {
+        r->ns[i] = 0;
+    }
+    r->running = false;
+}
+
+void time_report_phase(TimeReport *r, CompilerPhase phase)
+{
+    time_report_end(r);
+    r->current = phase;
+    r->start = now_ns();
+    r->running = true;
+}
+
+void time_report_end(TimeReport *r)
+{
+    if (r->running) {
+        r->ns[r->current] += now_ns() - r->start;
+        r->running = false;
+    }
+}
+
+void time_report_print(TimeReport *r, ComptimeCache *cache)
+{
+    u64 total = 0;
+    for (u32 i = 0; i < PHASE_LEN; i++) {
+        total += r->ns[i];
+    }
+    printf("--- time report ---\n");
+    for (u32 i = 0; i < PHASE_LEN; i++) {
+        printf("%-16s %10.3f ms %6.1f%%\n", phase_str_map[i], (f64)r->ns[i] / 1e6,
+               total == 0 ? 0.0 : 100.0 * (f64)r->ns[i] / (f64)total);
+        if (i == PHASE_COMPTIME) {
+            /* Calls to impure functions always run and aren't counted */
+            printf("    pure calls: %u memoized, %u from disk, %u run\n", cache->hits,
+                   cache->disk_hits, cache->misses);
+        }
+    }
+    printf("%-16s %10.3f ms\n", "total", (f64)total / 1e6);
+    printf("--- time report end ---\n");
+}
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include "base/types.h"
+#include "compiler/comptime/comptime.h"
+
+/* Phases of compile(), in the order they run */
+typedef enum {
+    PHASE_PARSE = 0,
+    PHASE_TYPEGEN,
+    PHASE_INFER,
+    PHASE_TYPECHECK,
+    PHASE_COMPTIME, // The @calls, see comptime/comptime.h
+    PHASE_RUN, // Bytecode for and run of main
+    PHASE_CODEGEN,
+    PHASE_LEN,
+} CompilerPhase;
+
+/* Wall clock time spent in each phase, for --time-report */
+typedef struct {
+    u64 ns[PHASE_LEN];
+    u64 start; // Of the current phase
+    CompilerPhase current;
+    bool running;
+} TimeReport;
+
+void time_report_init(TimeReport *r);
+/* Ends the current phase, if any, and starts phase */
+void time_report_phase(TimeReport *r, CompilerPhase phase);
+void time_report_end(TimeReport *r);
+/* With where the results of the comptime calls came from */
+void time_report_print(TimeReport *r, ComptimeCache *cache);
+
+#endif /* TIME_REPORT_H */
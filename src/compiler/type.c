@@ -21,8 +21,11 @@
 #include "base/nicc.h"
 #include "base/sac_single.h"
 #include "base/str.h"
+#include "comptime/ast_handle.h"
+#include "comptime/builtin.h"
 #include "compiler.h"
 #include "error.h"
+#include "mem_report.h"
 
 #include <assert.h>
 #include <stdbool.h>
@@ -48,7 +51,7 @@ static void *make_type_info(Arena *arena, TypeInfoKind kind, Str8 generated_by)
         [TYPE_POINTER] = { sizeof(TypeInfoPointer), false }
     };
 
-    TypeInfo *info = m_arena_alloc(arena, type_info_table[kind].size);
+    TypeInfo *info = m_arena_alloc_tagged(arena, type_info_table[kind].size, MEM_TAG_TYPE_INFO);
     info->is_resolved = type_info_table[kind].resolved_by_default;
     info->kind = kind;
     info->generated_by = generated_by;
@@ -93,17 +96,18 @@ u32 type_info_bit_size(TypeInfo *type_info)
     case TYPE_STRUCT:
         return ((TypeInfoStruct *)type_info)->bit_size;
     case TYPE_ENUM:
+        return 32;
     case TYPE_BOOL:
-        return 4;
+        return 8;
     case TYPE_POINTER:
     case TYPE_FUNC:
-        return 8;
+        return 64;
     default:
         assert(false && "type_info_bit_size not implemented");
     }
 }
 
-static SymbolTable symt_init(SymbolTable *parent)
+static SymbolTable symt_init(Arena *arena, SymbolTable *parent)
 {
     SymbolTable symt = { .sym_len = 0, .sym_cap = 16, .parent = parent };
 
@@ -111,8 +115,9 @@ static SymbolTable symt_init(SymbolTable *parent)
     if (parent == NULL) {
         symt.sym_cap = 64;
     }
-    symt.symbols = malloc(sizeof(Symbol *) * symt.sym_cap);
-    hashmap_init(&symt.map);
+    symt.symbols = m_arena_alloc_tagged(arena, sizeof(Symbol *) * symt.sym_cap, MEM_TAG_SYMBOL);
+    /* Symbol names live in the lex or persist arena, so the keys can be borrowed */
+    symbol_map_init_arena_tagged(&symt.map, arena, true, MEM_TAG_SYMBOL);
     return symt;
 }
 
@@ -135,10 +140,10 @@ static bool sym_generates_type(Symbol *sym)
 static Symbol *symt_new_sym(Compiler *c, SymbolTable *symt, SymbolKind sym_kind, Str8 name,
                             TypeInfo *type_info, AstNode *node)
 {
-    Symbol *existing_sym = hashmap_get(&symt->map, name.str, name.len);
+    Symbol *existing_sym = symbol_map_get(&symt->map, name.str, name.len);
     if (existing_sym == NULL && sym_kind == SYMBOL_LOCAL_VAR) {
         /* Local symbols can not have the same names as GLOBAL symbols */
-        existing_sym = hashmap_get(&c->symt_root.map, name.str, name.len);
+        existing_sym = symbol_map_get(&c->symt_root.map, name.str, name.len);
     }
     if (existing_sym != NULL) {
         error_sym(c->e, "Symbol already exists", name);
@@ -147,14 +152,14 @@ static Symbol *symt_new_sym(Compiler *c, SymbolTable *symt, SymbolKind sym_kind,
     }
 
     /* Create the new symbol */
-    Symbol *sym = m_arena_alloc(c->persist_arena, sizeof(Symbol));
+    Symbol *sym = m_arena_alloc_tagged(c->persist_arena, sizeof(Symbol), MEM_TAG_SYMBOL);
     sym->kind = sym_kind;
     sym->seq_no = symt->sym_len;
     sym->name = name;
     sym->type_info = type_info;
     sym->node = node;
     if (sym_generates_type(sym)) {
-        sym->symt_local = symt_init(symt);
+        sym->symt_local = symt_init(c->persist_arena, symt);
         /* Structs and enums have completely isolated scopes */
         if (type_info->kind == TYPE_STRUCT || type_info->kind == TYPE_ENUM) {
             sym->symt_local.parent = NULL;
@@ -163,23 +168,25 @@ static Symbol *symt_new_sym(Compiler *c, SymbolTable *symt, SymbolKind sym_kind,
 
     /* Ensure space in the symbol table and add the new symbol */
     if (symt->sym_len >= symt->sym_cap) {
+        Symbol **old_symbols = symt->symbols;
         symt->sym_cap *= 2;
-        symt->symbols = realloc(symt->symbols, sizeof(Symbol *) * symt->sym_cap);
+        symt->symbols = m_arena_alloc_tagged(c->persist_arena, sizeof(Symbol *) * symt->sym_cap,
+                                              MEM_TAG_SYMBOL);
+        memcpy(symt->symbols, old_symbols, sizeof(Symbol *) * symt->sym_len);
     }
     symt->symbols[symt->sym_len] = sym;
     symt->sym_len++;
 
     /* If symbol generated a new type, add it to the type table */
     if (sym_generates_type(sym)) {
-        // NOTE: double pointer ?
-        arraylist_append(&c->all_types, &type_info);
+        type_info_ptr_array_append(&c->all_types, type_info);
         if (type_info->kind == TYPE_STRUCT) {
             ((TypeInfoStruct *)type_info)->struct_id = c->struct_types.size;
-            arraylist_append(&c->struct_types, &type_info);
+            type_info_struct_ptr_array_append(&c->struct_types, (TypeInfoStruct *)type_info);
         }
     }
 
-    hashmap_put(&symt->map, name.str, name.len, sym, sizeof(Symbol *), false);
+    symbol_map_put(&symt->map, name.str, name.len, sym);
     return sym;
 }
 
@@ -188,7 +195,7 @@ Symbol *symt_find_sym(SymbolTable *symt, Str8 key)
     Symbol *sym = NULL;
     SymbolTable *symt_current = symt;
     while (sym == NULL && symt_current != NULL) {
-        sym = hashmap_get(&symt_current->map, key.str, key.len);
+        sym = symbol_map_get(&symt_current->map, key.str, key.len);
         symt_current = symt_current->parent;
     }
     return sym;
@@ -237,7 +244,8 @@ static void typegen_from_enum_decl(Compiler *c, AstEnum *decl)
 {
     TypeInfoEnum *t = make_type_info(c->persist_arena, TYPE_ENUM, decl->name);
     // NOTE: Could this be done better? Do we really need the member names here?
-    t->member_names = m_arena_alloc(c->persist_arena, sizeof(Str8) * decl->members.len);
+    t->member_names = m_arena_alloc_tagged(c->persist_arena, sizeof(Str8) * decl->members.len,
+                                            MEM_TAG_TYPE_INFO);
     t->members_len = decl->members.len;
 
     Symbol *sym =
@@ -254,13 +262,15 @@ static void typegen_from_struct_decl(Compiler *c, AstStruct *decl)
 {
     Arena *arena = c->persist_arena;
     TypeInfoStruct *t = make_type_info(arena, TYPE_STRUCT, decl->name);
-    t->members = m_arena_alloc(arena, sizeof(TypeInfoStructMember *) * decl->members.len);
+    t->members = m_arena_alloc_tagged(arena, sizeof(TypeInfoStructMember *) * decl->members.len,
+                                      MEM_TAG_TYPE_INFO);
     t->members_len = decl->members.len;
     symt_new_sym(c, &c->symt_root, SYMBOL_TYPE, decl->name, (TypeInfo *)t, (AstNode *)decl);
 
     for (u32 i = 0; i < decl->members.len; i++) {
         TypedIdent ident = decl->members.vars[i];
-        TypeInfoStructMember *member = m_arena_alloc(arena, sizeof(TypeInfoStructMember));
+        TypeInfoStructMember *member =
+            m_arena_alloc_tagged(arena, sizeof(TypeInfoStructMember), MEM_TAG_TYPE_INFO);
         t->members[i] = member;
         member->is_resolved = false;
         member->name = ident.name;
@@ -278,8 +288,10 @@ static void typegen_from_func_decl(Compiler *c, AstFunc *decl)
 {
     TypeInfoFunc *t = make_type_info(c->persist_arena, TYPE_FUNC, decl->name);
     t->n_params = decl->parameters.len;
-    t->param_names = m_arena_alloc(c->persist_arena, sizeof(Str8) * t->n_params);
-    t->param_types = m_arena_alloc(c->persist_arena, sizeof(TypeInfo *) * t->n_params);
+    t->param_names =
+        m_arena_alloc_tagged(c->persist_arena, sizeof(Str8) * t->n_params, MEM_TAG_TYPE_INFO);
+    t->param_types =
+        m_arena_alloc_tagged(c->persist_arena, sizeof(TypeInfo *) * t->n_params, MEM_TAG_TYPE_INFO);
     t->info.is_resolved = true; // We will error in this function if it does not resovle
     symt_new_sym(c, &c->symt_root, SYMBOL_FUNC, decl->name, (TypeInfo *)t, (AstNode *)decl);
 
@@ -294,6 +306,121 @@ static void typegen_from_func_decl(Compiler *c, AstFunc *decl)
     }
 }
 
+/* The struct in ast.h a value of type t is a handle to, or NULL if it isn't a handle */
+static TypeInfo *handle_struct(TypeInfo *t)
+{
+    if (t->kind == TYPE_POINTER && ((TypeInfoPointer *)t)->level_of_indirection == 1) {
+        t = ((TypeInfoPointer *)t)->pointer_to;
+    }
+    if (t == NULL || t->kind != TYPE_STRUCT || !ast_handle_type(t->generated_by)) {
+        return NULL;
+    }
+    return t;
+}
+
+static u32 handle_kinds(TypeInfo *t)
+{
+    TypeInfo *s = handle_struct(t);
+    return s == NULL ? 0 : ast_handle_kinds(s->generated_by);
+}
+
+/* True if a handle to the struct named from can be used as a handle to the one named to */
+static bool handle_fits(Str8 to, Str8 from)
+{
+    u32 to_kinds = ast_handle_kinds(to);
+    u32 from_kinds = ast_handle_kinds(from);
+    if ((to_kinds & AST_HANDLE_UNTAGGED) != 0) {
+        /* Nothing to check at runtime, so it has to be the same struct */
+        return STR8VIEW_EQUAL(to, from);
+    }
+    return to_kinds != 0 && from_kinds != 0 && (from_kinds & ~to_kinds) == 0;
+}
+
+static Str8 cstr_view(char *cstr)
+{
+    return (Str8){ .len = (u32)strlen(cstr), .str = (u8 *)cstr };
+}
+
+/*
+ * The members of a struct named like one in ast.h stand for the fields of the real one, see
+ * comptime/ast_handle.h. They must be declared as what the field holds, a word, a struct or a
+ * pointer to one, or comptime code could use a number as a node.
+ */
+static void check_handle_struct(Compiler *c, TypeInfoStruct *t)
+{
+    for (u32 i = 0; i < t->members_len; i++) {
+        TypeInfoStructMember *m = t->members[i];
+        s32 idx = ast_field_find(t->info.generated_by, m->name);
+        if (idx == -1) {
+            error_sym(c->e, "Is not a field of the struct in ast.h", m->name);
+            continue;
+        }
+        AstField *field = &ast_fields[idx];
+        TypeInfo *mt = m->type;
+        if (field->pointee == NULL) {
+            if (mt->kind != TYPE_INTEGER && mt->kind != TYPE_ENUM && mt->kind != TYPE_BOOL) {
+                error_sym(c->e, "Is a number in ast.h", m->name);
+            }
+            continue;
+        }
+        bool is_pointer =
+            mt->kind == TYPE_POINTER && ((TypeInfoPointer *)mt)->level_of_indirection == 1;
+        if (is_pointer) {
+            mt = ((TypeInfoPointer *)mt)->pointer_to;
+        }
+        if (is_pointer == field->is_inline || mt->kind != TYPE_STRUCT ||
+            !handle_fits(cstr_view(field->pointee), mt->generated_by)) {
+            error_sym(c->e, field->is_inline ? "Is a different struct in ast.h"
+                                             : "Is a pointer to a different struct in ast.h",
+                      m->name);
+        }
+    }
+}
+
+/* True if a value of type t can be passed as or hold a value of the builtin type bt */
+static bool fits_builtin_type(TypeInfo *t, BuiltinType bt, bool is_result)
+{
+    TypeInfo *s = handle_struct(t);
+    if (bt.type == NULL) {
+        return s == NULL &&
+               (t->kind == TYPE_INTEGER || t->kind == TYPE_ENUM || t->kind == TYPE_BOOL);
+    }
+    if (s == NULL) {
+        return false;
+    }
+    return is_result ? handle_fits(s->generated_by, cstr_view(bt.type))
+                     : handle_fits(cstr_view(bt.type), s->generated_by);
+}
+
+/*
+ * A compiler func is a declaration of a builtin, see comptime/builtin.h. The builtin gets the
+ * arguments as they are, so they must be what it takes or it would use a number as a node.
+ */
+static void check_compiler_func(Compiler *c, AstFunc *decl)
+{
+    s32 idx = builtin_find(decl->name);
+    if (idx == -1) {
+        error_sym(c->e, "Is declared without a body, but is no compiler func", decl->name);
+        return;
+    }
+    Builtin *builtin = &builtins[idx];
+    TypeInfoFunc *t = (TypeInfoFunc *)symt_find_sym(&c->symt_root, decl->name)->type_info;
+    if (t->n_params != builtin->n_params) {
+        error_sym(c->e, "Has a different number of parameters than the compiler func",
+                  decl->name);
+        return;
+    }
+    for (u32 i = 0; i < t->n_params; i++) {
+        if (!fits_builtin_type(t->param_types[i], builtin->params[i], false)) {
+            error_sym(c->e, "Is a different type of parameter in the compiler func",
+                      t->param_names[i]);
+        }
+    }
+    if (!fits_builtin_type(t->return_type, builtin->result, true)) {
+        error_sym(c->e, "Returns a different type than the compiler func", decl->name);
+    }
+}
+
 static void bind_expr(Compiler *c, SymbolTable *symt_local, AstExpr *head)
 {
     /* Creates and binds symbols to expressions */
@@ -341,18 +468,19 @@ static void bind_expr(Compiler *c, SymbolTable *symt_local, AstExpr *head)
     }
 }
 
-static void bind_stmt(Compiler *c, SymbolTable *symt_local, AstStmt *head)
+/* next_slot is the first frame slot not taken by a parameter or a local that is in scope */
+static void bind_stmt(Compiler *c, SymbolTable *symt_local, u32 next_slot, AstStmt *head)
 {
     switch (head->kind) {
     case STMT_WHILE:
         bind_expr(c, symt_local, AS_WHILE(head)->condition);
-        bind_stmt(c, symt_local, AS_WHILE(head)->body);
+        bind_stmt(c, symt_local, next_slot, AS_WHILE(head)->body);
         break;
     case STMT_IF:
         bind_expr(c, symt_local, AS_IF(head)->condition);
-        bind_stmt(c, symt_local, AS_IF(head)->then);
+        bind_stmt(c, symt_local, next_slot, AS_IF(head)->then);
         if (AS_IF(head)->else_ != NULL) {
-            bind_stmt(c, symt_local, AS_IF(head)->else_);
+            bind_stmt(c, symt_local, next_slot, AS_IF(head)->else_);
         }
         break;
     case STMT_BREAK:
@@ -374,17 +502,23 @@ static void bind_stmt(Compiler *c, SymbolTable *symt_local, AstStmt *head)
         AstBlock *stmt = AS_BLOCK(head);
         /* Blocks create new scopes */
         // TODO: If there are no declarations in this scope, we don't need to create a new one?
-        stmt->symt_local = m_arena_alloc(c->persist_arena, sizeof(SymbolTable));
-        *stmt->symt_local = symt_init(symt_local);
+        stmt->symt_local =
+            m_arena_alloc_tagged(c->persist_arena, sizeof(SymbolTable), MEM_TAG_SYMBOL);
+        *stmt->symt_local = symt_init(c->persist_arena, symt_local);
         symt_local = stmt->symt_local;
         /* Create symbols for declarations */
         for (u32 i = 0; i < stmt->declarations.len; i++) {
             TypedIdent decl = stmt->declarations.vars[i];
             TypeInfo *decl_type = ast_type_resolve(c, decl.ast_type_info, true);
-            symt_new_sym(c, symt_local, SYMBOL_LOCAL_VAR, decl.name, decl_type, (AstNode *)stmt);
+            Symbol *sym = symt_new_sym(c, symt_local, SYMBOL_LOCAL_VAR, decl.name, decl_type,
+                                       (AstNode *)stmt);
+            /* On a redefinition this is the old symbol, which may be a global */
+            if (sym->kind == SYMBOL_LOCAL_VAR) {
+                sym->frame_slot = next_slot++;
+            }
         }
         for (AstListNode *node = stmt->stmts->head; node != NULL; node = node->next) {
-            bind_stmt(c, symt_local, (AstStmt *)node->this);
+            bind_stmt(c, symt_local, next_slot, (AstStmt *)node->this);
         }
     }; break;
     case STMT_ASSIGNMENT:
@@ -405,11 +539,13 @@ static void bind_function(Compiler *c, AstFunc *func)
     for (u32 i = 0; i < func->parameters.len; i++) {
         TypedIdent param = func->parameters.vars[i];
         TypeInfo *param_t = ast_type_resolve(c, param.ast_type_info, true);
-        symt_new_sym(c, &func_sym->symt_local, SYMBOL_PARAM, param.name, param_t, (AstNode *)func);
+        Symbol *sym = symt_new_sym(c, &func_sym->symt_local, SYMBOL_PARAM, param.name, param_t,
+                                   (AstNode *)func);
+        sym->frame_slot = i;
     }
 
     if (func->body != NULL) {
-        bind_stmt(c, &func_sym->symt_local, func->body);
+        bind_stmt(c, &func_sym->symt_local, func->parameters.len, func->body);
     }
 }
 
@@ -466,11 +602,28 @@ static TypeInfo *typecheck_expr(Compiler *c, SymbolTable *symt_local, AstExpr *h
             break;
         }
 
+        /* Indexing, the result is an element of the array */
+        if (expr->op == TOKEN_LBRACKET) {
+            TypeInfo *index = typecheck_expr(c, symt_local, expr->right);
+            if (left->kind != TYPE_ARRAY || index->kind != TYPE_INTEGER) {
+                error_typecheck_binary(c->e, "Can not index", (AstNode *)head, left, index);
+                head->type = left;
+                break;
+            }
+            head->type = ((TypeInfoArray *)left)->element_type;
+            break;
+        }
+
         /* Regular binary operator */
         TypeInfo *right = typecheck_expr(c, symt_local, expr->right);
         if (!type_info_equal(left, right)) {
             error_typecheck_binary(c->e, "bin", (AstNode *)head, left, right);
         }
+        /* Handles are addresses of nodes, arithmetic on them would make up new ones */
+        if (handle_kinds(left) != 0 && expr->op != TOKEN_EQ && expr->op != TOKEN_NEQ) {
+            error_typecheck_binary(c->e, "Handles can only be compared", (AstNode *)head, left,
+                                   right);
+        }
 
         // TODO: some binary ops have a limited number of types that are allowed
         //       f.ex. we don't allow addition of structs
@@ -478,7 +631,11 @@ static TypeInfo *typecheck_expr(Compiler *c, SymbolTable *symt_local, AstExpr *h
     } break;
     case EXPR_LITERAL: {
         AstLiteral *lit = AS_LITERAL(head);
-        if (lit->lit_type == LIT_IDENT || lit->lit_type == LIT_NULL) {
+        if (lit->lit_type == LIT_IDENT && lit->sym == NULL) {
+            /* Made by a comptime call after binding, see comptime/builtin.h */
+            bind_expr(c, symt_local, head);
+        }
+        if ((lit->lit_type == LIT_IDENT || lit->lit_type == LIT_NULL) && lit->sym != NULL) {
             head->type = lit->sym->type_info;
         } else {
             // TODO: temporary assumption that every constant literal that is not an ident is a s32
@@ -575,6 +732,18 @@ static void typecheck_stmt(Compiler *c, SymbolTable *symt_local, TypeInfoFunc *p
         if (!type_info_equal(l, r)) {
             error_typecheck_binary(c->e, "Typecheck error in assignment", (AstNode *)head, l, r);
         }
+        AstBinary *target = AS_BINARY(AS_ASSIGNMENT(head)->left);
+        if (target->kind == EXPR_BINARY && target->op == TOKEN_DOT &&
+            handle_kinds(target->left->type) != 0) {
+            TypeInfo *t = target->left->type;
+            if (t->kind == TYPE_POINTER) {
+                t = ((TypeInfoPointer *)t)->pointer_to;
+            }
+            s32 field = ast_field_find(t->generated_by, AS_LITERAL(target->right)->literal);
+            if (field != -1 && ast_fields[field].is_read_only) {
+                error_node(c->e, "Comptime code can not change this field", (AstNode *)head);
+            }
+        }
     } break;
     case STMT_BREAK:
     case STMT_CONTINUE:
@@ -691,7 +860,7 @@ static void resolve_global_types(Compiler *c)
      * to be resolved.
      */
     for (u32 i = 0; i < c->all_types.size; i++) {
-        TypeInfo *t = *(TypeInfo **)arraylist_get(&c->all_types, i);
+        TypeInfo *t = c->all_types.data[i];
         if (t->is_resolved) {
             continue;
         }
@@ -732,7 +901,7 @@ static void resolve_global_types(Compiler *c)
 
 void typegen(Compiler *c, AstRoot *root)
 {
-    c->symt_root = symt_init(NULL);
+    c->symt_root = symt_init(c->persist_arena, NULL);
 
     /* Fill symbol table with builtin types */
     fill_builtin_types(c);
@@ -762,6 +931,17 @@ void typegen(Compiler *c, AstRoot *root)
     if (c->e->n_errors != 0) {
         return;
     }
+    for (u32 i = 0; i < c->struct_types.size; i++) {
+        TypeInfoStruct *s = c->struct_types.data[i];
+        if (ast_handle_type(s->info.generated_by)) {
+            check_handle_struct(c, s);
+        }
+    }
+    for (AstListNode *node = root->funcs.head; node != NULL; node = node->next) {
+        if (AS_FUNC(node->this)->body == NULL) {
+            check_compiler_func(c, AS_FUNC(node->this));
+        }
+    }
 
     /* Check for cirular type dependencies */
     ArenaTmp persist_arena_tmp = m_arena_tmp_init(c->persist_arena);
@@ -769,8 +949,7 @@ void typegen(Compiler *c, AstRoot *root)
     NAG_Graph graph =
         nag_make_graph(c->persist_arena, c->pass_arena, (NAG_Idx)c->struct_types.size);
     for (NAG_Idx i = 0; i < (NAG_Idx)c->struct_types.size; i++) {
-        TypeInfoStruct **t = arraylist_get(&c->struct_types, i);
-        graph_add_edges_from_struct_type(c->pass_arena, &graph, *t);
+        graph_add_edges_from_struct_type(c->pass_arena, &graph, c->struct_types.data[i]);
     }
 
     NAG_OrderList sccs = nag_scc(&graph);
@@ -780,7 +959,7 @@ void typegen(Compiler *c, AstRoot *root)
      */
     for (u32 i = 0; i < sccs.n; i++) {
         NAG_Order scc = sccs.orders[i];
-        Str8Builder sb = make_str_builder(&c->e->arena);
+        Str8Builder sb = make_str_builder(error_handler_arena(c->e));
         str_builder_append_str8(&sb, STR8_LIT("Circular dependency between structs: "));
         str_builder_sprintf(&sb, "%d", 1, scc.nodes[0]);
         for (u32 j = 0; j < scc.n_nodes; j++) {
@@ -798,18 +977,18 @@ void typegen(Compiler *c, AstRoot *root)
      *       so using that would save some compute.
      */
     NAG_Order rev_toposort = nag_rev_toposort(&graph);
-    ArrayList structs_sorted;
-    arraylist_init(&structs_sorted, sizeof(TypeInfoStruct *));
+    TypeInfoStructPtrArray structs_sorted;
+    type_info_struct_ptr_array_init(&structs_sorted);
     for (u32 i = 0; i < rev_toposort.n_nodes; i++) {
-        TypeInfoStruct **s = arraylist_get(&c->struct_types, rev_toposort.nodes[i]);
-        arraylist_append(&structs_sorted, s);
+        TypeInfoStruct *s = c->struct_types.data[rev_toposort.nodes[i]];
+        type_info_struct_ptr_array_append(&structs_sorted, s);
     }
-    arraylist_free(&c->struct_types);
+    type_info_struct_ptr_array_free(&c->struct_types);
     c->struct_types = structs_sorted;
 
     /* Calculate the size of each struct */
     for (u32 i = 0; i < c->struct_types.size; i++) {
-        TypeInfoStruct *s = *(TypeInfoStruct **)arraylist_get(&c->struct_types, i);
+        TypeInfoStruct *s = c->struct_types.data[i];
         s->bit_size = 0;
         for (u32 j = 0; j < s->members_len; j++) {
             TypeInfoStructMember *member = s->members[j];
@@ -838,17 +1017,21 @@ void infer(Compiler *c, AstRoot *root)
     }
 }
 
+void typecheck_func(Compiler *c, AstNode *node)
+{
+    AstFunc *func = AS_FUNC(node);
+    Symbol *func_sym = symt_find_sym(&c->symt_root, func->name);
+    assert(func_sym != NULL && "Could not find symbol for function in bind_and_check!?!?");
+    if (func->body != NULL) {
+        typecheck_stmt(c, &func_sym->symt_local, (TypeInfoFunc *)func_sym->type_info, func->body);
+    }
+}
+
 void typecheck(Compiler *c, AstRoot *root)
 {
     /* Typecheck each function */
     for (AstListNode *node = root->funcs.head; node != NULL; node = node->next) {
-        AstFunc *func = AS_FUNC(node->this);
-        Symbol *func_sym = symt_find_sym(&c->symt_root, func->name);
-        assert(func_sym != NULL && "Could not find symbol for function in bind_and_check!?!?");
-        if (func->body != NULL) {
-            typecheck_stmt(c, &func_sym->symt_local, (TypeInfoFunc *)func_sym->type_info,
-                           func->body);
-        }
+        typecheck_func(c, node->this);
     }
     // symt_print(c->symt_root);
 }
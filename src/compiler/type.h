@@ -95,6 +95,10 @@ typedef struct {
 } TypeInfoPointer;
 
 
+ARRAY_DEFINE(TypeInfoPtrArray, type_info_ptr_array, TypeInfo *)
+ARRAY_DEFINE(TypeInfoStructPtrArray, type_info_struct_ptr_array, TypeInfoStruct *)
+
+
 /* Symbol tuff */
 
 typedef enum {
@@ -114,11 +118,13 @@ typedef enum {
 typedef struct symbol_table_t SymbolTable;
 typedef struct symbol_t Symbol;
 
+HASHMAP_DEFINE(SymbolMap, symbol_map, Symbol *)
+
 struct symbol_table_t {
     Symbol **symbols;
     u32 sym_len;
     u32 sym_cap;
-    HashMap map; // Key: string (u8 *), Value: *Symbol
+    SymbolMap map; // Key: string (u8 *)
     SymbolTable *parent; // @NULLABLE
 };
 
@@ -130,7 +136,12 @@ struct symbol_t {
     AstNode *node; // @NULLABLE. Node which defined this symbol. If NULL then defined by compiler
     union {
         SymbolTable symt_local; // FUNC and TYPE (structs and enums) create local symbol tables
-        // u32 local_var_offset; //
+        /*
+         * LOCAL_VAR and PARAM. Dense index into the frame of the function, given out by the binder.
+         * Parameters come first, then locals. Locals in blocks that can't be live at the same
+         * time share slots.
+         */
+        u32 frame_slot;
     };
 };
 
@@ -141,5 +152,10 @@ Symbol *symt_find_sym(SymbolTable *symt, Str8 key);
 void typegen(Compiler *c, AstRoot *root);
 void infer(Compiler *c, AstRoot *root);
 void typecheck(Compiler *compiler, AstRoot *root);
+/*
+ * Typechecks a single function. Only reads the symbol tables and allocates on c->persist_arena,
+ * so it can run on many functions in parallel as long as every thread has its own arena.
+ */
+void typecheck_func(Compiler *c, AstNode *func);
 
 #endif /* TYPE_H */
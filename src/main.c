@@ -15,14 +15,23 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "compiler/ast.h"
 #include "compiler/codegen/gen.h"
 #include "compiler/compiler.h"
 #include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/comptime.h"
+#include "compiler/comptime/native.h"
+#include "compiler/comptime/peephole.h"
+#include "compiler/comptime/reg_bytecode.h"
+#include "compiler/comptime/reg_vm.h"
 #include "compiler/comptime/vm.h"
 #include "compiler/error.h"
+#include "compiler/mem_report.h"
 #include "compiler/parser.h"
+#include "compiler/time_report.h"
 #include "compiler/type.h"
 
 #include "base/str.h"
@@ -38,29 +47,124 @@ bool run_compiler_pass(Compiler *c, AstRoot *root, CompilerPass pass)
 {
     m_arena_clear(c->pass_arena);
     pass(c, root);
+    error_handler_merge(c->e);
     for (CompilerError *err = c->e->head; err != NULL; err = err->next) {
         printf("%s\n", err->msg.str);
     }
     return c->e->n_errors > 0;
 }
 
-u32 compile(char *input)
+/* A pass that works on one top-level item (f.ex. a function) at a time */
+typedef void (*CompilerItemPass)(Compiler *c, AstNode *item);
+
+typedef struct {
+    Compiler *c;
+    CompilerItemPass pass;
+    AstNode **items;
+    Arena *persist_arenas; // One per thread
+} ParallelPass;
+
+static void run_compiler_pass_items(void *arg, u32 start, u32 end, Arena *scratch, u32 worker_id)
+{
+    ParallelPass *pp = arg;
+    /* Every thread gets its own copy of the compiler so allocations don't race */
+    Compiler c = *pp->c;
+    c.persist_arena = &pp->persist_arenas[worker_id];
+    c.pass_arena = scratch;
+    for (u32 i = start; i < end; i++) {
+        error_handler_bind_thread(c.e, worker_id, i);
+        pp->pass(&c, pp->items[i]);
+    }
+}
+
+/*
+ * Runs the pass over every item in the list across the thread pool. Errors are merged in the
+ * order of the items, so the output is the same as if the items were processed one by one.
+ */
+bool run_compiler_pass_parallel(Compiler *c, AstList *items, Arena *persist_arenas,
+                                CompilerItemPass pass)
+{
+    m_arena_clear(c->pass_arena);
+    u32 n_items = 0;
+    for (AstListNode *node = items->head; node != NULL; node = node->next) {
+        n_items++;
+    }
+    AstNode **item_array = m_arena_alloc(c->pass_arena, sizeof(AstNode *) * n_items);
+    n_items = 0;
+    for (AstListNode *node = items->head; node != NULL; node = node->next) {
+        item_array[n_items++] = node->this;
+    }
+
+    ParallelPass pp = {
+        .c = c, .pass = pass, .items = item_array, .persist_arenas = persist_arenas
+    };
+    pool_parallel_for(c->pool, n_items, 1, run_compiler_pass_items, &pp);
+    error_handler_bind_thread(c->e, 0, 0);
+
+    error_handler_merge(c->e);
+    for (CompilerError *err = c->e->head; err != NULL; err = err->next) {
+        printf("%s\n", err->msg.str);
+    }
+    return c->e->n_errors > 0;
+}
+
+u32 compile(char *input, CompilerOptions *options)
 {
     Arena lex_arena;
     Arena persist_arena;
     Arena pass_arena;
-    m_arena_init_dynamic(&lex_arena, 1, 512);
-    m_arena_init_dynamic(&persist_arena, 2, 512);
-    m_arena_init_dynamic(&pass_arena, 1, 512);
+    /*
+     * The arenas reserve a modest amount of address space up front and chain on more if a large
+     * input needs it. The pass arena is cleared between passes, so pages above the ones most
+     * passes need are handed back to the OS on every clear.
+     */
+    m_arena_init_dynamic_flags(&lex_arena, 1, 512, SAC_FLAG_CHAINED);
+    m_arena_init_dynamic_flags(&persist_arena, 2, 512, SAC_FLAG_CHAINED);
+    m_arena_init_dynamic_flags(&pass_arena, 16, 512,
+                               SAC_FLAG_CHAINED | SAC_FLAG_DECOMMIT_ON_CLEAR);
+
+    ThreadPool pool;
+    u32 n_workers = options->n_threads == 0 ? pool_default_workers() : options->n_threads - 1;
+    pool_init(&pool, n_workers);
+    /* Things that outlive a pass, but are made during a parallel pass, live here */
+    Arena *worker_persist_arenas = malloc(sizeof(Arena) * (n_workers + 1));
+    for (u32 i = 0; i <= n_workers; i++) {
+        m_arena_init_dynamic_flags(&worker_persist_arenas[i], 1, 512, SAC_FLAG_CHAINED);
+    }
 
     ErrorHandler e;
-    error_handler_init(&e, input, "test.meta");
+    error_handler_init(&e, input, "test.meta", n_workers + 1);
 
-    Compiler compiler = { .persist_arena = &persist_arena, .pass_arena = &pass_arena, .e = &e };
-    arraylist_init(&compiler.struct_types, sizeof(TypeInfoStruct *));
-    arraylist_init(&compiler.all_types, sizeof(TypeInfo *));
+    /* One per arena, the worker persist and error arenas are reported as one family each */
+    u32 n_mem_stats = 3 + 2 * (n_workers + 1);
+    struct m_arena_stats *mem_stats = NULL;
+    if (options->mem_report) {
+        mem_stats = malloc(sizeof(struct m_arena_stats) * n_mem_stats);
+        m_arena_stats_enable(&lex_arena, &mem_stats[0], "lex_arena");
+        m_arena_stats_enable(&persist_arena, &mem_stats[1], "persist_arena");
+        m_arena_stats_enable(&pass_arena, &mem_stats[2], "pass_arena");
+        for (u32 i = 0; i <= n_workers; i++) {
+            m_arena_stats_enable(&worker_persist_arenas[i], &mem_stats[3 + i],
+                                 "worker_persist_arena");
+            m_arena_stats_enable(&e.buffers[i].arena, &mem_stats[4 + n_workers + i],
+                                 "error_arena");
+        }
+    }
+
+    Compiler compiler = {
+        .persist_arena = &persist_arena, .pass_arena = &pass_arena, .e = &e, .pool = &pool
+    };
+    type_info_struct_ptr_array_init(&compiler.struct_types);
+    type_info_ptr_array_init(&compiler.all_types);
+    ComptimeCache comptime_cache;
+    comptime_cache_init(&comptime_cache, &persist_arena,
+                        options->no_comptime_cache ? NULL : COMPTIME_CACHE_DIR);
+    TimeReport time_report;
+    time_report_init(&time_report);
 
+    time_report_phase(&time_report, PHASE_PARSE);
     AstRoot *ast_root = parse(&persist_arena, &lex_arena, &e, input);
+    error_handler_merge(&e);
     for (CompilerError *err = e.head; err != NULL; err = err->next) {
         printf("%s\n", err->msg.str);
     }
@@ -68,56 +172,178 @@ u32 compile(char *input)
         goto done;
     }
 
+    time_report_phase(&time_report, PHASE_TYPEGEN);
     if (run_compiler_pass(&compiler, ast_root, typegen)) {
         goto done;
     }
+    time_report_phase(&time_report, PHASE_INFER);
     if (run_compiler_pass(&compiler, ast_root, infer)) {
         goto done;
     }
-    if (run_compiler_pass(&compiler, ast_root, typecheck)) {
+    time_report_phase(&time_report, PHASE_TYPECHECK);
+    if (run_compiler_pass_parallel(&compiler, &ast_root->funcs, worker_persist_arenas,
+                                   typecheck_func)) {
         goto done;
     }
 
     ast_print((AstNode *)ast_root, 0);
     putchar('\n');
 
-    Bytecode bytecode = ast_to_bytecode(ast_root);
-    // Bytecode bytecode = fib_test();
-    disassemble(bytecode);
-    run(bytecode);
+    /*
+     * Calls run once, on the code as it was before any of them changed it. Nodes they make have no
+     * types yet, so the functions are typechecked again when something may have changed.
+     */
+    m_arena_clear(&pass_arena);
+    time_report_phase(&time_report, PHASE_COMPTIME);
+    bool changed = comptime_run_calls(&compiler, ast_root, &comptime_cache, options);
+    if (e.n_errors != 0) {
+        goto done;
+    }
+    if (changed && run_compiler_pass_parallel(&compiler, &ast_root->funcs, worker_persist_arenas,
+                                              typecheck_func)) {
+        goto done;
+    }
+
+    m_arena_clear(&pass_arena);
+    time_report_phase(&time_report, PHASE_RUN);
+    BytecodeWord native_result;
+    if (options->comptime == COMPTIME_NATIVE && native_run(&compiler, &native_result)) {
+        /* Ran natively, the VMs are the fallback */
+    } else if (options->comptime == COMPTIME_REG_VM) {
+        RegBytecode *bytecode = ast_to_reg_bytecode(&pass_arena, ast_root);
+        reg_disassemble(bytecode);
+        reg_run(bytecode);
+    } else {
+        Bytecode *bytecode = ast_to_bytecode(&pass_arena, ast_root);
+        // Bytecode *bytecode = fib_test(&pass_arena, 20);
+        if (options->op_pairs) {
+            bytecode_print_op_pairs(bytecode);
+        }
+        bytecode_peephole(bytecode);
+        disassemble(bytecode);
+        BytecodeFunc *unsupported = comptime_find_unsupported(&compiler, bytecode,
+                                                              bytecode->entry);
+        VMMeter meter;
+        vm_meter_init(&meter, options->comptime_fuel, options->comptime_deadline_ms);
+        if (unsupported != NULL) {
+            /* Only the VM can't run it, the C it is compiled to can */
+            printf("Not running %.*s on the VM, %.*s has code it can't run: %s\n",
+                   STR8VIEW_PRINT(bytecode->funcs[bytecode->entry].name),
+                   STR8VIEW_PRINT(unsupported->name), unsupported->unsupported_msg);
+        } else if (options->comptime_profile) {
+            VMProfile profile;
+            vm_profile_init(&profile, bytecode);
+            run_with(bytecode, &meter, &profile, false);
+            vm_profile_report(&profile);
+            vm_profile_release(&profile);
+        } else {
+            run_with(bytecode, &meter, NULL, options->comptime == COMPTIME_JIT);
+        }
+        if (meter.stop != VM_STOP_NONE) {
+            comptime_report_stop(&compiler, bytecode, &meter, bytecode->funcs[bytecode->entry].name,
+                                 options->comptime_deadline_ms);
+        }
+    }
 
+    time_report_phase(&time_report, PHASE_CODEGEN);
     transpile_to_c(&compiler);
 
 done:
+    time_report_end(&time_report);
     for (CompilerError *err = e.head; err != NULL; err = err->next) {
         printf("%s\n", err->msg.str);
     }
+    if (options->mem_report) {
+        mem_report_print(mem_stats, n_mem_stats);
+        free(mem_stats);
+    }
+    if (options->time_report) {
+        time_report_print(&time_report, &comptime_cache);
+    }
     // We could be "good citizens" and release the memory here, but the OS is going to do it
     // anyways on the process terminating, so it doesn't really make a difference.
-    // arraylist_free ...
+    // type_info_ptr_array_free ...
+    pool_destroy(&pool);
+    for (u32 i = 0; i <= n_workers; i++) {
+        m_arena_release(&worker_persist_arenas[i]);
+    }
+    free(worker_persist_arenas);
     error_handler_release(&e);
     m_arena_release(&persist_arena);
     m_arena_release(&lex_arena);
+    m_arena_release(&pass_arena);
     return e.n_errors;
 }
 
 
-int main(void)
+int main(int argc, char **argv)
 {
+    CompilerOptions options = { 0 };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mem-report") == 0) {
+            options.mem_report = true;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            options.n_threads = (u32)atoi(argv[i] + 10);
+        } else if (strcmp(argv[i], "--comptime=stack") == 0) {
+            options.comptime = COMPTIME_STACK_VM;
+        } else if (strcmp(argv[i], "--comptime=reg") == 0) {
+            options.comptime = COMPTIME_REG_VM;
+        } else if (strcmp(argv[i], "--comptime=jit") == 0) {
+            options.comptime = COMPTIME_JIT;
+        } else if (strcmp(argv[i], "--comptime=native") == 0) {
+            options.comptime = COMPTIME_NATIVE;
+        } else if (strcmp(argv[i], "--op-pairs") == 0) {
+            options.op_pairs = true;
+        } else if (strcmp(argv[i], "--comptime-profile") == 0) {
+            options.comptime_profile = true;
+        } else if (strncmp(argv[i], "--comptime-fuel=", 16) == 0) {
+            options.comptime_fuel = strtoull(argv[i] + 16, NULL, 10);
+        } else if (strncmp(argv[i], "--comptime-deadline=", 20) == 0) {
+            options.comptime_deadline_ms = strtoull(argv[i] + 20, NULL, 10);
+        } else if (strcmp(argv[i], "--no-comptime-cache") == 0) {
+            options.no_comptime_cache = true;
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            options.time_report = true;
+        } else {
+            fprintf(stderr, "metagenc: unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (options.comptime_profile && !VM_PROFILE) {
+        fprintf(stderr, "metagenc: --comptime-profile needs a build with VM_PROFILE, see "
+                        "'./build.sh profile'\n");
+        return 1;
+    }
+    if (options.comptime_profile && options.comptime != COMPTIME_STACK_VM) {
+        fprintf(stderr, "metagenc: --comptime-profile only profiles the stack VM\n");
+        return 1;
+    }
+    bool metered = options.comptime_fuel != 0 || options.comptime_deadline_ms != 0;
+    if (metered && options.comptime != COMPTIME_STACK_VM && options.comptime != COMPTIME_JIT) {
+        fprintf(stderr, "metagenc: --comptime-fuel and --comptime-deadline only bound the stack VM "
+                        "and the JIT\n");
+        return 1;
+    }
+
     Arena input_arena;
-    m_arena_init_dynamic(&input_arena, 1, 512);
-    char *input = m_arena_alloc_zero(&input_arena, 4096);
+    m_arena_init_dynamic_flags(&input_arena, 1, 512, SAC_FLAG_CHAINED);
+    u32 cap = 4096;
+    char *input = m_arena_alloc_zero(&input_arena, cap);
     char c;
     u32 i = 0;
     while ((c = getchar()) != EOF) {
-        if (i >= input_arena.pages_commited * 4096) {
-            m_arena_alloc_zero(&input_arena, 4096);
+        /* Always leave room for the null terminator */
+        if (i + 1 >= cap) {
+            input = m_arena_grow(&input_arena, input, cap, cap * 2);
+            memset(input + cap, 0, cap);
+            cap *= 2;
         }
         input[i] = c;
         i++;
     }
 
-    u32 n_errors = compile(input);
+    u32 n_errors = compile(input, &options);
     if (n_errors == 0)
         return 0;
     return 1;
@@ -1,10 +1,10 @@
 #!/bin/sh
 set -e
 
-SRCS=$(find . -type f -name "*.c" -not -name "main.c")
+SRCS=$(find src test -type f -name "*.c" -not -name "main.c" -not -name "parser_main.c")
 
-CFLAGS="-Isrc -Wall -Wpedantic -Wextra -Wshadow -std=c11 -g -D debug" # -fsanitize=address -fsanitize=undefined"
+CFLAGS="-Isrc -Wall -Wpedantic -Wextra -Wshadow -std=c11 -D_DEFAULT_SOURCE -pthread -g -D debug" # -fsanitize=address -fsanitize=undefined"
 OUT="metagenc-test"
-cc $CFLAGS $SRCS -o "$OUT"
+cc $CFLAGS $SRCS -o "$OUT" -ldl
 
 ./"$OUT"
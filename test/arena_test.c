@@ -0,0 +1,75 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "base/sac_single.h"
+#include "tests.h"
+
+/* A tmp taken in a block that m_arena_clear() dropped since */
+static void test_tmp_after_clear(void)
+{
+    Arena arena;
+    m_arena_init_dynamic_flags(&arena, 1, 2, SAC_FLAG_CHAINED);
+    size_t page_size = arena.page_size;
+    /* take the address space after the reservation, so it can't be extended in place */
+    uint8_t *end = arena.memory + 2 * page_size;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+    /* fails if something is mapped there already, which does just as well */
+    void *blocker = mmap(end, page_size, PROT_NONE, flags, -1, 0);
+    m_arena_alloc(&arena, 64);
+    ArenaTmp tmp = m_arena_tmp_init(&arena);
+    assert(m_arena_alloc(&arena, 4 * page_size) != NULL);
+    assert(arena.prev != NULL);
+    m_arena_clear(&arena);
+    assert(m_arena_alloc(&arena, 32 * page_size) != NULL);
+    m_arena_tmp_release(tmp);
+    assert(arena.prev == NULL);
+    assert(arena.offset == 0);
+    assert(m_arena_alloc(&arena, 64) != NULL);
+    m_arena_release(&arena);
+    if (blocker != MAP_FAILED)
+        munmap(blocker, page_size);
+}
+
+static void test_decommit_on_clear(void)
+{
+    Arena arena;
+    struct m_arena_stats stats;
+    m_arena_init_dynamic_flags(&arena, 1, 64, SAC_FLAG_DECOMMIT_ON_CLEAR);
+    m_arena_stats_enable(&arena, &stats, "test");
+    size_t size = 16 * arena.page_size;
+    memset(m_arena_alloc(&arena, size), 0xff, size);
+    assert(arena.pages_commited >= 16);
+    m_arena_clear(&arena);
+    assert(arena.pages_commited == 1);
+    assert(stats.pages_commited == 1);
+    assert(stats.peak_pages_commited >= 16);
+    /* committed again, and given back by the OS as zero */
+    uint8_t *memory = m_arena_alloc(&arena, size);
+    assert(memory != NULL && memory[size - 1] == 0);
+    assert(stats.pages_commited == arena.pages_commited);
+    m_arena_release(&arena);
+}
+
+void test_arena(void)
+{
+    test_tmp_after_clear();
+    test_decommit_on_clear();
+}
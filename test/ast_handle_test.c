@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "compiler/ast.h"
+#include "compiler/comptime/comptime.h"
+#include "compiler/lex.h"
+#include "test_program.h"
+#include "tests.h"
+
+/*
+ * @setop reads the name of the function it annotates and rewrites the operator in its body in
+ * place. On a struct the handle points at the wrong kind of node, which stops the call.
+ */
+static char *handle_program =
+    "enum AstNodeKind := EXPR_UNARY, EXPR_BINARY, EXPR_LITERAL, EXPR_CALL, STMT_WHILE, STMT_IF, "
+    "STMT_BREAK, STMT_CONTINUE, STMT_RETURN, STMT_EXPR, STMT_PRINT, STMT_BLOCK, STMT_ASSIGNMENT, "
+    "AST_FUNC, AST_STRUCT, AST_ENUM, AST_LIST, AST_TYPED_IDENT_LIST, AST_ROOT\n"
+    "\n"
+    "struct Str8 := len: s32\n"
+    "struct AstBinary := kind: AstNodeKind, op: s32\n"
+    "struct AstSingle := kind: AstNodeKind, node: ^AstBinary\n"
+    "struct AstListNode := this: ^AstSingle, next: ^AstListNode\n"
+    "struct AstList := kind: AstNodeKind, head: ^AstListNode\n"
+    "struct AstBlock := kind: AstNodeKind, stmts: ^AstList\n"
+    "struct AstFunc := kind: AstNodeKind, name: Str8, body: ^AstBlock\n"
+    "\n"
+    "func setop(f: ^AstFunc): ^AstFunc\n"
+    "begin\n"
+    "    var bin: ^AstBinary\n"
+    "    bin := f.body.stmts.head.this.node\n"
+    "    bin.op := bin.op - f.name.len\n"
+    "    return f\n"
+    "end\n"
+    "\n"
+    "@setop()\n"
+    "func sub(a: s32, b: s32): s32\n"
+    "begin\n"
+    "    return a - b\n"
+    "end\n"
+    "\n"
+    "@setop()\n"
+    "struct Oops := x: s32\n"
+    "\n"
+    "func main(): s32\n"
+    "begin\n"
+    "    return 0\n"
+    "end\n";
+
+void test_ast_handles(void)
+{
+    CompilerOptions options = { 0 };
+    TestProgram p;
+    test_program_init(&p, handle_program, 0);
+    ComptimeCache cache;
+    comptime_cache_init(&cache, &p.persist_arena, NULL);
+    comptime_run_calls(&p.c, p.root, &cache, &options);
+
+    /* Rewritten in the AST itself, nothing was copied */
+    AstFunc *sub = test_program_func(&p, "sub");
+    AstSingle *ret = (AstSingle *)AS_BLOCK(sub->body)->stmts->head->this;
+    assert(ret->kind == STMT_RETURN);
+    assert(AS_BINARY(ret->node)->op == TOKEN_MINUS - 3);
+
+    assert(p.e.n_errors == 1);
+    assert(strstr((char *)p.e.head->msg.str, "@setop") != NULL);
+    assert(strstr((char *)p.e.head->msg.str, "wrong kind of node") != NULL);
+    test_program_release(&p);
+}
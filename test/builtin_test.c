@@ -0,0 +1,123 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "compiler/ast.h"
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/comptime.h"
+#include "compiler/comptime/vm.h"
+#include "test_program.h"
+#include "tests.h"
+
+#define BUILTIN_DECLS                                                                        \
+    "enum AstNodeKind := EXPR_UNARY, EXPR_BINARY, EXPR_LITERAL, EXPR_CALL, STMT_WHILE, "     \
+    "STMT_IF, STMT_BREAK, STMT_CONTINUE, STMT_RETURN, STMT_EXPR, STMT_PRINT, STMT_BLOCK, "   \
+    "STMT_ASSIGNMENT, AST_FUNC, AST_STRUCT, AST_ENUM, AST_LIST, AST_TYPED_IDENT_LIST, "      \
+    "AST_ROOT\n"                                                                             \
+    "\n"                                                                                     \
+    "struct Str8 := len: s32\n"                                                              \
+    "struct Str8Builder := str: Str8\n"                                                      \
+    "struct Token := kind: s32\n"                                                            \
+    "struct AstLiteral := kind: AstNodeKind\n"                                               \
+    "struct AstListNode := this: ^AstLiteral, next: ^AstListNode\n"                          \
+    "struct AstList := kind: AstNodeKind, head: ^AstListNode\n"                              \
+    "struct AstBlock := kind: AstNodeKind, stmts: ^AstList\n"                                \
+    "struct AstFunc := kind: AstNodeKind, name: Str8, body: ^AstBlock\n"                     \
+    "\n"                                                                                     \
+    "compiler func make_token(kind: s32, lexeme: Str8): Token\n"                             \
+    "compiler func make_literal(token: Token): ^AstLiteral\n"                                \
+    "compiler func make_print(expr: ^AstLiteral): ^AstList\n"                                \
+    "compiler func make_list_node(node: ^AstList): ^AstListNode\n"                           \
+    "compiler func make_str_builder(): ^Str8Builder\n"                                       \
+    "compiler func str_builder_append_int(sb: ^Str8Builder, n: s32): ^Str8Builder\n"         \
+    "compiler func str_builder_end(sb: ^Str8Builder): Str8\n"                                \
+    "\n"
+
+/* Builds a print statement with the compiler funcs and puts it first in the body */
+static char *log_program = BUILTIN_DECLS
+    "func Log(f: ^AstFunc, id: s32): ^AstFunc\n"
+    "begin\n"
+    "    var sb: ^Str8Builder, node: ^AstListNode\n"
+    "    sb := str_builder_append_int(make_str_builder(), id)\n"
+    "    node := make_list_node(make_print(make_literal(make_token(1, str_builder_end(sb)))))\n"
+    "    node.next := f.body.stmts.head\n"
+    "    f.body.stmts.head := node\n"
+    "    return f\n"
+    "end\n"
+    "\n"
+    "func BadToken(f: ^AstFunc): ^AstFunc\n"
+    "begin\n"
+    "    var t: Token\n"
+    "    t := make_token(100000, str_builder_end(make_str_builder()))\n"
+    "    return f\n"
+    "end\n"
+    "\n"
+    "@Log(1000)\n"
+    "func add(a: s32, b: s32): s32\n"
+    "begin\n"
+    "    return a + b\n"
+    "end\n"
+    "\n"
+    "@BadToken()\n"
+    "func sub(a: s32, b: s32): s32\n"
+    "begin\n"
+    "    return a - b\n"
+    "end\n"
+    "\n"
+    "func main(): s32\n"
+    "begin\n"
+    "    return 0\n"
+    "end\n";
+
+/* Compiler funcs make AST nodes, so there has to be a compilation to put them in */
+static char *outside_program = BUILTIN_DECLS
+    "func main(): s32\n"
+    "begin\n"
+    "    var sb: ^Str8Builder\n"
+    "    sb := make_str_builder()\n"
+    "    return 0\n"
+    "end\n";
+
+void test_builtins(void)
+{
+    CompilerOptions options = { 0 };
+    TestProgram p;
+    test_program_init(&p, log_program, 0);
+    ComptimeCache cache;
+    comptime_cache_init(&cache, &p.persist_arena, NULL);
+    comptime_run_calls(&p.c, p.root, &cache, &options);
+
+    AstFunc *add = test_program_func(&p, "add");
+    AstList *print = (AstList *)AS_BLOCK(add->body)->stmts->head->this;
+    assert(print->kind == (AstNodeKind)STMT_PRINT);
+    AstLiteral *literal = AS_LITERAL(print->head->this);
+    assert(literal->literal.len == 4 && memcmp(literal->literal.str, "1000", 4) == 0);
+
+    assert(p.e.n_errors == 1);
+    assert(strstr((char *)p.e.head->msg.str, "@BadToken") != NULL);
+    assert(strstr((char *)p.e.head->msg.str, "argument out of range") != NULL);
+    test_program_release(&p);
+
+    test_program_init(&p, outside_program, 0);
+    VMMeter meter;
+    vm_meter_init(&meter, 0, 0);
+    run_with(ast_to_bytecode(&p.pass_arena, p.root), &meter, NULL, false);
+    assert(meter.stop == VM_STOP_NOT_COMPTIME);
+    test_program_release(&p);
+}
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "compiler/comptime/comptime.h"
+#include "test_program.h"
+#include "tests.h"
+
+static u32 n_cache_entries(char *dir)
+{
+    u32 n = 0;
+    DIR *d = opendir(dir);
+    assert(d != NULL);
+    for (struct dirent *ent = readdir(d); ent != NULL; ent = readdir(d)) {
+        n += ent->d_name[0] != '.';
+    }
+    closedir(d);
+    return n;
+}
+
+static void remove_cache_dir(char *dir)
+{
+    DIR *d = opendir(dir);
+    assert(d != NULL);
+    for (struct dirent *ent = readdir(d); ent != NULL; ent = readdir(d)) {
+        if (ent->d_name[0] == '.')
+            continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        remove(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+static bool has_result(ComptimeCache *cache, BytecodeWord value)
+{
+    ComptimeResult **results = malloc(sizeof(ComptimeResult *) * cache->results.map.len);
+    hashmap_get_values(&cache->results.map, (void **)results);
+    bool found = false;
+    for (u32 i = 0; i < cache->results.map.len; i++) {
+        found |= results[i]->value == value;
+    }
+    free(results);
+    return found;
+}
+
+/* The program the cache tests compile. @div stops, so it is never kept */
+static char *cache_program = "func fib(n: s32): s32\n"
+                             "begin\n"
+                             "    if n < 2 then return n\n"
+                             "    return fib(n - 1) + fib(n - 2)\n"
+                             "end\n"
+                             "\n"
+                             "func div(n: s32): s32\n"
+                             "begin\n"
+                             "    return n / (n - n)\n"
+                             "end\n"
+                             "\n"
+                             "@fib(20)\n"
+                             "@fib(20)\n"
+                             "struct A := x: s32\n"
+                             "\n"
+                             "@div(3)\n"
+                             "struct B := x: s32\n"
+                             "\n"
+                             "func main(): s32\n"
+                             "begin\n"
+                             "    return 0\n"
+                             "end\n";
+
+/* The same pure call twice is run once, and a later iteration finds both in memory */
+void test_comptime_memo(void)
+{
+    CompilerOptions options = { 0 };
+    TestProgram p;
+    test_program_init(&p, cache_program, 3);
+    ComptimeCache cache;
+    comptime_cache_init(&cache, &p.persist_arena, NULL);
+    comptime_run_calls(&p.c, p.root, &cache, &options);
+    assert(cache.misses == 1 && cache.hits == 1 && cache.disk_hits == 0);
+    assert(p.e.n_errors == 1);
+    assert(has_result(&cache, 6765));
+    assert(cache.results.map.len == 1);
+
+    /* The next iteration of the same compilation */
+    m_arena_clear(&p.pass_arena);
+    comptime_run_calls(&p.c, p.root, &cache, &options);
+    assert(cache.misses == 1 && cache.hits == 3 && cache.disk_hits == 0);
+    test_program_release(&p);
+}
+
+/* A later compilation finds the results on disk, and a call that stops is never written */
+void test_comptime_disk_cache(void)
+{
+    char dir[] = "/tmp/metagen-test-XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    CompilerOptions options = { 0 };
+
+    TestProgram p;
+    test_program_init(&p, cache_program, 3);
+    ComptimeCache cache;
+    comptime_cache_init(&cache, &p.persist_arena, dir);
+    comptime_run_calls(&p.c, p.root, &cache, &options);
+    assert(cache.misses == 1 && cache.disk_hits == 0);
+    assert(n_cache_entries(dir) == 1);
+    test_program_release(&p);
+
+    /* A later compilation of the same program */
+    test_program_init(&p, cache_program, 3);
+    comptime_cache_init(&cache, &p.persist_arena, dir);
+    comptime_run_calls(&p.c, p.root, &cache, &options);
+    assert(cache.misses == 0 && cache.hits == 0 && cache.disk_hits == 2);
+    assert(p.e.n_errors == 1);
+    assert(has_result(&cache, 6765));
+    assert(n_cache_entries(dir) == 1);
+    test_program_release(&p);
+
+    remove_cache_dir(dir);
+}
@@ -14,8 +14,12 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <stdio.h>
+
 #include "tests.h"
 
+#define NICC_IMPLEMENTATION
+#include "base/nicc.h"
 #define SAC_IMPLEMENTATION
 #include "base/sac_single.h"
 
@@ -23,4 +27,15 @@ int main(void)
 {
     test_binary_precedence();
     // test_lexer();
+    test_error_order();
+    test_hashmap();
+    test_arena();
+    test_peephole();
+    test_comptime_memo();
+    test_comptime_disk_cache();
+    test_jit();
+    test_reg_vm();
+    test_ast_handles();
+    test_builtins();
+    test_vm_heap();
 }
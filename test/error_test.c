@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "base/pool.h"
+#include "base/sac_single.h"
+#include "base/str.h"
+#include "compiler/error.h"
+#include "tests.h"
+
+#define N_ITEMS 20 // Makes 19 errors, so two passes stay below ERROR_HANDLER_MAX_ERRORS
+#define N_ITEMS_PAST_CAP 200
+
+typedef struct {
+    ErrorHandler *e;
+    u32 pass;
+    u32 n_items;
+} ErrorPass;
+
+/* Item i makes i % 3 errors, the later items first so they tend to finish before the earlier */
+static void make_errors(void *arg, u32 start, u32 end, Arena *scratch, u32 worker_id)
+{
+    (void)scratch;
+    ErrorPass *ep = arg;
+    for (u32 i = start; i < end; i++) {
+        u32 item = ep->n_items - 1 - i;
+        error_handler_bind_thread(ep->e, worker_id, item);
+        for (u32 k = 0; k < item % 3; k++) {
+            Str8Builder sb = make_str_builder(error_handler_arena(ep->e));
+            str_builder_sprintf(&sb, "%d:%d:%d", 3, (int)ep->pass, (int)item, (int)k);
+            error_msg_str8(ep->e, str_builder_end(&sb, true));
+        }
+    }
+}
+
+/* Errors come out in (item, seq) order, and a later pass goes after an earlier one */
+static void check_error_order(u32 n_workers)
+{
+    ThreadPool pool;
+    pool_init(&pool, n_workers);
+    ErrorHandler e;
+    error_handler_init(&e, "", "test.meta", n_workers + 1);
+
+    for (u32 pass = 0; pass < 2; pass++) {
+        ErrorPass ep = { .e = &e, .pass = pass, .n_items = N_ITEMS };
+        pool_parallel_for(&pool, N_ITEMS, 1, make_errors, &ep);
+        error_handler_bind_thread(&e, 0, 0);
+        error_handler_merge(&e);
+    }
+
+    CompilerError *err = e.head;
+    for (u32 pass = 0; pass < 2; pass++) {
+        for (u32 item = 0; item < N_ITEMS; item++) {
+            for (u32 k = 0; k < item % 3; k++) {
+                char expected[32];
+                snprintf(expected, sizeof(expected), "%u:%u:%u", pass, item, k);
+                assert(err != NULL);
+                assert(strcmp((char *)err->msg.str, expected) == 0);
+                err = err->next;
+            }
+        }
+    }
+    assert(err == NULL);
+
+    error_handler_release(&e);
+    pool_destroy(&pool);
+}
+
+/*
+ * The errors kept once there are too many are the first in order, not the first made. With one
+ * chunk the later items are made first.
+ */
+static void check_error_cap(u32 n_workers, u32 grain)
+{
+    ThreadPool pool;
+    pool_init(&pool, n_workers);
+    ErrorHandler e;
+    error_handler_init(&e, "", "test.meta", n_workers + 1);
+
+    ErrorPass ep = { .e = &e, .pass = 0, .n_items = N_ITEMS_PAST_CAP };
+    pool_parallel_for(&pool, N_ITEMS_PAST_CAP, grain, make_errors, &ep);
+    error_handler_bind_thread(&e, 0, 0);
+    error_handler_merge(&e);
+    assert(e.n_errors == ERROR_HANDLER_MAX_ERRORS);
+
+    CompilerError *err = e.head;
+    u32 n = 0;
+    for (u32 item = 0; n < ERROR_HANDLER_MAX_ERRORS; item++) {
+        for (u32 k = 0; k < item % 3 && n < ERROR_HANDLER_MAX_ERRORS; k++, n++) {
+            char expected[32];
+            snprintf(expected, sizeof(expected), "0:%u:%u", item, k);
+            assert(err != NULL);
+            assert(strcmp((char *)err->msg.str, expected) == 0);
+            err = err->next;
+        }
+    }
+    assert(err == NULL);
+
+    /* A later pass has nothing left to add */
+    ep.pass = 1;
+    pool_parallel_for(&pool, N_ITEMS_PAST_CAP, grain, make_errors, &ep);
+    error_handler_bind_thread(&e, 0, 0);
+    error_handler_merge(&e);
+    assert(e.n_errors == ERROR_HANDLER_MAX_ERRORS);
+    assert(e.tail->next == NULL);
+
+    error_handler_release(&e);
+    pool_destroy(&pool);
+}
+
+void test_error_order(void)
+{
+    check_error_order(0);
+    check_error_order(1);
+    check_error_order(3);
+    check_error_order(7);
+    check_error_cap(0, N_ITEMS_PAST_CAP);
+    check_error_cap(7, 1);
+}
@@ -0,0 +1,164 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "base/nicc.h"
+#include "base/sac_single.h"
+#include "tests.h"
+
+#define N_KEYS 1000
+
+static void *value_of(u32 key)
+{
+    return (void *)(uintptr_t)(key * 3 + 1);
+}
+
+/* Insert, override, delete and reinsert, checking every key after each step */
+static void check_insert_delete(HashMap *map)
+{
+    for (u32 key = 0; key < N_KEYS; key++) {
+        hashmap_put(map, &key, sizeof(key), value_of(key), sizeof(void *), false);
+    }
+    assert(map->len == N_KEYS);
+    assert(map->n_deleted == 0);
+
+    /* An existing key gets the new value and takes no new slot */
+    u32 overridden = 7;
+    hashmap_put(map, &overridden, sizeof(overridden), value_of(8), sizeof(void *), false);
+    assert(map->len == N_KEYS);
+    assert(hashmap_get(map, &overridden, sizeof(overridden)) == value_of(8));
+    hashmap_put(map, &overridden, sizeof(overridden), value_of(7), sizeof(void *), false);
+
+    /* Removing leaves tombstones, and lookups of the other keys probe past them */
+    for (u32 key = 0; key < N_KEYS; key += 2) {
+        assert(hashmap_rm(map, &key, sizeof(key)));
+        assert(!hashmap_rm(map, &key, sizeof(key)));
+    }
+    assert(map->len == N_KEYS / 2);
+    assert(map->n_deleted == N_KEYS / 2);
+    for (u32 key = 0; key < N_KEYS; key++) {
+        void *expected = key % 2 == 0 ? NULL : value_of(key);
+        assert(hashmap_get(map, &key, sizeof(key)) == expected);
+    }
+
+    /* Reinserted keys reuse the tombstones */
+    for (u32 key = 0; key < N_KEYS; key += 2) {
+        hashmap_put(map, &key, sizeof(key), value_of(key), sizeof(void *), false);
+    }
+    assert(map->len == N_KEYS);
+    assert(map->n_deleted < N_KEYS / 2);
+    for (u32 key = 0; key < N_KEYS; key++) {
+        assert(hashmap_get(map, &key, sizeof(key)) == value_of(key));
+    }
+}
+
+/* A map that stays small while keys come and go is rehashed in place instead of growing */
+static void check_tombstone_churn(void)
+{
+    HashMap map;
+    hashmap_init(&map);
+    for (u32 key = 0; key < 100 * N_KEYS; key++) {
+        hashmap_put(&map, &key, sizeof(key), value_of(key), sizeof(void *), false);
+        if (key >= 8) {
+            u32 old = key - 8;
+            assert(hashmap_rm(&map, &old, sizeof(old)));
+        }
+        assert(map.len <= 9);
+    }
+    assert(map.size_log2 <= HM_STARTING_SIZE_LOG2 + 1);
+    for (u32 key = 100 * N_KEYS - 8; key < 100 * N_KEYS; key++) {
+        assert(hashmap_get(&map, &key, sizeof(key)) == value_of(key));
+    }
+    hashmap_free(&map);
+}
+
+/* String keys with copied values, and removing frees them */
+static void check_string_keys(void)
+{
+    HashMap map;
+    hashmap_init(&map);
+    hashmap_ssput(&map, "fib", "func", true);
+    hashmap_ssput(&map, "main", "func", true);
+    hashmap_ssput(&map, "Pair", "struct", true);
+    assert(strcmp(hashmap_sget(&map, "Pair"), "struct") == 0);
+    hashmap_ssput(&map, "Pair", "enum", true);
+    assert(strcmp(hashmap_sget(&map, "Pair"), "enum") == 0);
+    assert(hashmap_srm(&map, "fib"));
+    assert(hashmap_sget(&map, "fib") == NULL);
+    assert(strcmp(hashmap_sget(&map, "main"), "func") == 0);
+    assert(map.len == 2);
+    hashmap_free(&map);
+}
+
+/*
+ * Keys of every length up to past two 16 byte reads, since the hash reads short, medium and long
+ * keys differently. Each key is a prefix of the next, so they only differ in their length.
+ */
+static void check_key_lengths(void)
+{
+    char text[64];
+    for (u32 i = 0; i < sizeof(text); i++) {
+        text[i] = (char)('a' + i % 26);
+    }
+    HashMap map;
+    hashmap_init(&map);
+    for (u32 len = 1; len <= sizeof(text); len++) {
+        hashmap_put(&map, text, len, value_of(len), sizeof(void *), false);
+    }
+    assert(map.len == sizeof(text));
+    for (u32 len = 1; len <= sizeof(text); len++) {
+        assert(hashmap_get(&map, text, len) == value_of(len));
+    }
+
+    /* Iterating skips the empty and deleted slots */
+    for (u32 len = 1; len <= sizeof(text); len += 2) {
+        assert(hashmap_rm(&map, text, len));
+    }
+    void *values[sizeof(text) / 2];
+    hashmap_get_values(&map, values);
+    uintptr_t sum = 0;
+    for (u32 i = 0; i < map.len; i++) {
+        sum += (uintptr_t)values[i];
+    }
+    uintptr_t expected = 0;
+    for (u32 len = 2; len <= sizeof(text); len += 2) {
+        expected += (uintptr_t)value_of(len);
+    }
+    assert(sum == expected);
+    hashmap_free(&map);
+}
+
+void test_hashmap(void)
+{
+    HashMap map;
+    hashmap_init(&map);
+    check_insert_delete(&map);
+    hashmap_free(&map);
+
+    Arena arena;
+    m_arena_init_dynamic(&arena, 1, 512);
+    hashmap_init_arena(&map, &arena, false);
+    check_insert_delete(&map);
+    m_arena_release(&arena);
+
+    check_tombstone_churn();
+    check_string_keys();
+    check_key_lengths();
+}
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/jit.h"
+#include "compiler/comptime/peephole.h"
+#include "compiler/comptime/vm.h"
+#include "test_program.h"
+#include "tests.h"
+
+/* Calls fib far more than JIT_CALL_THRESHOLD times */
+static char *fib_program = "func fib(n: s32): s32\n"
+                           "begin\n"
+                           "    if n < 2 then return n\n"
+                           "    return fib(n - 1) + fib(n - 2)\n"
+                           "end\n"
+                           "\n"
+                           "func main(): s32\n"
+                           "begin\n"
+                           "    return fib(22)\n"
+                           "end\n";
+
+/* Every kind of branch, in a function that gets hot from a loop in one that doesn't */
+static char *branchy_program = "func step(i: s32, acc: s32): s32\n"
+                               "begin\n"
+                               "    var j: s32\n"
+                               "    if i = 7 then acc := acc + 100 else acc := acc + i\n"
+                               "    if 50 < i then acc := acc - 1\n"
+                               "    if i != 13 then acc := acc + 2\n"
+                               "    j := 0\n"
+                               "    while j < i / 10 do\n"
+                               "    begin\n"
+                               "        acc := acc + (j << 1)\n"
+                               "        j := j + 1\n"
+                               "    end\n"
+                               "    return acc\n"
+                               "end\n"
+                               "\n"
+                               "func main(): s32\n"
+                               "begin\n"
+                               "    var i: s32, acc: s32\n"
+                               "    i := 0\n"
+                               "    acc := 0\n"
+                               "    while i < 500 do\n"
+                               "    begin\n"
+                               "        acc := step(i, acc)\n"
+                               "        i := i + 1\n"
+                               "    end\n"
+                               "    return acc\n"
+                               "end\n";
+
+/* Never returns, so it runs out of stack once compiled */
+static char *deep_program = "func down(n: s32): s32\n"
+                            "begin\n"
+                            "    return down(n + 1) + 1\n"
+                            "end\n"
+                            "\n"
+                            "func main(): s32\n"
+                            "begin\n"
+                            "    return down(0)\n"
+                            "end\n";
+
+/* Divides by zero once the function has been called enough to be compiled */
+static char *div_program = "func f(n: s32): s32\n"
+                           "begin\n"
+                           "    return 1000 / (n - 100)\n"
+                           "end\n"
+                           "\n"
+                           "func main(): s32\n"
+                           "begin\n"
+                           "    var i: s32, acc: s32\n"
+                           "    i := 0\n"
+                           "    acc := 0\n"
+                           "    while i < 200 do\n"
+                           "    begin\n"
+                           "        acc := acc + f(i)\n"
+                           "        i := i + 1\n"
+                           "    end\n"
+                           "    return acc\n"
+                           "end\n";
+
+/*
+ * Runs input on the interpreter and with the JIT, and checks they agree on the result, and on
+ * why and where the run stopped. Returns the result.
+ */
+static BytecodeWord check_same(char *input, u64 fuel, VMStop stop)
+{
+    TestProgram p;
+    test_program_init(&p, input, 0);
+    Bytecode *b = ast_to_bytecode(&p.pass_arena, p.root);
+    bytecode_peephole(b);
+
+    VMMeter interpreted;
+    vm_meter_init(&interpreted, fuel, 0);
+    BytecodeWord expected = run_with(b, &interpreted, NULL, false);
+    VMMeter jitted;
+    vm_meter_init(&jitted, fuel, 0);
+    BytecodeWord result = run_with(b, &jitted, NULL, true);
+
+    assert(interpreted.stop == stop);
+    assert(jitted.stop == stop);
+    if (stop == VM_STOP_NONE) {
+        assert(result == expected);
+    } else {
+        /* The run was unwound, neither has a result */
+        assert(jitted.stop_offset == interpreted.stop_offset);
+    }
+    if (stop == VM_STOP_NONE || stop == VM_STOP_FUEL) {
+        assert(vm_meter_used(&jitted) == vm_meter_used(&interpreted));
+    }
+    test_program_release(&p);
+    return expected;
+}
+
+void test_jit(void)
+{
+    assert(check_same(fib_program, 0, VM_STOP_NONE) == 17711);
+    check_same(branchy_program, 0, VM_STOP_NONE);
+    /* Stops in compiled code, and unwinds through compiled and interpreted frames */
+    check_same(fib_program, 20000, VM_STOP_FUEL);
+    check_same(deep_program, 0, VM_STOP_STACK_OVERFLOW);
+    check_same(div_program, 0, VM_STOP_DIV_ZERO);
+}
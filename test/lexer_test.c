@@ -20,6 +20,7 @@
 #include <stdio.h>
 
 #include "base/sac_single.h"
+#include "compiler/error.h"
 #include "compiler/lex.h"
 #include "tests.h"
 
@@ -29,14 +30,16 @@ void test_lexer(void)
     char *input = "var a = \"some_str\"; // ignored\nvar b = \"not_ignored\"";
     Lexer lexer;
     Arena arena;
-    lex_init(&lexer, input);
+    ErrorHandler e;
+    error_handler_init(&e, input, "test.meta", 1);
+    lex_init(&lexer, &e, input);
     m_arena_init_dynamic(&arena, 2, 512);
 
     printf("input: '%s'\n", input);
     while (1) {
         Token next = lex_next(&arena, &lexer);
         token_print(next);
-        if (next.type == TOKEN_EOF)
+        if (next.kind == TOKEN_EOF)
             break;
     }
 }
@@ -18,67 +18,56 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "base/sac_single.h"
 #include "compiler/ast.h"
+#include "compiler/error.h"
 #include "compiler/parser.h"
 #include "tests.h"
 
 
 static bool ast_cmp(AstExpr *a, AstExpr *b)
 {
-    if (a->type != b->type)
+    if (a->kind != b->kind)
         return false;
 
-    switch (a->type) {
+    switch (a->kind) {
     case EXPR_UNARY: {
-        AstExprUnary *A = AS_UNARY(a);
-        AstExprUnary *B = AS_UNARY(b);
+        AstUnary *A = AS_UNARY(a);
+        AstUnary *B = AS_UNARY(b);
         return A->op == B->op && ast_cmp(A->expr, B->expr);
     };
     case EXPR_BINARY: {
-        AstExprBinary *A = AS_BINARY(a);
-        AstExprBinary *B = AS_BINARY(b);
+        AstBinary *A = AS_BINARY(a);
+        AstBinary *B = AS_BINARY(b);
         return A->op == B->op && ast_cmp(A->left, B->left) && ast_cmp(A->right, B->right);
     };
     case EXPR_LITERAL: {
         if (AS_LITERAL(a)->lit_type != AS_LITERAL(b)->lit_type) {
             return false;
         }
-        // TODO: also consider other literal types
-        return AS_LITERAL(a)->num_value == AS_LITERAL(b)->num_value;
+        return STR8VIEW_EQUAL(AS_LITERAL(a)->literal, AS_LITERAL(b)->literal);
     };
-    case EXPR_LIST: {
-        AstExprList *A = AS_LIST(a);
-        AstExprList *B = AS_LIST(b);
-        AstExprListNode *node_a = &A->head;
-        AstExprListNode *node_b = &B->head;
-        if (node_a == NULL && node_b == NULL) {
-            return true;
-        }
-
-        do {
-            if (node_a == NULL || node_b == NULL) {
-                return false;
-            }
-            if (!ast_cmp(node_a->this, node_b->this)) {
-                return false;
-            }
-            node_a = node_a->next;
-            node_b = node_b->next;
-        } while (node_a != NULL && node_b != NULL);
-        return true;
-    }
     case EXPR_CALL: {
-        AstExprCall *A = AS_CALL(a);
-        AstExprCall *B = AS_CALL(b);
-        if (A->identifier != B->identifier) {
+        AstCall *A = AS_CALL(a);
+        AstCall *B = AS_CALL(b);
+        if (!STR8VIEW_EQUAL(A->identifier, B->identifier)) {
             return false;
         }
         if (A->args == NULL || B->args == NULL) {
             return A->args == NULL && B->args == NULL;
         }
-        return ast_cmp(A->args, B->args);
+        AstListNode *node_a = A->args->head;
+        AstListNode *node_b = B->args->head;
+        while (node_a != NULL && node_b != NULL) {
+            if (!ast_cmp((AstExpr *)node_a->this, (AstExpr *)node_b->this)) {
+                return false;
+            }
+            node_a = node_a->next;
+            node_b = node_b->next;
+        }
+        return node_a == NULL && node_b == NULL;
     };
     default: {
         printf("AST CMP UNKNOWN TYPE\n");
@@ -91,22 +80,39 @@ static bool ast_cmp(AstExpr *a, AstExpr *b)
 
 void test_binary_precedence(void)
 {
-    char *input = "4 * 3 + 7;";
+    char *input = "func main(): s32\nbegin\n    return 4 * 3 + 7\nend\n";
 
-    AstExprBinary expected;
-    expected.type = EXPR_BINARY;
+    AstBinary expected;
+    expected.kind = EXPR_BINARY;
     expected.op = TOKEN_PLUS;
 
-    AstExprLiteral right = { .type = EXPR_LITERAL, .lit_type = LIT_NUM, .num_value = 7 };
-    AstExprBinary left = { .type = EXPR_BINARY, .op = TOKEN_STAR };
-    AstExprLiteral left_left = { .type = EXPR_LITERAL, .lit_type = LIT_NUM, .num_value = 4 };
-    AstExprLiteral left_right = { .type = EXPR_LITERAL, .lit_type = LIT_NUM, .num_value = 3 };
+    AstLiteral right = { .kind = EXPR_LITERAL, .lit_type = LIT_NUM, .literal = STR8_LIT("7") };
+    AstBinary left = { .kind = EXPR_BINARY, .op = TOKEN_STAR };
+    AstLiteral left_left = { .kind = EXPR_LITERAL, .lit_type = LIT_NUM, .literal = STR8_LIT("4") };
+    AstLiteral left_right = { .kind = EXPR_LITERAL, .lit_type = LIT_NUM, .literal = STR8_LIT("3") };
     left.left = (AstExpr *)&left_left;
     left.right = (AstExpr *)&left_right;
     expected.right = (AstExpr *)&right;
     expected.left = (AstExpr *)&left;
 
-    ParseResult result = parse(input);
+    Arena arena;
+    Arena lex_arena;
+    m_arena_init_dynamic(&arena, 1, 64);
+    m_arena_init_dynamic(&lex_arena, 1, 64);
+    ErrorHandler e;
+    error_handler_init(&e, input, "test.meta", 1);
+
+    AstRoot *root = parse(&arena, &lex_arena, &e, input);
+    error_handler_merge(&e);
+    assert(e.n_errors == 0);
     // TODO: cmp stmts as well
-    // assert(ast_cmp((AstExpr *)&expected, result.head));
+    AstFunc *main_func = AS_FUNC(root->funcs.head->this);
+    AstBlock *body = AS_BLOCK(main_func->body);
+    AstSingle *ret = AS_SINGLE(body->stmts->head->this);
+    assert(ret->kind == STMT_RETURN);
+    assert(ast_cmp((AstExpr *)&expected, (AstExpr *)ret->node));
+
+    error_handler_release(&e);
+    m_arena_release(&lex_arena);
+    m_arena_release(&arena);
 }
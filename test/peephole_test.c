@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "base/sac_single.h"
+#include "base/str.h"
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/peephole.h"
+#include "compiler/comptime/vm.h"
+#include "test_program.h"
+#include "tests.h"
+
+static bool has_wide_branch(Bytecode *b)
+{
+    for (u32 offset = 0; offset < b->code_offset; offset += bytecode_op_len(b->code[offset])) {
+        OpCode op = b->code[offset];
+        if (op == OP_JMPW || op == OP_BIZW || op == OP_BNZW)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * A loop with every kind of branch the peephole pass fuses. With a long body in the loop the
+ * branches around it need the wide form, which the pass has to leave pointing at the same code.
+ */
+static char *branchy_program(Arena *arena, u32 body_len)
+{
+    Str8Builder sb = make_str_builder(arena);
+    char *head = "func main(): s32\n"
+                 "begin\n"
+                 "    var i: s32, sum: s32, x: s32\n"
+                 "    i := 0\n"
+                 "    sum := 0\n"
+                 "    x := 0\n"
+                 "    while i < 100 do\n"
+                 "    begin\n"
+                 "        if i = 7 then sum := sum + 100 else sum := sum + i\n"
+                 "        if 50 < i then sum := sum - 1\n"
+                 "        if i != 13 then\n"
+                 "        begin\n";
+    str_builder_append_cstr(&sb, head, strlen(head));
+    for (u32 i = 0; i < body_len; i++) {
+        char *stmt = "            x := x + 3\n";
+        str_builder_append_cstr(&sb, stmt, strlen(stmt));
+    }
+    char *tail = "        end\n"
+                 "        i := i + 1\n"
+                 "    end\n"
+                 "    return sum + x\n"
+                 "end\n";
+    str_builder_append_cstr(&sb, tail, strlen(tail));
+    return (char *)str_builder_end(&sb, true).str;
+}
+
+static void check_peephole(u32 body_len, bool wide)
+{
+    Arena arena;
+    m_arena_init_dynamic(&arena, 1, 64);
+    TestProgram p;
+    test_program_init(&p, branchy_program(&arena, body_len), 0);
+
+    Bytecode *plain = ast_to_bytecode(&p.pass_arena, p.root);
+    Bytecode *fused = ast_to_bytecode(&p.pass_arena, p.root);
+    assert(has_wide_branch(plain) == wide);
+    bytecode_peephole(fused);
+    assert(fused->code_offset < plain->code_offset);
+    assert(has_wide_branch(fused) == wide);
+
+    BytecodeWord expected = 4950 + 100 - 7 - 49 + 3 * body_len * 99;
+    assert(run(plain) == expected);
+    assert(run(fused) == expected);
+
+    test_program_release(&p);
+    m_arena_release(&arena);
+}
+
+void test_peephole(void)
+{
+    check_peephole(1, false);
+    check_peephole(3000, true);
+}
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/reg_bytecode.h"
+#include "compiler/comptime/reg_vm.h"
+#include "compiler/comptime/vm.h"
+#include "test_program.h"
+#include "tests.h"
+
+/* Recursion, with the arguments of a call worked out in registers of the caller */
+static char *fib_program = "func fib(n: s32): s32\n"
+                           "begin\n"
+                           "    if n < 2 then return n\n"
+                           "    return fib(n - 1) + fib(n - 2)\n"
+                           "end\n"
+                           "\n"
+                           "func main(): s32\n"
+                           "begin\n"
+                           "    return fib(20)\n"
+                           "end\n";
+
+/* Every comparison, nested blocks with their own locals and an expression with many temporaries */
+static char *branchy_program = "func step(i: s32, acc: s32): s32\n"
+                               "begin\n"
+                               "    if i = 7 then acc := acc + 100 else acc := acc + i\n"
+                               "    if 50 < i then acc := acc - 1\n"
+                               "    if i > 90 then acc := acc - 2\n"
+                               "    if i != 13 then\n"
+                               "    begin\n"
+                               "        var j: s32\n"
+                               "        j := 0\n"
+                               "        while j < i / 10 do\n"
+                               "        begin\n"
+                               "            acc := acc + (j << 1) - (j >> 1)\n"
+                               "            j := j + 1\n"
+                               "        end\n"
+                               "    end\n"
+                               "    return acc\n"
+                               "end\n"
+                               "\n"
+                               "func main(): s32\n"
+                               "begin\n"
+                               "    var i: s32, acc: s32\n"
+                               "    i := 0\n"
+                               "    acc := 0\n"
+                               "    while i < 100 do\n"
+                               "    begin\n"
+                               "        acc := step(i, acc)\n"
+                               "        i := i + 1\n"
+                               "    end\n"
+                               "    return acc + ((i * 2 + 1) * (i - 3) - (i + 4) * (i / 2))\n"
+                               "end\n";
+
+/* The register VM returns what the stack VM does for the same program */
+static BytecodeWord check_same(char *input)
+{
+    TestProgram p;
+    test_program_init(&p, input, 0);
+    BytecodeWord expected = run(ast_to_bytecode(&p.pass_arena, p.root));
+    BytecodeWord result = reg_run(ast_to_reg_bytecode(&p.pass_arena, p.root));
+    assert(result == expected);
+    test_program_release(&p);
+    return result;
+}
+
+void test_reg_vm(void)
+{
+    assert(check_same(fib_program) == 6765);
+    check_same(branchy_program);
+
+    /* The hand written programs the benchmarks use */
+    Arena arena;
+    m_arena_init_dynamic(&arena, 1, 64);
+    assert(reg_run(reg_fib_test(&arena, 15)) == run(fib_test(&arena, 15)));
+    m_arena_release(&arena);
+}
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "compiler/parser.h"
+#include "compiler/type.h"
+#include "test_program.h"
+
+void test_program_init(TestProgram *p, char *input, u32 n_workers)
+{
+    m_arena_init_dynamic_flags(&p->lex_arena, 1, 512, SAC_FLAG_CHAINED);
+    m_arena_init_dynamic_flags(&p->persist_arena, 2, 512, SAC_FLAG_CHAINED);
+    m_arena_init_dynamic_flags(&p->pass_arena, 16, 512, SAC_FLAG_CHAINED);
+    pool_init(&p->pool, n_workers);
+    error_handler_init(&p->e, input, "test.meta", n_workers + 1);
+    error_handler_bind_thread(&p->e, 0, 0);
+    p->c = (Compiler){ .persist_arena = &p->persist_arena,
+                       .pass_arena = &p->pass_arena,
+                       .e = &p->e,
+                       .pool = &p->pool };
+    type_info_struct_ptr_array_init(&p->c.struct_types);
+    type_info_ptr_array_init(&p->c.all_types);
+
+    p->root = parse(&p->persist_arena, &p->lex_arena, &p->e, input);
+    typegen(&p->c, p->root);
+    infer(&p->c, p->root);
+    for (AstListNode *node = p->root->funcs.head; node != NULL; node = node->next) {
+        typecheck_func(&p->c, node->this);
+    }
+    error_handler_merge(&p->e);
+    assert(p->e.n_errors == 0);
+    m_arena_clear(&p->pass_arena);
+}
+
+void test_program_release(TestProgram *p)
+{
+    pool_destroy(&p->pool);
+    error_handler_release(&p->e);
+    m_arena_release(&p->pass_arena);
+    m_arena_release(&p->persist_arena);
+    m_arena_release(&p->lex_arena);
+}
+
+AstFunc *test_program_func(TestProgram *p, char *name)
+{
+    for (AstListNode *n = p->root->funcs.head; n != NULL; n = n->next) {
+        AstFunc *func = AS_FUNC(n->this);
+        if (func->name.len == strlen(name) && memcmp(func->name.str, name, func->name.len) == 0)
+            return func;
+    }
+    assert(false);
+    return NULL;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TEST_PROGRAM_H
+#define TEST_PROGRAM_H
+
+#include "base/pool.h"
+#include "base/sac_single.h"
+#include "compiler/compiler.h"
+#include "compiler/error.h"
+
+/* A program parsed and typechecked the way compile() does it, on one thread */
+typedef struct {
+    Arena lex_arena;
+    Arena persist_arena;
+    Arena pass_arena;
+    ThreadPool pool;
+    ErrorHandler e;
+    Compiler c;
+    AstRoot *root;
+} TestProgram;
+
+void test_program_init(TestProgram *p, char *input, u32 n_workers);
+void test_program_release(TestProgram *p);
+/* The function in p named name */
+AstFunc *test_program_func(TestProgram *p, char *name);
+
+#endif /* TEST_PROGRAM_H */
@@ -19,5 +19,16 @@
 
 void test_binary_precedence(void);
 void test_lexer(void);
+void test_error_order(void);
+void test_hashmap(void);
+void test_arena(void);
+void test_peephole(void);
+void test_comptime_memo(void);
+void test_comptime_disk_cache(void);
+void test_jit(void);
+void test_reg_vm(void);
+void test_ast_handles(void);
+void test_builtins(void);
+void test_vm_heap(void);
 
 #endif /* TESTS_H */
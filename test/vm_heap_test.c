@@ -0,0 +1,140 @@
+/*
+ *  Copyright (C) 2025 Nicolai Brand (https://lytix.dev)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "compiler/comptime/bytecode.h"
+#include "compiler/comptime/comptime.h"
+#include "compiler/comptime/vm.h"
+#include "test_program.h"
+#include "tests.h"
+
+/*
+ * Structs in structs, arrays of structs and globals. A struct passed by value is copied, so the
+ * callee changing it leaves the caller's alone. Returned structs are the caller's to keep, and
+ * are given back once the statement is done, so the loop doesn't fill the heap.
+ */
+static char *heap_program = "struct Vec := x: s32, y: s32\n"
+                            "struct Box := lo: Vec, hi: Vec\n"
+                            "\n"
+                            "var grid: s32[64]\n"
+                            "var boxes: Box[4]\n"
+                            "\n"
+                            "func area(b: Box): s32\n"
+                            "begin\n"
+                            "    b.lo.x := 1000\n"
+                            "    return (b.hi.x - b.lo.x) * (b.hi.y - b.lo.y)\n"
+                            "end\n"
+                            "\n"
+                            "func grow(b: ^Box, n: s32): s32\n"
+                            "begin\n"
+                            "    b.hi.x := b.hi.x + n\n"
+                            "    return 0\n"
+                            "end\n"
+                            "\n"
+                            "func vec(x: s32, y: s32): Vec\n"
+                            "begin\n"
+                            "    var v: Vec, unused: Box\n"
+                            "    v.x := x\n"
+                            "    v.y := y\n"
+                            "    return v\n"
+                            "end\n"
+                            "\n"
+                            "func main(): s32\n"
+                            "begin\n"
+                            "    var b: Box, r: s32, i: s32, sum: s32\n"
+                            "    b.hi.x := 10\n"
+                            "    b.hi.y := 20\n"
+                            "    b.lo.x := 2\n"
+                            "    b.lo.y := 4\n"
+                            "    r := area(b)\n"
+                            "    if r != 0 - 15840 then return 1\n"
+                            "    if b.lo.x != 2 then return 2\n"
+                            "    r := grow(&b, 5)\n"
+                            "    boxes[3] := b\n"
+                            "    if boxes[3].hi.x != 15 then return 3\n"
+                            "    if boxes[2].hi.x != 0 then return 4\n"
+                            "    i := 0\n"
+                            "    sum := 0\n"
+                            "    while i < 100000 do\n"
+                            "    begin\n"
+                            "        b.lo := vec(i, 2 * i)\n"
+                            "        grid[i / 2000] := b.lo.y\n"
+                            "        sum := sum + vec(1, 2).y + b.lo.x - i\n"
+                            "        i := i + 1\n"
+                            "    end\n"
+                            "    return sum + grid[49]\n"
+                            "end\n";
+
+/* The VM has no code for taking the address of a local, so a call that can reach it is refused */
+static char *unsupported_program = "func addr(): s32\n"
+                                   "begin\n"
+                                   "    var i: s32, p: ^s32\n"
+                                   "    p := &i\n"
+                                   "    return 0\n"
+                                   "end\n"
+                                   "\n"
+                                   "func f(): s32\n"
+                                   "begin\n"
+                                   "    return addr()\n"
+                                   "end\n"
+                                   "\n"
+                                   "@f()\n"
+                                   "struct A := x: s32\n"
+                                   "\n"
+                                   "func main(): s32\n"
+                                   "begin\n"
+                                   "    return 0\n"
+                                   "end\n";
+
+void test_vm_heap(void)
+{
+    TestProgram p;
+    test_program_init(&p, heap_program, 0);
+    VMMeter meter;
+    vm_meter_init(&meter, 0, 0);
+    Bytecode *b = ast_to_bytecode(&p.pass_arena, p.root);
+    BytecodeWord result = run_with(b, &meter, NULL, false);
+    assert(meter.stop == VM_STOP_NONE);
+    assert(result == 100000 * 2 + 2 * 99999);
+
+    /* Every vec() in the loop is given back, so the heap never gets past a few structs */
+    Arena heap;
+    struct m_arena_stats stats;
+    vm_heap_init(&heap);
+    m_arena_stats_enable(&heap, &stats, "vm heap");
+    vm_meter_init(&meter, 0, 0);
+    BytecodeWord no_args[1] = { 0 };
+    assert(run_call(b, &p.pass_arena, &heap, &meter, b->entry, no_args) == result);
+    assert(stats.peak_offset < 512);
+    m_arena_release(&heap);
+    test_program_release(&p);
+
+    test_program_init(&p, unsupported_program, 0);
+    b = ast_to_bytecode(&p.pass_arena, p.root);
+    assert(b->funcs[0].unsupported != NULL && b->funcs[1].unsupported == NULL);
+    assert(comptime_find_unsupported(&p.c, b, 1) == &b->funcs[0]);
+    assert(comptime_find_unsupported(&p.c, b, 2) == NULL);
+    CompilerOptions options = { 0 };
+    ComptimeCache cache;
+    comptime_cache_init(&cache, &p.persist_arena, NULL);
+    comptime_run_calls(&p.c, p.root, &cache, &options);
+    assert(p.e.n_errors == 1);
+    assert(strstr((char *)p.e.head->msg.str, "@f: Can't run addr") != NULL);
+    test_program_release(&p);
+}